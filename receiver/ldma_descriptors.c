@@ -12,18 +12,20 @@
 #include "ldma_handler.h"
 #include "ldma_descriptors.h"
 
-LDMA_Descriptor_t msgToUartDsc[NUM_LDMA_DESCRIPTORS];
+LDMA_Descriptor_t msgToUartDscs[LDMA_RING_IDS][SLOT_LDMA_DESCRIPTORS]; // Own descriptors for every frame buffer.
+uint8_t msgToUartDscCount[LDMA_RING_IDS];
+volatile uint32_t uartFramesOut; // Stamp of the last frame out, written by LDMA.
 LDMA_Descriptor_t tokenToUartDsc;
 
 /**
  * This is a linked descriptor. An interrupt is generated when the last descriptor
  * finishes.
  *
- * This descriptor is set up to transfer from memory to UART 2 bytes at a time. 
- * Notice, that destination address is USARTn->TXDOUBLE, which is a two byte 
- * FIFO in the UART transfer area. Destination address is not incremented.
- * 
- * Transfer unit size (.xfer.size) is half-word (because ADC data is 16 bits).
+ * The frame is split into transfers by ldma_xfer_split(), one descriptor each.
+ * Most of it is transferred 2 bytes at a time. Notice, that destination address
+ * is then USARTn->TXDOUBLE, which is a two byte FIFO in the UART transfer area.
+ * An odd byte at the end of a part (or before its first half-word) is
+ * transferred alone to USARTn->TXDATA. Destination address is not incremented.
  *
  * Transfer block size (.xfer.blockSize) is 1, which means one unit of data is
  * transferred during a block. LDMA does not arbitrate during the transfer of 
@@ -34,68 +36,128 @@ LDMA_Descriptor_t tokenToUartDsc;
  * Transfer count (.xfer.xferCnt) is the number of units to be transferred 
  * within a descriptor.
  *
- * Byte swap is used, because memory is in little-endian order in the gecko memory. 
+ * Every descriptor has an absolute source address, the part it sends can be
+ * anywhere in memory, and links to the next one. The last one is not a
+ * transfer but a write: it stores the sequence number of the frame
+ * (msg_descriptor_stamp()) in uartFramesOut and generates the interrupt.
+ * Frames that end close together leave one pending interrupt, the stamp
+ * tells ldma_ring_complete() how many of them are out.
  *
- * The first descriptor uses absolute adderssing mode for source address. This 
- * is a requirement. The second descriptor uses relative adderssing mode for 
- * source address. This means that the second descriptors source address is
- * the address of the first descriptors last transfer (eg. if first descriptor
- * source address was 0x00001111 and the descriptor transferred 40 half words
- * then the address of the last transfer would be something like 0x00001125, 
- * since memory area is 32bit and 2 half words occupy one memory slot so the 
- * initial address gets incremented 20 memory slots). Since source address
- * increment is used, the last address actually becomes the address of the
- * next data value to be transferred (0x00001127) and 
- * no offset is needed (.xfer.srcAddr = 0).
+ * Every msg_pool slot and the stats frame (LDMA_RING_STATS) have their own
+ * descriptors, so the frame of one slot can be set up while LDMA sends
+ * others. The stamp does not link anywhere, msg_descriptor_link() lets it
+ * continue with another slot.
  */
-LDMA_Descriptor_t* msg_descriptor_config(uint32_t* bufAddr, uint32_t payload_len_bytes)
+static LDMA_Descriptor_t* xfer_descriptor_config(uint8_t slot, const uint8_t *const *parts, const uint16_t *part_lens, uint8_t num_parts)
 {
-    uint8_t i;
-    uint32_t transfer_count = (uint32_t)(payload_len_bytes/2); // Using half-word (16-bit) transfers
-    
-    // Create descriptors.
-    for (i = 0; i < NUM_LDMA_DESCRIPTORS; i++)
-    {
-        msgToUartDsc[i].xfer.structType     = ldmaCtrlStructTypeXfer;
-        msgToUartDsc[i].xfer.structReq      = 0; // Transfer started by USART signal, not descr. load.
-        msgToUartDsc[i].xfer.byteSwap       = 0; // Memory is in little-endian order, but network bytes are already swapped, so don't swap bytes.
-        msgToUartDsc[i].xfer.blockSize      = ldmaCtrlBlockSizeUnit1; // Smallest block so as not to starve other DMA channels.
-        msgToUartDsc[i].xfer.reqMode        = ldmaCtrlReqModeBlock; // Recommended for peripheral transfer.
-        msgToUartDsc[i].xfer.decLoopCnt     = 0; // Descriptor is not looped.
-        msgToUartDsc[i].xfer.ignoreSrec     = 1; // Page 519 efr32xg1 reference manual r1.1
-        msgToUartDsc[i].xfer.srcInc         = ldmaCtrlSrcIncOne;
-        msgToUartDsc[i].xfer.size           = ldmaCtrlSizeHalf; // Transfer 2 bytes at a time (half-word).
-        msgToUartDsc[i].xfer.dstInc         = ldmaCtrlDstIncNone; // Don't increment UART TX buffer.
-        msgToUartDsc[i].xfer.dstAddrMode    = ldmaCtrlDstAddrModeAbs;
-        msgToUartDsc[i].xfer.dstAddr        = (uint32_t)&USART_FOR_LDMA->TXDOUBLE; // UART TX buffer address for half-word data.
-        msgToUartDsc[i].xfer.linkAddr       = 4; // Point to next descriptor.
-        msgToUartDsc[i].xfer.linkMode       = ldmaLinkModeRel;
+    ldma_xfer_t xfers[SLOT_LDMA_DESCRIPTORS - 1];
+    uint8_t i, n = ldma_xfer_split(xfers, SLOT_LDMA_DESCRIPTORS - 1, parts, part_lens, num_parts);
+    LDMA_Descriptor_t *dsc = msgToUartDscs[slot];
 
-        if (0 == i) // First descriptor.
-        {
-            msgToUartDsc[i].xfer.srcAddrMode    = ldmaCtrlSrcAddrModeAbs;
-            msgToUartDsc[i].xfer.srcAddr        = (uint32_t)bufAddr; // Memory address
-        }
-        else // All but first.
-        {
-            msgToUartDsc[i].xfer.srcAddrMode    = ldmaCtrlSrcAddrModeRel;
-            msgToUartDsc[i].xfer.srcAddr        = 0; // Offset from source address of previous transfer.
-        }
-        
-        if ((NUM_LDMA_DESCRIPTORS - 1) == i) // Last descriptor.
+    msgToUartDscCount[slot] = n + 1;
+    for (i = 0; i < n; i++)
+    {
+        dsc[i].xfer.structType     = ldmaCtrlStructTypeXfer;
+        dsc[i].xfer.structReq      = 0; // Transfer started by USART signal, not descr. load.
+        dsc[i].xfer.byteSwap       = 0; // Frame bytes are in wire order already.
+        dsc[i].xfer.blockSize      = ldmaCtrlBlockSizeUnit1; // Smallest block so as not to starve other DMA channels.
+        dsc[i].xfer.reqMode        = ldmaCtrlReqModeBlock; // Recommended for peripheral transfer.
+        dsc[i].xfer.decLoopCnt     = 0; // Descriptor is not looped.
+        dsc[i].xfer.ignoreSrec     = 1; // Page 519 efr32xg1 reference manual r1.1
+        dsc[i].xfer.srcInc         = ldmaCtrlSrcIncOne;
+        dsc[i].xfer.dstInc         = ldmaCtrlDstIncNone; // Don't increment UART TX buffer.
+        dsc[i].xfer.dstAddrMode    = ldmaCtrlDstAddrModeAbs;
+        if (2 == xfers[i].unit_bytes)
         {
-            msgToUartDsc[i].xfer.xferCnt    = (transfer_count % 2048) - 1; // One less then needed. See manual p214. Using half-word tranfer hence divide data length with 2.
-            msgToUartDsc[i].xfer.doneIfs    = 1; // Generate interrupt after descriptor is done.
-            msgToUartDsc[i].xfer.link       = 0; // Don't link to next.
+            dsc[i].xfer.size       = ldmaCtrlSizeHalf; // Transfer 2 bytes at a time (half-word).
+            dsc[i].xfer.dstAddr    = (uint32_t)&USART_FOR_LDMA->TXDOUBLE; // UART TX buffer address for half-word data.
         }
-        else // All but last.
+        else
         {
-            msgToUartDsc[i].xfer.xferCnt    = 2047; // Transfers 2048 units. See manual p214.
-            msgToUartDsc[i].xfer.doneIfs    = 0; // No interrupt after descriptor is done.
-            msgToUartDsc[i].xfer.link       = 1; // Link to next descriptor.
+            dsc[i].xfer.size       = ldmaCtrlSizeByte; // Odd byte.
+            dsc[i].xfer.dstAddr    = (uint32_t)&USART_FOR_LDMA->TXDATA; // UART TX buffer address for byte data.
         }
+        dsc[i].xfer.srcAddrMode    = ldmaCtrlSrcAddrModeAbs;
+        dsc[i].xfer.srcAddr        = (uint32_t)xfers[i].src; // Part is somewhere else in memory.
+        dsc[i].xfer.xferCnt        = xfers[i].units - 1; // One less then needed. See manual p214.
+        dsc[i].xfer.linkAddr       = 4; // Point to next descriptor.
+        dsc[i].xfer.linkMode       = ldmaLinkModeRel;
+        dsc[i].xfer.doneIfs        = 0; // Interrupt comes from the stamp.
+        dsc[i].xfer.link           = 1;
     }
-    return &msgToUartDsc[0];
+
+    dsc[n].wri.structType          = ldmaCtrlStructTypeWrite;
+    dsc[n].wri.structReq           = 1; // Written when loaded, right after the last transfer.
+    dsc[n].wri.xferCnt             = 0;
+    dsc[n].wri.byteSwap            = 0;
+    dsc[n].wri.blockSize           = ldmaCtrlBlockSizeUnit1;
+    dsc[n].wri.doneIfs             = 1; // Interrupt after the whole frame.
+    dsc[n].wri.reqMode             = ldmaCtrlReqModeAll;
+    dsc[n].wri.decLoopCnt          = 0;
+    dsc[n].wri.ignoreSrec          = 0;
+    dsc[n].wri.srcInc              = ldmaCtrlSrcIncNone;
+    dsc[n].wri.size                = ldmaCtrlSizeWord;
+    dsc[n].wri.dstInc              = ldmaCtrlDstIncNone;
+    dsc[n].wri.srcAddrMode         = ldmaCtrlSrcAddrModeAbs;
+    dsc[n].wri.dstAddrMode         = ldmaCtrlDstAddrModeAbs;
+    dsc[n].wri.immVal              = 0; // msg_descriptor_stamp()
+    dsc[n].wri.dstAddr             = (uint32_t)&uartFramesOut;
+    dsc[n].wri.linkMode            = ldmaLinkModeAbs;
+    dsc[n].wri.link                = 0; // msg_descriptor_link()
+    dsc[n].wri.linkAddr            = 0;
+    return &dsc[0];
+}
+
+LDMA_Descriptor_t* msg_descriptor_config(uint8_t slot, uint32_t* bufAddr, uint32_t frame_len_bytes)
+{
+    const uint8_t *part = (const uint8_t*)bufAddr;
+    uint16_t part_len = (uint16_t)frame_len_bytes;
+
+    return xfer_descriptor_config(slot, &part, &part_len, 1);
+}
+
+/**
+ * A batch frame (msg_batch.h) is gathered from its parts, head, message
+ * bodies in their slots and CRC. Bodies can have any length.
+ */
+LDMA_Descriptor_t* batch_descriptor_config(uint8_t slot, const uint8_t *const *parts, const uint16_t *part_lens, uint8_t num_parts)
+{
+    return xfer_descriptor_config(slot, parts, part_lens, num_parts);
+}
+
+LDMA_Descriptor_t* msg_descriptor(uint8_t slot)
+{
+    return &msgToUartDscs[slot][0];
+}
+
+/**
+ * The stamp of slot from continues with the first descriptor of slot to.
+ * LDMA reads the link word when it loads the descriptor, so a link written
+ * after that is not followed, see ldma_ring.h. link is set last, the other
+ * fields are in the same word and must be right when LDMA sees it.
+ */
+void msg_descriptor_link(uint8_t from, uint8_t to)
+{
+    LDMA_Descriptor_t *last = &msgToUartDscs[from][msgToUartDscCount[from] - 1];
+
+    last->wri.linkAddr = (uint32_t)&msgToUartDscs[to][0] >> 2; // Word address
+    last->wri.linkMode = ldmaLinkModeAbs;
+    __DMB();
+    last->wri.link     = 1;
+}
+
+/**
+ * The frame of slot writes seq to uartFramesOut when its last byte is in
+ * the UART. Set before the frame is started or linked.
+ */
+void msg_descriptor_stamp(uint8_t slot, uint32_t seq)
+{
+    msgToUartDscs[slot][msgToUartDscCount[slot] - 1].wri.immVal = seq;
+}
+
+uint32_t msg_frames_out(void)
+{
+    return uartFramesOut;
 }
 
 LDMA_Descriptor_t* token_descriptor_config(uint32_t* bufAddr, uint32_t data_len_bytes)
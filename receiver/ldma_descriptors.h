@@ -12,14 +12,21 @@
 #define LDMA_USART_DRIVER_H_
 
 #include "retargetserialconfig.h"
+#include "msg_pool.h"
+#include "msg_batch.h"
+#include "ldma_xfer.h"
 
-#define MAX_DATA_LEN_BYTES          114 // Max length for radio msg
-#define NUM_LDMA_DESCRIPTORS        ((MAX_DATA_LEN_BYTES / 2048UL) + 1)
+#define SLOT_LDMA_DESCRIPTORS       (LDMA_XFER_PART_MAX * MSG_BATCH_PARTS + 1) // A data frame is one part, + the stamp.
 
 // tsb0 and smnt-mb platforms use different USART for log communication
 #define USART_FOR_LDMA RETARGET_UART
 
-LDMA_Descriptor_t* msg_descriptor_config(uint32_t * memAddr, uint32_t payload_len_bytes);
+LDMA_Descriptor_t* msg_descriptor_config(uint8_t slot, uint32_t * memAddr, uint32_t frame_len_bytes);
+LDMA_Descriptor_t* batch_descriptor_config(uint8_t slot, const uint8_t *const *parts, const uint16_t *part_lens, uint8_t num_parts);
+LDMA_Descriptor_t* msg_descriptor(uint8_t slot);
+void msg_descriptor_link(uint8_t from, uint8_t to);
+void msg_descriptor_stamp(uint8_t slot, uint32_t seq);
+uint32_t msg_frames_out(void);
 LDMA_Descriptor_t* token_descriptor_config(uint32_t * memAddr, uint32_t data_len_bytes);
 
 #endif // LDMA_USART_DRIVER_H_
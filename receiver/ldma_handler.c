@@ -2,7 +2,8 @@
  * @file ldma_handler.c
  *
  * @brief   Here LDMA is initialized and LDMA channels are configured and started.
- *          LDMA IRQ handler is here.
+ *          LDMA IRQ handler is here. Frames go out through the chain of
+ *          ldma_ring.h, the handler tells it when a frame is done.
  * 
  * 
  * @author Johannes Ehala, ProLab.
@@ -12,10 +13,21 @@
  */
 
 #include "em_cmu.h"
+#include "platform.h"
 #include "ldma_handler.h"
+#include "ldma_descriptors.h"
+#include "ldma_ring.h"
 
-osThreadId_t ldma_ready_callback_thread;
-uint32_t ldma_ready_flag;
+static void ring_start (void *hw, uint8_t slot);
+static void ring_link (void *hw, uint8_t from, uint8_t to);
+static void ring_stamp (void *hw, uint8_t slot, uint32_t seq);
+static uint32_t ring_out (void *hw);
+static bool ring_busy (void *hw);
+static void ring_sent (void *user, uint8_t slot);
+
+static const ldma_ring_ops_t uart_ring_ops = { ring_start, ring_link, ring_stamp, ring_out, ring_busy, ring_sent };
+static ldma_ring_t uart_ring;
+static void (*frame_sent)(void *user, uint8_t slot);
 
 /**
  * @brief LDMA IRQ handler.
@@ -35,18 +47,21 @@ void LDMA_IRQHandler(void)
     {
         /* Clear interrupt flag. */
         LDMA->IFC = ACC_LDMA_CHANNEL_UART_MASK;
-        osThreadFlagsSet(ldma_ready_callback_thread, ldma_ready_flag);
+        ldma_ring_complete(&uart_ring);
     }
 }
 
 /**
- * @brief Initialize the LDMA controller.
+ * @brief Initialize the LDMA controller. sent is called from the LDMA IRQ
+ *        with the slot of every frame that is out, more than one per
+ *        interrupt if they ended close together.
  */
-void ldma_init (osThreadId_t thread_id, uint32_t thread_flag)
+void ldma_init (void (*sent)(void *user, uint8_t slot), void *user)
 {
     LDMA_Init_t init = LDMA_INIT_DEFAULT; // Only priority based arbitration, no round-robin.
-    ldma_ready_callback_thread = thread_id;
-    ldma_ready_flag = thread_flag;
+
+    frame_sent = sent;
+    ldma_ring_init(&uart_ring, &uart_ring_ops, NULL, user);
     
     CMU_ClockEnable(cmuClock_LDMA, true);
     
@@ -77,3 +92,50 @@ bool ldma_busy()
 {
     return !LDMA_TransferDone(ACC_LDMA_CHANNEL_UART);
 }
+
+/**
+ * @brief Send the frame of slot after the ones in flight, its descriptor is
+ *        set up with msg_descriptor_config(). The UART goes on without a gap
+ *        if the frame is queued before the previous one is out.
+ */
+void ldma_uart_queue (uint8_t slot)
+{
+    NVIC_DisableIRQ(LDMA_IRQn); // The ring is not touched by the IRQ meanwhile.
+    ldma_ring_append(&uart_ring, slot);
+    NVIC_EnableIRQ(LDMA_IRQn);
+}
+
+const ldma_ring_t* ldma_uart_ring (void)
+{
+    return &uart_ring;
+}
+
+static void ring_start (void *hw, uint8_t slot)
+{
+    ldma_uart_start(msg_descriptor(slot));
+}
+
+static void ring_link (void *hw, uint8_t from, uint8_t to)
+{
+    msg_descriptor_link(from, to);
+}
+
+static void ring_stamp (void *hw, uint8_t slot, uint32_t seq)
+{
+    msg_descriptor_stamp(slot, seq);
+}
+
+static uint32_t ring_out (void *hw)
+{
+    return msg_frames_out();
+}
+
+static bool ring_busy (void *hw)
+{
+    return ldma_busy();
+}
+
+static void ring_sent (void *user, uint8_t slot)
+{
+    frame_sent(user, slot);
+}
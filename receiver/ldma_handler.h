@@ -13,6 +13,7 @@
 #include "em_ldma.h"
 #include "retargetserialconfig.h"
 #include "cmsis_os2.h"
+#include "ldma_ring.h"
 
 #define ACC_LDMA_CHANNEL_UART	        2 // Channel number 0...7
 #define ACC_LDMA_CHANNEL_UART_MASK      (1 << ACC_LDMA_CHANNEL_UART)
@@ -27,9 +28,11 @@
     #error "Unknown USART used for logging. Check retargetserialconfig.h."
 #endif
 
-void ldma_init (osThreadId_t thread_id, uint32_t thread_flag);
+void ldma_init (void (*sent)(void *user, uint8_t slot), void *user);
 void ldma_uart_start (LDMA_Descriptor_t* uartDescriptor);
 void ldma_uart_stop ();
 bool ldma_busy();
+void ldma_uart_queue (uint8_t slot);
+const ldma_ring_t* ldma_uart_ring (void);
 
 #endif // LDMA_HANDLER_H_
@@ -0,0 +1,54 @@
+/**
+ * @file ldma_ring.c
+ *
+ * @brief Frames in flight on the LDMA UART channel, see ldma_ring.h.
+ *
+ * @license MIT
+ */
+
+#include <string.h>
+
+#include "ldma_ring.h"
+
+void ldma_ring_init(ldma_ring_t *ring, const ldma_ring_ops_t *ops, void *hw, void *user)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->ops = ops;
+    ring->hw = hw;
+    ring->user = user;
+}
+
+void ldma_ring_append(ldma_ring_t *ring, uint8_t slot)
+{
+    uint32_t in_flight = ldma_ring_in_flight(ring);
+
+    ring->order[ring->appended % LDMA_RING_SLOTS] = slot;
+    ring->ops->stamp(ring->hw, slot, ring->appended + 1);
+    if(in_flight == 0)ring->ops->start(ring->hw, slot);
+    else ring->ops->link(ring->hw, ring->order[(ring->appended - 1) % LDMA_RING_SLOTS], slot);
+    ring->appended++;
+    if(in_flight + 1 > ring->max_in_flight)ring->max_in_flight = in_flight + 1;
+}
+
+void ldma_ring_complete(ldma_ring_t *ring)
+{
+    // Busy before out: a frame that ends in between is counted and its
+    // interrupt comes again, a stopped channel has its last stamp written.
+    bool busy = ring->ops->busy(ring->hw);
+    uint32_t out = ring->ops->out(ring->hw);
+    uint8_t slot;
+
+    while((int32_t)(out - ring->completed) > 0 && ring->completed != ring->appended)
+    {
+        slot = ring->order[ring->completed % LDMA_RING_SLOTS];
+        ring->completed++;
+        ring->ops->sent(ring->user, slot);
+    }
+
+    // The link to the next frame came after LDMA loaded the last descriptor.
+    if(ring->completed != ring->appended && !busy)
+    {
+        ring->ops->start(ring->hw, ring->order[ring->completed % LDMA_RING_SLOTS]);
+        ring->restarts++;
+    }
+}
@@ -0,0 +1,89 @@
+/**
+ * @file ldma_ring.h
+ *
+ * @brief Frames in flight on the LDMA UART channel, kept as one chain of
+ *        linked descriptors so the UART sends them back to back.
+ *
+ *        Every msg_pool slot has its own descriptors, and so has the stats
+ *        frame (LDMA_RING_STATS), frames are named by them. A new frame is linked
+ *        behind the last one in flight, or starts the channel if nothing is
+ *        in flight. The last descriptor of a frame writes its sequence
+ *        number (ops->stamp) where ops->out reads it and raises the done
+ *        interrupt. The interrupt hands back every slot the count says is
+ *        out (ops->sent) and, if the chain ran dry with frames still
+ *        waiting, starts the next one. That happens when a link was written
+ *        after LDMA had already loaded the descriptor it changes.
+ *
+ *        The hardware is reached through ops only, so the bookkeeping is
+ *        plain C and runs against a model of LDMA on the host
+ *        (test/fake_ldma.h). ldma_ring_append() must not be interrupted by
+ *        ldma_ring_complete(): call it with the done interrupt masked.
+ *        Frames that end before the interrupt runs share one interrupt, the
+ *        count is what tells how many are out, not the interrupts.
+ *
+ * @license MIT
+ */
+
+#ifndef LDMA_RING_H_
+#define LDMA_RING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "msg_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LDMA_RING_STATS             MSG_POOL_SLOTS // Stats frame, not a pool slot.
+#define LDMA_RING_IDS               (MSG_POOL_SLOTS + 1) // Pool slots and LDMA_RING_STATS.
+#define LDMA_RING_SLOTS             (2 * MSG_POOL_SLOTS) // Power of 2, room for every id in flight.
+
+typedef struct
+{
+    void (*start)(void *hw, uint8_t slot);              // Start the channel at the descriptor of slot.
+    void (*link)(void *hw, uint8_t from, uint8_t to);   // Descriptor of from continues with to.
+    void (*stamp)(void *hw, uint8_t slot, uint32_t seq);// Frame of slot sets out to seq when done.
+    uint32_t (*out)(void *hw);                          // Seq of the last frame done, 0 at start.
+    bool (*busy)(void *hw);                             // Channel is transferring.
+    void (*sent)(void *user, uint8_t slot);             // Slot is out, can be reused.
+} ldma_ring_ops_t;
+
+typedef struct
+{
+    const ldma_ring_ops_t *ops;
+    void *hw;
+    void *user;
+    uint8_t order[LDMA_RING_SLOTS]; // Slots in send order.
+    uint32_t appended;              // Frames handed to LDMA, counts up.
+    uint32_t completed;             // Frames sent, counts up.
+    uint32_t restarts;              // Chain ran dry with frames waiting, UART was idle.
+    uint32_t max_in_flight;
+} ldma_ring_t;
+
+void ldma_ring_init(ldma_ring_t *ring, const ldma_ring_ops_t *ops, void *hw, void *user);
+
+/**
+ * @brief Data loop, done interrupt masked: send slot after the frames in flight.
+ */
+void ldma_ring_append(ldma_ring_t *ring, uint8_t slot);
+
+/**
+ * @brief Done interrupt, its flag cleared: hand back every frame that is
+ *        out, oldest first. One that finds none (a transfer that was not
+ *        started by the ring, or frames already handed back) only checks
+ *        that the chain still runs.
+ */
+void ldma_ring_complete(ldma_ring_t *ring);
+
+static inline uint32_t ldma_ring_in_flight(const ldma_ring_t *ring)
+{
+    return ring->appended - ring->completed;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LDMA_RING_H_
@@ -0,0 +1,44 @@
+/**
+ * @file ldma_xfer.c
+ *
+ * @brief Frame parts split into LDMA transfers, see ldma_xfer.h.
+ *
+ * @license MIT
+ */
+
+#include <stddef.h>
+
+#include "ldma_xfer.h"
+
+uint8_t ldma_xfer_split(ldma_xfer_t *xfers, uint8_t max, const uint8_t *const *parts, const uint16_t *part_lens, uint8_t num_parts)
+{
+    const uint8_t *p;
+    uint16_t len, units;
+    uint8_t i, n = 0;
+
+    for(i = 0; i < num_parts; i++)
+    {
+        p = parts[i];
+        len = part_lens[i];
+        while(len > 0)
+        {
+            if(n == max)return 0;
+            if(len == 1 || ((uintptr_t)p & 1)) // Odd byte at the end or before the first half-word.
+            {
+                units = 1;
+                xfers[n].unit_bytes = 1;
+            }
+            else
+            {
+                units = len / 2 < LDMA_XFER_MAX_UNITS ? len / 2 : LDMA_XFER_MAX_UNITS;
+                xfers[n].unit_bytes = 2;
+            }
+            xfers[n].src = p;
+            xfers[n].units = units;
+            p += units * xfers[n].unit_bytes;
+            len -= units * xfers[n].unit_bytes;
+            n++;
+        }
+    }
+    return n;
+}
@@ -0,0 +1,47 @@
+/**
+ * @file ldma_xfer.h
+ *
+ * @brief Frame parts split into LDMA transfers to the UART, one descriptor
+ *        each, so a frame of any length goes out as it is.
+ *
+ *        Half-word transfers (TXDOUBLE) carry the bulk of a part, a byte
+ *        transfer (TXDATA) the odd byte at its end, and at its start if the
+ *        part is not half-word aligned. A descriptor moves at most
+ *        LDMA_XFER_MAX_UNITS units, longer parts get more of them.
+ *
+ *        Plain C without platform headers, builds on the host as well.
+ *
+ * @license MIT
+ */
+
+#ifndef LDMA_XFER_H_
+#define LDMA_XFER_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LDMA_XFER_MAX_UNITS         2048 // xferCnt is 11 bits and one less than the count.
+#define LDMA_XFER_PART_MAX          3    // Transfers of a part up to 2 * LDMA_XFER_MAX_UNITS bytes long.
+
+typedef struct
+{
+    const uint8_t *src;
+    uint16_t units;                 // 1...LDMA_XFER_MAX_UNITS
+    uint8_t unit_bytes;             // 1 or 2
+} ldma_xfer_t;
+
+/**
+ * @brief Transfers that send parts in order, empty parts are skipped.
+ * @param max  room in xfers.
+ * @return number of transfers, 0 if they don't fit in max.
+ */
+uint8_t ldma_xfer_split(ldma_xfer_t *xfers, uint8_t max, const uint8_t *const *parts, const uint16_t *part_lens, uint8_t num_parts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LDMA_XFER_H_
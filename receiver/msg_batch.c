@@ -0,0 +1,52 @@
+/**
+ * @file msg_batch.c
+ *
+ * @brief Radio messages collected into one batch frame, see msg_batch.h.
+ *
+ * @license MIT
+ */
+
+#include "msg_batch.h"
+
+bool msg_batch_add(msg_batch_t *batch, uint8_t slot, uint32_t now_us)
+{
+    if(batch->count == 0)batch->opened_us = now_us;
+    batch->slots[batch->count++] = slot;
+    return batch->count >= MSG_BATCH_MSGS;
+}
+
+uint32_t msg_batch_wait_us(const msg_batch_t *batch, uint32_t now_us)
+{
+    uint32_t waited = now_us - batch->opened_us; // Clock wraps around.
+
+    if(batch->count == 0)return UINT32_MAX;
+    if(batch->count >= MSG_BATCH_MSGS || waited >= MSG_BATCH_WAIT_US)return 0;
+    return MSG_BATCH_WAIT_US - waited;
+}
+
+uint16_t msg_batch_seal(msg_batch_t *batch, msg_pool_t *pool)
+{
+    const uint8_t *msgs[MSG_BATCH_MSGS];
+    uint16_t lens[MSG_BATCH_MSGS];
+    uint8_t i, n = 0;
+
+    for(i = 0; i < batch->count; i++)
+    {
+        msgs[i] = msg_pool_frame(pool, batch->slots[i]) + SERIAL_FRAME_HEADER_LEN;
+        lens[i] = msg_pool_payload_len(pool, batch->slots[i]);
+    }
+    batch->frame_len = serial_batch_seal((uint8_t*)batch->head, (uint8_t*)&batch->crc, msgs, lens, batch->count);
+
+    batch->parts[n] = (const uint8_t*)batch->head;
+    batch->part_lens[n++] = SERIAL_FRAME_HEADER_LEN + SERIAL_BATCH_HEAD_LEN(batch->count);
+    for(i = 0; i < batch->count; i++)
+    {
+        if(lens[i] <= SERIAL_BATCH_MSG_NR_LEN)continue; // Nothing to send.
+        batch->parts[n] = msgs[i] + SERIAL_BATCH_MSG_NR_LEN;
+        batch->part_lens[n++] = lens[i] - SERIAL_BATCH_MSG_NR_LEN;
+    }
+    batch->parts[n] = (const uint8_t*)&batch->crc;
+    batch->part_lens[n++] = SERIAL_FRAME_CRC_LEN;
+    batch->num_parts = n;
+    return batch->frame_len;
+}
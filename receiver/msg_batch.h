@@ -0,0 +1,107 @@
+/**
+ * @file msg_batch.h
+ *
+ * @brief Radio messages collected into one batch frame (serial_framing.h),
+ *        so the token, the header, the CRC and the LDMA done interrupt are
+ *        paid once for several messages.
+ *
+ *        A batch is sent when it has MSG_BATCH_MSGS messages or when
+ *        MSG_BATCH_WAIT_US have passed since its first message arrived,
+ *        both set at build time (Makefile BATCH_MSGS, BATCH_WAIT_US). A
+ *        batch of one message goes out as a plain data frame, so
+ *        MSG_BATCH_MSGS 1, the default, sends every message on its own.
+ *
+ *        Messages stay in their msg_pool slots. msg_batch_seal() writes the
+ *        frame head and CRC into the batch and lists the parts of the frame
+ *        in wire order, LDMA gathers them with one descriptor each.
+ *
+ *        Plain C without platform headers, builds on the host as well.
+ *
+ * @license MIT
+ */
+
+#ifndef MSG_BATCH_H_
+#define MSG_BATCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "serial_framing.h"
+#include "msg_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef MSG_BATCH_MSGS
+#define MSG_BATCH_MSGS              1 // N, messages in a batch at most.
+#endif
+#ifndef MSG_BATCH_WAIT_US
+#define MSG_BATCH_WAIT_US           2000 // T, the first message waits this long at most.
+#endif
+
+#if MSG_BATCH_MSGS < 1 || MSG_BATCH_MSGS > SERIAL_BATCH_MAX_MSGS
+#error "MSG_BATCH_MSGS must be 1...SERIAL_BATCH_MAX_MSGS"
+#endif
+#if 2 * MSG_BATCH_MSGS > MSG_POOL_SLOTS
+#error "MSG_POOL_SLOTS too small for a batch being sent and one being filled"
+#endif
+
+#define MSG_BATCH_PARTS             (MSG_BATCH_MSGS + 2) // Head, bodies, CRC.
+#define MSG_BATCH_HEAD_WORDS        ((SERIAL_FRAME_HEADER_LEN + SERIAL_BATCH_HEAD_LEN(MSG_BATCH_MSGS) + 3) / 4)
+
+typedef struct
+{
+    uint8_t slots[MSG_BATCH_MSGS];  // Messages in arrival order.
+    uint8_t count;
+    uint32_t opened_us;             // Arrival of the first message.
+    uint32_t head[MSG_BATCH_HEAD_WORDS]; // Token, header, batch header, 4 byte aligned for ldma.
+    uint32_t crc;                   // CRC in the first 2 bytes.
+    const uint8_t *parts[MSG_BATCH_PARTS]; // Frame in wire order, set by msg_batch_seal().
+    uint16_t part_lens[MSG_BATCH_PARTS];
+    uint8_t num_parts;
+    uint16_t frame_len;
+} msg_batch_t;
+
+/**
+ * @brief Add the message in slot, the first one starts the wait.
+ * @return true if the batch is full now.
+ */
+bool msg_batch_add(msg_batch_t *batch, uint8_t slot, uint32_t now_us);
+
+/**
+ * @brief Time the batch can still wait for messages, 0 if it is due.
+ *        Empty batches wait forever (UINT32_MAX).
+ */
+uint32_t msg_batch_wait_us(const msg_batch_t *batch, uint32_t now_us);
+
+/**
+ * @brief Batch of more than one message: write the frame head and CRC and
+ *        set parts, every message is sent as long as it is in its slot.
+ * @return frame length in bytes.
+ */
+uint16_t msg_batch_seal(msg_batch_t *batch, msg_pool_t *pool);
+
+/**
+ * @brief Message in slot can go into a batch frame, it is long enough to
+ *        have the message number for the batch header. Shorter ones are
+ *        sent in a data frame of their own.
+ */
+static inline bool msg_batch_fits(const msg_pool_t *pool, uint8_t slot)
+{
+    return msg_pool_payload_len(pool, slot) >= SERIAL_BATCH_MSG_NR_LEN;
+}
+
+/**
+ * @brief Batch is sent, start over.
+ */
+static inline void msg_batch_clear(msg_batch_t *batch)
+{
+    batch->count = 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MSG_BATCH_H_
@@ -0,0 +1,62 @@
+/**
+ * @file msg_pool.c
+ *
+ * @brief Frame buffers of the receiver, see msg_pool.h.
+ *
+ *        free_head and free_tail only count up, the ring position is the
+ *        count modulo MSG_POOL_SLOTS. Each is written by one side and read by
+ *        the other with acquire/release order, so a slot number is in the
+ *        ring before the other side sees it there.
+ *
+ * @license MIT
+ */
+
+#include <string.h>
+
+#include "msg_pool.h"
+
+void msg_pool_init(msg_pool_t *pool)
+{
+    uint8_t i;
+
+    for(i = 0; i < MSG_POOL_SLOTS; i++)
+    {
+        pool->free_slots[i] = i;
+        pool->payload_len[i] = 0;
+    }
+    pool->free_tail = 0;
+    __atomic_store_n(&pool->free_head, MSG_POOL_SLOTS, __ATOMIC_RELEASE);
+}
+
+int msg_pool_claim(msg_pool_t *pool)
+{
+    uint32_t tail = pool->free_tail;
+    uint8_t slot;
+
+    if(tail == __atomic_load_n(&pool->free_head, __ATOMIC_ACQUIRE))return -1; // Data loop or UART is behind.
+    slot = pool->free_slots[tail % MSG_POOL_SLOTS];
+    __atomic_store_n(&pool->free_tail, tail + 1, __ATOMIC_RELEASE);
+    return slot;
+}
+
+void msg_pool_unclaim(msg_pool_t *pool)
+{
+    // The slot number is still in the ring: the LDMA IRQ can't have put one
+    // back over it, that would take this slot as well.
+    __atomic_store_n(&pool->free_tail, pool->free_tail - 1, __ATOMIC_RELEASE);
+}
+
+void msg_pool_fill(msg_pool_t *pool, uint8_t slot, const void *payload, uint16_t len)
+{
+    if(len > SERIAL_FRAME_MAX_PAYLOAD)len = SERIAL_FRAME_MAX_PAYLOAD;
+    memcpy(msg_pool_frame(pool, slot) + SERIAL_FRAME_HEADER_LEN, payload, len);
+    pool->payload_len[slot] = len;
+}
+
+void msg_pool_release(msg_pool_t *pool, uint8_t slot)
+{
+    uint32_t head = pool->free_head;
+
+    pool->free_slots[head % MSG_POOL_SLOTS] = slot;
+    __atomic_store_n(&pool->free_head, head + 1, __ATOMIC_RELEASE);
+}
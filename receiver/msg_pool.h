@@ -0,0 +1,88 @@
+/**
+ * @file msg_pool.h
+ *
+ * @brief Frame buffers of the receiver, so a radio message is copied once.
+ *
+ *        The radio callback claims a free slot and copies the payload into
+ *        the payload part of its frame. Only the slot number goes through the
+ *        message queue. The data loop seals the frame in place (token, header,
+ *        CRC, see serial_framing.h) and hands it to LDMA. The LDMA IRQ puts
+ *        the slot back when the frame is out.
+ *
+ *        Free slots are a single producer single consumer ring of slot
+ *        numbers: only the LDMA IRQ puts slots back, only the radio callback
+ *        takes them. No locks and no interrupt masking.
+ *
+ *        Plain C without platform headers, builds on the host as well.
+ *
+ * @license MIT
+ */
+
+#ifndef MSG_POOL_H_
+#define MSG_POOL_H_
+
+#include <stdint.h>
+
+#include "serial_framing.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MSG_POOL_SLOTS              16 // Power of 2, queued messages + batches in the ldma chain + one being filled.
+#define MSG_POOL_FRAME_WORDS        ((SERIAL_FRAME_MAX_LEN + 3) / 4)
+
+typedef struct
+{
+    uint32_t frames[MSG_POOL_SLOTS][MSG_POOL_FRAME_WORDS]; // 4 byte aligned for ldma
+    uint16_t payload_len[MSG_POOL_SLOTS];
+    uint8_t free_slots[MSG_POOL_SLOTS];
+    uint32_t free_head;             // Slots put back, written by the LDMA IRQ only.
+    uint32_t free_tail;             // Slots taken, written by the radio callback only.
+} msg_pool_t;
+
+/**
+ * @brief All slots free.
+ */
+void msg_pool_init(msg_pool_t *pool);
+
+/**
+ * @brief Radio callback: take a free slot.
+ * @return slot number, -1 if all slots are in use.
+ */
+int msg_pool_claim(msg_pool_t *pool);
+
+/**
+ * @brief Radio callback: give back the slot just claimed, it was not used.
+ */
+void msg_pool_unclaim(msg_pool_t *pool);
+
+/**
+ * @brief Radio callback: copy the payload of a message into the frame of
+ *        slot, at most SERIAL_FRAME_MAX_PAYLOAD bytes.
+ */
+void msg_pool_fill(msg_pool_t *pool, uint8_t slot, const void *payload, uint16_t len);
+
+/**
+ * @brief LDMA IRQ: give slot back.
+ */
+void msg_pool_release(msg_pool_t *pool, uint8_t slot);
+
+/**
+ * @brief Frame of slot, the payload starts at SERIAL_FRAME_HEADER_LEN.
+ */
+static inline uint8_t* msg_pool_frame(msg_pool_t *pool, uint8_t slot)
+{
+    return (uint8_t*)pool->frames[slot];
+}
+
+static inline uint16_t msg_pool_payload_len(const msg_pool_t *pool, uint8_t slot)
+{
+    return pool->payload_len[slot];
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MSG_POOL_H_
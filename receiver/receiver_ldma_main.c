@@ -6,7 +6,9 @@
  *  - let ldma do ntoh conversion (This is done already)
  *  - use higher serial speed
  *  - don't defer msg handling to thread, use ldma from receive msg 
- *    interrupt (cuz queue does two copy operations)
+ *    interrupt (cuz queue does two copy operations) (Done differently:
+ *    the payload is copied once into a frame buffer of msg_pool.h, only
+ *    its slot number is queued)
  *
  * Copyright Thinnect Inc. 2019
  * Copyright Proactivity-Lab, Taltech 2022
@@ -37,6 +39,9 @@
 
 #include "ldma_handler.h"
 #include "ldma_descriptors.h"
+#include "serial_framing.h"
+#include "msg_pool.h"
+#include "msg_batch.h"
 
 #include "endianness.h"
 
@@ -49,28 +54,70 @@
 #include "incbin.h"
 INCBIN(Header, "header.bin");
 
-#define MAX_PAYLOAD_SIZE    114     // According to comms_get_payload_max_length()
+#ifndef RECEIVER_STATS_MS
+#define RECEIVER_STATS_MS   1000    // Stats frame interval, Makefile STATS_INTERVAL_MS
+#endif
 
 static osThreadId_t dr_thread_id;
-static osMessageQueueId_t dr_queue_id;
+static osMessageQueueId_t dr_queue_id; // Slot numbers of msg_pool
+static msg_pool_t pool;
+static msg_batch_t batches[MSG_POOL_SLOTS]; // Indexed by the slot of the first message.
+
+// Counters since boot, written by the radio callback only. The data loop
+// sends what they grew by in a stats frame, uart_stalls is not used here.
+static volatile serial_stats_t counters;
+static uint32_t stats_frame[(SERIAL_FRAME_OVERHEAD + SERIAL_STATS_LEN + 3) / 4]; // 4 byte aligned for ldma
+static volatile bool stats_sending;
 
 static comms_layer_t* radio;
     
 // Receive a message from the network
 static void receive_message (comms_layer_t* comms, const comms_msg_t* msg, void* user)
 {
-    uint8_t plen;
+    static bool msg_nr_valid = false;
+    static uint32_t next_msg_nr;
+    uint8_t plen, slot;
+    const uint8_t *payload;
+    uint32_t msg_nr;
+    int claimed;
     osStatus_t res;
     
     // Get payload length
     plen = (uint8_t)comms_get_payload_length(comms, msg);
+    payload = comms_get_payload(comms, msg, plen);
+    counters.received++;
+    if(plen == 0)return; // Nothing to forward, a frame is never empty.
+
+    // Check msg sequence number, before the message can be dropped here
+    if(plen >= sizeof(msg_nr))
+    {
+        memcpy(&msg_nr, payload, sizeof(msg_nr));
+        msg_nr = ntoh32(msg_nr);
+        if(msg_nr_valid && msg_nr != next_msg_nr)
+        {
+            counters.radio_lost += msg_nr - next_msg_nr; // Wraps around like the sender counter.
+            counters.radio_gaps++;
+        }
+        msg_nr_valid = true;
+        next_msg_nr = msg_nr + 1;
+    }
 
-    // Post to queue 
-    res = osMessageQueuePut(dr_queue_id, comms_get_payload(comms, msg, plen), 0, 0);
+    // Copy straight into the frame it is sent in
+    claimed = msg_pool_claim(&pool);
+    if(claimed < 0)
+    {
+        counters.no_buffer++; // Data loop or UART is behind.
+        return;
+    }
+    slot = (uint8_t)claimed;
+    msg_pool_fill(&pool, slot, payload, plen);
+
+    // Post slot number to queue, it has room for every slot
+    res = osMessageQueuePut(dr_queue_id, &slot, 0, 0);
     if(res != osOK)
     {
-        //PLATFORM_LedsSet(PLATFORM_LedsGet() | 0x02);
-        //info3("queue put error");
+        msg_pool_unclaim(&pool);
+        counters.queue_full++;
     }
 }
 
@@ -107,62 +154,164 @@ static comms_layer_t* radio_setup (am_addr_t node_addr)
 
 /**
  * @note    Expecting msg payload first 4 bytes to be msg sequence number.
- *          Expecting msg payload size (includeing seq.nr.) to be 100 bytes.
  *
+ *          Messages go out as frames of serial_framing.h, payload with
+ *          sequence number unchanged and as long as it was received, up to
+ *          SERIAL_FRAME_MAX_PAYLOAD bytes. The radio callback has copied the
+ *          message into the payload part of a msg_pool frame, the queue only
+ *          has its slot number. Messages are collected into a batch
+ *          (msg_batch.h) until it is full or its first message has waited
+ *          MSG_BATCH_WAIT_US. A single message is sealed in place, a batch
+ *          gets a head and CRC of its own and ldma gathers the bodies from
+ *          their slots. A message too short for a message number goes out
+ *          alone. The frame is linked into the ldma chain behind the
+ *          frames still being sent (ldma_ring.h), so the UART does not wait
+ *          for this loop between frames. The LDMA IRQ puts the slots back
+ *          into the pool when the frame is out.
+ *
+ *          Every RECEIVER_STATS_MS a stats frame tells the parser how many
+ *          messages were received, missing on the radio or dropped here
+ *          since the previous one.
  */
+static void frame_sent (void *user, uint8_t slot)
+{
+    msg_batch_t *batch;
+    uint8_t i;
+
+    if(slot == LDMA_RING_STATS)
+    {
+        stats_sending = false;
+        return;
+    }
+    batch = &batches[slot];
+    for(i = 0; i < batch->count; i++)msg_pool_release((msg_pool_t*)user, batch->slots[i]);
+}
+
+// Kernel tick in microseconds, resolution is one tick.
+static uint32_t now_us ()
+{
+    return (uint32_t)((uint64_t)osKernelGetTickCount() * 1000000 / osKernelGetTickFreq());
+}
+
+static uint32_t now_ms ()
+{
+    return (uint32_t)((uint64_t)osKernelGetTickCount() * 1000 / osKernelGetTickFreq());
+}
+
+static uint32_t us_to_ticks (uint32_t us)
+{
+    return (uint32_t)(((uint64_t)us * osKernelGetTickFreq() + 999999) / 1000000);
+}
+
+static void send_batch (msg_batch_t *batch)
+{
+    uint8_t slot = batch->slots[0];
+    uint8_t *frame = msg_pool_frame(&pool, slot);
+    uint16_t frame_len;
+
+    if(batch->count == 1)
+    {
+        frame_len = serial_frame_seal(frame, SERIAL_FRAME_TYPE_DATA, msg_pool_payload_len(&pool, slot));
+        msg_descriptor_config(slot, (uint32_t*)frame, frame_len);
+    }
+    else
+    {
+        msg_batch_seal(batch, &pool);
+        batch_descriptor_config(slot, batch->parts, batch->part_lens, batch->num_parts);
+    }
+    ldma_uart_queue(slot);
+    PLATFORM_LedsSet(PLATFORM_LedsGet() ^ 0x01);
+}
+
+// Counters grew by this much since the previous stats frame.
+static void send_stats (uint32_t now)
+{
+    static serial_stats_t reported; // Totals at the previous stats frame.
+    static uint32_t reported_ms;
+    static uint16_t report;
+    serial_stats_t totals, d;
+    uint16_t frame_len;
+
+    totals.received = counters.received;
+    totals.radio_lost = counters.radio_lost;
+    totals.radio_gaps = counters.radio_gaps;
+    totals.no_buffer = counters.no_buffer;
+    totals.queue_full = counters.queue_full;
+    totals.uart_stalls = ldma_uart_ring()->restarts;
+
+    d.report = report++;
+    d.interval_ms = now - reported_ms > UINT16_MAX ? UINT16_MAX : (uint16_t)(now - reported_ms);
+    d.received = totals.received - reported.received;
+    d.radio_lost = totals.radio_lost - reported.radio_lost;
+    d.radio_gaps = totals.radio_gaps - reported.radio_gaps;
+    d.no_buffer = totals.no_buffer - reported.no_buffer;
+    d.queue_full = totals.queue_full - reported.queue_full;
+    d.uart_stalls = totals.uart_stalls - reported.uart_stalls;
+    reported = totals;
+    reported_ms = now;
+
+    frame_len = serial_stats_seal((uint8_t*)stats_frame, &d);
+    stats_sending = true;
+    msg_descriptor_config(LDMA_RING_STATS, stats_frame, frame_len);
+    ldma_uart_queue(LDMA_RING_STATS);
+}
+
 void data_receive_loop ()
 {
-    #define LDMA_READY_FLAG         0x04
-    #define LDMA_READY_WAIT_TIME    500 // Kernel ticks
-    
-    static uint8_t msg[MAX_PAYLOAD_SIZE];
     static const uint16_t token[] = {0xDEAD, 0xBEEF};
-    uint32_t msg_nr, last_msg_nr, tf_wait;
+    msg_batch_t *batch = NULL; // Being filled.
+    uint8_t slot;
+    uint32_t wait, timeout, stats_due, now;
+    int32_t stats_left;
     
     osDelay(500);
     
-    ldma_init(dr_thread_id, LDMA_READY_FLAG);
+    ldma_init(frame_sent, &pool);
     ldma_uart_start(token_descriptor_config((uint32_t *)token, 4));
+    while(ldma_busy())osDelay(1); // Token goes out alone, before any frame.
+    send_stats(now_ms()); // Counts since boot.
+    stats_due = now_ms() + RECEIVER_STATS_MS;
     
     for(;;)
     {
-        // TOKEN TEST
-        /*osDelay(10);
-        *((uint32_t*)msg) = hton32(0xDEADBEEF);
-        tf_wait = osThreadFlagsWait(LDMA_READY_FLAG, osFlagsWaitAny, LDMA_READY_WAIT_TIME);
-        if(tf_wait == LDMA_READY_FLAG)
+        now = now_ms(); // Once, a later read could be past stats_due.
+        stats_left = (int32_t)(stats_due - now);
+        if(stats_left <= 0)
         {
-            ldma_uart_start(msg_descriptor_config(((uint32_t*)msg), 100));
-            PLATFORM_LedsSet(PLATFORM_LedsGet() ^ 0x01);
+            if(!stats_sending)send_stats(now); // Else the UART is stuck, the next one has the counts.
+            stats_due += RECEIVER_STATS_MS;
+            continue;
         }
-        else;*/
-        
-        if(osMessageQueueGet(dr_queue_id, &msg, NULL, 3000) == osOK)
+
+        wait = batch != NULL ? msg_batch_wait_us(batch, now_us()) : UINT32_MAX;
+        if(wait == 0)
+        {
+            send_batch(batch); // Every slot fits in the chain.
+            batch = NULL;
+            continue;
+        }
+
+        timeout = us_to_ticks((uint32_t)stats_left * 1000); // Above 0, same now as the check.
+        if(wait != UINT32_MAX && us_to_ticks(wait) < timeout)timeout = us_to_ticks(wait);
+        if(osMessageQueueGet(dr_queue_id, &slot, NULL, timeout) == osOK)
         {
-            // Check msg sequence number
-            msg_nr = ntoh32(*((uint32_t*)msg));
-            
-            if(msg_nr != (last_msg_nr + 1));//info3("Message lost %lu", msg_nr-last_msg_nr);
-            else ;//info3("msg ok");
-            
-            last_msg_nr = msg_nr;
-            
-            // Write bytes to serial using ldma
-            // ldma also converts network byte order to host byte order
-            *((uint32_t*)msg) = hton32(0xDEADBEEF);
-            tf_wait = osThreadFlagsWait(LDMA_READY_FLAG, osFlagsWaitAll, LDMA_READY_WAIT_TIME);
-            if(tf_wait == LDMA_READY_FLAG)
+            if(!msg_batch_fits(&pool, slot))
             {
-                ldma_uart_start(msg_descriptor_config(((uint32_t*)msg), 100));
-                //info3("send bytes %lu - %u", ((uint16_t*)msg)+4, ntoh16(*(((uint16_t*)msg)+4)));
-                PLATFORM_LedsSet(PLATFORM_LedsGet() ^ 0x01);
+                if(batch != NULL)send_batch(batch); // Keeps the order.
+                batch = &batches[slot];
+                msg_batch_clear(batch);
+                msg_batch_add(batch, slot, now_us());
+                send_batch(batch);
+                batch = NULL;
+                continue;
             }
-            else
+            if(batch == NULL)
             {
-                //info3("ldma busy error");
+                batch = &batches[slot];
+                msg_batch_clear(batch);
             }
+            msg_batch_add(batch, slot, now_us());
         }
-        else ;//info3("No msg yet");
     }
 }
 
@@ -172,7 +321,8 @@ void hb_loop ()
     am_addr_t node_addr = DEFAULT_AM_ADDR;
     uint8_t node_eui[8];
     
-    dr_queue_id = osMessageQueueNew(5, MAX_PAYLOAD_SIZE, NULL);
+    msg_pool_init(&pool);
+    dr_queue_id = osMessageQueueNew(MSG_POOL_SLOTS, sizeof(uint8_t), NULL);
     
     // Initialize node signature - get address and EUI64
     if (SIG_GOOD == sigInit())
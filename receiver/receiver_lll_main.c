@@ -41,6 +41,8 @@
 INCBIN(Header, "header.bin");
 
 #define MSG_RECEIVE_FLAG    0x01
+#define MSG_NR_ITEMS        2   // Message number in front of the samples, in 16-bit items.
+#define SAMPLE_Z            127 // z value of the sender test pattern.
 
 static osThreadId_t dr_thread_id;
 static osMessageQueueId_t dr_queue_id;
@@ -54,7 +56,7 @@ static comms_layer_t* radio;
 typedef struct
 {
     uint8_t bytes;
-    uint8_t data_items;
+    uint8_t data_items;         // x, y, z samples, without the message number.
     uint32_t msgnr;
     uint16_t x_first;
     uint16_t y_first;
@@ -74,20 +76,21 @@ static void receive_message (comms_layer_t* comms, const comms_msg_t* msg, void*
     
     // Get payload length
     msg_cont.bytes = (uint8_t)comms_get_payload_length(comms, msg);
-    msg_cont.data_items = (uint8_t) (msg_cont.bytes / 2);
+    msg_cont.data_items = (uint8_t) (msg_cont.bytes / 2 - MSG_NR_ITEMS);
     
     payload32 = (uint32_t*)comms_get_payload(comms, msg, msg_cont.bytes);
     msg_cont.msgnr = ntoh32(*(payload32));
     
-    payload = (uint16_t*)comms_get_payload(comms, msg, msg_cont.bytes);
+    // Samples follow the message number
+    payload = (uint16_t*)comms_get_payload(comms, msg, msg_cont.bytes) + MSG_NR_ITEMS;
     
     // Read first 6 bytes and read last 6 btyes
     msg_cont.x_first = ntoh16(*payload);
     msg_cont.y_first = ntoh16(*(payload+1));
     msg_cont.z_first = ntoh16(*(payload+2));
-    msg_cont.x_last = ntoh16(*(payload+msg_cont.data_items-2));
-    msg_cont.y_last = ntoh16(*(payload+msg_cont.data_items-1));
-    msg_cont.z_last = ntoh16(*(payload+msg_cont.data_items));
+    msg_cont.x_last = ntoh16(*(payload+msg_cont.data_items-3));
+    msg_cont.y_last = ntoh16(*(payload+msg_cont.data_items-2));
+    msg_cont.z_last = ntoh16(*(payload+msg_cont.data_items-1));
     
     if(msg_nr != (msg_cont.msgnr - 1))info("Message lost %lu", msg_cont.msgnr-msg_nr);
     msg_nr = msg_cont.msgnr;
@@ -131,7 +134,7 @@ void data_receive_loop ()
 {
     static msg_content_t msg_cont;
     bool msg_lost, data_lost;
-    uint16_t last_x = -1;
+    uint16_t last_x = -1; // First message starts from x = 0.
     
     osDelay(500);
 
@@ -147,13 +150,13 @@ void data_receive_loop ()
             }
             else info("Mutex unavailable");
             
-            // Check data for data loss (lost messages)
+            // Check data for data loss (lost messages), x and y wrap around at 0xffff
             msg_lost = data_lost = false;
-            if(msg_cont.x_first == last_x + 1)msg_lost = true;
-            if(msg_cont.x_first + msg_cont.data_items == msg_cont.x_last)data_lost = true;
-            if(msg_cont.z_first == msg_cont.z_last && msg_cont.z_first == 127)data_lost = true;
+            if(msg_cont.x_first != (uint16_t)(last_x + 1))msg_lost = true;
+            if((uint16_t)(msg_cont.x_last - msg_cont.x_first) != msg_cont.data_items / 3 - 1)data_lost = true;
+            if((uint16_t)(msg_cont.y_first - msg_cont.y_last) != msg_cont.data_items / 3 - 1)data_lost = true;
+            if(msg_cont.z_first != SAMPLE_Z || msg_cont.z_last != SAMPLE_Z)data_lost = true;
             
-            // NB! There will be data loss when x value wraps around (from 0xffff to 0)
             if(msg_lost | data_lost)
             {
                 if(osMutexAcquire(statistics_mutex_id, 1000) == osOK)
@@ -195,7 +198,6 @@ void statistics_loop ()
         }
         else info("Mutex unavailable");
         
-        // NB! There will be data loss when x value wraps around (from 0xffff to 0)
         if(!loss)info3("During %u seconds - %lu bytes received, no loss", REPORT_INTERVAL, bytes);
         else info3("Data lost! during %u seconds - %lu bytes received", REPORT_INTERVAL, bytes);
     }
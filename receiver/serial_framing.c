@@ -0,0 +1,199 @@
+/**
+ * @file serial_framing.c
+ *
+ * @brief Framing of radio messages forwarded over serial, see serial_framing.h.
+ *        CRC is crc_ccitt_ffff() from lammertb.libcrc.
+ *
+ * @license MIT
+ */
+
+#include "serial_framing.h"
+
+#include "checksum.h"
+
+uint16_t serial_frame_seal(uint8_t *frame, uint8_t type, uint16_t payload_len)
+{
+    uint16_t crc;
+
+    frame[0] = (uint8_t)(SERIAL_FRAME_TOKEN >> 24);
+    frame[1] = (uint8_t)(SERIAL_FRAME_TOKEN >> 16);
+    frame[2] = (uint8_t)(SERIAL_FRAME_TOKEN >> 8);
+    frame[3] = (uint8_t)(SERIAL_FRAME_TOKEN);
+    frame[4] = type;
+    frame[5] = 0;
+    frame[6] = (uint8_t)(payload_len >> 8);
+    frame[7] = (uint8_t)(payload_len);
+
+    // Token is left out of the CRC, it is the same for every frame.
+    crc = crc_ccitt_ffff(frame + SERIAL_FRAME_TOKEN_LEN, SERIAL_FRAME_HEADER_LEN - SERIAL_FRAME_TOKEN_LEN + payload_len);
+    frame[SERIAL_FRAME_HEADER_LEN + payload_len] = (uint8_t)(crc >> 8);
+    frame[SERIAL_FRAME_HEADER_LEN + payload_len + 1] = (uint8_t)(crc);
+
+    return SERIAL_FRAME_OVERHEAD + payload_len;
+}
+
+static uint8_t* put16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)(v);
+    return p + 2;
+}
+
+static uint8_t* put32(uint8_t *p, uint32_t v)
+{
+    return put16(put16(p, (uint16_t)(v >> 16)), (uint16_t)v);
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return ((uint32_t)get16(p) << 16) | get16(p + 2);
+}
+
+static uint16_t body_len(uint16_t msg_len)
+{
+    return msg_len > SERIAL_BATCH_MSG_NR_LEN ? msg_len - SERIAL_BATCH_MSG_NR_LEN : 0;
+}
+
+// Entries of a batch payload add up to its length.
+static int batch_consistent(const uint8_t *payload, uint16_t len)
+{
+    uint8_t count = payload[0], i;
+    uint32_t total;
+
+    if(count == 0 || count > SERIAL_BATCH_MAX_MSGS || payload[1] != 0 || len < SERIAL_BATCH_HEAD_LEN(count))return 0;
+    total = SERIAL_BATCH_HEAD_LEN(count);
+    for(i = 0; i < count; i++)
+    {
+        total += get16(payload + 2 + SERIAL_BATCH_ENTRY_LEN * i + 4);
+    }
+    return total == len;
+}
+
+serial_frame_status_t serial_frame_check(const uint8_t *buf, size_t avail, serial_frame_info_t *info)
+{
+    uint16_t len, crc, max;
+
+    if(avail < SERIAL_FRAME_HEADER_LEN)return SERIAL_FRAME_INCOMPLETE;
+    if(buf[0] != (uint8_t)(SERIAL_FRAME_TOKEN >> 24) || buf[1] != (uint8_t)(SERIAL_FRAME_TOKEN >> 16)
+        || buf[2] != (uint8_t)(SERIAL_FRAME_TOKEN >> 8) || buf[3] != (uint8_t)(SERIAL_FRAME_TOKEN))
+    {
+        return SERIAL_FRAME_BAD_TOKEN;
+    }
+
+    len = (uint16_t)((buf[6] << 8) | buf[7]);
+    if(buf[4] == SERIAL_FRAME_TYPE_DATA)max = SERIAL_FRAME_MAX_PAYLOAD;
+    else if(buf[4] == SERIAL_FRAME_TYPE_BATCH)max = SERIAL_BATCH_MAX_PAYLOAD;
+    else if(buf[4] == SERIAL_FRAME_TYPE_STATS)max = SERIAL_STATS_LEN;
+    else return SERIAL_FRAME_BAD_HEADER;
+    if(buf[5] != 0 || len == 0 || len > max)return SERIAL_FRAME_BAD_HEADER;
+    if(buf[4] == SERIAL_FRAME_TYPE_STATS && len != SERIAL_STATS_LEN)return SERIAL_FRAME_BAD_HEADER;
+    if(avail < (size_t)(SERIAL_FRAME_OVERHEAD + len))return SERIAL_FRAME_INCOMPLETE;
+
+    crc = crc_ccitt_ffff(buf + SERIAL_FRAME_TOKEN_LEN, SERIAL_FRAME_HEADER_LEN - SERIAL_FRAME_TOKEN_LEN + len);
+    if(buf[SERIAL_FRAME_HEADER_LEN + len] != (uint8_t)(crc >> 8) || buf[SERIAL_FRAME_HEADER_LEN + len + 1] != (uint8_t)(crc))
+    {
+        return SERIAL_FRAME_BAD_CRC;
+    }
+    if(buf[4] == SERIAL_FRAME_TYPE_BATCH && !batch_consistent(buf + SERIAL_FRAME_HEADER_LEN, len))return SERIAL_FRAME_BAD_HEADER;
+
+    info->type = buf[4];
+    info->flags = buf[5];
+    info->payload_len = len;
+    info->payload = buf + SERIAL_FRAME_HEADER_LEN;
+    info->frame_len = SERIAL_FRAME_OVERHEAD + len;
+    return SERIAL_FRAME_OK;
+}
+
+uint16_t serial_batch_seal(uint8_t *head, uint8_t *crc, const uint8_t *const *msgs, const uint16_t *lens, uint8_t count)
+{
+    uint16_t payload_len = SERIAL_BATCH_HEAD_LEN(count), len, sum;
+    uint8_t *entry = head + SERIAL_FRAME_HEADER_LEN + 2;
+    const uint8_t *body;
+    uint8_t i;
+
+    for(i = 0; i < count; i++)
+    {
+        len = body_len(lens[i]);
+        entry[0] = msgs[i][0]; // Message number, already big-endian.
+        entry[1] = msgs[i][1];
+        entry[2] = msgs[i][2];
+        entry[3] = msgs[i][3];
+        put16(entry + 4, len);
+        entry += SERIAL_BATCH_ENTRY_LEN;
+        payload_len += len;
+    }
+
+    head[0] = (uint8_t)(SERIAL_FRAME_TOKEN >> 24);
+    head[1] = (uint8_t)(SERIAL_FRAME_TOKEN >> 16);
+    head[2] = (uint8_t)(SERIAL_FRAME_TOKEN >> 8);
+    head[3] = (uint8_t)(SERIAL_FRAME_TOKEN);
+    head[4] = SERIAL_FRAME_TYPE_BATCH;
+    head[5] = 0;
+    head[6] = (uint8_t)(payload_len >> 8);
+    head[7] = (uint8_t)(payload_len);
+    head[SERIAL_FRAME_HEADER_LEN] = count;
+    head[SERIAL_FRAME_HEADER_LEN + 1] = 0;
+
+    // Same CRC as over one buffer, carried on over the bodies where they are.
+    sum = crc_ccitt_ffff(head + SERIAL_FRAME_TOKEN_LEN, SERIAL_FRAME_HEADER_LEN - SERIAL_FRAME_TOKEN_LEN + SERIAL_BATCH_HEAD_LEN(count));
+    for(i = 0; i < count; i++)
+    {
+        body = msgs[i] + SERIAL_BATCH_MSG_NR_LEN;
+        for(len = body_len(lens[i]); len > 0; len--)sum = update_crc_ccitt(sum, *body++);
+    }
+    crc[0] = (uint8_t)(sum >> 8);
+    crc[1] = (uint8_t)(sum);
+
+    return SERIAL_FRAME_OVERHEAD + payload_len;
+}
+
+uint8_t serial_batch_split(const serial_frame_info_t *info, serial_batch_msg_t msgs[SERIAL_BATCH_MAX_MSGS])
+{
+    const uint8_t *entry = info->payload + 2;
+    uint8_t count = info->payload[0], i;
+    const uint8_t *body = info->payload + SERIAL_BATCH_HEAD_LEN(count);
+
+    for(i = 0; i < count; i++)
+    {
+        msgs[i].msg_nr = get32(entry);
+        msgs[i].body = body;
+        msgs[i].body_len = get16(entry + 4);
+        body += msgs[i].body_len;
+        entry += SERIAL_BATCH_ENTRY_LEN;
+    }
+    return count;
+}
+
+uint16_t serial_stats_seal(uint8_t *frame, const serial_stats_t *stats)
+{
+    uint8_t *p = frame + SERIAL_FRAME_HEADER_LEN;
+
+    p = put16(p, stats->report);
+    p = put16(p, stats->interval_ms);
+    p = put32(p, stats->received);
+    p = put32(p, stats->radio_lost);
+    p = put32(p, stats->radio_gaps);
+    p = put32(p, stats->no_buffer);
+    p = put32(p, stats->queue_full);
+    put32(p, stats->uart_stalls);
+    return serial_frame_seal(frame, SERIAL_FRAME_TYPE_STATS, SERIAL_STATS_LEN);
+}
+
+void serial_stats_get(const serial_frame_info_t *info, serial_stats_t *stats)
+{
+    const uint8_t *p = info->payload;
+
+    stats->report = get16(p);
+    stats->interval_ms = get16(p + 2);
+    stats->received = get32(p + 4);
+    stats->radio_lost = get32(p + 8);
+    stats->radio_gaps = get32(p + 12);
+    stats->no_buffer = get32(p + 16);
+    stats->queue_full = get32(p + 20);
+    stats->uart_stalls = get32(p + 24);
+}
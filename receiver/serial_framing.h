@@ -0,0 +1,153 @@
+/**
+ * @file serial_framing.h
+ *
+ * @brief Framing of radio messages forwarded over serial.
+ *
+ *        Frame on the wire, multi-byte fields big-endian:
+ *          0  token   4 bytes  0xDEADBEEF
+ *          4  type    1 byte   SERIAL_FRAME_TYPE_...
+ *          5  flags   1 byte   0, reserved
+ *          6  length  2 bytes  payload length
+ *          8  payload length bytes (radio message as received)
+ *          8+length   CRC-CCITT (0xFFFF) of bytes 4...8+length-1, 2 bytes
+ *
+ *        The token alone can appear inside payload data, a frame is only
+ *        accepted when length and CRC check out.
+ *
+ *        A batch frame (SERIAL_FRAME_TYPE_BATCH) carries several radio
+ *        messages, its payload is
+ *          0  count   1 byte   messages, 1...SERIAL_BATCH_MAX_MSGS
+ *          1  0       1 byte   reserved
+ *          2  count entries of message number (4 bytes) and body length (2 bytes)
+ *          2+6*count  bodies back to back, a body is a radio message without
+ *                     its message number
+ *
+ *        A stats frame (SERIAL_FRAME_TYPE_STATS) carries the counters of the
+ *        receiver since its previous stats frame, see serial_stats_t, all
+ *        fields in that order.
+ *
+ *        Plain C, used by the receiver firmware and the host serial parser.
+ *
+ * @license MIT
+ */
+
+#ifndef SERIAL_FRAMING_H_
+#define SERIAL_FRAMING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SERIAL_FRAME_TOKEN          0xDEADBEEFUL
+#define SERIAL_FRAME_TOKEN_LEN      4
+#define SERIAL_FRAME_HEADER_LEN     8
+#define SERIAL_FRAME_CRC_LEN        2
+#define SERIAL_FRAME_OVERHEAD       (SERIAL_FRAME_HEADER_LEN + SERIAL_FRAME_CRC_LEN)
+#define SERIAL_FRAME_MAX_PAYLOAD    114 // Max radio payload, comms_get_payload_max_length()
+#define SERIAL_FRAME_MAX_LEN        (SERIAL_FRAME_OVERHEAD + SERIAL_FRAME_MAX_PAYLOAD)
+
+#define SERIAL_BATCH_MAX_MSGS       8
+#define SERIAL_BATCH_MSG_NR_LEN     4 // Radio message starts with its number.
+#define SERIAL_BATCH_ENTRY_LEN      6
+#define SERIAL_BATCH_HEAD_LEN(n)    (2 + SERIAL_BATCH_ENTRY_LEN * (n))
+#define SERIAL_BATCH_MAX_PAYLOAD    (SERIAL_BATCH_HEAD_LEN(SERIAL_BATCH_MAX_MSGS) \
+                                     + SERIAL_BATCH_MAX_MSGS * (SERIAL_FRAME_MAX_PAYLOAD - SERIAL_BATCH_MSG_NR_LEN))
+#define SERIAL_FRAME_MAX_WIRE_LEN   (SERIAL_FRAME_OVERHEAD + SERIAL_BATCH_MAX_PAYLOAD) // Longest frame of any type.
+
+typedef enum
+{
+    SERIAL_FRAME_TYPE_DATA = 0x01,  // Radio message payload
+    SERIAL_FRAME_TYPE_BATCH = 0x02, // Several radio messages
+    SERIAL_FRAME_TYPE_STATS = 0x03  // Receiver counters
+} serial_frame_type_t;
+
+typedef enum
+{
+    SERIAL_FRAME_OK,
+    SERIAL_FRAME_INCOMPLETE,        // Need more bytes to decide.
+    SERIAL_FRAME_BAD_TOKEN,
+    SERIAL_FRAME_BAD_HEADER,        // Unknown type or length out of range.
+    SERIAL_FRAME_BAD_CRC
+} serial_frame_status_t;
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t flags;
+    uint16_t payload_len;
+    const uint8_t *payload;
+    uint16_t frame_len;             // Including token, header and CRC.
+} serial_frame_info_t;
+
+typedef struct
+{
+    uint32_t msg_nr;
+    const uint8_t *body;            // Message after its number.
+    uint16_t body_len;
+} serial_batch_msg_t;
+
+#define SERIAL_STATS_LEN            28 // Payload of a stats frame.
+
+typedef struct
+{
+    uint16_t report;                // Counts up with every stats frame, wraps around.
+    uint16_t interval_ms;           // Time since the previous stats frame.
+    uint32_t received;              // Radio messages received.
+    uint32_t radio_lost;            // Messages missing from the message numbers.
+    uint32_t radio_gaps;            // Places where messages are missing.
+    uint32_t no_buffer;             // Dropped, all frame buffers were queued or in the LDMA chain.
+    uint32_t queue_full;            // Dropped, message queue full.
+    uint32_t uart_stalls;           // LDMA chain ran dry with frames waiting, UART was idle.
+} serial_stats_t;
+
+/**
+ * @brief Complete a frame in place. Payload must already be at
+ *        frame + SERIAL_FRAME_HEADER_LEN, token, header and CRC are added.
+ *        frame must have room for payload_len + SERIAL_FRAME_OVERHEAD bytes.
+ * @return frame length in bytes.
+ */
+uint16_t serial_frame_seal(uint8_t *frame, uint8_t type, uint16_t payload_len);
+
+/**
+ * @brief Check the frame starting at buf (at the token), avail bytes are available.
+ * @return SERIAL_FRAME_OK and info filled in, or why the frame was not accepted.
+ */
+serial_frame_status_t serial_frame_check(const uint8_t *buf, size_t avail, serial_frame_info_t *info);
+
+/**
+ * @brief Token, header and batch header of a batch frame of count messages
+ *        into head (SERIAL_FRAME_HEADER_LEN + SERIAL_BATCH_HEAD_LEN(count)
+ *        bytes), CRC into crc (2 bytes). The messages are not copied, on the
+ *        wire head is followed by the bodies (msgs[i] + SERIAL_BATCH_MSG_NR_LEN,
+ *        lens[i] - SERIAL_BATCH_MSG_NR_LEN bytes) in order and crc.
+ * @param msgs  radio messages, each starting with its big-endian number.
+ * @return frame length in bytes.
+ */
+uint16_t serial_batch_seal(uint8_t *head, uint8_t *crc, const uint8_t *const *msgs, const uint16_t *lens, uint8_t count);
+
+/**
+ * @brief Messages of a batch frame that passed serial_frame_check().
+ * @return number of messages.
+ */
+uint8_t serial_batch_split(const serial_frame_info_t *info, serial_batch_msg_t msgs[SERIAL_BATCH_MAX_MSGS]);
+
+/**
+ * @brief Stats frame of stats into frame, which has room for
+ *        SERIAL_FRAME_OVERHEAD + SERIAL_STATS_LEN bytes.
+ * @return frame length in bytes.
+ */
+uint16_t serial_stats_seal(uint8_t *frame, const serial_stats_t *stats);
+
+/**
+ * @brief Counters of a stats frame that passed serial_frame_check().
+ */
+void serial_stats_get(const serial_frame_info_t *info, serial_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SERIAL_FRAMING_H_
@@ -0,0 +1,21 @@
+/**
+ * @file bench.h
+ *
+ * @brief Clock for the host benchmarks.
+ *
+ * @license MIT
+ */
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <time.h>
+
+static inline double bench_now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#endif // BENCH_H_
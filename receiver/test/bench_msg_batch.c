@@ -0,0 +1,143 @@
+/**
+ * @file bench_msg_batch.c
+ *
+ * @brief Radio messages batched into frames or sent one per frame: bytes
+ *        on the wire and LDMA done interrupts per message, the wait the
+ *        batching adds, and CPU time for fill, batch and seal on the host.
+ *
+ *        Messages of PAYLOAD_LEN bytes arrive at random (exponential gaps)
+ *        at the given rate and go through msg_batch and the sealing of the
+ *        data loop. A frame is one done interrupt, frames that end close
+ *        together can share one, so that is the upper bound. The UART load
+ *        is for 8N1, over 100% the UART can't keep up and messages are
+ *        dropped for want of a slot. An 802.15.4 radio delivers some
+ *        hundred messages per second at most.
+ *
+ *        The batch size is set at build time, the Makefile builds this for
+ *        several: bench_msg_batch_1 is the unbatched stream, every message
+ *        its own data frame.
+ *
+ *        bench_msg_batch_N [messages [baud]], 1000000 messages per rate
+ *        and 115200 baud, the parser's default, by default.
+ *
+ * @license MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "bench.h"
+#include "msg_batch.h"
+#include "msg_pool.h"
+#include "serial_framing.h"
+
+#define PAYLOAD_LEN                 100 // Message number and 48 samples.
+#define UART_BITS_PER_BYTE          10
+
+static msg_pool_t pool;
+static msg_batch_t batches[MSG_POOL_SLOTS]; // Indexed by the slot of the first message.
+static uint32_t arrived_us[MSG_POOL_SLOTS];
+static uint32_t rnd_state = 1;
+
+static uint32_t uart_baud = 115200;
+static uint64_t wire_bytes, frames, waited_us, max_wait_us;
+static volatile uint32_t sink;
+
+static double rnd_unit(void)
+{
+    rnd_state = rnd_state * 1103515245 + 12345;
+    return ((rnd_state >> 8) + 0.5) / (1 << 24);
+}
+
+// Data loop sends the batch at now_us, the frame is out and its slots free.
+static void send_batch(msg_batch_t *batch, uint32_t now_us)
+{
+    uint8_t slot = batch->slots[0], i;
+    uint16_t frame_len;
+
+    if(batch->count == 1)frame_len = serial_frame_seal(msg_pool_frame(&pool, slot), SERIAL_FRAME_TYPE_DATA, msg_pool_payload_len(&pool, slot));
+    else frame_len = msg_batch_seal(batch, &pool);
+    wire_bytes += frame_len;
+    frames++;
+    sink += frame_len;
+    for(i = 0; i < batch->count; i++)
+    {
+        waited_us += now_us - arrived_us[batch->slots[i]];
+        if(now_us - arrived_us[batch->slots[i]] > max_wait_us)max_wait_us = now_us - arrived_us[batch->slots[i]];
+        msg_pool_release(&pool, batch->slots[i]);
+    }
+    msg_batch_clear(batch);
+}
+
+static void run(uint32_t num_msgs, double msgs_per_s)
+{
+    uint8_t payload[PAYLOAD_LEN];
+    msg_batch_t *batch = NULL;
+    double t = 0, start, s, span_s, uart_bytes_per_s = (double)uart_baud / UART_BITS_PER_BYTE;
+    uint32_t nr, now = 0, wait;
+    int slot;
+
+    wire_bytes = frames = waited_us = max_wait_us = 0;
+    memset(payload, 0x5A, sizeof(payload));
+    msg_pool_init(&pool);
+    start = bench_now_s();
+    for(nr = 0; nr < num_msgs; nr++)
+    {
+        t += -log(rnd_unit()) * 1e6 / msgs_per_s;
+        now = (uint32_t)t;
+
+        // The data loop wakes up for a batch that is due before this message.
+        wait = batch != NULL ? msg_batch_wait_us(batch, batch->opened_us) : UINT32_MAX;
+        if(wait != UINT32_MAX && now - batch->opened_us >= wait)
+        {
+            send_batch(batch, batch->opened_us + wait);
+            batch = NULL;
+        }
+
+        // Radio callback.
+        slot = msg_pool_claim(&pool);
+        payload[0] = (uint8_t)(nr >> 24);
+        payload[1] = (uint8_t)(nr >> 16);
+        payload[2] = (uint8_t)(nr >> 8);
+        payload[3] = (uint8_t)nr;
+        msg_pool_fill(&pool, (uint8_t)slot, payload, PAYLOAD_LEN);
+        arrived_us[slot] = now;
+
+        // Data loop.
+        if(batch == NULL)
+        {
+            batch = &batches[slot];
+            msg_batch_clear(batch);
+        }
+        if(msg_batch_add(batch, (uint8_t)slot, now))
+        {
+            send_batch(batch, now);
+            batch = NULL;
+        }
+    }
+    if(batch != NULL)send_batch(batch, now);
+    s = bench_now_s() - start;
+
+    span_s = t * 1e-6;
+    printf("%4.0f msg/s: %5.2f msgs/frame, %6.1f B/msg on the wire (%5.1f%% of unbatched), %7.0f irq/s at most, "
+        "UART %5.1f%%, wait %6.0f us mean %6.0f max, %5.1f ns/msg\n",
+        msgs_per_s, (double)num_msgs / frames, (double)wire_bytes / num_msgs,
+        100.0 * wire_bytes / ((double)num_msgs * (PAYLOAD_LEN + SERIAL_FRAME_OVERHEAD)),
+        frames / span_s, 100.0 * wire_bytes / span_s / uart_bytes_per_s,
+        (double)waited_us / num_msgs, (double)max_wait_us, s * 1e9 / num_msgs);
+}
+
+int main(int argc, char **argv)
+{
+    static const double rates[] = { 25, 50, 100, 200, 400 };
+    uint32_t num_msgs = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 0) : 1000000;
+    unsigned i;
+
+    if(argc > 2)uart_baud = (uint32_t)strtoul(argv[2], NULL, 0);
+    printf("MSG_BATCH_MSGS %d, MSG_BATCH_WAIT_US %d, %d byte messages, %u baud\n",
+        MSG_BATCH_MSGS, MSG_BATCH_WAIT_US, PAYLOAD_LEN, uart_baud);
+    for(i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)run(num_msgs, rates[i]);
+    return 0;
+}
@@ -0,0 +1,150 @@
+/**
+ * @file bench_msg_pool.c
+ *
+ * @brief Radio callback to data loop hand-over, before and with the frame
+ *        buffer pool, on the CMSIS shim with one thread on each side.
+ *
+ *          queue  payload copied into the message queue and out of it into
+ *                 the frame, as before
+ *          pool   payload copied once into a pool slot, only the slot
+ *                 number is queued, the frame is sealed in place
+ *
+ *        Both queues hold QUEUE_MSGS messages, so a slot is always free
+ *        for the radio side. It waits instead of dropping, so the rate is
+ *        what the hand-over sustains. Copies are payload copies per message,
+ *        bytes all bytes copied per message, locked the bytes of them the
+ *        queue copies with its lock held.
+ *
+ *        On the receiver the queue copies with interrupts masked, the radio
+ *        IRQ waits for it: the locked bytes are what the pool saves. On a
+ *        host a copy of 114 bytes costs a few ns, less than the queue lock
+ *        and the CRC, which both paths share and which set the rate, so
+ *        the rates only show that the pool keeps up.
+ *
+ *        bench_msg_pool [messages], 2000000 by default.
+ *
+ * @license MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "cmsis_os2.h"
+#include "msg_pool.h"
+
+#define QUEUE_MSGS                  (MSG_POOL_SLOTS - 2) // One slot with each side.
+#define PAYLOAD_LEN                 100 // Message number and 48 samples.
+
+static uint32_t num_msgs;
+static osMessageQueueId_t queue;
+static msg_pool_t pool;
+static uint32_t frames[2][MSG_POOL_FRAME_WORDS];
+static volatile uint32_t sink;
+
+// Radio driver buffer with message nr.
+static void radio_payload(uint8_t *payload, uint32_t nr)
+{
+    memcpy(payload, &nr, sizeof(nr));
+}
+
+static void queue_radio(void *arg)
+{
+    uint8_t payload[SERIAL_FRAME_MAX_PAYLOAD] = {0};
+    uint32_t nr;
+
+    (void)arg;
+    for(nr = 0; nr < num_msgs; nr++)
+    {
+        radio_payload(payload, nr);
+        osMessageQueuePut(queue, payload, 0, osWaitForever);
+    }
+}
+
+static void queue_data(void *arg)
+{
+    uint8_t *frame;
+    uint32_t nr, cur = 0;
+
+    (void)arg;
+    for(nr = 0; nr < num_msgs; nr++)
+    {
+        frame = (uint8_t*)frames[cur];
+        osMessageQueueGet(queue, frame + SERIAL_FRAME_HEADER_LEN, NULL, osWaitForever);
+        sink += serial_frame_seal(frame, SERIAL_FRAME_TYPE_DATA, PAYLOAD_LEN);
+        cur ^= 1;
+    }
+}
+
+static void pool_radio(void *arg)
+{
+    uint8_t payload[SERIAL_FRAME_MAX_PAYLOAD] = {0};
+    uint32_t nr;
+    uint8_t slot;
+    int claimed;
+
+    (void)arg;
+    for(nr = 0; nr < num_msgs; nr++)
+    {
+        radio_payload(payload, nr);
+        while((claimed = msg_pool_claim(&pool)) < 0)osThreadYield();
+        slot = (uint8_t)claimed;
+        msg_pool_fill(&pool, slot, payload, PAYLOAD_LEN);
+        osMessageQueuePut(queue, &slot, 0, osWaitForever);
+    }
+}
+
+static void pool_data(void *arg)
+{
+    uint32_t nr;
+    uint8_t slot;
+
+    (void)arg;
+    for(nr = 0; nr < num_msgs; nr++)
+    {
+        osMessageQueueGet(queue, &slot, NULL, osWaitForever);
+        sink += serial_frame_seal(msg_pool_frame(&pool, slot), SERIAL_FRAME_TYPE_DATA, msg_pool_payload_len(&pool, slot));
+        msg_pool_release(&pool, slot); // LDMA done.
+    }
+}
+
+static double run(osThreadFunc_t radio, osThreadFunc_t data)
+{
+    osThreadId_t r, d;
+    double t0 = bench_now_s();
+
+    d = osThreadNew(data, NULL, NULL);
+    r = osThreadNew(radio, NULL, NULL);
+    osThreadJoin(r);
+    osThreadJoin(d);
+    return bench_now_s() - t0;
+}
+
+int main(int argc, char **argv)
+{
+    double t_queue, t_pool;
+    uint64_t bytes_queue, locked_pool;
+
+    num_msgs = argc > 1 ? strtoul(argv[1], NULL, 0) : 2000000;
+
+    queue = osMessageQueueNew(QUEUE_MSGS, SERIAL_FRAME_MAX_PAYLOAD, NULL);
+    t_queue = run(queue_radio, queue_data);
+    bytes_queue = osMessageQueueCopiedBytes(queue); // All of it locked.
+    osMessageQueueDelete(queue);
+
+    msg_pool_init(&pool);
+    queue = osMessageQueueNew(QUEUE_MSGS, sizeof(uint8_t), NULL);
+    t_pool = run(pool_radio, pool_data);
+    locked_pool = osMessageQueueCopiedBytes(queue); // msg_pool_fill() is not.
+    osMessageQueueDelete(queue);
+
+    printf("%u messages of %d bytes\n", num_msgs, PAYLOAD_LEN);
+    printf("queue: 2 copies, %5.1f bytes/message, %5.1f locked, %8.0f messages/s on two threads\n",
+           (double)bytes_queue / num_msgs, (double)bytes_queue / num_msgs, num_msgs / t_queue);
+    printf("pool:  1 copy,  %5.1f bytes/message, %5.1f locked, %8.0f messages/s on two threads\n",
+           (double)(locked_pool + (uint64_t)num_msgs * PAYLOAD_LEN) / num_msgs, (double)locked_pool / num_msgs, num_msgs / t_pool);
+    printf("pool: %.0f%% of the bytes copied, %.1f%% with the queue locked\n",
+           100.0 * (locked_pool + (uint64_t)num_msgs * PAYLOAD_LEN) / bytes_queue, 100.0 * locked_pool / bytes_queue);
+    return 0;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file bench_serial_framing.c
+ *
+ * @brief Frame building and CRC validation against the serial line rate.
+ *        A stream of data frames and a stream of full batch frames are
+ *        sealed and checked frame by frame. The rate is given in MB/s and
+ *        as the UART baud rate it keeps up with (10 bits per byte, 8N1).
+ *
+ *        bench_serial_framing [MB], 64 MB per stream by default.
+ *
+ * @license MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "serial_framing.h"
+
+#define UART_BITS_PER_BYTE          10
+
+static void report(const char *what, size_t bytes, double seconds)
+{
+    double mbs = bytes / seconds / 1e6;
+
+    printf("%-28s %8.1f MB/s, %7.1f Mbaud\n", what, mbs, mbs * UART_BITS_PER_BYTE);
+}
+
+static void bench_data(size_t bytes)
+{
+    size_t frames = bytes / SERIAL_FRAME_MAX_LEN, f, ok = 0;
+    uint8_t *buf = malloc(frames * SERIAL_FRAME_MAX_LEN), *frame;
+    serial_frame_info_t info;
+    double t0, t_seal, t_check;
+
+    memset(buf, 0x5A, frames * SERIAL_FRAME_MAX_LEN);
+    t0 = bench_now_s();
+    for(f = 0, frame = buf; f < frames; f++)frame += serial_frame_seal(frame, SERIAL_FRAME_TYPE_DATA, SERIAL_FRAME_MAX_PAYLOAD);
+    t_seal = bench_now_s() - t0;
+    t0 = bench_now_s();
+    for(f = 0, frame = buf; f < frames; f++)
+    {
+        if(serial_frame_check(frame, SERIAL_FRAME_MAX_LEN, &info) == SERIAL_FRAME_OK)ok++;
+        frame += SERIAL_FRAME_MAX_LEN;
+    }
+    t_check = bench_now_s() - t0;
+    if(ok != frames)printf("%zu of %zu data frames failed the check\n", frames - ok, frames);
+    report("data frame seal:", frames * SERIAL_FRAME_MAX_LEN, t_seal);
+    report("data frame check:", frames * SERIAL_FRAME_MAX_LEN, t_check);
+    free(buf);
+}
+
+static void bench_batch(size_t bytes)
+{
+    static uint8_t msg_bufs[SERIAL_BATCH_MAX_MSGS][SERIAL_FRAME_MAX_PAYLOAD];
+    const uint8_t *msgs[SERIAL_BATCH_MAX_MSGS];
+    uint16_t lens[SERIAL_BATCH_MAX_MSGS], head_len = SERIAL_FRAME_HEADER_LEN + SERIAL_BATCH_HEAD_LEN(SERIAL_BATCH_MAX_MSGS);
+    size_t frames = bytes / SERIAL_FRAME_MAX_WIRE_LEN, f, ok = 0, i;
+    uint8_t *buf = malloc(frames * SERIAL_FRAME_MAX_WIRE_LEN), *frame;
+    serial_frame_info_t info;
+    double t0, t_seal, t_check;
+
+    for(i = 0; i < SERIAL_BATCH_MAX_MSGS; i++)
+    {
+        memset(msg_bufs[i], (int)i, SERIAL_FRAME_MAX_PAYLOAD);
+        msgs[i] = msg_bufs[i];
+        lens[i] = SERIAL_FRAME_MAX_PAYLOAD;
+    }
+    // Bodies are where the LDMA would send them from, only head and CRC are written.
+    for(f = 0, frame = buf; f < frames; f++, frame += SERIAL_FRAME_MAX_WIRE_LEN)
+    {
+        for(i = 0; i < SERIAL_BATCH_MAX_MSGS; i++)
+        {
+            memcpy(frame + head_len + i * (SERIAL_FRAME_MAX_PAYLOAD - SERIAL_BATCH_MSG_NR_LEN),
+                   msg_bufs[i] + SERIAL_BATCH_MSG_NR_LEN, SERIAL_FRAME_MAX_PAYLOAD - SERIAL_BATCH_MSG_NR_LEN);
+        }
+    }
+    t0 = bench_now_s();
+    for(f = 0, frame = buf; f < frames; f++, frame += SERIAL_FRAME_MAX_WIRE_LEN)
+    {
+        serial_batch_seal(frame, frame + SERIAL_FRAME_MAX_WIRE_LEN - SERIAL_FRAME_CRC_LEN, msgs, lens, SERIAL_BATCH_MAX_MSGS);
+    }
+    t_seal = bench_now_s() - t0;
+    t0 = bench_now_s();
+    for(f = 0, frame = buf; f < frames; f++)
+    {
+        if(serial_frame_check(frame, SERIAL_FRAME_MAX_WIRE_LEN, &info) == SERIAL_FRAME_OK)ok++;
+        frame += SERIAL_FRAME_MAX_WIRE_LEN;
+    }
+    t_check = bench_now_s() - t0;
+    if(ok != frames)printf("%zu of %zu batch frames failed the check\n", frames - ok, frames);
+    report("batch frame seal:", frames * SERIAL_FRAME_MAX_WIRE_LEN, t_seal);
+    report("batch frame check:", frames * SERIAL_FRAME_MAX_WIRE_LEN, t_check);
+    free(buf);
+}
+
+int main(int argc, char **argv)
+{
+    size_t mb = argc > 1 ? strtoul(argv[1], NULL, 0) : 64;
+
+    bench_data(mb << 20);
+    bench_batch(mb << 20);
+    return 0;
+}
@@ -0,0 +1,26 @@
+/**
+ * @file check.h
+ *
+ * @brief Minimal checks for the host unit tests. A failed CHECK prints
+ *        where it failed and the test goes on, check_done() gives the
+ *        exit code.
+ *
+ * @license MIT
+ */
+
+#ifndef CHECK_H_
+#define CHECK_H_
+
+#include <stdio.h>
+
+static int check_failures = 0;
+
+#define CHECK(cond) do { if(!(cond)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); check_failures++; } } while(0)
+
+static inline int check_done(void)
+{
+    printf("%d failures\n", check_failures);
+    return check_failures != 0;
+}
+
+#endif // CHECK_H_
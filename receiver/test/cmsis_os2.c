@@ -0,0 +1,228 @@
+/**
+ * @file cmsis_os2.c
+ *
+ * @brief CMSIS-RTOS2 on pthreads for the host tests, see cmsis_os2.h.
+ *        A message queue is a ring of fixed size messages under one mutex,
+ *        messages are copied in and out as on the target.
+ *
+ * @license MIT
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cmsis_os2.h"
+
+#define TICK_FREQ                   1000
+
+typedef struct
+{
+    osThreadFunc_t func;
+    void *argument;
+    pthread_t tid;
+} thread_t;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    uint8_t *msgs;
+    uint32_t msg_count;
+    uint32_t msg_size;
+    uint32_t head;                  // Next message to get.
+    uint32_t count;
+    uint64_t copied;                // Bytes copied in and out.
+} queue_t;
+
+uint32_t osKernelGetTickCount(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * TICK_FREQ + ts.tv_nsec / (1000000000 / TICK_FREQ));
+}
+
+uint32_t osKernelGetTickFreq(void)
+{
+    return TICK_FREQ;
+}
+
+osStatus_t osDelay(uint32_t ticks)
+{
+    struct timespec ts = {ticks / TICK_FREQ, (long)(ticks % TICK_FREQ) * (1000000000 / TICK_FREQ)};
+
+    while(nanosleep(&ts, &ts) != 0 && errno == EINTR);
+    return osOK;
+}
+
+static void* thread_main(void *arg)
+{
+    thread_t *t = (thread_t*)arg;
+
+    t->func(t->argument);
+    return NULL;
+}
+
+osThreadId_t osThreadNew(osThreadFunc_t func, void *argument, const osThreadAttr_t *attr)
+{
+    thread_t *t = malloc(sizeof(thread_t));
+
+    (void)attr;
+    if(t == NULL)return NULL;
+    t->func = func;
+    t->argument = argument;
+    if(pthread_create(&t->tid, NULL, thread_main, t) != 0)
+    {
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+osStatus_t osThreadJoin(osThreadId_t thread_id)
+{
+    thread_t *t = (thread_t*)thread_id;
+
+    if(t == NULL || pthread_join(t->tid, NULL) != 0)return osErrorParameter;
+    free(t);
+    return osOK;
+}
+
+osStatus_t osThreadYield(void)
+{
+    sched_yield();
+    return osOK;
+}
+
+osMessageQueueId_t osMessageQueueNew(uint32_t msg_count, uint32_t msg_size, const osMessageQueueAttr_t *attr)
+{
+    queue_t *q = calloc(1, sizeof(queue_t));
+
+    (void)attr;
+    if(q == NULL || msg_count == 0 || msg_size == 0 || (q->msgs = malloc((size_t)msg_count * msg_size)) == NULL)
+    {
+        free(q);
+        return NULL;
+    }
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    q->msg_count = msg_count;
+    q->msg_size = msg_size;
+    return q;
+}
+
+// Absolute CLOCK_REALTIME deadline timeout ticks from now, for pthread_cond_timedwait().
+static struct timespec deadline(uint32_t timeout)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout / TICK_FREQ;
+    ts.tv_nsec += (long)(timeout % TICK_FREQ) * (1000000000 / TICK_FREQ);
+    if(ts.tv_nsec >= 1000000000)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    return ts;
+}
+
+// With q->lock held, wait on cond until the queue has room (for_room) or
+// a message (!for_room), at most timeout ticks. Returns 1 if it has.
+static int wait_for(queue_t *q, pthread_cond_t *cond, int for_room, uint32_t timeout)
+{
+    struct timespec until = deadline(timeout);
+
+    while(for_room ? q->count == q->msg_count : q->count == 0)
+    {
+        if(timeout == 0)return 0;
+        if(timeout == osWaitForever)pthread_cond_wait(cond, &q->lock);
+        else if(pthread_cond_timedwait(cond, &q->lock, &until) == ETIMEDOUT)
+        {
+            return for_room ? q->count < q->msg_count : q->count > 0;
+        }
+    }
+    return 1;
+}
+
+osStatus_t osMessageQueuePut(osMessageQueueId_t mq_id, const void *msg_ptr, uint8_t msg_prio, uint32_t timeout)
+{
+    queue_t *q = (queue_t*)mq_id;
+
+    (void)msg_prio;
+    if(q == NULL || msg_ptr == NULL)return osErrorParameter;
+    pthread_mutex_lock(&q->lock);
+    if(!wait_for(q, &q->not_full, 1, timeout))
+    {
+        pthread_mutex_unlock(&q->lock);
+        return timeout == 0 ? osErrorResource : osErrorTimeout;
+    }
+    memcpy(q->msgs + (size_t)((q->head + q->count) % q->msg_count) * q->msg_size, msg_ptr, q->msg_size);
+    q->count++;
+    q->copied += q->msg_size;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+    return osOK;
+}
+
+osStatus_t osMessageQueueGet(osMessageQueueId_t mq_id, void *msg_ptr, uint8_t *msg_prio, uint32_t timeout)
+{
+    queue_t *q = (queue_t*)mq_id;
+
+    if(q == NULL || msg_ptr == NULL)return osErrorParameter;
+    pthread_mutex_lock(&q->lock);
+    if(!wait_for(q, &q->not_empty, 0, timeout))
+    {
+        pthread_mutex_unlock(&q->lock);
+        return timeout == 0 ? osErrorResource : osErrorTimeout;
+    }
+    memcpy(msg_ptr, q->msgs + (size_t)q->head * q->msg_size, q->msg_size);
+    q->head = (q->head + 1) % q->msg_count;
+    q->count--;
+    q->copied += q->msg_size;
+    if(msg_prio != NULL)*msg_prio = 0;
+    pthread_cond_signal(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+    return osOK;
+}
+
+uint32_t osMessageQueueGetCount(osMessageQueueId_t mq_id)
+{
+    queue_t *q = (queue_t*)mq_id;
+    uint32_t count;
+
+    pthread_mutex_lock(&q->lock);
+    count = q->count;
+    pthread_mutex_unlock(&q->lock);
+    return count;
+}
+
+osStatus_t osMessageQueueDelete(osMessageQueueId_t mq_id)
+{
+    queue_t *q = (queue_t*)mq_id;
+
+    if(q == NULL)return osErrorParameter;
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+    free(q->msgs);
+    free(q);
+    return osOK;
+}
+
+uint64_t osMessageQueueCopiedBytes(osMessageQueueId_t mq_id)
+{
+    queue_t *q = (queue_t*)mq_id;
+    uint64_t copied;
+
+    pthread_mutex_lock(&q->lock);
+    copied = q->copied;
+    pthread_mutex_unlock(&q->lock);
+    return copied;
+}
@@ -0,0 +1,86 @@
+/**
+ * @file cmsis_os2.h
+ *
+ * @brief The part of CMSIS-RTOS2 the receiver uses, on pthreads, so its
+ *        modules run in host tests and benchmarks. Same names, types and
+ *        return values as the real header. Kernel ticks are milliseconds.
+ *
+ *        osMessageQueueCopiedBytes() is not CMSIS, it tells the benchmarks
+ *        how many bytes a queue copied in and out.
+ *
+ * @license MIT
+ */
+
+#ifndef CMSIS_OS2_H_
+#define CMSIS_OS2_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define osWaitForever               0xFFFFFFFFU
+
+typedef enum
+{
+    osOK = 0,
+    osError = -1,
+    osErrorTimeout = -2,
+    osErrorResource = -3,
+    osErrorParameter = -4,
+    osErrorNoMemory = -5,
+    osErrorISR = -6
+} osStatus_t;
+
+typedef void *osThreadId_t;
+typedef void *osMessageQueueId_t;
+typedef void (*osThreadFunc_t)(void *argument);
+
+typedef struct
+{
+    const char *name;
+    uint32_t attr_bits;
+    void *cb_mem;
+    uint32_t cb_size;
+    void *stack_mem;
+    uint32_t stack_size;
+    int32_t priority;               // Ignored on the host.
+    uint32_t tz_module;
+    uint32_t reserved;
+} osThreadAttr_t;
+
+typedef struct
+{
+    const char *name;
+    uint32_t attr_bits;
+    void *cb_mem;
+    uint32_t cb_size;
+    void *mq_mem;
+    uint32_t mq_size;
+} osMessageQueueAttr_t;
+
+uint32_t osKernelGetTickCount(void);
+uint32_t osKernelGetTickFreq(void);
+osStatus_t osDelay(uint32_t ticks);
+
+/**
+ * @brief Thread running func(argument), joinable with osThreadJoin().
+ */
+osThreadId_t osThreadNew(osThreadFunc_t func, void *argument, const osThreadAttr_t *attr);
+osStatus_t osThreadJoin(osThreadId_t thread_id);
+osStatus_t osThreadYield(void);
+
+osMessageQueueId_t osMessageQueueNew(uint32_t msg_count, uint32_t msg_size, const osMessageQueueAttr_t *attr);
+osStatus_t osMessageQueuePut(osMessageQueueId_t mq_id, const void *msg_ptr, uint8_t msg_prio, uint32_t timeout);
+osStatus_t osMessageQueueGet(osMessageQueueId_t mq_id, void *msg_ptr, uint8_t *msg_prio, uint32_t timeout);
+uint32_t osMessageQueueGetCount(osMessageQueueId_t mq_id);
+osStatus_t osMessageQueueDelete(osMessageQueueId_t mq_id);
+uint64_t osMessageQueueCopiedBytes(osMessageQueueId_t mq_id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CMSIS_OS2_H_
@@ -0,0 +1,91 @@
+/**
+ * @file fake_ldma.c
+ *
+ * @brief Model of the LDMA UART channel, see fake_ldma.h.
+ *
+ * @license MIT
+ */
+
+#include <string.h>
+
+#include "fake_ldma.h"
+
+static void load(fake_ldma_t *f, uint8_t id)
+{
+    f->cur = id;
+    f->left = f->len[id];
+    f->busy = true;
+}
+
+static void start(void *hw, uint8_t slot)
+{
+    fake_ldma_t *f = (fake_ldma_t*)hw;
+
+    if(f->busy)f->errors++;
+    load(f, slot);
+}
+
+static void link(void *hw, uint8_t from, uint8_t to)
+{
+    ((fake_ldma_t*)hw)->link[from] = to;
+}
+
+static void stamp(void *hw, uint8_t slot, uint32_t seq)
+{
+    ((fake_ldma_t*)hw)->seq[slot] = seq;
+}
+
+static uint32_t out(void *hw)
+{
+    return ((fake_ldma_t*)hw)->out;
+}
+
+static bool busy(void *hw)
+{
+    return ((fake_ldma_t*)hw)->busy;
+}
+
+const ldma_ring_ops_t fake_ldma_ops = { start, link, stamp, out, busy, NULL };
+
+void fake_ldma_init(fake_ldma_t *f, uint32_t irq_latency, void (*done)(fake_ldma_t *f, uint8_t id), void *ctx)
+{
+    memset(f, 0, sizeof(*f));
+    memset(f->link, 0xFF, sizeof(f->link));
+    f->irq_latency = irq_latency;
+    f->done = done;
+    f->ctx = ctx;
+}
+
+void fake_ldma_config(fake_ldma_t *f, uint8_t id, uint16_t len)
+{
+    f->len[id] = len;
+    f->link[id] = -1;
+}
+
+void fake_ldma_raise(fake_ldma_t *f)
+{
+    if(f->irq_pending)return; // Merged into the pending one.
+    f->irq_pending = true;
+    f->irq_due = f->now + f->irq_latency;
+}
+
+void fake_ldma_step(fake_ldma_t *f)
+{
+    uint8_t id;
+
+    f->now++;
+    if(!f->busy || --f->left > 0)return;
+    id = f->cur;
+    f->out = f->seq[id];
+    fake_ldma_raise(f);
+    if(f->link[id] >= 0)load(f, (uint8_t)f->link[id]);
+    else f->busy = false;
+    if(f->done != NULL)f->done(f, id);
+}
+
+bool fake_ldma_irq(fake_ldma_t *f)
+{
+    if(!f->irq_pending || (int32_t)(f->now - f->irq_due) < 0)return false;
+    f->irq_pending = false;
+    return true;
+}
@@ -0,0 +1,72 @@
+/**
+ * @file fake_ldma.h
+ *
+ * @brief Model of the LDMA UART channel behind ldma_ring_ops_t, in byte
+ *        times of the UART.
+ *
+ *        Every id has its frame length, the id it links to and its stamp.
+ *        A frame sends one byte per step. When its last byte is out the
+ *        stamp is written, the done interrupt is raised and the link is
+ *        read, as LDMA reads it when it loads the stamp descriptor: a link
+ *        written after that is not followed and the channel stops. The
+ *        interrupt runs irq_latency steps after it was raised, interrupts
+ *        raised meanwhile are merged into it, as the one flag bit does.
+ *
+ * @license MIT
+ */
+
+#ifndef FAKE_LDMA_H_
+#define FAKE_LDMA_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ldma_ring.h"
+
+typedef struct fake_ldma fake_ldma_t;
+
+struct fake_ldma
+{
+    uint16_t len[LDMA_RING_IDS];    // Frame bytes of every id.
+    int16_t link[LDMA_RING_IDS];    // Id the frame continues with, -1 none.
+    uint32_t seq[LDMA_RING_IDS];    // Stamp written when the frame is done.
+    bool busy;
+    uint8_t cur;                    // Id being sent.
+    uint16_t left;                  // Bytes of cur still to send.
+    uint32_t out;                   // Last stamp written.
+    bool irq_pending;
+    uint32_t irq_due;
+    uint32_t irq_latency;
+    uint32_t now;                   // Steps, byte times.
+    uint32_t errors;                // Started while busy.
+    void (*done)(fake_ldma_t *f, uint8_t id); // Last byte of id is out.
+    void *ctx;
+};
+
+extern const ldma_ring_ops_t fake_ldma_ops;
+
+void fake_ldma_init(fake_ldma_t *f, uint32_t irq_latency, void (*done)(fake_ldma_t *f, uint8_t id), void *ctx);
+
+/**
+ * @brief Descriptors of id set up for a frame of len bytes, not linked,
+ *        as msg_descriptor_config() does.
+ */
+void fake_ldma_config(fake_ldma_t *f, uint8_t id, uint16_t len);
+
+/**
+ * @brief Raise the done interrupt, as a transfer outside the ring does.
+ */
+void fake_ldma_raise(fake_ldma_t *f);
+
+/**
+ * @brief One byte time.
+ */
+void fake_ldma_step(fake_ldma_t *f);
+
+/**
+ * @brief The done interrupt runs now: its flag is cleared, true if it
+ *        was pending and its latency is over.
+ */
+bool fake_ldma_irq(fake_ldma_t *f);
+
+#endif // FAKE_LDMA_H_
@@ -0,0 +1,19 @@
+/**
+ * @file em_cmu.h
+ *
+ * @brief Stand-in for the emlib CMU header, the clock the LDMA handler
+ *        turns on, for the host syntax check of the firmware sources.
+ *
+ * @license MIT
+ */
+
+#ifndef EM_CMU_H_
+#define EM_CMU_H_
+
+#include <stdbool.h>
+
+typedef enum { cmuClock_LDMA } CMU_Clock_TypeDef;
+
+void CMU_ClockEnable(CMU_Clock_TypeDef clock, bool enable);
+
+#endif // EM_CMU_H_
@@ -0,0 +1,120 @@
+/**
+ * @file em_ldma.h
+ *
+ * @brief Stand-in for the emlib LDMA header (and the CMSIS core parts the
+ *        receiver uses with it), only so that the firmware sources that
+ *        program LDMA compile on the host. Same names and descriptor
+ *        fields as the real one, nothing behind the functions.
+ *
+ * @license MIT
+ */
+
+#ifndef EM_LDMA_H_
+#define EM_LDMA_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum { LDMA_IRQn = 8 } IRQn_Type;
+
+void NVIC_ClearPendingIRQ(IRQn_Type irq);
+void NVIC_EnableIRQ(IRQn_Type irq);
+void NVIC_DisableIRQ(IRQn_Type irq);
+void NVIC_SetPriority(IRQn_Type irq, uint32_t priority);
+
+#define __DMB()                     __sync_synchronize()
+
+typedef struct
+{
+    volatile uint32_t IFC;
+} LDMA_TypeDef;
+
+extern LDMA_TypeDef ldma_stub;
+#define LDMA                        (&ldma_stub)
+#define LDMA_IF_ERROR               (1UL << 31)
+
+enum { ldmaCtrlStructTypeXfer, ldmaCtrlStructTypeSync, ldmaCtrlStructTypeWrite };
+enum { ldmaCtrlBlockSizeUnit1 };
+enum { ldmaCtrlReqModeBlock, ldmaCtrlReqModeAll };
+enum { ldmaCtrlSrcIncOne, ldmaCtrlSrcIncTwo, ldmaCtrlSrcIncFour, ldmaCtrlSrcIncNone };
+enum { ldmaCtrlSizeByte, ldmaCtrlSizeHalf, ldmaCtrlSizeWord };
+enum { ldmaCtrlDstIncOne, ldmaCtrlDstIncTwo, ldmaCtrlDstIncFour, ldmaCtrlDstIncNone };
+enum { ldmaCtrlSrcAddrModeAbs, ldmaCtrlSrcAddrModeRel };
+enum { ldmaCtrlDstAddrModeAbs, ldmaCtrlDstAddrModeRel };
+enum { ldmaLinkModeAbs, ldmaLinkModeRel };
+typedef enum { ldmaPeripheralSignal_NONE, ldmaPeripheralSignal_USART0_TXBL, ldmaPeripheralSignal_USART2_TXBL } LDMA_PeripheralSignal_t;
+
+typedef union
+{
+    struct
+    {
+        uint32_t structType : 2;
+        uint32_t reserved0  : 1;
+        uint32_t structReq  : 1;
+        uint32_t xferCnt    : 11;
+        uint32_t byteSwap   : 1;
+        uint32_t blockSize  : 4;
+        uint32_t doneIfs    : 1;
+        uint32_t reqMode    : 1;
+        uint32_t decLoopCnt : 1;
+        uint32_t ignoreSrec : 1;
+        uint32_t srcInc     : 2;
+        uint32_t size       : 2;
+        uint32_t dstInc     : 2;
+        uint32_t srcAddrMode: 1;
+        uint32_t dstAddrMode: 1;
+        uint32_t srcAddr;
+        uint32_t dstAddr;
+        uint32_t linkMode   : 1;
+        uint32_t link       : 1;
+        int32_t  linkAddr   : 30;
+    } xfer;
+    struct
+    {
+        uint32_t structType : 2;
+        uint32_t reserved0  : 1;
+        uint32_t structReq  : 1;
+        uint32_t xferCnt    : 11;
+        uint32_t byteSwap   : 1;
+        uint32_t blockSize  : 4;
+        uint32_t doneIfs    : 1;
+        uint32_t reqMode    : 1;
+        uint32_t decLoopCnt : 1;
+        uint32_t ignoreSrec : 1;
+        uint32_t srcInc     : 2;
+        uint32_t size       : 2;
+        uint32_t dstInc     : 2;
+        uint32_t srcAddrMode: 1;
+        uint32_t dstAddrMode: 1;
+        uint32_t immVal;
+        uint32_t dstAddr;
+        uint32_t linkMode   : 1;
+        uint32_t link       : 1;
+        int32_t  linkAddr   : 30;
+    } wri;
+} LDMA_Descriptor_t;
+
+typedef struct
+{
+    uint8_t ldmaInitCtrlNumFixed;
+    uint8_t ldmaInitCtrlSyncPrsClrEn;
+    uint8_t ldmaInitCtrlSyncPrsSetEn;
+    uint8_t ldmaInitIrqPriority;
+} LDMA_Init_t;
+
+typedef struct
+{
+    LDMA_PeripheralSignal_t ldmaReqSel;
+} LDMA_TransferCfg_t;
+
+#define LDMA_INIT_DEFAULT           { 8, 0, 0, 3 }
+#define LDMA_TRANSFER_CFG_PERIPHERAL(signal) { signal }
+
+void LDMA_Init(const LDMA_Init_t *init);
+void LDMA_StartTransfer(int ch, const LDMA_TransferCfg_t *transfer, const LDMA_Descriptor_t *descriptor);
+void LDMA_StopTransfer(int ch);
+bool LDMA_TransferDone(int ch);
+void LDMA_IntEnable(uint32_t flags);
+uint32_t LDMA_IntGetEnabled(void);
+
+#endif // EM_LDMA_H_
@@ -0,0 +1,19 @@
+/**
+ * @file platform.h
+ *
+ * @brief Stand-in for the node platform header, the LEDs, for the host
+ *        syntax check of the firmware sources.
+ *
+ * @license MIT
+ */
+
+#ifndef PLATFORM_H_
+#define PLATFORM_H_
+
+#include <stdint.h>
+
+void PLATFORM_LedsInit(void);
+void PLATFORM_LedsSet(uint8_t leds);
+uint8_t PLATFORM_LedsGet(void);
+
+#endif // PLATFORM_H_
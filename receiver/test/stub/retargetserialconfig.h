@@ -0,0 +1,27 @@
+/**
+ * @file retargetserialconfig.h
+ *
+ * @brief Stand-in for the platform serial config, a tsb0 like board that
+ *        logs on USART0, for the host syntax check of the firmware sources.
+ *
+ * @license MIT
+ */
+
+#ifndef RETARGETSERIALCONFIG_H_
+#define RETARGETSERIALCONFIG_H_
+
+#include <stdint.h>
+
+typedef struct
+{
+    volatile uint32_t TXDATA;
+    volatile uint32_t TXDOUBLE;
+} USART_TypeDef;
+
+extern USART_TypeDef usart0_stub;
+#define USART0                      (&usart0_stub)
+
+#define LOGGER_LDMA_USART0
+#define RETARGET_UART               USART0
+
+#endif // RETARGETSERIALCONFIG_H_
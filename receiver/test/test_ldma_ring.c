@@ -0,0 +1,293 @@
+/**
+ * @file test_ldma_ring.c
+ *
+ * @brief Chain of frames on the LDMA UART channel against the model of
+ *        fake_ldma.h: every frame sent once and in order, slots handed
+ *        back only after they are out, every one of them when several
+ *        frames share a done interrupt, links that come too late, stray
+ *        interrupts, counters wrapping around, and the worst case the UART
+ *        waits with frames queued.
+ *
+ * @license MIT
+ */
+
+#include <string.h>
+
+#include "check.h"
+#include "fake_ldma.h"
+#include "ldma_ring.h"
+#include "msg_pool.h"
+
+#define LOG_FRAMES                  1024 // Power of 2, more than can be in flight.
+
+enum { LOAD_RANDOM, LOAD_AT_END, LOAD_BURST };
+
+typedef struct
+{
+    fake_ldma_t ldma;
+    ldma_ring_t ring;
+    ldma_ring_ops_t ops;
+    msg_pool_t pool;
+    bool stats_queued;
+    bool frame_ended;               // A frame ended in this step.
+    uint8_t ids[LOG_FRAMES];        // Frames in append order.
+    uint16_t lens[LOG_FRAMES];
+    uint32_t appended_at[LOG_FRAMES];
+    uint32_t sent_at[LOG_FRAMES];
+    uint32_t appended, sent, released;
+    uint32_t gap, max_gap;          // Steps the UART is idle with frames queued.
+    uint32_t max_delay;             // Steps a frame waits to start with the UART free.
+    uint32_t max_release;           // Steps from out to handed back.
+    uint32_t max_latency;           // Steps from appended to out.
+    uint32_t irqs, multi_irqs;      // Interrupts, those that handed back more than one.
+} sim_t;
+
+static sim_t sim;
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd(void)
+{
+    rnd_state = rnd_state * 1103515245 + 12345;
+    return rnd_state >> 8;
+}
+
+// Model: the last byte of id is out.
+static void frame_done(fake_ldma_t *f, uint8_t id)
+{
+    sim_t *s = (sim_t*)f->ctx;
+    uint32_t k = s->sent % LOG_FRAMES;
+    uint32_t start = f->now - s->lens[k];
+    uint32_t ready = s->appended_at[k];
+
+    CHECK(s->sent < s->appended);
+    CHECK(id == s->ids[k]);
+    if(s->sent > 0 && s->sent_at[(s->sent - 1) % LOG_FRAMES] > ready)ready = s->sent_at[(s->sent - 1) % LOG_FRAMES];
+    if(start - ready > s->max_delay)s->max_delay = start - ready;
+    if(f->now - s->appended_at[k] > s->max_latency)s->max_latency = f->now - s->appended_at[k];
+    s->sent_at[k] = f->now;
+    s->sent++;
+    s->frame_ended = true;
+}
+
+// Ring: slot is handed back.
+static void frame_released(void *user, uint8_t slot)
+{
+    sim_t *s = (sim_t*)user;
+    uint32_t k = s->released % LOG_FRAMES;
+
+    CHECK(s->released < s->sent); // Out before it is handed back.
+    CHECK(slot == s->ids[k]);
+    if(s->ldma.now - s->sent_at[k] > s->max_release)s->max_release = s->ldma.now - s->sent_at[k];
+    s->released++;
+    if(slot == LDMA_RING_STATS)s->stats_queued = false;
+    else msg_pool_release(&s->pool, slot);
+}
+
+static void sim_init(uint32_t irq_latency, uint32_t base)
+{
+    memset(&sim, 0, sizeof(sim));
+    fake_ldma_init(&sim.ldma, irq_latency, frame_done, &sim);
+    sim.ops = fake_ldma_ops;
+    sim.ops.sent = frame_released;
+    ldma_ring_init(&sim.ring, &sim.ops, &sim.ldma, &sim);
+    msg_pool_init(&sim.pool);
+
+    // Frame counters, and the stamps with them, start at base.
+    sim.ring.appended = sim.ring.completed = base;
+    sim.ldma.out = base;
+}
+
+// Data loop: queue a frame of len bytes, false if no slot is free.
+static bool sim_append(uint16_t len, bool stats)
+{
+    uint32_t k = sim.appended % LOG_FRAMES;
+    int slot;
+
+    if(stats)
+    {
+        if(sim.stats_queued)return false;
+        sim.stats_queued = true;
+        slot = LDMA_RING_STATS;
+    }
+    else if((slot = msg_pool_claim(&sim.pool)) < 0)return false;
+
+    fake_ldma_config(&sim.ldma, (uint8_t)slot, len);
+    sim.ids[k] = (uint8_t)slot;
+    sim.lens[k] = len;
+    sim.appended_at[k] = sim.ldma.now;
+    sim.appended++;
+    ldma_ring_append(&sim.ring, (uint8_t)slot);
+    return true;
+}
+
+// One byte time: LDMA, then its interrupt, then the data loop.
+static void sim_step(int load, uint16_t max_len, uint32_t stray)
+{
+    uint32_t before, n;
+
+    sim.frame_ended = false;
+    fake_ldma_step(&sim.ldma);
+    if(stray != 0 && rnd() % stray == 0)fake_ldma_raise(&sim.ldma);
+    if(fake_ldma_irq(&sim.ldma))
+    {
+        before = sim.released;
+        ldma_ring_complete(&sim.ring);
+        sim.irqs++;
+        if(sim.released - before > 1)sim.multi_irqs++;
+    }
+
+    if(load == LOAD_RANDOM && rnd() % 8 == 0)sim_append((uint16_t)(rnd() % max_len + 1), rnd() % 16 == 0);
+    else if(load == LOAD_AT_END && (sim.frame_ended || ldma_ring_in_flight(&sim.ring) == 0))
+    {
+        // Right when LDMA has read the link of the frame that ended.
+        sim_append((uint16_t)(rnd() % max_len + 1), false);
+    }
+    else if(load == LOAD_BURST && rnd() % 256 == 0)
+    {
+        for(n = rnd() % 8 + 1; n > 0; n--)sim_append((uint16_t)(rnd() % max_len + 1), rnd() % 4 == 0);
+    }
+
+    if(!sim.ldma.busy && sim.sent != sim.appended)
+    {
+        sim.gap++;
+        if(sim.gap > sim.max_gap)sim.max_gap = sim.gap;
+    }
+    else sim.gap = 0;
+}
+
+// Runs steps with load, then without until everything is handed back.
+static void sim_run(int load, uint16_t max_len, uint32_t stray, uint32_t steps)
+{
+    uint32_t i, free_slots = 0;
+
+    for(i = 0; i < steps; i++)sim_step(load, max_len, stray);
+    for(i = 0; i < 1000000 && (ldma_ring_in_flight(&sim.ring) != 0 || sim.ldma.busy || sim.ldma.irq_pending); i++)
+    {
+        sim_step(-1, max_len, 0);
+    }
+
+    CHECK(sim.ldma.errors == 0); // Never started while busy.
+    CHECK(sim.appended > 0);
+    CHECK(sim.sent == sim.appended);
+    CHECK(sim.released == sim.appended);
+    CHECK(ldma_ring_in_flight(&sim.ring) == 0);
+    CHECK(!sim.stats_queued);
+    while(msg_pool_claim(&sim.pool) >= 0)free_slots++;
+    CHECK(free_slots == MSG_POOL_SLOTS);
+    CHECK(sim.ring.max_in_flight <= LDMA_RING_IDS);
+}
+
+static void test_back_to_back(void)
+{
+    int i;
+
+    // Appended while the one before is sent: linked, never restarted.
+    sim_init(3, 0);
+    for(i = 0; i < 5; i++)CHECK(sim_append(20, i == 4));
+    sim_run(-1, 20, 0, 0);
+    CHECK(sim.ring.restarts == 0);
+    CHECK(sim.max_gap == 0);
+    CHECK(sim.sent_at[4] == 100); // 5 frames of 20 bytes without a gap.
+}
+
+static void test_late_link(void)
+{
+    uint32_t latency;
+
+    // Appended in the step the frame before ended: the chain stops, the
+    // interrupt starts the frame latency steps later.
+    for(latency = 0; latency < 40; latency += 7)
+    {
+        sim_init(latency, 0);
+        CHECK(sim_append(10, false));
+        while(!sim.frame_ended)sim_step(-1, 10, 0);
+        CHECK(!sim.ldma.busy);
+        CHECK(sim_append(10, false));
+        sim_run(-1, 10, 0, 0);
+        CHECK(sim.ring.restarts == (latency > 0)); // Without latency the first is handed back before.
+        CHECK(sim.max_delay == latency);
+        CHECK(sim.sent_at[1] == 10 + latency + 10);
+    }
+}
+
+static void test_shared_interrupt(void)
+{
+    int i;
+
+    // Three short frames end before the interrupt of the first runs.
+    sim_init(50, 0);
+    for(i = 0; i < 3; i++)CHECK(sim_append(4, false));
+    for(i = 0; i < 12; i++)sim_step(-1, 4, 0);
+    CHECK(sim.sent == 3);
+    CHECK(sim.released == 0);
+    CHECK(sim.ldma.irq_pending);
+    sim_run(-1, 4, 0, 0);
+    CHECK(sim.irqs == 1);
+    CHECK(sim.released == 3);
+    CHECK(sim.max_release == 50); // First one out at step 4, interrupt at 54.
+}
+
+static void test_stray_interrupt(void)
+{
+    // A transfer outside the ring (the token) raises the interrupt.
+    sim_init(2, 0);
+    fake_ldma_raise(&sim.ldma);
+    sim_step(-1, 1, 0);
+    sim_step(-1, 1, 0);
+    sim_step(-1, 1, 0);
+    CHECK(sim.irqs == 1);
+    CHECK(sim.released == 0);
+    CHECK(sim.ring.restarts == 0);
+
+    // And while frames are in flight: none of them is handed back early.
+    CHECK(sim_append(30, false));
+    fake_ldma_raise(&sim.ldma);
+    sim_run(-1, 30, 0, 0);
+    CHECK(sim.released == 1);
+    CHECK(sim.ring.restarts == 0);
+}
+
+static void test_random(void)
+{
+    static const uint32_t latencies[] = { 0, 1, 5, 30, 200 };
+    static const uint16_t max_lens[] = { 2, 16, SERIAL_FRAME_MAX_LEN };
+    static const int loads[] = { LOAD_RANDOM, LOAD_AT_END, LOAD_BURST };
+    unsigned l, m, d;
+    uint32_t latency, multi = 0, restarts = 0;
+
+    for(l = 0; l < sizeof(latencies) / sizeof(latencies[0]); l++)
+    {
+        for(m = 0; m < sizeof(max_lens) / sizeof(max_lens[0]); m++)
+        {
+            for(d = 0; d < sizeof(loads) / sizeof(loads[0]); d++)
+            {
+                latency = latencies[l];
+                sim_init(latency, d == 1 ? 0xFFFFFF00 : 0);
+                sim_run(loads[d], max_lens[m], 64, 200000);
+
+                // Worst case: the UART waits at most one interrupt latency
+                // with frames queued, a slot is handed back within one.
+                CHECK(sim.max_gap <= latency);
+                CHECK(sim.max_delay <= latency);
+                CHECK(sim.max_release <= latency);
+                printf("latency %3u max len %3u load %d: %6u frames, %5u restarts, %5u shared irqs, worst wait %3u, out %5u, release %3u\n",
+                    latency, max_lens[m], loads[d], sim.appended, sim.ring.restarts, sim.multi_irqs,
+                    sim.max_delay, sim.max_latency, sim.max_release);
+                multi += sim.multi_irqs;
+                restarts += sim.ring.restarts;
+            }
+        }
+    }
+    CHECK(multi > 0); // Shared interrupts were met.
+    CHECK(restarts > 0); // And late links.
+}
+
+int main(void)
+{
+    test_back_to_back();
+    test_late_link();
+    test_shared_interrupt();
+    test_stray_interrupt();
+    test_random();
+    return check_done();
+}
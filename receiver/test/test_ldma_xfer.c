@@ -0,0 +1,177 @@
+/**
+ * @file test_ldma_xfer.c
+ *
+ * @brief Frame parts split into LDMA transfers: every part length from 1
+ *        to SERIAL_FRAME_MAX_LEN and beyond one descriptor, at every
+ *        alignment, and data and batch frames of mixed message lengths.
+ *        The transfers are replayed as LDMA would, half-words to TXDOUBLE
+ *        and bytes to TXDATA, and must give the parts back in order.
+ *
+ * @license MIT
+ */
+
+#include <string.h>
+
+#include "check.h"
+#include "ldma_xfer.h"
+#include "msg_batch.h"
+#include "msg_pool.h"
+#include "serial_framing.h"
+
+#define MAX_XFERS                   (LDMA_XFER_PART_MAX * MSG_BATCH_PARTS) // SLOT_LDMA_DESCRIPTORS without the stamp.
+#define LONG_PART                   (2 * LDMA_XFER_MAX_UNITS)
+
+static uint8_t src[LONG_PART + 8];
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd(void)
+{
+    rnd_state = rnd_state * 1103515245 + 12345;
+    return rnd_state >> 8;
+}
+
+/*
+ * Sends the transfers to the UART, which gets them at wire: every transfer
+ * is sound for LDMA (half-words aligned, counts in range).
+ * Returns the bytes sent.
+ */
+static size_t replay(const ldma_xfer_t *xfers, uint8_t n, uint8_t *wire)
+{
+    size_t len = 0;
+    uint8_t i;
+
+    for(i = 0; i < n; i++)
+    {
+        CHECK(xfers[i].units >= 1 && xfers[i].units <= LDMA_XFER_MAX_UNITS);
+        CHECK(xfers[i].unit_bytes == 1 || xfers[i].unit_bytes == 2);
+        if(xfers[i].unit_bytes == 2)CHECK(((uintptr_t)xfers[i].src & 1) == 0);
+        else CHECK(xfers[i].units == 1); // Odd bytes only.
+        memcpy(wire + len, xfers[i].src, (size_t)xfers[i].units * xfers[i].unit_bytes);
+        len += (size_t)xfers[i].units * xfers[i].unit_bytes;
+    }
+    return len;
+}
+
+static void test_every_length(void)
+{
+    static uint8_t wire[LONG_PART + 8];
+    ldma_xfer_t xfers[MAX_XFERS];
+    const uint8_t *part;
+    uint16_t len, part_len, bytes;
+    unsigned align;
+    uint8_t n;
+
+    for(len = 0; len < sizeof(src); len++)src[len] = (uint8_t)rnd();
+    for(align = 0; align < 4; align++)
+    {
+        for(len = 1; len <= LONG_PART; len++)
+        {
+            if(len > SERIAL_FRAME_MAX_LEN + 8 && len % 61 != 0 && len < LONG_PART - 4)continue; // Long ones sampled.
+            part = src + align;
+            part_len = len;
+            n = ldma_xfer_split(xfers, MAX_XFERS, &part, &part_len, 1);
+            CHECK(n >= 1 && n <= LDMA_XFER_PART_MAX);
+            CHECK(replay(xfers, n, wire) == len);
+            CHECK(memcmp(wire, part, len) == 0);
+
+            // Fewest transfers: an odd start byte, the half-words, an odd end byte.
+            bytes = (uint16_t)(len - (align & 1));
+            CHECK(n == (align & 1) + (bytes / 2 + LDMA_XFER_MAX_UNITS - 1) / LDMA_XFER_MAX_UNITS + (bytes & 1));
+
+            // Not enough room: nothing.
+            CHECK(ldma_xfer_split(xfers, n - 1, &part, &part_len, 1) == 0);
+        }
+    }
+}
+
+static void test_mixed_parts(void)
+{
+    static uint8_t wire[MSG_BATCH_PARTS * 200];
+    uint8_t expect[MSG_BATCH_PARTS * 200];
+    ldma_xfer_t xfers[MAX_XFERS];
+    const uint8_t *parts[MSG_BATCH_PARTS];
+    uint16_t lens[MSG_BATCH_PARTS];
+    size_t total;
+    uint32_t round;
+    uint8_t i, num, n;
+
+    for(round = 0; round < 100000; round++)
+    {
+        // Parts anywhere in memory, empty ones among them.
+        num = (uint8_t)(rnd() % MSG_BATCH_PARTS + 1);
+        total = 0;
+        for(i = 0; i < num; i++)
+        {
+            lens[i] = (uint16_t)(rnd() % 4 == 0 ? rnd() % 4 : rnd() % 200);
+            parts[i] = src + rnd() % (sizeof(src) - 200);
+            memcpy(expect + total, parts[i], lens[i]);
+            total += lens[i];
+        }
+        n = ldma_xfer_split(xfers, MAX_XFERS, parts, lens, num);
+        CHECK((n == 0) == (total == 0));
+        CHECK(replay(xfers, n, wire) == total);
+        CHECK(memcmp(wire, expect, total) == 0);
+    }
+}
+
+static void test_frames(void)
+{
+    static msg_pool_t pool;
+    static uint8_t wire[SERIAL_FRAME_MAX_WIRE_LEN];
+    uint8_t payload[SERIAL_FRAME_MAX_PAYLOAD];
+    ldma_xfer_t xfers[MAX_XFERS];
+    const uint8_t *part;
+    uint16_t len, part_len, frame_len;
+    serial_frame_info_t info;
+    msg_batch_t batch;
+    uint32_t round;
+    uint8_t i, n, slot, count;
+
+    // Data frame of every message length, sealed in place in a slot.
+    msg_pool_init(&pool);
+    for(len = 1; len <= SERIAL_FRAME_MAX_PAYLOAD; len++)
+    {
+        for(i = 0; i < len; i++)payload[i] = (uint8_t)rnd();
+        slot = (uint8_t)msg_pool_claim(&pool);
+        msg_pool_fill(&pool, slot, payload, len);
+        part = msg_pool_frame(&pool, slot);
+        part_len = serial_frame_seal(msg_pool_frame(&pool, slot), SERIAL_FRAME_TYPE_DATA, len);
+        n = ldma_xfer_split(xfers, MAX_XFERS, &part, &part_len, 1);
+        CHECK(n == 1 + (len & 1)); // Slots are word aligned.
+        CHECK(replay(xfers, n, wire) == part_len);
+        CHECK(serial_frame_check(wire, part_len, &info) == SERIAL_FRAME_OK);
+        CHECK(info.payload_len == len && memcmp(info.payload, payload, len) == 0);
+        msg_pool_release(&pool, slot);
+    }
+
+    // Batches of messages of mixed lengths, bodies start at odd and even offsets.
+    for(round = 0; round < 20000; round++)
+    {
+        msg_pool_init(&pool);
+        msg_batch_clear(&batch);
+        count = (uint8_t)(rnd() % MSG_BATCH_MSGS + 1);
+        if(count < 2)continue;
+        for(i = 0; i < count; i++)
+        {
+            len = (uint16_t)(SERIAL_BATCH_MSG_NR_LEN + rnd() % (SERIAL_FRAME_MAX_PAYLOAD - SERIAL_BATCH_MSG_NR_LEN + 1));
+            for(n = 0; n < len; n++)payload[n] = (uint8_t)rnd();
+            slot = (uint8_t)msg_pool_claim(&pool);
+            msg_pool_fill(&pool, slot, payload, len);
+            msg_batch_add(&batch, slot, 0);
+        }
+        frame_len = msg_batch_seal(&batch, &pool);
+        n = ldma_xfer_split(xfers, MAX_XFERS, batch.parts, batch.part_lens, batch.num_parts);
+        CHECK(n > 0);
+        CHECK(replay(xfers, n, wire) == frame_len);
+        CHECK(serial_frame_check(wire, frame_len, &info) == SERIAL_FRAME_OK);
+        CHECK(info.type == SERIAL_FRAME_TYPE_BATCH);
+    }
+}
+
+int main(void)
+{
+    test_every_length();
+    test_mixed_parts();
+    test_frames();
+    return check_done();
+}
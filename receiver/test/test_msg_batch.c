@@ -0,0 +1,216 @@
+/**
+ * @file test_msg_batch.c
+ *
+ * @brief Batching of radio messages: a batch is due with MSG_BATCH_MSGS
+ *        messages or MSG_BATCH_WAIT_US after its first one, also when the
+ *        clock wraps around, a single message waits the full time and goes
+ *        out as a data frame, and the parts of a sealed batch make a frame
+ *        that splits back into the messages.
+ *
+ * @license MIT
+ */
+
+#include <string.h>
+
+#include "check.h"
+#include "msg_batch.h"
+#include "msg_pool.h"
+#include "serial_framing.h"
+
+static msg_pool_t pool;
+static msg_batch_t batch;
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd(void)
+{
+    rnd_state = rnd_state * 1103515245 + 12345;
+    return rnd_state >> 8;
+}
+
+// Radio message nr of len bytes into a new slot, as the radio callback does.
+static uint8_t radio_msg(uint32_t nr, uint16_t len)
+{
+    uint8_t payload[SERIAL_FRAME_MAX_PAYLOAD];
+    uint16_t i;
+    int slot = msg_pool_claim(&pool);
+
+    CHECK(slot >= 0);
+    payload[0] = (uint8_t)(nr >> 24);
+    payload[1] = (uint8_t)(nr >> 16);
+    payload[2] = (uint8_t)(nr >> 8);
+    payload[3] = (uint8_t)nr;
+    for(i = SERIAL_BATCH_MSG_NR_LEN; i < len; i++)payload[i] = (uint8_t)rnd();
+    msg_pool_fill(&pool, (uint8_t)slot, payload, len);
+    return (uint8_t)slot;
+}
+
+static void release_all(void)
+{
+    uint8_t i;
+
+    for(i = 0; i < batch.count; i++)msg_pool_release(&pool, batch.slots[i]);
+    msg_batch_clear(&batch);
+}
+
+static void test_empty(void)
+{
+    msg_pool_init(&pool);
+    memset(&batch, 0, sizeof(batch));
+    CHECK(msg_batch_wait_us(&batch, 0) == UINT32_MAX);
+    CHECK(msg_batch_wait_us(&batch, 123456789) == UINT32_MAX);
+}
+
+static void test_flush_on_count(void)
+{
+    static const uint32_t starts[] = { 0, 1000, 0xFFFFFFFF - 10 };
+    unsigned s;
+    uint32_t now;
+    uint8_t i;
+
+    for(s = 0; s < sizeof(starts) / sizeof(starts[0]); s++)
+    {
+        // Messages faster than the wait: the N-th makes the batch due.
+        msg_pool_init(&pool);
+        msg_batch_clear(&batch);
+        now = starts[s];
+        for(i = 0; i < MSG_BATCH_MSGS; i++)
+        {
+            CHECK(msg_batch_add(&batch, radio_msg(i, 100), now) == (i == MSG_BATCH_MSGS - 1));
+            CHECK(batch.count == i + 1);
+            if(i + 1 < MSG_BATCH_MSGS)CHECK(msg_batch_wait_us(&batch, now) == MSG_BATCH_WAIT_US - (uint32_t)i);
+            else CHECK(msg_batch_wait_us(&batch, now) == 0);
+            now++;
+        }
+        CHECK(batch.opened_us == starts[s]);
+        release_all();
+        CHECK(msg_batch_wait_us(&batch, now) == UINT32_MAX);
+    }
+}
+
+static void test_flush_on_time(void)
+{
+    static const uint32_t starts[] = { 0, 5000, 0xFFFFFFFF - MSG_BATCH_WAIT_US / 2 };
+    unsigned s;
+    uint32_t t0;
+
+    for(s = 0; s < sizeof(starts) / sizeof(starts[0]); s++)
+    {
+        // Fewer than N messages: due MSG_BATCH_WAIT_US after the first one,
+        // later messages don't move that.
+        msg_pool_init(&pool);
+        msg_batch_clear(&batch);
+        t0 = starts[s];
+        msg_batch_add(&batch, radio_msg(1, 100), t0);
+        if(MSG_BATCH_MSGS > 1)
+        {
+            CHECK(msg_batch_wait_us(&batch, t0) == MSG_BATCH_WAIT_US);
+            CHECK(msg_batch_wait_us(&batch, t0 + 1) == MSG_BATCH_WAIT_US - 1);
+            CHECK(msg_batch_wait_us(&batch, t0 + MSG_BATCH_WAIT_US - 1) == 1);
+        }
+        if(MSG_BATCH_MSGS > 2)
+        {
+            CHECK(!msg_batch_add(&batch, radio_msg(2, 100), t0 + MSG_BATCH_WAIT_US - 10));
+            CHECK(msg_batch_wait_us(&batch, t0 + MSG_BATCH_WAIT_US - 10) == 10);
+        }
+        CHECK(msg_batch_wait_us(&batch, t0 + MSG_BATCH_WAIT_US) == 0);
+        CHECK(msg_batch_wait_us(&batch, t0 + MSG_BATCH_WAIT_US + 1) == 0);
+        CHECK(msg_batch_wait_us(&batch, t0 + 10 * MSG_BATCH_WAIT_US) == 0);
+        release_all();
+    }
+}
+
+static void test_single(void)
+{
+    uint8_t *frame;
+    uint16_t frame_len;
+    serial_frame_info_t info;
+    uint8_t slot;
+
+    // One message and nothing after it: waits the full time.
+    msg_pool_init(&pool);
+    msg_batch_clear(&batch);
+    slot = radio_msg(0x01020304, 100);
+    CHECK(msg_batch_fits(&pool, slot));
+    CHECK(msg_batch_add(&batch, slot, 7) == (MSG_BATCH_MSGS == 1));
+    if(MSG_BATCH_MSGS > 1)
+    {
+        CHECK(msg_batch_wait_us(&batch, 7) == MSG_BATCH_WAIT_US);
+        CHECK(msg_batch_wait_us(&batch, 7 + MSG_BATCH_WAIT_US - 1) == 1);
+    }
+    CHECK(msg_batch_wait_us(&batch, 7 + MSG_BATCH_WAIT_US) == 0);
+
+    // Sent alone it is a data frame sealed in its slot, no batch header.
+    frame = msg_pool_frame(&pool, slot);
+    frame_len = serial_frame_seal(frame, SERIAL_FRAME_TYPE_DATA, msg_pool_payload_len(&pool, slot));
+    CHECK(frame_len == 100 + SERIAL_FRAME_OVERHEAD);
+    CHECK(serial_frame_check(frame, frame_len, &info) == SERIAL_FRAME_OK);
+    CHECK(info.type == SERIAL_FRAME_TYPE_DATA);
+    CHECK(info.payload_len == 100);
+    CHECK(info.payload[0] == 0x01 && info.payload[3] == 0x04);
+    release_all();
+
+    // Too short for a message number: never batched.
+    CHECK(!msg_batch_fits(&pool, radio_msg(0, 0)));
+    CHECK(!msg_batch_fits(&pool, radio_msg(0, SERIAL_BATCH_MSG_NR_LEN - 1)));
+    CHECK(msg_batch_fits(&pool, radio_msg(0, SERIAL_BATCH_MSG_NR_LEN)));
+}
+
+static void test_seal(void)
+{
+    uint8_t wire[SERIAL_FRAME_MAX_WIRE_LEN];
+    uint16_t lens[MSG_BATCH_MSGS], wire_len, n;
+    serial_batch_msg_t split[SERIAL_BATCH_MAX_MSGS];
+    serial_frame_info_t info;
+    uint32_t round;
+    uint8_t count, i, bodies;
+    const uint8_t *payload;
+
+    for(round = 0; round < 10000; round++)
+    {
+        msg_pool_init(&pool);
+        msg_batch_clear(&batch);
+        count = (uint8_t)(rnd() % MSG_BATCH_MSGS + 1);
+        if(count < 2)continue; // A single message is a data frame.
+        bodies = 0;
+        for(i = 0; i < count; i++)
+        {
+            // Every length, messages of only a number have no body part.
+            lens[i] = (uint16_t)(SERIAL_BATCH_MSG_NR_LEN + rnd() % (SERIAL_FRAME_MAX_PAYLOAD - SERIAL_BATCH_MSG_NR_LEN + 1));
+            if(lens[i] > SERIAL_BATCH_MSG_NR_LEN)bodies++;
+            msg_batch_add(&batch, radio_msg(round * 16 + i, lens[i]), round);
+        }
+
+        // LDMA gathers the parts in order.
+        CHECK(msg_batch_seal(&batch, &pool) == batch.frame_len);
+        CHECK(batch.num_parts == bodies + 2);
+        for(i = 0, wire_len = 0; i < batch.num_parts; i++)
+        {
+            CHECK(batch.part_lens[i] > 0);
+            memcpy(wire + wire_len, batch.parts[i], batch.part_lens[i]);
+            wire_len += batch.part_lens[i];
+        }
+        CHECK(wire_len == batch.frame_len);
+        CHECK(serial_frame_check(wire, wire_len, &info) == SERIAL_FRAME_OK);
+        CHECK(info.type == SERIAL_FRAME_TYPE_BATCH);
+        CHECK(serial_batch_split(&info, split) == count);
+        for(i = 0; i < count; i++)
+        {
+            payload = msg_pool_frame(&pool, batch.slots[i]) + SERIAL_FRAME_HEADER_LEN;
+            n = lens[i] - SERIAL_BATCH_MSG_NR_LEN;
+            CHECK(split[i].msg_nr == round * 16 + i);
+            CHECK(split[i].body_len == n);
+            CHECK(memcmp(split[i].body, payload + SERIAL_BATCH_MSG_NR_LEN, n) == 0);
+        }
+        release_all();
+    }
+}
+
+int main(void)
+{
+    test_empty();
+    test_flush_on_count();
+    test_flush_on_time();
+    test_single();
+    test_seal();
+    return check_done();
+}
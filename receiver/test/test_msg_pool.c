@@ -0,0 +1,219 @@
+/**
+ * @file test_msg_pool.c
+ *
+ * @brief Frame buffer pool: claim, release, unclaim, exhaustion, payload
+ *        fill, counters wrapping around, and a radio callback thread and a
+ *        data loop thread passing slots through a CMSIS message queue.
+ *
+ * @license MIT
+ */
+
+#include <string.h>
+
+#include "check.h"
+#include "cmsis_os2.h"
+#include "msg_pool.h"
+
+static msg_pool_t pool;
+
+// Claims every free slot, each must be new. Returns the number claimed.
+static int claim_all(uint8_t *held)
+{
+    int slot, n = 0;
+
+    while((slot = msg_pool_claim(&pool)) >= 0)
+    {
+        CHECK(slot < MSG_POOL_SLOTS && !held[slot]);
+        held[slot] = 1;
+        n++;
+    }
+    return n;
+}
+
+static void test_claim_release(void)
+{
+    uint8_t held[MSG_POOL_SLOTS] = {0};
+    int slot, i;
+
+    msg_pool_init(&pool);
+    CHECK(claim_all(held) == MSG_POOL_SLOTS);
+    CHECK(msg_pool_claim(&pool) == -1); // Exhausted.
+    CHECK(msg_pool_claim(&pool) == -1);
+
+    msg_pool_release(&pool, 5);
+    held[5] = 0;
+    CHECK(msg_pool_claim(&pool) == 5);
+    CHECK(msg_pool_claim(&pool) == -1);
+
+    // Slots come back in the order they were released.
+    for(i = MSG_POOL_SLOTS - 1; i >= 0; i--)msg_pool_release(&pool, (uint8_t)i);
+    for(i = MSG_POOL_SLOTS - 1; i >= 0; i--)
+    {
+        slot = msg_pool_claim(&pool);
+        CHECK(slot == i);
+    }
+    CHECK(msg_pool_claim(&pool) == -1);
+}
+
+static void test_unclaim(void)
+{
+    uint8_t held[MSG_POOL_SLOTS] = {0};
+    int slot, again;
+
+    msg_pool_init(&pool);
+    slot = msg_pool_claim(&pool);
+    msg_pool_unclaim(&pool);
+    again = msg_pool_claim(&pool);
+    CHECK(again == slot);
+    msg_pool_unclaim(&pool);
+    CHECK(claim_all(held) == MSG_POOL_SLOTS);
+
+    // Last free slot claimed and given back, then released slots behind it.
+    msg_pool_release(&pool, 3);
+    slot = msg_pool_claim(&pool);
+    CHECK(slot == 3);
+    msg_pool_unclaim(&pool);
+    msg_pool_release(&pool, 7);
+    CHECK(msg_pool_claim(&pool) == 3);
+    CHECK(msg_pool_claim(&pool) == 7);
+    CHECK(msg_pool_claim(&pool) == -1);
+}
+
+static void test_fill(void)
+{
+    uint8_t payload[SERIAL_FRAME_MAX_PAYLOAD + 10], *frame;
+    int slot, i;
+
+    for(i = 0; i < (int)sizeof(payload); i++)payload[i] = (uint8_t)(i + 1);
+    msg_pool_init(&pool);
+    slot = msg_pool_claim(&pool);
+    frame = msg_pool_frame(&pool, (uint8_t)slot);
+    CHECK(((uintptr_t)frame & 3) == 0); // LDMA word alignment.
+    memset(frame, 0, SERIAL_FRAME_MAX_LEN);
+    msg_pool_fill(&pool, (uint8_t)slot, payload, 37);
+    CHECK(msg_pool_payload_len(&pool, (uint8_t)slot) == 37);
+    CHECK(memcmp(frame + SERIAL_FRAME_HEADER_LEN, payload, 37) == 0);
+    CHECK(frame[SERIAL_FRAME_HEADER_LEN - 1] == 0 && frame[SERIAL_FRAME_HEADER_LEN + 37] == 0);
+
+    // Longer than a radio payload is cut.
+    msg_pool_fill(&pool, (uint8_t)slot, payload, sizeof(payload));
+    CHECK(msg_pool_payload_len(&pool, (uint8_t)slot) == SERIAL_FRAME_MAX_PAYLOAD);
+    CHECK(memcmp(frame + SERIAL_FRAME_HEADER_LEN, payload, SERIAL_FRAME_MAX_PAYLOAD) == 0);
+    CHECK(serial_frame_seal(frame, SERIAL_FRAME_TYPE_DATA, SERIAL_FRAME_MAX_PAYLOAD) <= sizeof(pool.frames[0]));
+}
+
+static void test_wraparound(void)
+{
+    uint8_t held[MSG_POOL_SLOTS] = {0}, order[MSG_POOL_SLOTS];
+    uint32_t x = 1, round;
+    int n, i, j, slot;
+    uint8_t t;
+
+    // Counters just before they wrap, same ring positions.
+    msg_pool_init(&pool);
+    pool.free_tail += 0xFFFFFF00;
+    pool.free_head += 0xFFFFFF00;
+    for(round = 0; round < 1000; round++)
+    {
+        // Claim some, release them in random order.
+        x = x * 1103515245 + 12345;
+        for(n = 0; n < (int)((x >> 8) % MSG_POOL_SLOTS) + 1; n++)
+        {
+            slot = msg_pool_claim(&pool);
+            CHECK(slot >= 0 && !held[slot]);
+            if(slot < 0)break;
+            held[slot] = 1;
+            order[n] = (uint8_t)slot;
+        }
+        for(i = n - 1; i > 0; i--)
+        {
+            x = x * 1103515245 + 12345;
+            j = (int)((x >> 8) % (uint32_t)(i + 1));
+            t = order[i];
+            order[i] = order[j];
+            order[j] = t;
+        }
+        for(i = 0; i < n; i++)
+        {
+            held[order[i]] = 0;
+            msg_pool_release(&pool, order[i]);
+        }
+    }
+    CHECK(pool.free_tail < 0xFFFFFF00); // Wrapped.
+    CHECK(claim_all(held) == MSG_POOL_SLOTS);
+}
+
+#define STRESS_MSGS                 1000000
+
+static osMessageQueueId_t queue;
+static uint8_t owned[MSG_POOL_SLOTS];
+static uint32_t double_claims, bad_payload;
+
+// Radio callback: claim, fill with the message number, queue the slot.
+static void radio_thread(void *arg)
+{
+    uint8_t payload[SERIAL_FRAME_MAX_PAYLOAD];
+    uint32_t nr;
+    int slot;
+
+    (void)arg;
+    for(nr = 0; nr < STRESS_MSGS; nr++)
+    {
+        while((slot = msg_pool_claim(&pool)) < 0)osThreadYield(); // Data loop is behind.
+        if(__atomic_exchange_n(&owned[slot], 1, __ATOMIC_ACQ_REL))double_claims++; // Slot handed out while held.
+        memset(payload, (int)(nr & 0xFF), sizeof(payload));
+        memcpy(payload, &nr, sizeof(nr));
+        msg_pool_fill(&pool, (uint8_t)slot, payload, (uint16_t)(4 + nr % (SERIAL_FRAME_MAX_PAYLOAD - 3)));
+        osMessageQueuePut(queue, &slot, 0, osWaitForever);
+    }
+}
+
+// Data loop and LDMA IRQ: check the message, release the slot.
+static void data_thread(void *arg)
+{
+    const uint8_t *payload;
+    uint32_t nr, expect;
+    uint16_t len, i;
+    int slot;
+
+    (void)arg;
+    for(expect = 0; expect < STRESS_MSGS; expect++)
+    {
+        osMessageQueueGet(queue, &slot, NULL, osWaitForever);
+        payload = msg_pool_frame(&pool, (uint8_t)slot) + SERIAL_FRAME_HEADER_LEN;
+        len = msg_pool_payload_len(&pool, (uint8_t)slot);
+        memcpy(&nr, payload, sizeof(nr));
+        if(nr != expect || len != 4 + nr % (SERIAL_FRAME_MAX_PAYLOAD - 3))bad_payload++;
+        for(i = 4; i < len; i++)if(payload[i] != (uint8_t)nr)bad_payload++;
+        __atomic_store_n(&owned[slot], 0, __ATOMIC_RELEASE);
+        msg_pool_release(&pool, (uint8_t)slot);
+    }
+}
+
+static void test_threads(void)
+{
+    osThreadId_t radio, data;
+    uint8_t held[MSG_POOL_SLOTS] = {0};
+
+    msg_pool_init(&pool);
+    queue = osMessageQueueNew(MSG_POOL_SLOTS, sizeof(int), NULL);
+    data = osThreadNew(data_thread, NULL, NULL);
+    radio = osThreadNew(radio_thread, NULL, NULL);
+    osThreadJoin(radio);
+    osThreadJoin(data);
+    CHECK(double_claims == 0);
+    CHECK(bad_payload == 0);
+    CHECK(osMessageQueueGetCount(queue) == 0);
+    CHECK(claim_all(held) == MSG_POOL_SLOTS); // No slot lost.
+    osMessageQueueDelete(queue);
+}
+
+int main(void)
+{
+    test_claim_release();
+    test_unclaim();
+    test_fill();
+    test_wraparound();
+    test_threads();
+    return check_done();
+}
@@ -0,0 +1,219 @@
+/**
+ * @file test_serial_framing.c
+ *
+ * @brief Frames of every type built and checked, truncated and corrupted
+ *        frames rejected, batch frames split back into their messages.
+ *
+ * @license MIT
+ */
+
+#include <string.h>
+
+#include "check.h"
+#include "checksum.h"
+#include "serial_framing.h"
+
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd(void)
+{
+    rnd_state = rnd_state * 1103515245 + 12345;
+    return rnd_state >> 8;
+}
+
+static uint16_t data_frame(uint8_t *frame, uint16_t len)
+{
+    uint16_t i;
+
+    for(i = 0; i < len; i++)frame[SERIAL_FRAME_HEADER_LEN + i] = (uint8_t)rnd();
+    return serial_frame_seal(frame, SERIAL_FRAME_TYPE_DATA, len);
+}
+
+static void test_crc(void)
+{
+    // CRC-CCITT (0xFFFF) check value.
+    CHECK(crc_ccitt_ffff((const unsigned char*)"123456789", 9) == 0x29B1);
+}
+
+static void test_data_frames(void)
+{
+    uint8_t frame[SERIAL_FRAME_MAX_LEN + 1];
+    serial_frame_info_t info;
+    uint16_t len, frame_len;
+
+    for(len = 1; len <= SERIAL_FRAME_MAX_PAYLOAD; len++)
+    {
+        frame_len = data_frame(frame, len);
+        CHECK(frame_len == len + SERIAL_FRAME_OVERHEAD);
+        CHECK(frame[0] == 0xDE && frame[1] == 0xAD && frame[2] == 0xBE && frame[3] == 0xEF);
+        CHECK(frame[6] == len >> 8 && frame[7] == (len & 0xFF));
+        CHECK(serial_frame_check(frame, frame_len, &info) == SERIAL_FRAME_OK);
+        CHECK(info.type == SERIAL_FRAME_TYPE_DATA && info.flags == 0);
+        CHECK(info.payload_len == len && info.payload == frame + SERIAL_FRAME_HEADER_LEN);
+        CHECK(info.frame_len == frame_len);
+        // Bytes after the frame are not looked at.
+        CHECK(serial_frame_check(frame, frame_len + 1, &info) == SERIAL_FRAME_OK);
+    }
+}
+
+static void test_truncated(void)
+{
+    uint8_t frame[SERIAL_FRAME_MAX_LEN];
+    serial_frame_info_t info;
+    uint16_t len, frame_len;
+    size_t avail;
+
+    for(len = 1; len <= SERIAL_FRAME_MAX_PAYLOAD; len++)
+    {
+        frame_len = data_frame(frame, len);
+        for(avail = 0; avail < frame_len; avail++)
+        {
+            CHECK(serial_frame_check(frame, avail, &info) == SERIAL_FRAME_INCOMPLETE);
+        }
+    }
+}
+
+static void test_corrupted(void)
+{
+    uint8_t frame[SERIAL_FRAME_MAX_LEN + 256];
+    serial_frame_info_t info;
+    serial_frame_status_t status;
+    uint16_t len, frame_len, bit;
+
+    for(len = 1; len <= SERIAL_FRAME_MAX_PAYLOAD; len += 7)
+    {
+        frame_len = data_frame(frame, len);
+        memset(frame + frame_len, 0, sizeof(frame) - frame_len);
+        for(bit = 0; bit < frame_len * 8; bit++)
+        {
+            frame[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+            status = serial_frame_check(frame, sizeof(frame), &info);
+            if(bit < SERIAL_FRAME_TOKEN_LEN * 8)CHECK(status == SERIAL_FRAME_BAD_TOKEN);
+            else if(bit < SERIAL_FRAME_HEADER_LEN * 8)CHECK(status == SERIAL_FRAME_BAD_HEADER || status == SERIAL_FRAME_BAD_CRC);
+            else CHECK(status == SERIAL_FRAME_BAD_CRC);
+            frame[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+        }
+        CHECK(serial_frame_check(frame, frame_len, &info) == SERIAL_FRAME_OK);
+    }
+}
+
+static void test_bad_header(void)
+{
+    uint8_t frame[SERIAL_FRAME_MAX_WIRE_LEN + 8];
+    serial_frame_info_t info;
+
+    memset(frame, 0, sizeof(frame));
+    serial_frame_seal(frame, 0x09, 10);
+    CHECK(serial_frame_check(frame, sizeof(frame), &info) == SERIAL_FRAME_BAD_HEADER);
+    serial_frame_seal(frame, SERIAL_FRAME_TYPE_DATA, 0);
+    CHECK(serial_frame_check(frame, sizeof(frame), &info) == SERIAL_FRAME_BAD_HEADER);
+    serial_frame_seal(frame, SERIAL_FRAME_TYPE_DATA, SERIAL_FRAME_MAX_PAYLOAD + 1);
+    CHECK(serial_frame_check(frame, sizeof(frame), &info) == SERIAL_FRAME_BAD_HEADER);
+    serial_frame_seal(frame, SERIAL_FRAME_TYPE_STATS, SERIAL_STATS_LEN - 1);
+    CHECK(serial_frame_check(frame, sizeof(frame), &info) == SERIAL_FRAME_BAD_HEADER);
+    serial_frame_seal(frame, SERIAL_FRAME_TYPE_BATCH, SERIAL_BATCH_MAX_PAYLOAD + 1);
+    CHECK(serial_frame_check(frame, sizeof(frame), &info) == SERIAL_FRAME_BAD_HEADER);
+
+    // Reserved flags must be 0.
+    data_frame(frame, 20);
+    frame[5] = 1;
+    CHECK(serial_frame_check(frame, sizeof(frame), &info) == SERIAL_FRAME_BAD_HEADER);
+}
+
+// Batch frame of count messages as it goes out: head, bodies, CRC.
+static uint16_t batch_frame(uint8_t *wire, const uint8_t *const *msgs, const uint16_t *lens, uint8_t count)
+{
+    uint8_t head[SERIAL_FRAME_HEADER_LEN + SERIAL_BATCH_HEAD_LEN(SERIAL_BATCH_MAX_MSGS)], crc[SERIAL_FRAME_CRC_LEN];
+    uint16_t frame_len = serial_batch_seal(head, crc, msgs, lens, count), n, i, body;
+
+    n = SERIAL_FRAME_HEADER_LEN + SERIAL_BATCH_HEAD_LEN(count);
+    memcpy(wire, head, n);
+    for(i = 0; i < count; i++)
+    {
+        body = lens[i] > SERIAL_BATCH_MSG_NR_LEN ? lens[i] - SERIAL_BATCH_MSG_NR_LEN : 0;
+        memcpy(wire + n, msgs[i] + SERIAL_BATCH_MSG_NR_LEN, body);
+        n += body;
+    }
+    memcpy(wire + n, crc, SERIAL_FRAME_CRC_LEN);
+    CHECK(n + SERIAL_FRAME_CRC_LEN == frame_len);
+    return frame_len;
+}
+
+static void test_batch(void)
+{
+    static uint8_t bufs[SERIAL_BATCH_MAX_MSGS][SERIAL_FRAME_MAX_PAYLOAD];
+    const uint8_t *msgs[SERIAL_BATCH_MAX_MSGS];
+    uint16_t lens[SERIAL_BATCH_MAX_MSGS], frame_len, body;
+    uint8_t wire[SERIAL_FRAME_MAX_WIRE_LEN];
+    serial_batch_msg_t split[SERIAL_BATCH_MAX_MSGS];
+    serial_frame_info_t info;
+    uint8_t count, i;
+    uint16_t j;
+    int round;
+
+    for(round = 0; round < 10000; round++)
+    {
+        count = (uint8_t)(1 + rnd() % SERIAL_BATCH_MAX_MSGS);
+        for(i = 0; i < count; i++)
+        {
+            lens[i] = (uint16_t)(SERIAL_BATCH_MSG_NR_LEN + rnd() % (SERIAL_FRAME_MAX_PAYLOAD - SERIAL_BATCH_MSG_NR_LEN + 1));
+            for(j = 0; j < lens[i]; j++)bufs[i][j] = (uint8_t)rnd();
+            msgs[i] = bufs[i];
+        }
+        frame_len = batch_frame(wire, msgs, lens, count);
+        CHECK(serial_frame_check(wire, frame_len, &info) == SERIAL_FRAME_OK);
+        CHECK(info.type == SERIAL_FRAME_TYPE_BATCH && info.frame_len == frame_len);
+        CHECK(serial_batch_split(&info, split) == count);
+        for(i = 0; i < count; i++)
+        {
+            body = lens[i] - SERIAL_BATCH_MSG_NR_LEN;
+            CHECK(split[i].msg_nr == (((uint32_t)bufs[i][0] << 24) | ((uint32_t)bufs[i][1] << 16) | (bufs[i][2] << 8) | bufs[i][3]));
+            CHECK(split[i].body_len == body);
+            CHECK(memcmp(split[i].body, bufs[i] + SERIAL_BATCH_MSG_NR_LEN, body) == 0);
+        }
+        CHECK(serial_frame_check(wire, frame_len - 1, &info) == SERIAL_FRAME_INCOMPLETE);
+        wire[frame_len - 3] ^= 0x10;
+        CHECK(serial_frame_check(wire, frame_len, &info) == SERIAL_FRAME_BAD_CRC);
+    }
+
+    // Entry lengths that don't add up to the payload, with a good CRC.
+    lens[0] = 20;
+    msgs[0] = bufs[0];
+    lens[1] = 30;
+    msgs[1] = bufs[1];
+    frame_len = batch_frame(wire, msgs, lens, 2);
+    wire[SERIAL_FRAME_HEADER_LEN + 2 + 5]++;
+    serial_frame_seal(wire, SERIAL_FRAME_TYPE_BATCH, frame_len - SERIAL_FRAME_OVERHEAD);
+    CHECK(serial_frame_check(wire, frame_len, &info) == SERIAL_FRAME_BAD_HEADER);
+
+    // No messages.
+    wire[SERIAL_FRAME_HEADER_LEN] = 0;
+    wire[SERIAL_FRAME_HEADER_LEN + 1] = 0;
+    serial_frame_seal(wire, SERIAL_FRAME_TYPE_BATCH, 2);
+    CHECK(serial_frame_check(wire, SERIAL_FRAME_OVERHEAD + 2, &info) == SERIAL_FRAME_BAD_HEADER);
+}
+
+static void test_stats(void)
+{
+    serial_stats_t stats = {0xFFFE, 1000, 123456789, 0x80000001, 7, 0xFFFFFFFF, 1, 42}, got;
+    uint8_t frame[SERIAL_FRAME_OVERHEAD + SERIAL_STATS_LEN];
+    serial_frame_info_t info;
+
+    CHECK(serial_stats_seal(frame, &stats) == sizeof(frame));
+    CHECK(serial_frame_check(frame, sizeof(frame), &info) == SERIAL_FRAME_OK);
+    CHECK(info.type == SERIAL_FRAME_TYPE_STATS);
+    serial_stats_get(&info, &got);
+    CHECK(memcmp(&stats, &got, sizeof(stats)) == 0);
+}
+
+int main(void)
+{
+    test_crc();
+    test_data_frames();
+    test_truncated();
+    test_corrupted();
+    test_bad_header();
+    test_batch();
+    test_stats();
+    return check_done();
+}
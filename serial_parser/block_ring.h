@@ -0,0 +1,138 @@
+/**
+ * @file block_ring.h
+ *
+ * @brief Bounded lock-free single-producer/single-consumer ring of data
+ *        blocks, used to pass blocks between the reader, decoder and writer
+ *        threads. Block memory is allocated once, the producer fills a
+ *        block in place and publishes it, the consumer releases it when done.
+ *
+ *        A side that has to wait (ring full or empty) sleeps a little and
+ *        polls again, there are no locks or condition variables.
+ *
+ * @license MIT
+ */
+
+#ifndef BLOCK_RING_H_
+#define BLOCK_RING_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <atomic>
+
+#define BLOCK_RING_POLL_NS          20000 // Sleep between polls of a full or empty ring.
+
+#define BLOCK_FLAG_EOF              0x0001 // No more blocks, block carries no data.
+#define BLOCK_FLAG_DISCONTINUITY    0x0002 // Input was dropped before this block.
+
+typedef struct
+{
+    u_int8_t *data;
+    size_t len;                 // Bytes used.
+    u_int64_t time_ns;          // CLOCK_MONOTONIC when the data was read.
+    u_int32_t flags;            // BLOCK_FLAG_...
+} block_t;
+
+typedef struct
+{
+    alignas(64) std::atomic<size_t> head;   // Blocks published, written by producer only.
+    alignas(64) std::atomic<size_t> tail;   // Blocks released, written by consumer only.
+    alignas(64) size_t depth;
+    size_t block_size;
+    block_t *blocks;
+    u_int8_t *storage;
+    std::atomic<u_int64_t> full_waits;      // Producer found the ring full.
+} block_ring_t;
+
+static inline void block_ring_sleep()
+{
+    struct timespec ts = {0, BLOCK_RING_POLL_NS};
+    nanosleep(&ts, NULL);
+}
+
+/**
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+static inline int block_ring_init(block_ring_t *r, size_t depth, size_t block_size)
+{
+    size_t i;
+
+    r->head = 0;
+    r->tail = 0;
+    r->full_waits = 0;
+    r->depth = depth;
+    r->block_size = block_size;
+    r->blocks = (block_t*)calloc(depth, sizeof(block_t));
+    r->storage = (u_int8_t*)malloc(depth * block_size);
+    if(r->blocks == NULL || r->storage == NULL)return -1;
+    for(i = 0; i < depth; i++)r->blocks[i].data = r->storage + i * block_size;
+    return 0;
+}
+
+static inline void block_ring_free(block_ring_t *r)
+{
+    free(r->blocks);
+    free(r->storage);
+}
+
+/**
+ * @brief Producer: get the next free block without waiting.
+ * @return block to fill or NULL if the ring is full.
+ */
+static inline block_t* block_ring_try_acquire(block_ring_t *r)
+{
+    size_t head = r->head.load(std::memory_order_relaxed);
+    block_t *b;
+
+    if(head - r->tail.load(std::memory_order_acquire) >= r->depth)return NULL;
+    b = &r->blocks[head % r->depth];
+    b->len = 0;
+    b->flags = 0;
+    b->time_ns = 0;
+    return b;
+}
+
+/**
+ * @brief Producer: get the next free block, wait for the consumer if the ring is full.
+ */
+static inline block_t* block_ring_acquire(block_ring_t *r)
+{
+    block_t *b = block_ring_try_acquire(r);
+
+    if(b == NULL)
+    {
+        r->full_waits.fetch_add(1, std::memory_order_relaxed);
+        while((b = block_ring_try_acquire(r)) == NULL)block_ring_sleep();
+    }
+    return b;
+}
+
+/**
+ * @brief Producer: hand the block acquired last over to the consumer.
+ */
+static inline void block_ring_publish(block_ring_t *r)
+{
+    r->head.store(r->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Consumer: get the oldest published block, wait if there is none.
+ */
+static inline block_t* block_ring_peek(block_ring_t *r)
+{
+    size_t tail = r->tail.load(std::memory_order_relaxed);
+
+    while(r->head.load(std::memory_order_acquire) == tail)block_ring_sleep();
+    return &r->blocks[tail % r->depth];
+}
+
+/**
+ * @brief Consumer: done with the block returned by block_ring_peek().
+ */
+static inline void block_ring_release(block_ring_t *r)
+{
+    r->tail.store(r->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+#endif // BLOCK_RING_H_
@@ -0,0 +1,88 @@
+/**
+ * @file capture_split.h
+ *
+ * @brief Splits a recorded capture into chunks that can be decoded
+ *        independently and still give the same frames as one sequential run.
+ *
+ *        A chunk boundary is a frame boundary the decoder can't get wrong:
+ *        in framed mode a data or batch frame, of any length, that is
+ *        followed by another valid frame, in legacy mode a token 96 bytes
+ *        after the previous token. The decoder of the next chunk is primed
+ *        with that last frame, see frame_decoder_prime().
+ *
+ * @license MIT
+ */
+
+#ifndef CAPTURE_SPLIT_H_
+#define CAPTURE_SPLIT_H_
+
+#include <sys/types.h>
+
+#include "token_scanner.h"
+#include "frame_decoder.h"
+#include "../receiver/serial_framing.h"
+
+#define CAPTURE_SPLIT_SCAN_BYTES    65536 // Token positions are collected this many bytes at a time.
+
+/**
+ * @brief Frame ends with a radio message, the next frame continues from it.
+ *        A frame that passed its CRC is whole, whatever its length.
+ */
+static inline bool capture_frame_full(const serial_frame_info_t *info)
+{
+    return info->type == SERIAL_FRAME_TYPE_DATA || info->type == SERIAL_FRAME_TYPE_BATCH;
+}
+
+/**
+ * @brief Find the first boundary at or after from and before limit in the
+ *        capture buf of len bytes.
+ * @param boundary  first byte of the next chunk.
+ * @param prime     first byte of the frame before boundary, the next chunk's
+ *                  decoder is primed with [prime, boundary).
+ * @return true if a boundary was found.
+ */
+static inline bool capture_find_boundary(const u_int8_t *buf, size_t len, size_t from, size_t limit, bool framed,
+                                         size_t *boundary, size_t *prime)
+{
+    static size_t ends[TOKEN_SCAN_MAX_ENDS(CAPTURE_SPLIT_SCAN_BYTES)];
+    const size_t legacy_frame = TOKEN_LEN + FRAME_PAYLOAD_BYTES;
+    serial_frame_info_t info, next;
+    size_t pos, to, n, t, start, last = ~(size_t)0;
+
+    // Legacy mode needs the token before the first one in range.
+    pos = (!framed && from >= legacy_frame) ? from - legacy_frame : from;
+    for(; pos < limit; pos = to)
+    {
+        to = limit - pos < CAPTURE_SPLIT_SCAN_BYTES ? limit : pos + CAPTURE_SPLIT_SCAN_BYTES;
+        n = token_scan_range(buf, pos, to, len, ends);
+        for(t = 0; t < n; t++)
+        {
+            start = ends[t] - TOKEN_LEN;
+            if(framed)
+            {
+                if(serial_frame_check(buf + start, len - start, &info) == SERIAL_FRAME_OK
+                    && capture_frame_full(&info)
+                    && start + info.frame_len < limit
+                    && serial_frame_check(buf + start + info.frame_len, len - start - info.frame_len, &next) == SERIAL_FRAME_OK)
+                {
+                    *prime = start;
+                    *boundary = start + info.frame_len;
+                    return true;
+                }
+            }
+            else
+            {
+                if(last != ~(size_t)0 && start - last == legacy_frame && ends[t] >= from && ends[t] < limit)
+                {
+                    *prime = last;
+                    *boundary = ends[t]; // Token stays with the chunk before, it ends the frame.
+                    return true;
+                }
+                last = start;
+            }
+        }
+    }
+    return false;
+}
+
+#endif // CAPTURE_SPLIT_H_
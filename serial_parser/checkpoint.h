@@ -0,0 +1,243 @@
+/**
+ * @file checkpoint.h
+ *
+ * @brief Decoder state saved now and then, so a parser that is restarted
+ *        (crash, operator, log rotation) continues where the last one
+ *        stopped: frame numbers go on, the first frame is checked against
+ *        the message number and sample sequence the last one expected (so
+ *        what was lost while no parser ran is counted), and the counters add
+ *        up over all runs.
+ *
+ *        The decoder thread takes a snapshot at the end of an input block and
+ *        notes how far the output stream is. The writer thread saves it once
+ *        the output up to there is in the file, so a checkpoint never covers
+ *        frames the results file doesn't have, and notes the file and its
+ *        length there. On resume the file is cut back to that length
+ *        (checkpoint_trim()): frames a crashed parser wrote after the
+ *        checkpoint would repeat frame numbers, they are counted as lost
+ *        instead. Files rotated to after the checkpoint are left alone.
+ *        The checkpoint file is replaced with a rename, a crash leaves the
+ *        old or the new one.
+ *
+ * @license MIT
+ */
+
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <atomic>
+
+#include "frame_decoder.h"
+#include "output_buffer.h"
+#include "result_index.h"
+
+#define CHECKPOINT_MAGIC            "RSCHECKP"
+#define CHECKPOINT_VERSION          2
+#define CHECKPOINT_SUFFIX           ".ckpt"
+#define CHECKPOINT_NAME_CHARS       272
+
+typedef struct
+{
+    char magic[8];              // CHECKPOINT_MAGIC, not 0 terminated.
+    u_int16_t version;
+    u_int16_t framed;           // Decoder was in framed mode.
+    u_int32_t bytes;            // sizeof(checkpoint_t)
+    u_int32_t restarts;         // Runs that resumed from a checkpoint.
+    u_int64_t saved_ns;         // CLOCK_REALTIME when the snapshot was taken.
+    u_int64_t next_index;       // Frame number of the next frame.
+    u_int64_t last_arrival_ns;  // CLOCK_REALTIME of the last frame, 0 if unknown.
+    continuity_t cont;          // What the next frame should continue.
+    stats_t stats;              // Counters of all runs.
+    u_int64_t results_bytes;    // Length of results_name at the snapshot.
+    char results_name[CHECKPOINT_NAME_CHARS]; // Results file being written, "" if unknown.
+} checkpoint_t;
+
+// Snapshot on its way from the decoder to the writer thread.
+typedef struct
+{
+    char name[CHECKPOINT_NAME_CHARS];
+    std::atomic<bool> ready;    // Set by the decoder, cleared by the writer when saved.
+    u_int64_t stream_offset;    // Output stream holds every frame of the snapshot up to here.
+    checkpoint_t snapshot;
+    u_int64_t saved;            // Checkpoints written, writer thread only.
+    u_int64_t errors;
+} checkpoint_slot_t;
+
+static inline void checkpoint_slot_init(checkpoint_slot_t *s, const char *results_name)
+{
+    snprintf(s->name, sizeof(s->name), "%s%s", results_name, CHECKPOINT_SUFFIX);
+    s->ready.store(false);
+    s->saved = 0;
+    s->errors = 0;
+}
+
+/**
+ * @brief Snapshot of decoder d, stats are the counters of all runs.
+ *        realtime_offset_ns converts arrival times to CLOCK_REALTIME.
+ */
+static inline void checkpoint_take(checkpoint_t *c, const frame_decoder_t *d, const stats_t *stats, u_int32_t restarts,
+                                   u_int64_t now_ns, u_int64_t realtime_offset_ns)
+{
+    memset(c, 0, sizeof(*c));
+    memcpy(c->magic, CHECKPOINT_MAGIC, sizeof(c->magic));
+    c->version = CHECKPOINT_VERSION;
+    c->framed = d->framed;
+    c->bytes = sizeof(*c);
+    c->restarts = restarts;
+    c->saved_ns = now_ns + realtime_offset_ns;
+    c->next_index = d->frame.index;
+    c->last_arrival_ns = d->last_arrival_ns != 0 ? d->last_arrival_ns + realtime_offset_ns : 0;
+    c->cont = d->cont;
+    c->stats = *stats;
+}
+
+/**
+ * @brief Write c to name.tmp and rename it to name.
+ * @return 0 on success, -1 on error.
+ */
+static inline int checkpoint_save(const char *name, const checkpoint_t *c)
+{
+    char tmp[CHECKPOINT_NAME_CHARS + 8];
+    int fd, res;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", name);
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)return -1;
+    res = write_all(fd, c, sizeof(*c));
+    if(res == 0)res = fdatasync(fd);
+    close(fd);
+    if(res == 0)res = rename(tmp, name);
+    return res == 0 ? 0 : -1;
+}
+
+/**
+ * @return 0 if name holds a checkpoint of a decoder in the same mode, else -1.
+ */
+static inline int checkpoint_load(const char *name, checkpoint_t *c, bool framed)
+{
+    int fd = open(name, O_RDONLY);
+    ssize_t n;
+
+    if(fd < 0)return -1;
+    n = read(fd, c, sizeof(*c));
+    close(fd);
+    if(n != sizeof(*c) || memcmp(c->magic, CHECKPOINT_MAGIC, sizeof(c->magic)) != 0 || c->version != CHECKPOINT_VERSION
+        || c->bytes != sizeof(*c) || c->framed != framed)return -1;
+    return 0;
+}
+
+/**
+ * @brief Cut the results file of c and its sidecar index back to where c
+ *        was taken.
+ * @return bytes cut off the results file, -1 on error.
+ */
+static inline long long checkpoint_trim(const checkpoint_t *c)
+{
+    char name[CHECKPOINT_NAME_CHARS + 8];
+    result_index_header_t h;
+    result_index_entry_t e;
+    struct stat st;
+    u_int64_t size;
+    off_t end;
+    int fd;
+
+    if(c->results_name[0] == '\0' || stat(c->results_name, &st) != 0)return 0;
+    size = st.st_size;
+    if(size <= c->results_bytes)return 0;
+    if(truncate(c->results_name, c->results_bytes) != 0)return -1;
+
+    // Entries are in file order, drop those past the new end.
+    snprintf(name, sizeof(name), "%s%s", c->results_name, RESULT_INDEX_SUFFIX);
+    fd = open(name, O_RDWR);
+    if(fd >= 0)
+    {
+        if(pread(fd, &h, sizeof(h), 0) == sizeof(h) && memcmp(h.magic, RESULT_INDEX_MAGIC, sizeof(h.magic)) == 0
+            && h.entry_bytes == sizeof(e) && fstat(fd, &st) == 0)
+        {
+            for(end = st.st_size; end >= (off_t)(h.header_bytes + sizeof(e)); end -= sizeof(e))
+            {
+                if(pread(fd, &e, sizeof(e), end - sizeof(e)) != sizeof(e) || e.offset < c->results_bytes)break;
+            }
+            if(end < st.st_size)ftruncate(fd, end);
+        }
+        close(fd);
+    }
+    return (long long)(size - c->results_bytes);
+}
+
+/**
+ * @brief Continue decoder d from checkpoint c. Frame numbers go on, the
+ *        first frame is checked against what c expected and its timing goes
+ *        to the gap histogram.
+ */
+static inline void checkpoint_resume(frame_decoder_t *d, const checkpoint_t *c, u_int64_t realtime_offset_ns)
+{
+    d->frame.index = c->next_index;
+    d->cont = c->cont;
+    d->last_arrival_ns = c->last_arrival_ns > realtime_offset_ns ? c->last_arrival_ns - realtime_offset_ns : 0;
+    d->gap = true;
+}
+
+/**
+ * @brief Pass on a frame without samples flagged FRAME_FLAG_RESTART, so the
+ *        results show where the parser was restarted. It has the number of
+ *        the next frame, which is not counted.
+ */
+static inline void checkpoint_mark_restart(frame_decoder_t *d, u_int64_t now_ns)
+{
+    frame_t *f = &d->frame;
+
+    f->offset = d->offset;
+    f->arrival_ns = now_ns;
+    f->msg_nr = 0;
+    f->payload_bytes = 0;
+    f->flags = FRAME_FLAG_RESTART;
+    f->num_samples = 0;
+    f->corrupt = 0;
+    if(d->handler != NULL)d->handler(d, f);
+}
+
+/**
+ * @brief Decoder: hand a snapshot to the writer thread, unless the last one
+ *        is still waiting for its output to be written.
+ */
+static inline void checkpoint_offer(checkpoint_slot_t *s, const checkpoint_t *c, u_int64_t stream_offset)
+{
+    if(s->ready.load(std::memory_order_acquire))return;
+    s->snapshot = *c;
+    s->stream_offset = stream_offset;
+    s->ready.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Results file name is file_bytes long at the checkpoint.
+ */
+static inline void checkpoint_locate(checkpoint_t *c, const char *name, u_int64_t file_bytes)
+{
+    snprintf(c->results_name, sizeof(c->results_name), "%s", name);
+    c->results_bytes = file_bytes;
+}
+
+/**
+ * @brief Writer: save the snapshot if the output stream is written up to
+ *        it. file_name is file_bytes long and holds the end of the stream.
+ */
+static inline void checkpoint_poll(checkpoint_slot_t *s, u_int64_t stream_written, const char *file_name, u_int64_t file_bytes)
+{
+    u_int64_t behind;
+
+    if(!s->ready.load(std::memory_order_acquire) || s->stream_offset > stream_written)return;
+    behind = stream_written - s->stream_offset;
+    checkpoint_locate(&s->snapshot, file_name, behind <= file_bytes ? file_bytes - behind : 0);
+    if(checkpoint_save(s->name, &s->snapshot) == 0)s->saved++;
+    else s->errors++;
+    s->ready.store(false, std::memory_order_release);
+}
+
+#endif // CHECKPOINT_H_
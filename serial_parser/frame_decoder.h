@@ -0,0 +1,504 @@
+/**
+ * @file frame_decoder.h
+ *
+ * @brief Cuts the receiver byte stream into frames and decodes each frame
+ *        payload into x/y/z samples.
+ *
+ *        Receiver output for every radio message is a frame as described in
+ *        serial_framing.h: token, header with the payload length, the radio
+ *        message (4 byte message number and big-endian 16-bit samples,
+ *        x y z x y z ..., 48 by default, as many as the sender puts in) and
+ *        a CRC. With little_endian set the samples are
+ *        taken as little-endian (sample_order.h). A token only starts a frame if length and
+ *        CRC check out, token bytes inside sample data don't split frames.
+ *        A batch frame carries several radio messages, each is passed on as
+ *        a frame of its own, with the message number from the batch header.
+ *        Stats frames of the receiver are added to the statistics only.
+ *
+ *        Older receiver firmware wrote the token over the message number and
+ *        sent nothing else, frames are then the bytes between two tokens
+ *        (legacy mode).
+ *
+ *        The sender (write_new_data() in sender_main.c) increments x,
+ *        decrements y and keeps z at 127, so the first triple of a frame must
+ *        continue where the previous frame stopped. Breaks in that sequence
+ *        or in the message numbers are lost messages, message numbers that
+ *        go back (a restart) are a resync. A frame that passed its CRC is
+ *        whole whatever its length, in legacy mode frames shorter than 96
+ *        sample bytes lost bytes. Inside a whole frame every sample
+ *        is checked against the pattern (pattern_check.h), samples that are
+ *        off were corrupted on the way.
+ *
+ * @license MIT
+ */
+
+#ifndef FRAME_DECODER_H_
+#define FRAME_DECODER_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "token_scanner.h"
+#include "stats.h"
+#include "pattern_check.h"
+#include "sample_order.h"
+#include "../receiver/serial_framing.h"
+
+#define FRAME_SAMPLES               48 // DATA_PATCH_LEN in sender
+#define FRAME_TRIPLES               (FRAME_SAMPLES / 3)
+#define FRAME_PAYLOAD_BYTES         (FRAME_SAMPLES * 2)
+#define FRAME_MSG_NR_BYTES          4 // Message number in front of the samples, framed mode.
+#define FRAME_MAX_PAYLOAD_BYTES     1024 // Legacy mode, longer runs without a token are cut into frames of this size.
+#define FRAME_MAX_SAMPLES           (FRAME_MAX_PAYLOAD_BYTES / 2)
+#define FRAME_SCAN_CHUNK_BYTES      65536 // Input is added to the window this many bytes at a time.
+#define FRAME_WINDOW_BYTES          (FRAME_SCAN_CHUNK_BYTES + FRAME_MAX_PAYLOAD_BYTES + TOKEN_LEN)
+
+static_assert(SERIAL_FRAME_MAX_WIRE_LEN <= FRAME_MAX_PAYLOAD_BYTES + TOKEN_LEN, "Unfinished frame must fit in the window");
+
+#define FRAME_FLAG_PARTIAL          0x0001 // Legacy mode, payload is not FRAME_PAYLOAD_BYTES long.
+#define FRAME_FLAG_SEQUENCE_BREAK   0x0002 // First triple does not continue the previous frame.
+#define FRAME_FLAG_MSG_NR           0x0004 // msg_nr is valid.
+#define FRAME_FLAG_MSG_GAP          0x0008 // Message numbers are missing before this frame.
+#define FRAME_FLAG_CORRUPT          0x0010 // Samples don't follow the test pattern, see corrupt.
+#define FRAME_FLAG_RESTART          0x0020 // No samples, parser resumed from a checkpoint here (checkpoint.h).
+
+typedef struct
+{
+    u_int64_t index;            // Frame number since first token.
+    u_int64_t offset;           // Input byte offset of the first sample byte.
+    u_int64_t arrival_ns;       // CLOCK_MONOTONIC time the block with the frame end was read, 0 if unknown.
+    u_int32_t msg_nr;           // Radio message number, if FRAME_FLAG_MSG_NR.
+    u_int16_t payload_bytes;    // Sample bytes in the frame.
+    u_int16_t flags;            // FRAME_FLAG_...
+    u_int16_t num_samples;
+    u_int64_t corrupt;          // Bit i set if samples[i] is off the test pattern, full frames only.
+    alignas(32) u_int16_t samples[FRAME_MAX_SAMPLES]; // x, y, z, x, y, z ... in host byte order.
+} frame_t;
+
+// Expected first triple and message number of the next frame.
+typedef struct
+{
+    bool valid;
+    u_int16_t next_x;
+    u_int16_t next_y;
+    bool msg_valid;
+    u_int32_t next_msg_nr;
+    bool report_valid;
+    u_int16_t next_report;      // Receiver stats frame number.
+} continuity_t;
+
+typedef struct frame_decoder frame_decoder_t;
+typedef void (*frame_handler_t)(frame_decoder_t *d, const frame_t *f);
+
+struct frame_decoder
+{
+    bool framed;                // Length and CRC framing, else legacy token only stream.
+    bool little_endian;         // Samples are little-endian on the wire, set by caller.
+    bool synced;                // Set after the first token (legacy) or valid frame.
+    u_int64_t offset;           // Input bytes consumed so far, also stats.bytes.
+    u_int64_t block_ns;         // Arrival time of the current block, set by caller.
+    u_int64_t stop_offset;      // Framed mode, frames starting here or later are left alone.
+    FILE *log;                  // Lost and partial frames are reported here, NULL for quiet.
+    u_int8_t window[FRAME_WINDOW_BYTES]; // Input not turned into frames yet.
+    size_t window_len;
+    u_int64_t window_offset;    // Input offset of window[0].
+    size_t scan_pos;            // Tokens before this window position are handled.
+    size_t frame_start;         // Legacy mode, first payload byte of the current frame.
+    u_int64_t frame_end;        // Framed mode, input offset just past the last valid frame.
+    frame_t frame;              // Frame being passed on.
+    continuity_t cont;
+    frame_handler_t handler;
+    void *user;
+
+    u_int64_t last_arrival_ns;  // Arrival time of the previous frame, 0 before the first.
+    bool gap;                   // Data was lost since the previous frame.
+    stats_t stats;              // Counters since start, read by the statistics thread.
+    timing_t timing;            // Ditto.
+};
+
+static inline void frame_decoder_init(frame_decoder_t *d, bool framed, frame_handler_t handler, void *user)
+{
+    memset(d, 0, sizeof(*d));
+    d->framed = framed;
+    d->stop_offset = ~0ULL;
+    d->log = stdout;
+    d->handler = handler;
+    d->user = user;
+}
+
+/**
+ * @brief Check the frame against the message number and sample sequence of
+ *        the previous frame and report partial frames and lost samples.
+ */
+static inline void frame_check_continuity(frame_decoder_t *d, frame_t *f)
+{
+    u_int32_t lost_msgs;
+    u_int16_t lost, x0, y0, triples;
+
+    if(!d->framed && f->payload_bytes != FRAME_PAYLOAD_BYTES)
+    {
+        f->flags |= FRAME_FLAG_PARTIAL;
+        counter_add(&d->stats.partial_frames, 1);
+        if(d->log != NULL)fprintf(d->log, "Frame %llu: partial, %u of %u bytes\n", (unsigned long long)f->index,
+                                  f->payload_bytes, FRAME_PAYLOAD_BYTES);
+    }
+
+    if(f->flags & FRAME_FLAG_MSG_NR)
+    {
+        lost_msgs = f->msg_nr - d->cont.next_msg_nr; // Wraps around like the receiver counter.
+        if(d->cont.msg_valid && (int32_t)lost_msgs < 0)
+        {
+            // Numbers went back: sender or receiver restarted, or a repeat.
+            // Nothing is known about what is lost, start over from here.
+            counter_add(&d->stats.resyncs, 1);
+            if(d->log != NULL)fprintf(d->log, "Frame %llu: message %lu, numbers went back from %lu\n", (unsigned long long)f->index,
+                                      (unsigned long)f->msg_nr, (unsigned long)d->cont.next_msg_nr);
+        }
+        else if(d->cont.msg_valid && lost_msgs != 0)
+        {
+            f->flags |= FRAME_FLAG_MSG_GAP;
+            counter_add(&d->stats.lost_messages, lost_msgs);
+            if(d->log != NULL)fprintf(d->log, "Frame %llu: message %lu, %lu messages lost\n", (unsigned long long)f->index,
+                                      (unsigned long)f->msg_nr, (unsigned long)lost_msgs);
+        }
+        d->cont.msg_valid = true;
+        d->cont.next_msg_nr = f->msg_nr + 1;
+    }
+
+    if(f->num_samples < 3)return; // Nothing to compare.
+
+    x0 = f->samples[0];
+    y0 = f->samples[1];
+    if(!(f->flags & FRAME_FLAG_PARTIAL))f->corrupt = pattern_check_frame(f->samples, f->num_samples, &x0, &y0);
+    if(f->corrupt != 0)
+    {
+        f->flags |= FRAME_FLAG_CORRUPT;
+        counter_add(&d->stats.corrupt_frames, 1);
+        counter_add(&d->stats.corrupt_samples, __builtin_popcountll(f->corrupt));
+        if(d->log != NULL)
+        {
+            fprintf(d->log, "Frame %llu: %d samples corrupted at", (unsigned long long)f->index, __builtin_popcountll(f->corrupt));
+            for(u_int64_t m = f->corrupt; m != 0; m &= m - 1)fprintf(d->log, " %d", __builtin_ctzll(m));
+            fprintf(d->log, "\n");
+        }
+    }
+
+    // x0 and y0 are where the pattern of a full frame starts, even if the
+    // first triple is corrupted.
+    if(d->cont.valid && (x0 != d->cont.next_x || y0 != d->cont.next_y))
+    {
+        lost = (u_int16_t)(x0 - d->cont.next_x); // Wraps around at 0xFFFF like the sender counters.
+        f->flags |= FRAME_FLAG_SEQUENCE_BREAK;
+        counter_add(&d->stats.sequence_breaks, 1);
+        counter_add(&d->stats.lost_triples, lost);
+        if(d->log != NULL)fprintf(d->log, "Frame %llu: sequence break, %u x/y/z triples lost (~%u frames)\n", (unsigned long long)f->index,
+                                  lost, (lost + FRAME_TRIPLES - 1) / FRAME_TRIPLES);
+    }
+
+    // Continue after the last triple, a cut one counts as well. Bytes are
+    // missing from a partial frame, so its end can't be trusted, but the
+    // radio message had FRAME_TRIPLES triples.
+    triples = d->framed ? (u_int16_t)((f->num_samples + 2) / 3) : FRAME_TRIPLES;
+    d->cont.valid = true;
+    d->cont.next_x = (u_int16_t)(x0 + triples);
+    d->cont.next_y = (u_int16_t)(y0 - triples);
+}
+
+/**
+ * @brief Record the time since the previous frame. Frames read in the same
+ *        block have the same arrival time.
+ */
+static inline void frame_record_timing(frame_decoder_t *d, const frame_t *f)
+{
+    u_int64_t dt;
+
+    if(f->arrival_ns == 0)return; // Offline, no times.
+    if(d->last_arrival_ns != 0 && f->arrival_ns >= d->last_arrival_ns)
+    {
+        dt = f->arrival_ns - d->last_arrival_ns;
+        histogram_record(&d->timing.interarrival, dt);
+        if(d->gap || (f->flags & (FRAME_FLAG_PARTIAL | FRAME_FLAG_SEQUENCE_BREAK | FRAME_FLAG_MSG_GAP)))
+        {
+            histogram_record(&d->timing.gaps, dt);
+        }
+    }
+    d->last_arrival_ns = f->arrival_ns;
+    d->gap = false;
+}
+
+/**
+ * @brief Decode payload bytes into samples and pass the frame on.
+ * @param offset  input offset of payload.
+ * @param msg_nr  payload starts with the radio message number.
+ */
+static inline void frame_complete(frame_decoder_t *d, const u_int8_t *payload, size_t len, u_int64_t offset, bool msg_nr)
+{
+    frame_t *f = &d->frame;
+    size_t i;
+
+    f->flags = 0;
+    f->corrupt = 0;
+    if(msg_nr)
+    {
+        if(len >= FRAME_MSG_NR_BYTES)
+        {
+            f->msg_nr = ((u_int32_t)payload[0] << 24) | ((u_int32_t)payload[1] << 16) | ((u_int32_t)payload[2] << 8) | payload[3];
+            f->flags |= FRAME_FLAG_MSG_NR;
+        }
+        else f->msg_nr = 0;
+        i = len < FRAME_MSG_NR_BYTES ? len : FRAME_MSG_NR_BYTES;
+        payload += i;
+        offset += i;
+        len -= i;
+    }
+
+    f->offset = offset;
+    f->payload_bytes = (u_int16_t)len;
+    f->arrival_ns = d->block_ns;
+    f->num_samples = (u_int16_t)(len / 2); // A trailing odd byte is dropped.
+    samples_from_wire(f->samples, payload, f->num_samples, d->little_endian);
+    frame_check_continuity(d, f);
+    frame_record_timing(d, f);
+    counter_add(&d->stats.frames, 1);
+    if(d->handler != NULL)d->handler(d, f);
+    f->index++;
+}
+
+/**
+ * @brief Pass on every message of a batch frame like frame_complete(),
+ *        message number from the batch header.
+ * @param offset  input offset of payload.
+ */
+static inline void frame_complete_batch(frame_decoder_t *d, const serial_frame_info_t *info, u_int64_t offset)
+{
+    frame_t *f = &d->frame;
+    serial_batch_msg_t msgs[SERIAL_BATCH_MAX_MSGS];
+    u_int8_t i, n = serial_batch_split(info, msgs);
+
+    for(i = 0; i < n; i++)
+    {
+        f->flags = FRAME_FLAG_MSG_NR;
+        f->corrupt = 0;
+        f->msg_nr = msgs[i].msg_nr;
+        f->offset = offset + (msgs[i].body - info->payload);
+        f->payload_bytes = msgs[i].body_len;
+        f->arrival_ns = d->block_ns;
+        f->num_samples = (u_int16_t)(msgs[i].body_len / 2);
+        samples_from_wire(f->samples, msgs[i].body, f->num_samples, d->little_endian);
+        frame_check_continuity(d, f);
+        frame_record_timing(d, f);
+        counter_add(&d->stats.frames, 1);
+        if(d->handler != NULL)d->handler(d, f);
+        f->index++;
+    }
+}
+
+/**
+ * @brief Add the counters of a receiver stats frame. They count from the
+ *        previous stats frame, the first one from the receiver's start.
+ */
+static inline void frame_receiver_stats(frame_decoder_t *d, const serial_frame_info_t *info)
+{
+    serial_stats_t rs;
+    u_int16_t lost;
+
+    serial_stats_get(info, &rs);
+    if(d->cont.report_valid && rs.report != d->cont.next_report)
+    {
+        lost = (u_int16_t)(rs.report - d->cont.next_report);
+        counter_add(&d->stats.receiver_reports_lost, lost);
+        if(d->log != NULL)fprintf(d->log, "Receiver report %u: %u reports lost\n", rs.report, lost);
+    }
+    d->cont.report_valid = true;
+    d->cont.next_report = (u_int16_t)(rs.report + 1);
+
+    counter_add(&d->stats.receiver_reports, 1);
+    counter_add(&d->stats.receiver_received, rs.received);
+    counter_add(&d->stats.radio_lost, rs.radio_lost);
+    counter_add(&d->stats.receiver_dropped, (u_int64_t)rs.no_buffer + rs.queue_full);
+    counter_add(&d->stats.uart_stalls, rs.uart_stalls);
+}
+
+/**
+ * @brief Legacy mode, token missing for too long. Pass on frames of
+ *        FRAME_MAX_PAYLOAD_BYTES as long as they end before window position end.
+ */
+static inline void frame_cut_legacy(frame_decoder_t *d, size_t end)
+{
+    while(end >= d->frame_start + FRAME_MAX_PAYLOAD_BYTES)
+    {
+        frame_complete(d, d->window + d->frame_start, FRAME_MAX_PAYLOAD_BYTES, d->window_offset + d->frame_start, false);
+        counter_add(&d->stats.resyncs, 1);
+        d->frame_start += FRAME_MAX_PAYLOAD_BYTES;
+    }
+}
+
+/**
+ * @brief Legacy mode, frames are the bytes between tokens.
+ * @return window position from which bytes are still needed.
+ */
+static inline size_t frame_scan_legacy(frame_decoder_t *d, const size_t *ends, size_t num_tokens)
+{
+    size_t t, start, next = d->scan_pos;
+
+    for(t = 0; t < num_tokens; t++)
+    {
+        start = ends[t] - TOKEN_LEN;
+        if(d->synced)
+        {
+            frame_cut_legacy(d, start);
+            if(start > d->frame_start) // Back to back tokens carry no frame.
+            {
+                frame_complete(d, d->window + d->frame_start, start - d->frame_start, d->window_offset + d->frame_start, false);
+            }
+        }
+        d->synced = true;
+        d->frame_start = ends[t];
+        next = ends[t];
+    }
+
+    // A token can still start in the last bytes of the window.
+    if(d->window_len >= TOKEN_LEN && next < d->window_len - (TOKEN_LEN - 1))next = d->window_len - (TOKEN_LEN - 1);
+    d->scan_pos = next;
+    if(!d->synced)return next;
+
+    if(d->window_len >= TOKEN_LEN)frame_cut_legacy(d, d->window_len - (TOKEN_LEN - 1)); // The rest may be the start of a token.
+    return d->frame_start < next ? d->frame_start : next;
+}
+
+/**
+ * @brief Framed mode, a token starts a frame if the frame behind it checks out.
+ * @return window position from which bytes are still needed.
+ */
+static inline size_t frame_scan_framed(frame_decoder_t *d, const size_t *ends, size_t num_tokens)
+{
+    serial_frame_info_t info;
+    serial_frame_status_t status;
+    size_t t, start, next = d->scan_pos;
+
+    for(t = 0; t < num_tokens; t++)
+    {
+        start = ends[t] - TOKEN_LEN;
+        if(start < next)continue; // Inside a frame already taken.
+        if(d->window_offset + start >= d->stop_offset)
+        {
+            d->scan_pos = start;
+            return start;
+        }
+
+        status = serial_frame_check(d->window + start, d->window_len - start, &info);
+        if(status == SERIAL_FRAME_INCOMPLETE)
+        {
+            d->scan_pos = start; // Decide when more bytes are in.
+            return start;
+        }
+        else if(status == SERIAL_FRAME_OK)
+        {
+            if(d->synced && d->window_offset + start != d->frame_end)counter_add(&d->stats.resyncs, 1); // Bytes between frames.
+            d->synced = true;
+            if(info.type == SERIAL_FRAME_TYPE_BATCH)frame_complete_batch(d, &info, d->window_offset + start + SERIAL_FRAME_HEADER_LEN);
+            else if(info.type == SERIAL_FRAME_TYPE_STATS)frame_receiver_stats(d, &info);
+            else frame_complete(d, info.payload, info.payload_len, d->window_offset + start + SERIAL_FRAME_HEADER_LEN, true);
+            next = start + info.frame_len;
+            d->frame_end = d->window_offset + next;
+        }
+        else
+        {
+            if(d->synced)counter_add(&d->stats.crc_errors, 1); // Corrupted frame or token bytes in data.
+            next = start + 1;
+        }
+    }
+
+    // A token can still start in the last bytes of the window.
+    if(d->window_len >= TOKEN_LEN && next < d->window_len - (TOKEN_LEN - 1))next = d->window_len - (TOKEN_LEN - 1);
+    d->scan_pos = next;
+    return next;
+}
+
+/**
+ * @brief Feed a block of input bytes. The handler is called for every
+ *        frame that is complete.
+ */
+static inline void frame_decode_block(frame_decoder_t *d, const u_int8_t *buf, size_t len)
+{
+    static thread_local size_t ends[TOKEN_SCAN_MAX_ENDS(FRAME_WINDOW_BYTES)];
+    size_t num_tokens, chunk, keep;
+
+    while(len > 0)
+    {
+        chunk = len < FRAME_SCAN_CHUNK_BYTES ? len : FRAME_SCAN_CHUNK_BYTES;
+        memcpy(d->window + d->window_len, buf, chunk);
+        d->window_len += chunk;
+        buf += chunk;
+        len -= chunk;
+
+        num_tokens = token_scan_range(d->window, d->scan_pos, d->window_len, d->window_len, ends);
+        if(d->framed)keep = frame_scan_framed(d, ends, num_tokens);
+        else keep = frame_scan_legacy(d, ends, num_tokens);
+
+        // Drop what is done with, an unfinished frame stays in the window.
+        memmove(d->window, d->window + keep, d->window_len - keep);
+        d->window_len -= keep;
+        d->window_offset += keep;
+        d->scan_pos -= keep;
+        d->frame_start -= d->frame_start < keep ? d->frame_start : keep;
+
+        d->offset += chunk;
+        counter_add(&d->stats.bytes, chunk);
+    }
+}
+
+/**
+ * @brief Input was lost, drop the frame being collected and wait for the
+ *        next token. The sequence check reports the gap on the next frame.
+ */
+static inline void frame_decoder_resync(frame_decoder_t *d)
+{
+    if(d->synced)counter_add(&d->stats.resyncs, 1);
+    d->synced = false;
+    d->gap = true;
+    d->window_offset = d->offset;
+    d->window_len = 0;
+    d->scan_pos = 0;
+    d->frame_start = 0;
+}
+
+/**
+ * @brief Start in the middle of a stream as if everything before offset had
+ *        been decoded. buf holds the input just before offset, a whole frame
+ *        (framed mode) or a whole frame between two tokens (legacy mode), it
+ *        sets sync and continuity without output. Counters start from 0.
+ */
+static inline void frame_decoder_prime(frame_decoder_t *d, const u_int8_t *buf, size_t len, u_int64_t offset)
+{
+    frame_handler_t handler = d->handler;
+    FILE *log = d->log;
+
+    d->handler = NULL;
+    d->log = NULL;
+    d->offset = offset - len;
+    d->window_offset = offset - len;
+    frame_decode_block(d, buf, len);
+    d->handler = handler;
+    d->log = log;
+
+    memset(&d->stats, 0, sizeof(d->stats));
+    memset(&d->timing, 0, sizeof(d->timing));
+    d->last_arrival_ns = 0;
+    d->frame.index = 0;
+}
+
+/**
+ * @brief End of input. In legacy mode the last frame has no token after it,
+ *        an incomplete frame at the end of a framed stream is dropped.
+ */
+static inline void frame_decoder_finish(frame_decoder_t *d)
+{
+    if(!d->framed && d->synced && d->window_len > d->frame_start)
+    {
+        frame_complete(d, d->window + d->frame_start, d->window_len - d->frame_start, d->window_offset + d->frame_start, false);
+    }
+}
+
+#endif // FRAME_DECODER_H_
@@ -0,0 +1,267 @@
+/**
+ * @file frame_shm.h
+ *
+ * @brief Decoded frames published live in POSIX shared memory, for local
+ *        consumers (dashboards, analyzers) that would otherwise tail and
+ *        re-parse the results file.
+ *
+ *        One writer (the parser) and any number of readers. The segment is a
+ *        header and a ring of slots, each slot holds one result_record_t (the
+ *        record of the binary results file) and a sequence word: odd while
+ *        the writer fills the slot, 2 * (frame sequence + 1) when done. A
+ *        reader copies the record and checks the sequence word before and
+ *        after (seqlock), so reads take no locks and the writer never waits
+ *        for a reader. A reader that falls more than a ring behind loses the
+ *        oldest frames and is told how many.
+ *
+ *        The writer creates a new segment on start (readers of the old one
+ *        see it closed) and marks it closed at the end. The segment stays
+ *        until the next writer or shm_unlink, so a late reader can still read
+ *        the last frames.
+ *
+ *        Readers: frame_shm_open(), then frame_shm_read() or
+ *        frame_shm_read_wait() in a loop, see shm_to_text.cpp.
+ *        Link with -lrt on glibc before 2.34.
+ *
+ * @license MIT
+ */
+
+#ifndef FRAME_SHM_H_
+#define FRAME_SHM_H_
+
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "result_file.h"
+
+#define FRAME_SHM_MAGIC             "RSFRMSHM"
+#define FRAME_SHM_VERSION           2 // 1 had 48 samples per record.
+#define FRAME_SHM_DEFAULT_SLOTS     65536 // 9 MB, minutes of frames at full serial rate.
+#define FRAME_SHM_POLL_NS           100000 // frame_shm_read_wait() checks for new frames this often.
+
+typedef struct
+{
+    char magic[8];              // FRAME_SHM_MAGIC, not 0 terminated, written last.
+    u_int16_t version;
+    u_int16_t header_bytes;     // sizeof(frame_shm_header_t), slots follow.
+    u_int16_t slot_bytes;       // sizeof(frame_shm_slot_t)
+    u_int16_t record_samples;   // RESULT_RECORD_SAMPLES
+    u_int32_t num_slots;        // Power of 2.
+    u_int32_t writer_pid;
+    u_int64_t created_ns;       // CLOCK_REALTIME when the writer started.
+    u_int32_t closed;           // Writer has finished, no more frames come.
+    u_int8_t reserved[28];
+    alignas(64) u_int64_t head; // Frames published, read by every reader.
+    u_int8_t head_pad[56];
+} frame_shm_header_t;           // 128 bytes
+
+typedef struct
+{
+    u_int64_t seq;              // 0 empty, odd while written, 2 * (frame sequence + 1) when done.
+    result_record_t record;
+} frame_shm_slot_t;             // 144 bytes
+
+typedef struct
+{
+    int fd;
+    frame_shm_header_t *header;
+    frame_shm_slot_t *slots;
+    size_t map_len;
+    u_int64_t next;             // Sequence of the next frame.
+    u_int64_t mask;             // num_slots - 1
+} frame_shm_writer_t;
+
+typedef struct
+{
+    int fd;
+    const frame_shm_header_t *header;
+    const frame_shm_slot_t *slots;
+    size_t map_len;
+    u_int64_t next;             // Sequence of the next frame to read.
+    u_int64_t mask;
+    u_int64_t lost;             // Frames overwritten before they were read.
+} frame_shm_reader_t;
+
+/**
+ * @brief Create the segment name ("/something"), replacing an old one.
+ *        num_slots is rounded up to a power of 2.
+ * @return 0 on success, -1 on error (errno is set).
+ */
+static inline int frame_shm_create(frame_shm_writer_t *w, const char *name, u_int32_t num_slots)
+{
+    struct timespec ts;
+    u_int32_t n = 1;
+
+    while(n < num_slots)n <<= 1;
+    memset(w, 0, sizeof(*w));
+    w->mask = n - 1;
+    w->map_len = sizeof(frame_shm_header_t) + (size_t)n * sizeof(frame_shm_slot_t);
+
+    shm_unlink(name); // Readers of an old segment keep it until they let go.
+    w->fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if(w->fd < 0)return -1;
+    if(ftruncate(w->fd, w->map_len) != 0)
+    {
+        close(w->fd);
+        shm_unlink(name);
+        return -1;
+    }
+    w->header = (frame_shm_header_t*)mmap(NULL, w->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, w->fd, 0);
+    if(w->header == MAP_FAILED)
+    {
+        close(w->fd);
+        shm_unlink(name);
+        return -1;
+    }
+    w->slots = (frame_shm_slot_t*)(w->header + 1);
+
+    // Segment is zero filled: empty slots, head 0.
+    clock_gettime(CLOCK_REALTIME, &ts);
+    w->header->version = FRAME_SHM_VERSION;
+    w->header->header_bytes = sizeof(frame_shm_header_t);
+    w->header->slot_bytes = sizeof(frame_shm_slot_t);
+    w->header->record_samples = RESULT_RECORD_SAMPLES;
+    w->header->num_slots = n;
+    w->header->writer_pid = (u_int32_t)getpid();
+    w->header->created_ns = (u_int64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(w->header->magic, FRAME_SHM_MAGIC, sizeof(w->header->magic));
+    return 0;
+}
+
+/**
+ * @brief Publish a decoded frame, see result_record_fill(). Never waits.
+ */
+static inline void frame_shm_publish(frame_shm_writer_t *w, const frame_t *f, u_int16_t port, u_int64_t realtime_offset_ns)
+{
+    frame_shm_slot_t *slot = &w->slots[w->next & w->mask];
+
+    __atomic_store_n(&slot->seq, 2 * w->next + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE); // Readers that see the new record see the odd sequence.
+    result_record_fill(&slot->record, f, port, realtime_offset_ns);
+    __atomic_store_n(&slot->seq, 2 * w->next + 2, __ATOMIC_RELEASE);
+    w->next++;
+    __atomic_store_n(&w->header->head, w->next, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Mark the segment closed and unmap it. It is not removed.
+ */
+static inline void frame_shm_close(frame_shm_writer_t *w)
+{
+    __atomic_store_n(&w->header->closed, 1, __ATOMIC_RELEASE);
+    munmap(w->header, w->map_len);
+    close(w->fd);
+}
+
+/**
+ * @brief Attach to the segment of a running (or finished) writer.
+ * @param from_oldest  start with the oldest frame still in the ring, else
+ *                     with the next frame published.
+ * @return 0 on success, -1 if there is no segment or it isn't one this code reads.
+ */
+static inline int frame_shm_open(frame_shm_reader_t *r, const char *name, bool from_oldest)
+{
+    const frame_shm_header_t *h;
+    struct stat st;
+    u_int64_t head;
+
+    memset(r, 0, sizeof(*r));
+    r->fd = shm_open(name, O_RDONLY, 0);
+    if(r->fd < 0)return -1;
+    if(fstat(r->fd, &st) != 0 || (size_t)st.st_size < sizeof(frame_shm_header_t))
+    {
+        close(r->fd);
+        return -1;
+    }
+    r->map_len = st.st_size;
+    h = (const frame_shm_header_t*)mmap(NULL, r->map_len, PROT_READ, MAP_SHARED, r->fd, 0);
+    if(h == MAP_FAILED)
+    {
+        close(r->fd);
+        return -1;
+    }
+    r->header = h;
+    if(memcmp(h->magic, FRAME_SHM_MAGIC, sizeof(h->magic)) != 0 || h->version != FRAME_SHM_VERSION
+        || h->slot_bytes != sizeof(frame_shm_slot_t) || h->num_slots == 0 || (h->num_slots & (h->num_slots - 1)) != 0
+        || h->header_bytes + (size_t)h->num_slots * h->slot_bytes > r->map_len)
+    {
+        munmap((void*)h, r->map_len);
+        close(r->fd);
+        return -1;
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    r->slots = (const frame_shm_slot_t*)((const u_int8_t*)h + h->header_bytes);
+    r->mask = h->num_slots - 1;
+    head = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+    r->next = (!from_oldest) ? head : (head > h->num_slots ? head - h->num_slots : 0);
+    return 0;
+}
+
+/**
+ * @brief Copy the next frame to rec without waiting.
+ * @return 1 if rec was filled, 0 if there is no new frame yet, -1 if the
+ *         writer has closed and every frame was read.
+ */
+static inline int frame_shm_read(frame_shm_reader_t *r, result_record_t *rec)
+{
+    const frame_shm_slot_t *slot;
+    u_int64_t head, seq, check;
+    u_int64_t num_slots = r->mask + 1;
+
+    for(;;)
+    {
+        // closed is read first, so a frame published before closing is not missed.
+        bool closed = __atomic_load_n(&r->header->closed, __ATOMIC_ACQUIRE);
+        head = __atomic_load_n(&r->header->head, __ATOMIC_ACQUIRE);
+        if(r->next >= head)return closed ? -1 : 0;
+        if(head - r->next > num_slots)
+        {
+            r->lost += head - num_slots - r->next;
+            r->next = head - num_slots;
+        }
+
+        slot = &r->slots[r->next & r->mask];
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if(seq == 2 * r->next + 2)
+        {
+            memcpy(rec, &slot->record, sizeof(*rec));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            check = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+            if(check == seq)
+            {
+                r->next++;
+                return 1;
+            }
+        }
+        // Writer has gone round the ring and is over this slot already.
+        r->lost++;
+        r->next++;
+    }
+}
+
+/**
+ * @brief Like frame_shm_read() but waits for the next frame.
+ * @return 1 if rec was filled, -1 if the writer has closed and every frame was read.
+ */
+static inline int frame_shm_read_wait(frame_shm_reader_t *r, result_record_t *rec)
+{
+    struct timespec ts = {0, FRAME_SHM_POLL_NS};
+    int res;
+
+    while((res = frame_shm_read(r, rec)) == 0)nanosleep(&ts, NULL);
+    return res;
+}
+
+static inline void frame_shm_detach(frame_shm_reader_t *r)
+{
+    munmap((void*)r->header, r->map_len);
+    close(r->fd);
+}
+
+#endif // FRAME_SHM_H_
@@ -0,0 +1,332 @@
+/**
+ * @brief Generates the byte stream of a receiver without hardware, for
+ *        measuring the parser. Samples follow write_new_data() of
+ *        sender_main.c (x from 0 up, y from 0xFFFF down, z 127), message
+ *        numbers count from 0, one frame of serial_framing.h per message.
+ *        Loss, bit errors and truncated frames can be injected, what was
+ *        injected is printed at the end so it can be compared with what
+ *        the parser found. Same seed, same stream.
+ *
+ * @usage
+ *        ./gen_stream -n 1000000 stream.bin
+ *        ./gen_stream -n 100000 -l 0.01 -e 1e-6 -t 0.001 lossy.bin
+ *        ./gen_stream -L -n 100000 legacy.bin     (token and samples only, old receiver)
+ *        ./gen_stream -x -n 10000 stream.hex      (jpnevulator hex dump)
+ *        ./gen_stream -E -n 100000 le.bin         (little-endian samples, parse with -E)
+ *        ./gen_stream -B 4 -n 100000 batch.bin    (batch frames of 4 messages)
+ *        ./gen_stream -R 1000 -l 0.01 -n 100000 rep.bin (receiver stats frames)
+ *        ./gen_stream -V -B 4 -n 100000 mixed.bin (messages of 1...18 triples)
+ *        ./gen_stream -n 1000 | ./pars_serial_direct -r out.txt (stdout, not to a terminal)
+ *
+ *        -l  probability a message is lost on the radio link (not sent at all)
+ *        -e  bit error rate on the serial line, bits are flipped anywhere in the stream
+ *        -t  probability a frame loses its tail (cut at a random byte)
+ *        -s  seed
+ *        -B  messages per batch frame (receiver BATCH_MSGS), a batch is
+ *            always full, the bytes and frames per message are printed
+ *        -R  receiver stats frame after every this many messages, with the
+ *            messages lost with -l as lost on the radio
+ *        -V  every message has a random number of triples, up to what fits
+ *            in the largest radio payload, instead of FRAME_TRIPLES
+ *
+ *        gcc -O2 -c ../receiver/serial_framing.c libcrc/src/crcccitt.c -I libcrc/include
+ *        g++ -O2 -o gen_stream gen_stream.cpp serial_framing.o crcccitt.o
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "frame_decoder.h"
+#include "output_buffer.h"
+#include "../receiver/serial_framing.h"
+
+#define MSG_BYTES                   (FRAME_MSG_NR_BYTES + FRAME_PAYLOAD_BYTES) // Sender default
+#define MSG_MAX_TRIPLES             ((SERIAL_FRAME_MAX_PAYLOAD - FRAME_MSG_NR_BYTES) / 6)
+#define MSG_MAX_BYTES               (FRAME_MSG_NR_BYTES + 6 * MSG_MAX_TRIPLES)
+#define HEX_BYTES_PER_LINE          16
+
+// xorshift64*, same numbers on every host.
+typedef struct
+{
+    u_int64_t state;
+} rng_t;
+
+static u_int64_t rng_next(rng_t *r)
+{
+    r->state ^= r->state >> 12;
+    r->state ^= r->state << 25;
+    r->state ^= r->state >> 27;
+    return r->state * 2685821657736338717ULL;
+}
+
+// Uniform in (0, 1].
+static double rng_uniform(rng_t *r)
+{
+    return ((rng_next(r) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+// Bits until the next bit error, bit errors are independent.
+static u_int64_t rng_error_gap(rng_t *r, double ber)
+{
+    double gap = floor(log(rng_uniform(r)) / log1p(-ber));
+    return gap < 1e18 ? (u_int64_t)gap : (u_int64_t)1e18;
+}
+
+/**
+ * @brief Frame of count messages, as the receiver sends it: a data frame
+ *        for one message, a batch frame for more.
+ * @return frame length.
+ */
+static size_t batch_frame(u_int8_t *frame, u_int8_t msgs[][MSG_MAX_BYTES], const u_int16_t *lens, unsigned int count)
+{
+    const u_int8_t *ptrs[SERIAL_BATCH_MAX_MSGS];
+    u_int8_t crc[SERIAL_FRAME_CRC_LEN], *p;
+    size_t len;
+    unsigned int i;
+
+    if(count == 1)
+    {
+        memcpy(frame + SERIAL_FRAME_HEADER_LEN, msgs[0], lens[0]);
+        return serial_frame_seal(frame, SERIAL_FRAME_TYPE_DATA, lens[0]);
+    }
+
+    for(i = 0; i < count; i++)ptrs[i] = msgs[i];
+    len = serial_batch_seal(frame, crc, ptrs, lens, (u_int8_t)count);
+    p = frame + SERIAL_FRAME_HEADER_LEN + SERIAL_BATCH_HEAD_LEN(count);
+    for(i = 0; i < count; i++)
+    {
+        memcpy(p, msgs[i] + SERIAL_BATCH_MSG_NR_LEN, lens[i] - SERIAL_BATCH_MSG_NR_LEN);
+        p += lens[i] - SERIAL_BATCH_MSG_NR_LEN;
+    }
+    memcpy(p, crc, SERIAL_FRAME_CRC_LEN);
+    return len;
+}
+
+/**
+ * @brief Write bytes as jpnevulator hex dump, column is the position in the line.
+ */
+static void write_hex(output_buffer_t *o, const u_int8_t *data, size_t len, unsigned int *column)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    char *p = output_reserve(o, len * 3);
+    size_t i;
+
+    for(i = 0; i < len; i++)
+    {
+        *p++ = digits[data[i] >> 4];
+        *p++ = digits[data[i] & 0x0F];
+        *column = (*column + 1) % HEX_BYTES_PER_LINE;
+        *p++ = *column == 0 ? '\n' : ' ';
+    }
+    output_commit(o, len * 3);
+}
+
+/**
+ * @brief Usage on stderr, stdout is the stream.
+ */
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-n frames] [-L] [-E] [-x] [-l loss] [-e bit-error-rate] [-t truncate] [-s seed] [-B batch] [-R report-messages] [-V] [stream-file]\n"
+                    "Without stream-file the stream goes to stdout, which must not be a terminal unless -x.\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    int opt, out_fd = STDOUT_FILENO;
+    bool legacy = false, hex = false, little_endian = false, mixed = false;
+    double loss = 0, ber = 0, truncate = 0;
+    unsigned long long num_frames = 1000, written = 0, lost = 0, truncated = 0, flipped = 0, bytes = 0, frames = 0;
+    unsigned long long report_every = 0, reports = 0, missing = 0;
+    u_int16_t counter_x = 0, counter_y = 0xffff, counter_z = 127;
+    u_int32_t frame_buf[(SERIAL_FRAME_MAX_WIRE_LEN + SERIAL_FRAME_OVERHEAD + SERIAL_STATS_LEN + 3) / 4];
+    serial_stats_t report = {0, 1000, 0, 0, 0, 0, 0, 0};
+    u_int8_t *frame = (u_int8_t*)frame_buf, *msg;
+    u_int8_t batch_msgs[SERIAL_BATCH_MAX_MSGS][MSG_MAX_BYTES];
+    u_int16_t batch_lens[SERIAL_BATCH_MAX_MSGS], msg_len = MSG_BYTES, triples = FRAME_TRIPLES;
+    u_int64_t next_error;
+    unsigned int column = 0, batch = 1, batched = 0;
+    size_t len, i;
+    output_buffer_t out;
+    rng_t rng = {0x9E3779B97F4A7C15ULL};
+
+    while((opt = getopt(argc, argv, "n:LExl:e:t:s:B:R:V")) != -1)
+    {
+        switch(opt)
+        {
+            case 'n': // Messages sent.
+                num_frames = strtoull(optarg, NULL, 0);
+                break;
+            case 'L': // Legacy stream, token written over the message number.
+                legacy = true;
+                break;
+            case 'E': // Samples little-endian, receiver LDMA swaps bytes.
+                little_endian = true;
+                break;
+            case 'x': // jpnevulator hex dump instead of raw bytes.
+                hex = true;
+                break;
+            case 'l':
+                loss = atof(optarg);
+                break;
+            case 'e':
+                ber = atof(optarg);
+                break;
+            case 't':
+                truncate = atof(optarg);
+                break;
+            case 's':
+                rng.state = strtoull(optarg, NULL, 0) | 1; // xorshift state must not be 0.
+                break;
+            case 'B': // Messages per batch frame.
+                batch = (unsigned int)atoi(optarg);
+                break;
+            case 'R': // Receiver stats frame every this many messages.
+                report_every = strtoull(optarg, NULL, 0);
+                break;
+            case 'V': // Mixed message sizes.
+                mixed = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if(batch < 1 || batch > SERIAL_BATCH_MAX_MSGS || (legacy && (batch > 1 || report_every > 0 || mixed)))
+    {
+        fprintf(stderr, "-B must be 1...%d, -B, -R and -V not with -L\n", SERIAL_BATCH_MAX_MSGS);
+        return 1;
+    }
+    if (optind < argc)
+    {
+        out_fd = open(argv[optind], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out_fd < 0)
+        {
+            fprintf(stderr, "Failed to open %s!\n", argv[optind]);
+            return 1;
+        }
+    }
+    else if(!hex && isatty(out_fd))
+    {
+        // Binary stream goes to a file or a pipe, not to the terminal.
+        usage(argv[0]);
+        return 1;
+    }
+    if (output_init(&out, out_fd, OUTPUT_BUFFER_BYTES) != 0)return 1;
+    next_error = ber > 0 ? rng_error_gap(&rng, ber) : ~0ULL;
+
+    // Receiver sends a lone token at start.
+    memcpy(frame, token_bytes, TOKEN_LEN);
+    len = TOKEN_LEN;
+    msg = legacy ? frame : frame + SERIAL_FRAME_HEADER_LEN;
+    for(unsigned long long n = 0; n <= num_frames; n++)
+    {
+        if(n > 0)
+        {
+            if(batch > 1)msg = batch_msgs[batched];
+            if(mixed)
+            {
+                triples = (u_int16_t)(1 + rng_next(&rng) % MSG_MAX_TRIPLES);
+                msg_len = (u_int16_t)(FRAME_MSG_NR_BYTES + 6 * triples);
+            }
+
+            // Radio message as the sender fills it, big-endian.
+            msg[0] = (u_int8_t)((n - 1) >> 24);
+            msg[1] = (u_int8_t)((n - 1) >> 16);
+            msg[2] = (u_int8_t)((n - 1) >> 8);
+            msg[3] = (u_int8_t)(n - 1);
+            for(i = 0; i < triples; i++)
+            {
+                msg[FRAME_MSG_NR_BYTES + 6 * i] = (u_int8_t)(counter_x >> 8);
+                msg[FRAME_MSG_NR_BYTES + 6 * i + 1] = (u_int8_t)counter_x;
+                msg[FRAME_MSG_NR_BYTES + 6 * i + 2] = (u_int8_t)(counter_y >> 8);
+                msg[FRAME_MSG_NR_BYTES + 6 * i + 3] = (u_int8_t)counter_y;
+                msg[FRAME_MSG_NR_BYTES + 6 * i + 4] = (u_int8_t)(counter_z >> 8);
+                msg[FRAME_MSG_NR_BYTES + 6 * i + 5] = (u_int8_t)counter_z;
+                counter_x++;
+                counter_y--;
+            }
+            for(i = FRAME_MSG_NR_BYTES; little_endian && i < msg_len; i += 2)
+            {
+                u_int8_t b = msg[i];
+                msg[i] = msg[i + 1];
+                msg[i + 1] = b;
+            }
+            if(loss > 0 && rng_uniform(&rng) <= loss)
+            {
+                lost++;
+                missing++;
+            }
+            else
+            {
+                written++;
+                batch_lens[batched++] = msg_len;
+                report.received++;
+                if(missing > 0)
+                {
+                    report.radio_lost += missing; // The receiver sees the gap here.
+                    report.radio_gaps++;
+                    missing = 0;
+                }
+            }
+
+            // What the receiver sends, a batch when it is full.
+            len = 0;
+            if(batched > 0 && (batched >= batch || n == num_frames))
+            {
+                if(legacy)
+                {
+                    memcpy(frame, token_bytes, TOKEN_LEN);
+                    len = MSG_BYTES;
+                }
+                else if(batch > 1)len = batch_frame(frame, batch_msgs, batch_lens, batched);
+                else len = serial_frame_seal(frame, SERIAL_FRAME_TYPE_DATA, msg_len);
+                batched = 0;
+                frames++;
+
+                if(truncate > 0 && rng_uniform(&rng) <= truncate)
+                {
+                    len = rng_next(&rng) % len; // Tail lost.
+                    truncated++;
+                }
+            }
+
+            // Receiver counters since the previous stats frame.
+            if(report_every > 0 && n % report_every == 0)
+            {
+                len += serial_stats_seal(frame + len, &report);
+                report.report++;
+                report.received = report.radio_lost = report.radio_gaps = 0;
+                reports++;
+            }
+            if(len == 0)continue;
+        }
+
+        // Serial line bit errors.
+        while(next_error < len * 8)
+        {
+            frame[next_error / 8] ^= (u_int8_t)(1 << (next_error % 8));
+            flipped++;
+            next_error += 1 + rng_error_gap(&rng, ber);
+        }
+        if(next_error != ~0ULL)next_error -= len * 8;
+
+        if(hex)write_hex(&out, frame, len, &column);
+        else output_write(&out, frame, len);
+        bytes += len;
+    }
+    if(hex && column != 0)output_write(&out, "\n", 1);
+    output_close(&out);
+
+    fprintf(stderr, "%llu messages, %llu lost, %llu frames written (%llu bytes), %llu truncated, %llu bits flipped\n",
+            num_frames, lost, frames, bytes, truncated, flipped);
+    if(reports > 0)fprintf(stderr, "%llu receiver stats frames\n", reports);
+    if(written > 0)
+    {
+        fprintf(stderr, "%llu messages written, %.2f bytes and %.3f frames (LDMA done interrupts) per message\n",
+                written, (double)bytes / written, (double)frames / written);
+    }
+    return 0;
+}
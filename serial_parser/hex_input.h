@@ -0,0 +1,74 @@
+/**
+ * @file hex_input.h
+ *
+ * @brief Turns the hex dump of jpnevulator ("DE AD BE EF\n...") back into
+ *        bytes. Numbers are separated by anything that is not a hex digit,
+ *        like scanf("%x ") did. Text can be fed in arbitrary pieces.
+ *
+ * @license MIT
+ */
+
+#ifndef HEX_INPUT_H_
+#define HEX_INPUT_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+
+typedef struct
+{
+    unsigned int value;         // Number being read.
+    bool in_number;
+} hex_input_t;
+
+static inline void hex_input_init(hex_input_t *h)
+{
+    h->value = 0;
+    h->in_number = false;
+}
+
+/**
+ * @brief Convert len characters of text, out must have room for len / 2 + 1 bytes.
+ * @return number of bytes written to out.
+ */
+static inline size_t hex_input_convert(hex_input_t *h, const char *text, size_t len, u_int8_t *out)
+{
+    size_t i, n = 0;
+    int digit;
+    char c;
+
+    for(i = 0; i < len; i++)
+    {
+        c = text[i];
+        if(c >= '0' && c <= '9')digit = c - '0';
+        else if(c >= 'a' && c <= 'f')digit = c - 'a' + 10;
+        else if(c >= 'A' && c <= 'F')digit = c - 'A' + 10;
+        else digit = -1;
+
+        if(digit >= 0)
+        {
+            h->value = (h->value << 4) | digit;
+            h->in_number = true;
+        }
+        else if(h->in_number)
+        {
+            out[n++] = (u_int8_t)h->value;
+            h->value = 0;
+            h->in_number = false;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief End of text, a number may still be pending.
+ * @return number of bytes written to out (0 or 1).
+ */
+static inline size_t hex_input_finish(hex_input_t *h, u_int8_t *out)
+{
+    if(!h->in_number)return 0;
+    out[0] = (u_int8_t)h->value;
+    hex_input_init(h);
+    return 1;
+}
+
+#endif // HEX_INPUT_H_
@@ -0,0 +1,132 @@
+/**
+ * @file histogram.h
+ *
+ * @brief Log-bucketed histogram of durations in nanoseconds. Every power of
+ *        two is split into HISTOGRAM_SUB_BUCKETS buckets, so a percentile is
+ *        within 1/8 of the true value, from 1 ns up to centuries, in 4 kB.
+ *
+ *        Like the counters in stats.h a histogram has one writer thread and is
+ *        read by the statistics thread, buckets are updated with relaxed
+ *        atomic stores.
+ *
+ * @license MIT
+ */
+
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#define HISTOGRAM_SUB_BITS          3
+#define HISTOGRAM_SUB_BUCKETS       (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_LINEAR            (2 * HISTOGRAM_SUB_BUCKETS) // Values below this have a bucket each.
+#define HISTOGRAM_BUCKETS           (HISTOGRAM_LINEAR + (64 - HISTOGRAM_SUB_BITS - 1) * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct
+{
+    u_int64_t max;              // Largest value recorded.
+    u_int64_t buckets[HISTOGRAM_BUCKETS];
+} histogram_t;
+
+static inline unsigned int histogram_bucket(u_int64_t v)
+{
+    unsigned int e;
+
+    if(v < HISTOGRAM_LINEAR)return (unsigned int)v;
+    e = 63 - __builtin_clzll(v); // >= HISTOGRAM_SUB_BITS + 1
+    return HISTOGRAM_LINEAR + (e - HISTOGRAM_SUB_BITS - 1) * HISTOGRAM_SUB_BUCKETS
+        + (unsigned int)((v >> (e - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+/**
+ * @brief Largest value that goes into bucket b.
+ */
+static inline u_int64_t histogram_bucket_top(unsigned int b)
+{
+    unsigned int e, sub;
+
+    if(b < HISTOGRAM_LINEAR)return b;
+    e = (b - HISTOGRAM_LINEAR) / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BITS + 1;
+    sub = (b - HISTOGRAM_LINEAR) % HISTOGRAM_SUB_BUCKETS;
+    return ((u_int64_t)(HISTOGRAM_SUB_BUCKETS + sub + 1) << (e - HISTOGRAM_SUB_BITS)) - 1;
+}
+
+/**
+ * @brief Add a value, only from the writer thread.
+ */
+static inline void histogram_record(histogram_t *h, u_int64_t v)
+{
+    u_int64_t *b = &h->buckets[histogram_bucket(v)];
+
+    __atomic_store_n(b, *b + 1, __ATOMIC_RELAXED);
+    if(v > h->max)__atomic_store_n(&h->max, v, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Add the buckets of h to sum, for several decoders.
+ */
+static inline void histogram_add(histogram_t *sum, const histogram_t *h)
+{
+    u_int64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+    unsigned int i;
+
+    for(i = 0; i < HISTOGRAM_BUCKETS; i++)sum->buckets[i] += __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+    if(max > sum->max)sum->max = max;
+}
+
+/**
+ * @brief What was recorded between two snapshots. The largest value is only
+ *        known if it was recorded in between, else the top bucket tells.
+ */
+static inline void histogram_diff(histogram_t *d, const histogram_t *now, const histogram_t *prev)
+{
+    unsigned int i;
+
+    for(i = 0; i < HISTOGRAM_BUCKETS; i++)d->buckets[i] = now->buckets[i] - prev->buckets[i];
+    d->max = now->max > prev->max ? now->max : 0;
+}
+
+static inline u_int64_t histogram_count(const histogram_t *h)
+{
+    u_int64_t n = 0;
+    unsigned int i;
+
+    for(i = 0; i < HISTOGRAM_BUCKETS; i++)n += h->buckets[i];
+    return n;
+}
+
+/**
+ * @brief Value that permille / 1000 of the recorded values are not above,
+ *        rounded up to the bucket. 1000 is the largest value.
+ */
+static inline u_int64_t histogram_percentile(const histogram_t *h, u_int64_t count, unsigned int permille)
+{
+    u_int64_t rank = (count * permille + 999) / 1000, seen = 0, top;
+    unsigned int i;
+
+    if(rank == 0)rank = 1;
+    for(i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        seen += h->buckets[i];
+        if(seen >= rank)break;
+    }
+    if(i == HISTOGRAM_BUCKETS)return h->max;
+    top = histogram_bucket_top(i);
+    return (h->max != 0 && h->max < top) ? h->max : top;
+}
+
+/**
+ * @brief Print count, p50, p99, p99.9 and max in milliseconds, nothing if empty.
+ */
+static inline void histogram_print(FILE *fp, const char *name, const histogram_t *h)
+{
+    u_int64_t n = histogram_count(h);
+
+    if(n == 0)return;
+    fprintf(fp, "%s %llu: p50 %.3f p99 %.3f p99.9 %.3f max %.3f ms", name, (unsigned long long)n,
+            histogram_percentile(h, n, 500) / 1e6, histogram_percentile(h, n, 990) / 1e6,
+            histogram_percentile(h, n, 999) / 1e6, histogram_percentile(h, n, 1000) / 1e6);
+}
+
+#endif // HISTOGRAM_H_
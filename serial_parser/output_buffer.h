@@ -0,0 +1,184 @@
+/**
+ * @file output_buffer.h
+ *
+ * @brief Block buffer all results are written through. Without a ring the
+ *        buffer goes to the file with one write() when it fills up. With a
+ *        ring the filled block is handed to the writer thread instead, so the
+ *        decoder never waits for disk I/O unless all blocks are in flight.
+ *        A buffer can also write to a fixed place in the file with pwrite(),
+ *        so several threads can fill one file.
+ *
+ * @license MIT
+ */
+
+#ifndef OUTPUT_BUFFER_H_
+#define OUTPUT_BUFFER_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "block_ring.h"
+
+#define OUTPUT_BUFFER_BYTES         (1024 * 1024)
+
+typedef struct
+{
+    int fd;
+    block_ring_t *ring;         // NULL if written directly.
+    block_t *block;             // Ring block being filled.
+    char *buf;
+    size_t len;
+    size_t size;
+    u_int64_t written;          // Bytes handed on so far.
+    off_t file_offset;          // pwrite() position, -1 to write() at the current position.
+} output_buffer_t;
+
+/**
+ * @brief Write len bytes, retrying short writes.
+ * @return 0 on success, -1 on write error.
+ */
+static inline int write_all(int fd, const void *data, size_t len)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while(done < len)
+    {
+        n = write(fd, (const char*)data + done, len - done);
+        if(n > 0)done += n;
+        else if(n < 0 && errno == EINTR)continue;
+        else return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief pwrite() len bytes at offset, retrying short writes.
+ * @return 0 on success, -1 on write error.
+ */
+static inline int pwrite_all(int fd, const void *data, size_t len, off_t offset)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while(done < len)
+    {
+        n = pwrite(fd, (const char*)data + done, len - done, offset + done);
+        if(n > 0)done += n;
+        else if(n < 0 && errno == EINTR)continue;
+        else return -1;
+    }
+    return 0;
+}
+
+static inline int output_init(output_buffer_t *o, int fd, size_t size)
+{
+    o->fd = fd;
+    o->file_offset = -1;
+    o->ring = NULL;
+    o->block = NULL;
+    o->len = 0;
+    o->size = size;
+    o->written = 0;
+    o->buf = (char*)malloc(size);
+    return o->buf != NULL ? 0 : -1;
+}
+
+/**
+ * @brief Write to fd from offset on. fd is shared, output_close() leaves it open.
+ */
+static inline int output_init_at(output_buffer_t *o, int fd, size_t size, off_t offset)
+{
+    int res = output_init(o, fd, size);
+
+    o->file_offset = offset;
+    return res;
+}
+
+/**
+ * @brief Write into blocks of ring, which the writer thread drains to the file.
+ */
+static inline void output_init_ring(output_buffer_t *o, int fd, block_ring_t *ring)
+{
+    o->fd = fd;
+    o->file_offset = -1;
+    o->ring = ring;
+    o->block = block_ring_acquire(ring);
+    o->buf = (char*)o->block->data;
+    o->len = 0;
+    o->size = ring->block_size;
+    o->written = 0;
+}
+
+/**
+ * @brief Hand all buffered bytes on.
+ * @return 0 on success, -1 on write error.
+ */
+static inline int output_flush(output_buffer_t *o)
+{
+    int res = 0;
+
+    if(o->len == 0)return 0;
+    if(o->ring != NULL)
+    {
+        o->block->len = o->len;
+        block_ring_publish(o->ring);
+        o->block = block_ring_acquire(o->ring);
+        o->buf = (char*)o->block->data;
+    }
+    else if(o->file_offset >= 0)
+    {
+        res = pwrite_all(o->fd, o->buf, o->len, o->file_offset);
+        o->file_offset += o->len;
+    }
+    else res = write_all(o->fd, o->buf, o->len);
+    o->written += o->len;
+    o->len = 0;
+    return res;
+}
+
+/**
+ * @brief Make room for at least len bytes.
+ * @return pointer to the free space in the buffer.
+ */
+static inline char* output_reserve(output_buffer_t *o, size_t len)
+{
+    if(o->size - o->len < len)output_flush(o);
+    return o->buf + o->len;
+}
+
+static inline void output_commit(output_buffer_t *o, size_t len)
+{
+    o->len += len;
+}
+
+static inline void output_write(output_buffer_t *o, const void *data, size_t len)
+{
+    memcpy(output_reserve(o, len), data, len);
+    output_commit(o, len);
+}
+
+/**
+ * @brief Flush and close. With a ring the writer thread is told to stop
+ *        and closes the file.
+ */
+static inline void output_close(output_buffer_t *o)
+{
+    output_flush(o);
+    if(o->ring != NULL)
+    {
+        o->block->flags = BLOCK_FLAG_EOF;
+        block_ring_publish(o->ring);
+    }
+    else
+    {
+        free(o->buf);
+        if(o->file_offset < 0)close(o->fd);
+    }
+    o->buf = NULL;
+}
+
+#endif // OUTPUT_BUFFER_H_
@@ -0,0 +1,274 @@
+/**
+ * @file output_writer.h
+ *
+ * @brief Writer thread of the results file. Drains the output ring to disk
+ *        and is the only place file I/O happens, so disk stalls are taken up
+ *        by the ring, not by the decoder or reader.
+ *
+ *        Long runs can rotate the results: after rotate_bytes or rotate_ns
+ *        the writer continues in a new file name.NNNNNN (numbered on from
+ *        the files already there). A file only changes between blocks, so
+ *        text lines and binary records are never split. Every new file can
+ *        start with a header (start_file).
+ *
+ *        Disk space is preallocated ahead of the writes (fallocate, the file
+ *        size still grows with the data), and the rest released when a file
+ *        is done. With sync_ns a sync thread calls fdatasync() that often on
+ *        its own copy of the fd, and once more on every finished file, so the
+ *        writer never waits for the disk to flush.
+ *
+ *        With an index every file gets a sidecar index (result_index.h), the
+ *        writer turns the marks of the decoder into offsets in the file.
+ *        Decoder checkpoints (checkpoint.h) are saved once the output they
+ *        cover is written.
+ *
+ * @license MIT
+ */
+
+#ifndef OUTPUT_WRITER_H_
+#define OUTPUT_WRITER_H_
+
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <atomic>
+
+#include "block_ring.h"
+#include "output_buffer.h"
+#include "result_index.h"
+#include "checkpoint.h"
+
+#define OUTPUT_WRITER_PREALLOC_BYTES    (16 * 1024 * 1024) // Disk space is reserved this much ahead.
+#define OUTPUT_WRITER_NAME_CHARS        256
+#define OUTPUT_WRITER_POLL_NS           100000000 // Sync thread checks for work this often.
+
+typedef struct output_writer output_writer_t;
+typedef int (*output_file_start_t)(int fd); // Header for a new file, -1 if an old file can't be appended to.
+
+struct output_writer
+{
+    const char *name;           // Results file, or prefix of the rotated files.
+    u_int64_t rotate_bytes;     // New file when the next block would go past this, 0 for no size limit.
+    u_int64_t rotate_ns;        // New file for blocks after this long, 0 for no time limit.
+    u_int64_t sync_ns;          // fdatasync() this often, 0 for never.
+    output_file_start_t start_file; // NULL for no header.
+    result_index_t *index;      // Marks for the sidecar index, NULL for no index.
+    checkpoint_slot_t *checkpoint; // Decoder snapshots to save, NULL for none.
+
+    int fd;
+    char file_name[OUTPUT_WRITER_NAME_CHARS];
+    unsigned int file_nr;       // Rotated file being written.
+    u_int64_t file_bytes;
+    u_int64_t file_start_ns;
+    off_t allocated;            // Disk space reserved up to here, -1 if fallocate is not supported.
+    u_int64_t errors;           // Failed writes.
+    u_int64_t files;            // Files written to.
+    u_int64_t stream_bytes;     // Output stream written so far, over all files.
+    result_index_file_t index_file;
+
+    std::atomic<int> sync_fd;   // Copy of fd for the sync thread, -1 if none.
+    std::atomic<int> retired_fd;// Copy of a finished file, synced and closed by the sync thread.
+    std::atomic<bool> running;
+    pthread_t sync_tid;
+};
+
+static inline u_int64_t output_writer_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u_int64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline bool output_writer_rotates(const output_writer_t *w)
+{
+    return w->rotate_bytes > 0 || w->rotate_ns > 0;
+}
+
+/**
+ * @brief Sync thread body. Syncs the current file every sync_ns and finished
+ *        files as soon as they are handed over.
+ */
+static inline void* output_writer_sync_thread(void *arg)
+{
+    output_writer_t *w = (output_writer_t*)arg;
+    struct timespec poll = {0, OUTPUT_WRITER_POLL_NS};
+    u_int64_t next_ns = output_writer_now_ns() + w->sync_ns;
+    bool running;
+    int fd;
+
+    for(;;)
+    {
+        running = w->running.load(std::memory_order_acquire); // The last file is handed over before the stop.
+        fd = w->retired_fd.load(std::memory_order_acquire);
+        if(fd >= 0)
+        {
+            fdatasync(fd);
+            close(fd);
+            w->retired_fd.store(-1, std::memory_order_release);
+        }
+        if(!running)break;
+        if(output_writer_now_ns() >= next_ns)
+        {
+            fd = w->sync_fd.load(std::memory_order_acquire);
+            if(fd >= 0)fdatasync(fd);
+            next_ns += w->sync_ns;
+        }
+        nanosleep(&poll, NULL);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Finish the current file: give back unused preallocated space and
+ *        let the sync thread flush it.
+ */
+static inline void output_writer_close_file(output_writer_t *w)
+{
+    int copy;
+
+    if(w->fd < 0)return;
+    result_index_file_close(&w->index_file);
+    if(w->allocated > 0)ftruncate(w->fd, lseek(w->fd, 0, SEEK_END));
+    if(w->sync_ns > 0)
+    {
+        copy = w->sync_fd.exchange(-1, std::memory_order_acq_rel);
+        while(w->retired_fd.load(std::memory_order_acquire) >= 0)block_ring_sleep();
+        w->retired_fd.store(copy, std::memory_order_release);
+    }
+    close(w->fd);
+    w->fd = -1;
+}
+
+/**
+ * @brief Open the next file (the only one if there's no rotation).
+ * @return 0 on success, -1 if it can't be opened, -2 if start_file refused it.
+ */
+static inline int output_writer_open_file(output_writer_t *w)
+{
+    if(output_writer_rotates(w))
+    {
+        do
+        {
+            snprintf(w->file_name, sizeof(w->file_name), "%s.%06u", w->name, w->file_nr++);
+        }
+        while(access(w->file_name, F_OK) == 0); // Don't write into the files of an earlier run.
+    }
+    else snprintf(w->file_name, sizeof(w->file_name), "%s", w->name);
+
+    w->fd = open(w->file_name, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if(w->fd < 0)return -1;
+    if(w->start_file != NULL && w->start_file(w->fd) != 0)
+    {
+        close(w->fd);
+        w->fd = -1;
+        return -2;
+    }
+    if(w->index != NULL && result_index_file_open(&w->index_file, w->file_name, w->index->stride) != 0)
+    {
+        printf("Failed to open %s, no index for %s!\n", w->index_file.name, w->file_name);
+    }
+    w->file_bytes = lseek(w->fd, 0, SEEK_END);
+    w->allocated = w->file_bytes;
+    w->file_start_ns = output_writer_now_ns();
+    w->files++;
+    if(w->sync_ns > 0)w->sync_fd.store(dup(w->fd), std::memory_order_release);
+    return 0;
+}
+
+/**
+ * @brief Open the first file and start the sync thread. Called before the
+ *        writer thread, so a file that can't be used is reported at once.
+ * @return 0 on success, else see output_writer_open_file().
+ */
+static inline int output_writer_init(output_writer_t *w, const char *name, output_file_start_t start_file)
+{
+    int res;
+
+    w->name = name;
+    w->start_file = start_file;
+    w->file_nr = 0;
+    w->errors = 0;
+    w->files = 0;
+    w->stream_bytes = 0;
+    w->index_file.fd = -1;
+    w->sync_fd.store(-1);
+    w->retired_fd.store(-1);
+    w->running.store(true);
+    res = output_writer_open_file(w);
+    if(res != 0)return res;
+    if(w->sync_ns > 0)pthread_create(&w->sync_tid, NULL, output_writer_sync_thread, w);
+    return 0;
+}
+
+/**
+ * @brief Reserve disk space ahead of the file end.
+ */
+static inline void output_writer_prealloc(output_writer_t *w, size_t len)
+{
+    if(w->allocated < 0 || (off_t)(w->file_bytes + len) <= w->allocated)return;
+    if(fallocate(w->fd, FALLOC_FL_KEEP_SIZE, w->allocated, OUTPUT_WRITER_PREALLOC_BYTES) == 0)
+    {
+        w->allocated += OUTPUT_WRITER_PREALLOC_BYTES;
+    }
+    else w->allocated = -1; // Not supported by the file system, don't try again.
+}
+
+/**
+ * @brief Writer thread body, drains ring until the EOF block, then closes
+ *        the file and waits for the last sync.
+ */
+static inline void output_writer_run(output_writer_t *w, block_ring_t *ring)
+{
+    result_index_entry_t e;
+    u_int64_t file_offset;
+    block_t *b;
+
+    for(;;)
+    {
+        b = block_ring_peek(ring);
+        if(b->flags & BLOCK_FLAG_EOF)break;
+
+        if(output_writer_rotates(w) && w->file_bytes > 0
+            && ((w->rotate_bytes > 0 && w->file_bytes + b->len > w->rotate_bytes)
+                || (w->rotate_ns > 0 && output_writer_now_ns() - w->file_start_ns >= w->rotate_ns)))
+        {
+            output_writer_close_file(w);
+            if(output_writer_open_file(w) != 0)printf("Failed to open %s!\n", w->file_name);
+        }
+
+        file_offset = w->file_bytes;
+        if(w->fd >= 0)
+        {
+            output_writer_prealloc(w, b->len);
+            if(write_all(w->fd, b->data, b->len) != 0)w->errors++;
+            else w->file_bytes += b->len;
+        }
+        else w->errors++;
+        if(w->index != NULL)
+        {
+            while(result_index_take(w->index, w->stream_bytes + b->len, &e))
+            {
+                e.offset = file_offset + (e.offset - w->stream_bytes);
+                result_index_file_add(&w->index_file, &e);
+            }
+            result_index_file_flush(&w->index_file);
+        }
+        w->stream_bytes += b->len;
+        if(w->checkpoint != NULL)checkpoint_poll(w->checkpoint, w->stream_bytes, w->file_name, w->file_bytes);
+        block_ring_release(ring);
+    }
+    block_ring_release(ring);
+
+    output_writer_close_file(w);
+    if(w->sync_ns > 0)
+    {
+        w->running.store(false, std::memory_order_release);
+        pthread_join(w->sync_tid, NULL);
+    }
+}
+
+#endif // OUTPUT_WRITER_H_
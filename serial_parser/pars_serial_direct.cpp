@@ -1,10 +1,85 @@
 /**
- * @brief Receives bytes from jpnevulator serial sniffer. Waits to receive
- *        special token. Then starts logging all subsequent non-token bytes. 
- * 
- * @usage 
+ * @brief Receives bytes from the receiver serial port. Waits to receive
+ *        special token. Then decodes every frame (token, header, message
+ *        number, 48 x/y/z samples and CRC, see serial_framing.h) that follows,
+ *        logs the samples and reports lost, corrupted and partial frames.
+ *        Every message of a batch frame is logged as a frame of its own.
+ *
+ * @usage
+ *        ./pars_serial_direct -i /dev/ttyUSB0 results-filename
+ *        ./pars_serial_direct -i /dev/ttyUSB0 -t 1000000 results-filename
+ *        ./pars_serial_direct results-filename < /dev/ttyUSB0
+ *        ./pars_serial_direct -i capture.bin results-filename
  *        jpnevulator -read -t /dev/ttyUSB0 | ./pars_serial_direct results-filename
- *        baud rate 115200
+ *
+ *        Input is the framed stream as raw bytes, read in large blocks from
+ *        the file or tty given with -i, or from stdin. A tty, given with -i
+ *        or on stdin, is set up by the parser (serial_port.h): raw 8N1 at
+ *        -t baud (default 115200, any rate the UART takes). Bytes the kernel
+ *        lost to overruns or line errors are reported with the statistics.
+ *        A pipe or file on stdin is taken as the hex dump of jpnevulator
+ *        (compatibility mode), unless -r says it is raw bytes.
+ *
+ *        With -L the input is the legacy stream of receiver firmware
+ *        without framing, token followed by samples only.
+ *        Samples are big-endian on the wire, -E takes them as little-endian
+ *        (receiver with byteSwap set in msg_descriptor_config()).
+ *
+ *        With -b results are written in the binary format of result_file.h,
+ *        one fixed size record per frame. With -c they are packed instead
+ *        (result_pack.h): samples predicted from the ones before, the
+ *        residuals bit-packed, about 10 bytes per frame of the test pattern.
+ *        result_to_text converts both back.
+ *
+ *        Reading, decoding and writing run in three threads connected by
+ *        lock-free rings of -D blocks of -B bytes. Disk stalls don't stop
+ *        the reader, if the decoder falls behind on a tty input is dropped
+ *        (and counted) rather than letting the tty buffer overflow.
+ *
+ *        Long runs: -R bytes or -W seconds rotate the results file to
+ *        results-filename.NNNNNN, -Y seconds fdatasync()s it from a thread of
+ *        its own (output_writer.h). Ctrl-C stops reading, what was read is
+ *        still decoded and written.
+ *
+ *        Several receivers: give -i once per port. One thread reads all
+ *        ports with epoll (port_set.h), every port has its own decoder and
+ *        results file results-filename.N (N = order of -i). With -M all
+ *        ports go to results-filename, text lines and binary records carry
+ *        the port number. Statistics are the sum over all ports.
+ *
+ *        ./pars_serial_direct -i /dev/ttyUSB0 -i /dev/ttyUSB1 -i /dev/ttyACM0 results-filename
+ *
+ *        Recorded captures: -P threads (0 = all cores) maps the file given
+ *        with -i and decodes chunks of it in parallel (capture_split.h).
+ *        Results and reports are the same as from a sequential run, except
+ *        that binary records have no arrival time (0).
+ *
+ *        ./pars_serial_direct -P 0 -i capture.bin results-filename
+ *
+ *        Investigating a loss: -I stride writes a sidecar index
+ *        results-filename.idx (result_index.h) with the offset and arrival
+ *        time of every stride-th frame, of every frame for text results,
+ *        result_seek uses it to jump straight to a frame or time. Not with -P.
+ *
+ *        ./pars_serial_direct -b -I 1000 -i /dev/ttyUSB0 results-filename
+ *        ./result_seek -f 123456 -n 10 results-filename
+ *
+ *        Restarts: -C seconds saves the decoder state that often (and at the
+ *        end) to results-filename.ckpt (checkpoint.h). A parser started
+ *        with -C and a checkpoint there resumes from it: results written
+ *        after the checkpoint (by a crashed parser) are cut off, frame
+ *        numbers go on, a restart record (text: a '#' line) marks the break in the results,
+ *        messages lost while no parser ran are counted and the totals are
+ *        reported over all runs as well. Delete the file to start over. One
+ *        input only.
+ *
+ *        Live consumers: -X /name also publishes every decoded frame to the
+ *        POSIX shared memory ring /name (frame_shm.h), read without locks by
+ *        any number of processes, see shm_to_text.cpp. Not with -P.
+ *
+ *        git clone https://github.com/lammertb/libcrc.git
+ *        gcc -O2 -c ../receiver/serial_framing.c libcrc/src/crcccitt.c -I libcrc/include
+ *        g++ -O2 -pthread -o pars_serial_direct pars_serial_direct.cpp serial_framing.o crcccitt.o
  *
  * @note this little-endian-big-endian business makes the code complicated to understand
  */
@@ -14,115 +89,1205 @@
 #include <cstring>
 #include <signal.h>
 #include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "frame_decoder.h"
+#include "result_file.h"
+#include "result_pack.h"
+#include "result_index.h"
+#include "text_output.h"
+#include "hex_input.h"
+#include "block_ring.h"
+#include "port_set.h"
+#include "capture_split.h"
+#include "serial_port.h"
+#include "output_writer.h"
+#include "checkpoint.h"
+#include "frame_shm.h"
 
-#define NUM_TOKEN_BYTES             4
-#define NUM_DATA_ELEMENT_BYTES      2
 #define NUM_FILE_NAME_CHARACTERS    100
-static u_int8_t token[NUM_TOKEN_BYTES];
-static int count_to_4 = 3, count_3_elements;
-bool token_received(int i);
-void write_to_log();
+#define DEFAULT_BLOCK_BYTES         65536 // Bytes requested from input with one read() call
+#define MIN_BLOCK_BYTES             4096
+#define DEFAULT_RING_DEPTH          64 // Blocks in flight between two threads
+#define DEFAULT_STATS_INTERVAL      1 // Seconds
+#define DEFAULT_CHECKPOINT_INTERVAL 10 // Seconds
+#define STATS_POLL_NS               100000000 // Statistics thread checks for end of input this often
+#define MAX_THREADS                 64 // Offline mode
+#define MIN_CHUNK_BYTES             (1024 * 1024) // Offline mode doesn't split captures into smaller chunks
+
+typedef enum
+{
+    RESULT_TEXT,                // Three samples per line.
+    RESULT_BINARY,              // result_file.h records.
+    RESULT_PACKED               // result_pack.h frames.
+} result_format_t;
+
+// Reader thread, feeds input blocks to the decoder.
+typedef struct
+{
+    int fd;
+    bool raw;                   // Raw bytes, else jpnevulator hex dump.
+    bool drop_when_full;        // A tty can't wait for the decoder, its buffer would overflow.
+    block_ring_t *ring;
+    u_int64_t dropped_blocks;   // Counters written by reader thread only.
+    u_int64_t dropped_bytes;
+} reader_t;
+
+// Statistics thread, reports counters of decoders and reader every interval.
+typedef struct
+{
+    FILE *fp;
+    unsigned int interval;      // Seconds
+    frame_decoder_t *const *decoders;
+    size_t num_decoders;
+    const reader_t *reader;     // NULL if there is no reader thread.
+    const serial_port_t *ttys;  // Inputs that are ttys, for kernel error counters.
+    size_t num_ttys;
+    bool running;
+} stats_reporter_t;
+
+// Where the frames of a decoder are written.
+typedef struct
+{
+    output_buffer_t *out;
+    int port;                   // Port number for merged output, else -1.
+    frame_shm_writer_t *shm;    // Frames are also published here, NULL if not.
+    u_int16_t input;            // Port number in the shared memory records.
+    result_pack_t *pack;        // Encoder of packed output, NULL if not packed.
+    result_index_t *index;      // Sidecar index marks, NULL for no index.
+    result_index_file_t *index_file; // Index written by the decoder, NULL if the writer thread does it.
+    u_int64_t index_base;       // File offset of the output stream start, without writer thread.
+} log_target_t;
+
+// Offline mode, one chunk of a capture decoded by one thread.
+typedef struct
+{
+    const u_int8_t *data;       // Whole capture.
+    size_t data_len;
+    size_t start;               // Chunk is data[start, end).
+    size_t end;
+    size_t prime;               // Decoder is primed with data[prime, start).
+    bool framed;
+    bool little_endian;         // Samples little-endian on the wire.
+    bool binary_output;
+    u_int64_t frames;           // Decoded, numbered from 0 in every chunk.
+    u_int64_t out_bytes;
+    u_int64_t index_base;       // Frames in the chunks before, added when appended.
+    int out_fd;                 // Results file for the first chunk, a temporary file for the others.
+    off_t out_offset;           // Results of this chunk start here in out_fd.
+    output_buffer_t out;
+    log_target_t target;
+    char *log;                  // Frame reports of this chunk.
+    size_t log_len;
+    stats_t stats;
+} chunk_job_t;
+
+void* reader_thread(void *arg);
+void* writer_thread(void *arg);
+void* stats_thread(void *arg);
+void stats_collect(const stats_reporter_t *s, stats_t *st);
+void timing_collect(const stats_reporter_t *s, timing_t *t);
+void print_totals(const char *prefix, const stats_t *t);
+void* chunk_thread(void *arg);
+int open_chunk_file(const char *filename);
+int append_chunk(const chunk_job_t *j, int out_fd, off_t offset);
+void print_chunk_log(const char *log, size_t len, u_int64_t index_base);
+int run_chunks(const char *input_name, const char *filename, result_format_t format, bool legacy_input, bool little_endian,
+               unsigned int threads);
+int run_ports(const char *const *input_names, size_t num_inputs, const char *filename, result_format_t format,
+              bool merged_output, bool legacy_input, bool little_endian, size_t block_bytes, unsigned int baud, stats_reporter_t *reporter,
+              frame_shm_writer_t *shm, u_int64_t index_stride);
+int setup_tty(serial_port_t *tty, int fd, const char *name, unsigned int baud);
+void write_to_log(frame_decoder_t *d, const frame_t *f);
+void write_to_log_binary(frame_decoder_t *d, const frame_t *f);
+void write_to_log_packed(frame_decoder_t *d, const frame_t *f);
+void index_frame(log_target_t *t, const frame_t *f);
+frame_handler_t result_handler(result_format_t format);
+output_file_start_t result_header(result_format_t format);
+int write_binary_header(int fd);
+int write_packed_header(int fd);
+void print_packed(u_int64_t bytes, u_int64_t frames);
+void take_checkpoint(checkpoint_t *c, const stats_reporter_t *s, const stats_t *previous, u_int32_t restarts, u_int64_t now_ns);
+u_int64_t parse_size(const char *s);
 
-bool logging_enabled = false;
-int flush_token_count = 0;
-int data_element_count = 0;
+u_int64_t realtime_offset_ns = 0; // CLOCK_REALTIME - CLOCK_MONOTONIC
 
-FILE *fp = NULL;
+output_buffer_t out;
+output_writer_t writer;
+frame_shm_writer_t shm;
+block_ring_t input_ring, output_ring;
+volatile sig_atomic_t stop_requested = 0;
 
-void sigint_handler(int sig)
+/**
+ * @brief SIGINT and SIGTERM only ask the reader to stop, what was read is
+ *        still decoded and written. A second signal doesn't wait for that.
+ */
+void stop_handler(int sig)
 {
-    fclose(fp);
-    exit(sig);
+    if(stop_requested)_exit(128 + sig);
+    stop_requested = 1;
 }
 
-int main(int argc, char **argv) 
+/**
+ * @brief Install stop_handler(). Without SA_RESTART a blocking read() or
+ *        epoll_wait() returns with EINTR in the thread that gets the signal.
+ */
+void install_stop_handler(sigset_t *signals)
 {
-	int i, bytes, total_bytes;
-	bool firsttime = true;
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigemptyset(signals);
+    sigaddset(signals, SIGINT);
+    sigaddset(signals, SIGTERM);
+}
+
+static u_int64_t clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (u_int64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double monotonic_seconds()
+{
+    return clock_ns(CLOCK_MONOTONIC) / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	int opt, res;
+	bool merged_output = false, legacy_input = false, little_endian = false, eof = false;
+	result_format_t format = RESULT_TEXT;
+	const char *input_names[PORT_SET_MAX_PORTS], *stats_name = NULL, *shm_name = NULL;
+	u_int64_t index_stride = 0, checkpoint_ns = 0, next_checkpoint_ns = 0;
+	size_t num_inputs = 0;
+	long threads = -1;
+	unsigned int baud = SERIAL_PORT_DEFAULT_BAUD;
+	static serial_port_t tty;
 	char filename[NUM_FILE_NAME_CHARACTERS];
+	double start, elapsed;
+	size_t block_bytes = DEFAULT_BLOCK_BYTES, ring_depth = DEFAULT_RING_DEPTH;
+	static frame_decoder_t decoder;
+	static frame_decoder_t *const decoders[] = {&decoder};
+	static result_pack_t pack;
+	static result_index_t index;
+	static checkpoint_slot_t checkpoint;
+	checkpoint_t resume_from, snapshot;
+	stats_t previous;
+	u_int32_t restarts = 0;
+	bool resumed = false;
+	long long trimmed;
+	reader_t reader = {STDIN_FILENO, false, false, &input_ring, 0, 0};
+	stats_reporter_t reporter = {stderr, DEFAULT_STATS_INTERVAL, decoders, 1, &reader, NULL, 0, true};
+	log_target_t target = {&out, -1, NULL, 0, NULL, NULL, NULL, 0};
+	pthread_t reader_tid, writer_tid, stats_tid;
+	sigset_t stop_signals;
+	stats_t totals;
+	static timing_t timing;
+	block_t *b;
+
+    while((opt = getopt(argc, argv, "ri:t:LEbcMP:B:D:s:S:R:W:Y:X:I:C:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'r': // Raw binary input instead of jpnevulator hex dump.
+                reader.raw = true;
+                break;
+            case 'i': // Read from file or tty instead of stdin, once per port.
+                if(num_inputs == PORT_SET_MAX_PORTS)
+                {
+                    printf("At most %d inputs!\n", PORT_SET_MAX_PORTS);
+                    return 0;
+                }
+                input_names[num_inputs++] = optarg;
+                reader.raw = true;
+                break;
+            case 't': // tty baud rate.
+                baud = strtoul(optarg, NULL, 0);
+                break;
+            case 'L': // Legacy input without length and CRC.
+                legacy_input = true;
+                break;
+            case 'E': // Samples little-endian on the wire.
+                little_endian = true;
+                break;
+            case 'b': // Binary results file.
+                format = RESULT_BINARY;
+                break;
+            case 'c': // Packed binary results file.
+                format = RESULT_PACKED;
+                break;
+            case 'M': // Several inputs, all results to one file.
+                merged_output = true;
+                break;
+            case 'P': // Decode a capture file with this many threads, 0 for all cores.
+                threads = strtol(optarg, NULL, 0);
+                break;
+            case 'B': // Pipeline block size in bytes.
+                block_bytes = strtoul(optarg, NULL, 0);
+                if(block_bytes < MIN_BLOCK_BYTES)block_bytes = MIN_BLOCK_BYTES;
+                break;
+            case 'D': // Pipeline ring depth in blocks.
+                ring_depth = strtoul(optarg, NULL, 0);
+                if(ring_depth < 2)ring_depth = 2;
+                break;
+            case 's': // Statistics to file instead of stderr.
+                stats_name = optarg;
+                break;
+            case 'S': // Statistics interval in seconds, 0 turns reports off.
+                reporter.interval = strtoul(optarg, NULL, 0);
+                break;
+            case 'R': // New results file after this many bytes (k, M, G).
+                writer.rotate_bytes = parse_size(optarg);
+                break;
+            case 'W': // New results file every this many seconds.
+                writer.rotate_ns = strtoull(optarg, NULL, 0) * 1000000000ULL;
+                break;
+            case 'Y': // fdatasync() results every this many seconds.
+                writer.sync_ns = strtoull(optarg, NULL, 0) * 1000000000ULL;
+                break;
+            case 'X': // Publish frames to this shared memory ring.
+                shm_name = optarg;
+                break;
+            case 'I': // Sidecar index with every this many frames.
+                index_stride = strtoull(optarg, NULL, 0);
+                if(index_stride == 0)index_stride = RESULT_INDEX_DEFAULT_STRIDE;
+                break;
+            case 'C': // Checkpoint every this many seconds, resume from it.
+                checkpoint_ns = strtoull(optarg, NULL, 0) * 1000000000ULL;
+                if(checkpoint_ns == 0)checkpoint_ns = DEFAULT_CHECKPOINT_INTERVAL * 1000000000ULL;
+                break;
+            default:
+                printf("Usage: %s [-r] [-i input]... [-t baud] [-L] [-E] [-b] [-c] [-M] [-P threads] [-B block-bytes] [-D ring-depth] [-s stats-file] [-S stats-seconds] [-R rotate-bytes] [-W rotate-seconds] [-Y sync-seconds] [-X /shm-name] [-I index-stride] [-C checkpoint-seconds] results-filename\n", argv[0]);
+                return 0;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        printf("No file name specified!\n");
+        return 0;
+    }
+    strncpy(filename, argv[optind], NUM_FILE_NAME_CHARACTERS - 1);
+    filename[NUM_FILE_NAME_CHARACTERS - 1] = '\0';
+    if (index_stride > 0 && format == RESULT_TEXT)index_stride = 1; // Text has no frame boundaries, result_seek finds them in the index.
+
+    if (stats_name != NULL)
+    {
+        reporter.fp = fopen(stats_name, "a");
+        if (!reporter.fp)
+        {
+            printf("Failed to open %s!\n", stats_name);
+            return 0;
+        }
+    }
+
+    if (threads >= 0)
+    {
+        if (num_inputs != 1)
+        {
+            printf("-P needs one capture file (-i)!\n");
+            return 0;
+        }
+        if (format == RESULT_PACKED)
+        {
+            printf("-c can't be used with -P!\n");
+            return 0;
+        }
+        if (shm_name != NULL)printf("-X is not used with -P.\n");
+        if (index_stride > 0)printf("-I is not used with -P.\n");
+        if (checkpoint_ns > 0)printf("-C is not used with -P.\n");
+        return run_chunks(input_names[0], filename, format, legacy_input, little_endian, (unsigned int)threads);
+    }
 
-    signal(SIGINT, sigint_handler);
+    install_stop_handler(&stop_signals);
+    if (shm_name != NULL)
+    {
+        if (frame_shm_create(&shm, shm_name, FRAME_SHM_DEFAULT_SLOTS) != 0)
+        {
+            printf("Failed to create shared memory %s: %s\n", shm_name, strerror(errno));
+            return 0;
+        }
+        printf("Publish frames to shared memory %s.\n", shm_name);
+        target.shm = &shm;
+    }
+    if (num_inputs > 1)
+    {
+        if (checkpoint_ns > 0)printf("-C is not used with several inputs.\n");
+        res = run_ports(input_names, num_inputs, filename, format, merged_output,
+                        legacy_input, little_endian, block_bytes, baud, &reporter, target.shm, index_stride);
+        if (target.shm != NULL)frame_shm_close(&shm);
+        return res;
+    }
 
-    *argv++; // Don't read our own name.
-    if (*argv == NULL)printf("No file name specified!");
-    else memmove(&filename, *argv, NUM_FILE_NAME_CHARACTERS);
-    
-    fp = fopen(filename, "a"); // Open the file again.
-    if (!fp)
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL); // Threads started from here on don't get them, only the reader, see reader_thread().
+    if (num_inputs == 1)
+    {
+        reader.fd = open(input_names[0], O_RDONLY | O_NOCTTY);
+        if (reader.fd < 0)
+        {
+            printf("Failed to open %s!\n", input_names[0]);
+            return 0;
+        }
+    }
+    reader.drop_when_full = isatty(reader.fd);
+    if (reader.drop_when_full)
+    {
+        if (setup_tty(&tty, reader.fd, num_inputs == 1 ? input_names[0] : "stdin", baud) != 0)return 0;
+        reader.raw = true; // Hex dump only comes through a pipe.
+        reporter.ttys = &tty;
+        reporter.num_ttys = 1;
+    }
+
+    if (block_ring_init(&input_ring, ring_depth, block_bytes) != 0
+        || block_ring_init(&output_ring, ring_depth, block_bytes) != 0)
+    {
+        printf("Out of memory!\n");
+        return 0;
+    }
+
+    if (index_stride > 0)
+    {
+        result_index_init(&index, index_stride);
+        target.index = &index;
+        writer.index = &index;
+    }
+    memset(&previous, 0, sizeof(previous));
+    if (checkpoint_ns > 0)
+    {
+        checkpoint_slot_init(&checkpoint, filename);
+        writer.checkpoint = &checkpoint;
+        if (checkpoint_load(checkpoint.name, &resume_from, !legacy_input) == 0)
+        {
+            resumed = true;
+            previous = resume_from.stats;
+            restarts = resume_from.restarts + 1;
+            trimmed = checkpoint_trim(&resume_from);
+            if (trimmed > 0)printf("Cut %lld bytes written after the checkpoint off %s.\n", trimmed, resume_from.results_name);
+            else if (trimmed < 0)printf("Failed to cut %s back to the checkpoint!\n", resume_from.results_name);
+        }
+        else if (access(checkpoint.name, F_OK) == 0)printf("%s is not a checkpoint of this input mode, start over.\n", checkpoint.name);
+    }
+    res = output_writer_init(&writer, filename, result_header(format));
+    if (res != 0)
+    {
+        if (res == -2)printf("%s is not a %s results file!\n", writer.file_name, format == RESULT_PACKED ? "packed" : "binary");
+        else printf("Failed to open %s!\n", writer.file_name);
+        return 0;
+    }
+    else printf("Write results to %s.\n", writer.file_name);
+    output_init_ring(&out, -1, &output_ring); // The writer thread has the file.
+    realtime_offset_ns = clock_ns(CLOCK_REALTIME) - clock_ns(CLOCK_MONOTONIC);
+
+    if (format == RESULT_PACKED)
+    {
+        result_pack_init(&pack);
+        target.pack = &pack;
+    }
+    frame_decoder_init(&decoder, !legacy_input, result_handler(format), &target);
+    decoder.little_endian = little_endian;
+    if (resumed)
+    {
+        checkpoint_resume(&decoder, &resume_from, realtime_offset_ns);
+        printf("Resume from %s: frame %llu on, saved %.1f s ago, restart %u.\n", checkpoint.name,
+               (unsigned long long)resume_from.next_index, (clock_ns(CLOCK_REALTIME) - resume_from.saved_ns) / 1e9, restarts);
+        checkpoint_mark_restart(&decoder, clock_ns(CLOCK_MONOTONIC));
+    }
+    start = monotonic_seconds();
+    pthread_create(&writer_tid, NULL, writer_thread, &writer);
+    pthread_create(&reader_tid, NULL, reader_thread, &reader);
+    if(reporter.interval > 0)pthread_create(&stats_tid, NULL, stats_thread, &reporter);
+
+    // Decoder stage runs on the main thread.
+    while(!eof)
+    {
+        b = block_ring_peek(&input_ring);
+        if(b->flags & BLOCK_FLAG_DISCONTINUITY)frame_decoder_resync(&decoder);
+        decoder.block_ns = b->time_ns;
+        if(b->len > 0)frame_decode_block(&decoder, b->data, b->len);
+        eof = b->flags & BLOCK_FLAG_EOF;
+        block_ring_release(&input_ring);
+        if(checkpoint_ns > 0 && decoder.block_ns >= next_checkpoint_ns)
+        {
+            // Every frame of the snapshot is in the output stream before written + len.
+            take_checkpoint(&snapshot, &reporter, &previous, restarts, decoder.block_ns);
+            checkpoint_offer(&checkpoint, &snapshot, out.written + out.len);
+            next_checkpoint_ns = decoder.block_ns + checkpoint_ns;
+        }
+    }
+    frame_decoder_finish(&decoder);
+    output_close(&out);
+    pthread_join(reader_tid, NULL);
+    pthread_join(writer_tid, NULL);
+    if(checkpoint_ns > 0)
+    {
+        // All output is written, the last state goes straight to the file.
+        take_checkpoint(&snapshot, &reporter, &previous, restarts, clock_ns(CLOCK_MONOTONIC));
+        checkpoint_locate(&snapshot, writer.file_name, writer.file_bytes);
+        if(checkpoint_save(checkpoint.name, &snapshot) == 0)checkpoint.saved++;
+        else checkpoint.errors++;
+    }
+    elapsed = monotonic_seconds() - start;
+    if(reporter.interval > 0)
+    {
+        __atomic_store_n(&reporter.running, false, __ATOMIC_RELAXED);
+        pthread_join(stats_tid, NULL);
+    }
+
+    // End of input, report how fast it was consumed.
+    stats_collect(&reporter, &totals);
+    printf("Parsed %llu bytes in %.3f s (%.2f MB/s)\n", (unsigned long long)totals.bytes, elapsed,
+           elapsed > 0 ? totals.bytes / elapsed / 1e6 : 0.0);
+    print_totals("", &totals);
+    timing_collect(&reporter, &timing);
+    timing_print(stdout, "", &timing);
+    printf("Pipeline: input ring full %llu times, %llu blocks (%llu bytes) dropped, output ring full %llu times, %llu write errors\n",
+           (unsigned long long)input_ring.full_waits.load(), (unsigned long long)reader.dropped_blocks,
+           (unsigned long long)reader.dropped_bytes, (unsigned long long)output_ring.full_waits.load(),
+           (unsigned long long)writer.errors);
+    if (format == RESULT_PACKED)print_packed(out.written, totals.frames);
+    if (index_stride > 0 && index.dropped > 0)printf("Index: %llu entries dropped, writer was behind\n", (unsigned long long)index.dropped);
+    if (checkpoint_ns > 0)printf("Checkpoint %s: saved %llu times, %llu errors\n", checkpoint.name,
+                                 (unsigned long long)checkpoint.saved, (unsigned long long)checkpoint.errors);
+    if (resumed)print_totals("Since the first start: ", &snapshot.stats);
+    if (output_writer_rotates(&writer))printf("Results in %llu files, last %s\n", (unsigned long long)writer.files, writer.file_name);
+    if (stop_requested)printf("Stopped by signal, all input read was written.\n");
+    if (target.shm != NULL)frame_shm_close(&shm);
+    block_ring_free(&input_ring);
+    block_ring_free(&output_ring);
+	return 0;
+}
+
+/**
+ * @brief Several receivers, all ports are read and decoded on this thread
+ *        with epoll. Results are written straight from the decoder without
+ *        the rings, one results file per port or one for all (merged_output).
+ */
+int run_ports(const char *const *input_names, size_t num_inputs, const char *filename, result_format_t format,
+              bool merged_output, bool legacy_input, bool little_endian, size_t block_bytes, unsigned int baud, stats_reporter_t *reporter,
+              frame_shm_writer_t *shm, u_int64_t index_stride)
+{
+    static frame_decoder_t *decoders[PORT_SET_MAX_PORTS];
+    static serial_port_t ttys[PORT_SET_MAX_PORTS];
+    size_t num_ttys = 0;
+    static output_buffer_t outs[PORT_SET_MAX_PORTS];
+    static log_target_t targets[PORT_SET_MAX_PORTS];
+    static result_pack_t packs[PORT_SET_MAX_PORTS];
+    static result_index_t indexes[PORT_SET_MAX_PORTS];
+    static result_index_file_t index_files[PORT_SET_MAX_PORTS];
+    u_int64_t index_bases[PORT_SET_MAX_PORTS];
+    u_int64_t out_bytes = 0;
+    char name[NUM_FILE_NAME_CHARACTERS + 8];
+    char prefix[NUM_FILE_NAME_CHARACTERS + 16];
+    size_t i, num_outputs = merged_output ? 1 : num_inputs;
+    port_set_t ports;
+    pthread_t stats_tid;
+    stats_t totals;
+    static timing_t timing;
+    double start, elapsed;
+    int fd;
+
+    if(port_set_init(&ports, block_bytes) != 0)
+    {
+        printf("Failed to set up epoll!\n");
+        return 0;
+    }
+
+    realtime_offset_ns = clock_ns(CLOCK_REALTIME) - clock_ns(CLOCK_MONOTONIC);
+    for(i = 0; i < num_outputs; i++)
+    {
+        if(merged_output)snprintf(name, sizeof(name), "%s", filename);
+        else snprintf(name, sizeof(name), "%s.%u", filename, (unsigned int)i);
+        fd = open(name, O_RDWR | O_CREAT | O_APPEND, 0644);
+        if(fd < 0 || output_init(&outs[i], fd, OUTPUT_BUFFER_BYTES) != 0)
+        {
+            printf("Failed to open %s!\n", name);
+            return 0;
+        }
+        else printf("Write results to %s.\n", name);
+        if(result_header(format) != NULL && result_header(format)(fd) != 0)
+        {
+            printf("%s is not a %s results file!\n", name, format == RESULT_PACKED ? "packed" : "binary");
+            return 0;
+        }
+        result_pack_init(&packs[i]);
+        index_bases[i] = lseek(fd, 0, SEEK_END);
+        index_files[i].fd = -1;
+        if(index_stride > 0 && result_index_file_open(&index_files[i], name, index_stride) != 0)
+        {
+            printf("Failed to open %s!\n", index_files[i].name);
+            return 0;
+        }
+    }
+
+    for(i = 0; i < num_inputs; i++)
+    {
+        fd = open(input_names[i], O_RDONLY | O_NOCTTY);
+        decoders[i] = (frame_decoder_t*)aligned_alloc(alignof(frame_decoder_t), sizeof(frame_decoder_t)); // frame.samples is aligned.
+        if(fd < 0 || decoders[i] == NULL)
+        {
+            printf("Failed to open %s!\n", input_names[i]);
+            return 0;
+        }
+        if(isatty(fd) && setup_tty(&ttys[num_ttys++], fd, input_names[i], baud) != 0)return 0;
+        targets[i].out = &outs[merged_output ? 0 : i];
+        targets[i].port = merged_output ? (int)i : -1;
+        targets[i].shm = shm;
+        targets[i].input = (u_int16_t)i;
+        targets[i].pack = format == RESULT_PACKED ? &packs[merged_output ? 0 : i] : NULL;
+        if(index_stride > 0)
+        {
+            result_index_init(&indexes[i], index_stride);
+            targets[i].index = &indexes[i];
+            targets[i].index_file = &index_files[merged_output ? 0 : i];
+            targets[i].index_base = index_bases[merged_output ? 0 : i];
+        }
+        frame_decoder_init(decoders[i], !legacy_input, result_handler(format), &targets[i]);
+        decoders[i]->little_endian = little_endian;
+        if(port_set_add(&ports, input_names[i], fd, decoders[i]) != 0)
+        {
+            printf("Can't poll %s!\n", input_names[i]);
+            return 0;
+        }
+    }
+
+    reporter->decoders = decoders;
+    reporter->num_decoders = num_inputs;
+    reporter->reader = NULL;
+    reporter->ttys = ttys;
+    reporter->num_ttys = num_ttys;
+    start = monotonic_seconds();
+    if(reporter->interval > 0)pthread_create(&stats_tid, NULL, stats_thread, reporter);
+
+    ports.stop = &stop_requested;
+    port_set_run(&ports);
+
+    for(i = 0; i < num_outputs; i++)
+    {
+        output_close(&outs[i]);
+        out_bytes += outs[i].written;
+        result_index_file_close(&index_files[i]);
+    }
+    elapsed = monotonic_seconds() - start;
+    if(reporter->interval > 0)
+    {
+        __atomic_store_n(&reporter->running, false, __ATOMIC_RELAXED);
+        pthread_join(stats_tid, NULL);
+    }
+
+    // End of input, report every port and the sum.
+    for(i = 0; i < num_inputs; i++)
+    {
+        memset(&totals, 0, sizeof(totals));
+        stats_add(&totals, &decoders[i]->stats);
+        snprintf(prefix, sizeof(prefix), "Port %u %s: ", (unsigned int)i, input_names[i]);
+        print_totals(prefix, &totals);
+        timing_print(stdout, prefix, &decoders[i]->timing);
+    }
+    stats_collect(reporter, &totals);
+    printf("Parsed %llu bytes from %u ports in %.3f s (%.2f MB/s)\n", (unsigned long long)totals.bytes,
+           (unsigned int)num_inputs, elapsed, elapsed > 0 ? totals.bytes / elapsed / 1e6 : 0.0);
+    print_totals("", &totals);
+    timing_collect(reporter, &timing);
+    timing_print(stdout, "", &timing);
+    if(format == RESULT_PACKED)print_packed(out_bytes, totals.frames);
+    for(i = 0; i < num_inputs; i++)free(decoders[i]);
+    port_set_free(&ports);
+    return 0;
+}
+
+/**
+ * @brief Offline mode. The capture is mapped and split into one chunk per
+ *        thread, every chunk is decoded once. The first chunk writes straight
+ *        to the results file, the others to temporary files that are appended
+ *        in order when all are done, with frame numbers counted on from the
+ *        chunks before. Frame reports are collected per chunk and printed in
+ *        order.
+ */
+int run_chunks(const char *input_name, const char *filename, result_format_t format, bool legacy_input, bool little_endian,
+               unsigned int threads)
+{
+    static chunk_job_t jobs[MAX_THREADS];
+    pthread_t tids[MAX_THREADS];
+    const u_int8_t *data;
+    size_t len, i, num_jobs, boundary, prime, from;
+    u_int64_t frames = 0;
+    off_t offset;
+    stats_t totals;
+    struct stat st;
+    double start, elapsed;
+    int in_fd, out_fd;
+
+    in_fd = open(input_name, O_RDONLY);
+    if(in_fd < 0 || fstat(in_fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        printf("Failed to open %s, -P needs a capture file!\n", input_name);
+        return 0;
+    }
+    len = st.st_size;
+    data = (const u_int8_t*)mmap(NULL, len > 0 ? len : 1, PROT_READ, MAP_PRIVATE, in_fd, 0);
+    close(in_fd);
+    if(data == MAP_FAILED)
+    {
+        printf("Failed to map %s!\n", input_name);
+        return 0;
+    }
+    madvise((void*)data, len, MADV_SEQUENTIAL);
+
+    out_fd = open(filename, O_RDWR | O_CREAT, 0644);
+    if(out_fd < 0)
     {
         printf("Failed to open %s!\n", filename);
         return 0;
     }
     else printf("Write results to %s.\n", filename);
-    
-    
-    bytes=0;
-    while(1)
-	{
-		if(scanf("%x ", &i))
-		{
-    	    // Write byte to token discovery buffer and check if we have a token.
-			if(token_received(i))
-			{
-			    if(firsttime)
-			    {
-			        logging_enabled = true;
-			        firsttime = false;
-			    }
-			    flush_token_count = 0;
-			    data_element_count = 2;
-			    count_3_elements = 1;
-			    //printf("Token - %u bytes received before token (including token).\n", bytes);
-			    bytes = 0;
-			}
-			else ;
-			bytes++;
-			total_bytes++;
-			write_to_log();
-			if(total_bytes%100000 == 0)printf("Bytes received so far %u\n", total_bytes);
-		}
-	}
-	return 0;
+    if(format == RESULT_BINARY && write_binary_header(out_fd) != 0)
+    {
+        printf("%s is not a binary results file!\n", filename);
+        return 0;
+    }
+    offset = lseek(out_fd, 0, SEEK_END);
+
+    if(threads == 0)threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if(threads > MAX_THREADS)threads = MAX_THREADS;
+    if(threads > len / MIN_CHUNK_BYTES)threads = len / MIN_CHUNK_BYTES;
+    if(threads < 1)threads = 1;
+
+    // Chunk boundaries near equal parts, a part without one joins the chunk before.
+    memset(jobs, 0, sizeof(jobs));
+    num_jobs = 1;
+    for(i = 1; i < threads; i++)
+    {
+        from = len / threads * i;
+        if(from <= jobs[num_jobs - 1].start)from = jobs[num_jobs - 1].start + 1;
+        if(capture_find_boundary(data, len, from, len / threads * (i + 1), !legacy_input, &boundary, &prime))
+        {
+            jobs[num_jobs].start = boundary;
+            jobs[num_jobs].prime = prime;
+            num_jobs++;
+        }
+    }
+    for(i = 0; i < num_jobs; i++)
+    {
+        jobs[i].data = data;
+        jobs[i].data_len = len;
+        jobs[i].end = i + 1 < num_jobs ? jobs[i + 1].start : len;
+        jobs[i].framed = !legacy_input;
+        jobs[i].little_endian = little_endian;
+        jobs[i].binary_output = format == RESULT_BINARY;
+        jobs[i].out_fd = i == 0 ? out_fd : open_chunk_file(filename);
+        jobs[i].out_offset = i == 0 ? offset : 0;
+        if(jobs[i].out_fd < 0)
+        {
+            printf("Failed to create a temporary file next to %s: %s\n", filename, strerror(errno));
+            return 0;
+        }
+    }
+
+    realtime_offset_ns = 0; // No arrival times in a capture.
+    start = monotonic_seconds();
+    for(i = 0; i < num_jobs; i++)pthread_create(&tids[i], NULL, chunk_thread, &jobs[i]);
+    for(i = 0; i < num_jobs; i++)pthread_join(tids[i], NULL);
+
+    // Chunks after the first one follow it in order.
+    for(i = 0; i < num_jobs; i++)
+    {
+        jobs[i].index_base = frames;
+        frames += jobs[i].frames;
+        if(i > 0)
+        {
+            if(append_chunk(&jobs[i], out_fd, offset) != 0)printf("Failed to append chunk %zu to %s: %s\n", i, filename, strerror(errno));
+            close(jobs[i].out_fd);
+        }
+        offset += jobs[i].out_bytes;
+    }
+    elapsed = monotonic_seconds() - start;
+    close(out_fd);
+
+    memset(&totals, 0, sizeof(totals));
+    for(i = 0; i < num_jobs; i++)
+    {
+        print_chunk_log(jobs[i].log, jobs[i].log_len, jobs[i].index_base);
+        free(jobs[i].log);
+        stats_add(&totals, &jobs[i].stats);
+    }
+    munmap((void*)data, len > 0 ? len : 1);
+
+    printf("Parsed %llu bytes in %.3f s (%.2f MB/s) with %u threads\n", (unsigned long long)totals.bytes, elapsed,
+           elapsed > 0 ? totals.bytes / elapsed / 1e6 : 0.0, (unsigned int)num_jobs);
+    print_totals("", &totals);
+    return 0;
+}
+
+/**
+ * @brief Offline mode, decodes one chunk. A framed decoder gets a frame
+ *        length more than the chunk, so a frame check near the end sees
+ *        the same bytes as in a sequential run, but stops at the chunk end.
+ */
+void* chunk_thread(void *arg)
+{
+    chunk_job_t *j = (chunk_job_t*)arg;
+    frame_decoder_t *d = (frame_decoder_t*)aligned_alloc(alignof(frame_decoder_t), sizeof(frame_decoder_t)); // frame.samples is aligned.
+    size_t end = j->end;
+    FILE *log;
+
+    output_init_at(&j->out, j->out_fd, OUTPUT_BUFFER_BYTES, j->out_offset);
+    j->target.out = &j->out;
+    j->target.port = -1;
+    frame_decoder_init(d, j->framed, j->binary_output ? write_to_log_binary : write_to_log, &j->target);
+    log = open_memstream(&j->log, &j->log_len);
+    d->log = log;
+    d->little_endian = j->little_endian;
+    if(j->start > 0)frame_decoder_prime(d, j->data + j->prime, j->start - j->prime, j->start);
+
+    if(j->framed && end < j->data_len)
+    {
+        d->stop_offset = end;
+        end = j->data_len - end < SERIAL_FRAME_MAX_WIRE_LEN ? j->data_len : end + SERIAL_FRAME_MAX_WIRE_LEN;
+    }
+    frame_decode_block(d, j->data + j->start, end - j->start);
+    frame_decoder_finish(d);
+
+    j->frames = counter_get(&d->stats.frames);
+    j->stats = d->stats;
+    j->stats.bytes = j->end - j->start;
+    output_close(&j->out);
+    j->out_bytes = j->out.written;
+    fclose(log);
+    free(d);
+    return NULL;
 }
 
-bool token_received(int i)
+/**
+ * @brief Offline mode, unnamed temporary file for the results of a chunk,
+ *        in the directory of filename so appending it stays on one file
+ *        system. Gone when closed.
+ * @return file descriptor, -1 on error.
+ */
+int open_chunk_file(const char *filename)
 {
-    u_int8_t k;
-    
-    if(count_to_4 >= 0 )token[count_to_4--] = (u_int8_t) i; // Only first 4 bytes end up here.
-    else
+    char dir[NUM_FILE_NAME_CHARACTERS], path[NUM_FILE_NAME_CHARACTERS + 32];
+    const char *slash = strrchr(filename, '/');
+    int fd;
+
+    if(slash == NULL)strcpy(dir, ".");
+    else snprintf(dir, sizeof(dir), "%.*s", (int)(slash - filename) + 1, filename);
+#ifdef O_TMPFILE
+    fd = open(dir, O_TMPFILE | O_RDWR, 0600);
+    if(fd >= 0)return fd;
+#endif
+    // File systems without O_TMPFILE.
+    snprintf(path, sizeof(path), "%s/.pars_chunk_XXXXXX", dir);
+    fd = mkstemp(path);
+    if(fd >= 0)unlink(path);
+    return fd;
+}
+
+/**
+ * @brief Offline mode, results of a chunk from its temporary file to the
+ *        results file at offset. Binary records get the frames of the chunks
+ *        before added to their index. Text is copied in the kernel where the
+ *        file system can.
+ * @return 0 on success, -1 on I/O error.
+ */
+int append_chunk(const chunk_job_t *j, int out_fd, off_t offset)
+{
+    static result_record_t records[OUTPUT_BUFFER_BYTES / sizeof(result_record_t)];
+    off_t in_offset = 0;
+    ssize_t n = 0, k;
+
+    if(!j->binary_output)
     {
-        // Shift all bytes in token buffer to the right.
-        for(k=(NUM_TOKEN_BYTES-1);k>0;k--)token[k] = token[k-1];
-        token[k] = (u_int8_t) i;
+        while((u_int64_t)in_offset < j->out_bytes
+              && (n = copy_file_range(j->out_fd, &in_offset, out_fd, &offset, j->out_bytes - in_offset, 0)) > 0);
+        if(n < 0 && errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP)return -1;
     }
-    return *(u_int32_t*)token == 0xDEADBEEF;
+    // Binary records, or text copy_file_range() can't do.
+    while((u_int64_t)in_offset < j->out_bytes)
+    {
+        n = pread(j->out_fd, records, sizeof(records), in_offset);
+        if(n <= 0)return -1;
+        for(k = 0; j->binary_output && k < n / (ssize_t)sizeof(result_record_t); k++)records[k].index += j->index_base;
+        if(pwrite_all(out_fd, records, n, offset) != 0)return -1;
+        in_offset += n;
+        offset += n;
+    }
+    return 0;
 }
 
-void write_to_log()
+/**
+ * @brief Offline mode, frame reports of a chunk to stdout with its frame
+ *        numbers counted on from index_base.
+ */
+void print_chunk_log(const char *log, size_t len, u_int64_t index_base)
 {
-    if(logging_enabled)
+    const char *p = log, *end = log + len, *line_end;
+    unsigned long long index;
+    char *num_end;
+
+    while(p < end)
     {
-        if(flush_token_count == NUM_TOKEN_BYTES) // Avoid writing token to output.
+        line_end = (const char*)memchr(p, '\n', end - p);
+        line_end = line_end != NULL ? line_end + 1 : end;
+        if(index_base > 0 && line_end - p > 6 && memcmp(p, "Frame ", 6) == 0)
         {
-            if(data_element_count == NUM_DATA_ELEMENT_BYTES) // Avoid writing single bytes to output, write whole element.
+            index = strtoull(p + 6, &num_end, 10);
+            if(*num_end == ':')
             {
-                if(count_3_elements < 3) // Write count_3_elements elements on one line.
-                {
-                    fprintf(fp, "%u ", *((u_int16_t*)token+1));
-                    count_3_elements++;
-                }
-                else // End the line.
-                {
-                    fprintf(fp, "%u\n", *((u_int16_t*)token+1));
-                    count_3_elements = 1;
-                }
-                data_element_count = 1;
+                printf("Frame %llu", index + index_base);
+                p = num_end;
             }
-            else data_element_count++; // Count to NUM_DATA_ELEMENT_BYTES.
         }
-        else flush_token_count++; // Counting to NUM_TOKEN_BYTES.
+        fwrite(p, 1, line_end - p, stdout);
+        p = line_end;
+    }
+}
+
+/**
+ * @brief Reader stage. Reads blocks of raw bytes or hex text from input and
+ *        passes them to the decoder. Never waits for the decoder when reading
+ *        a tty, if the ring is full the data is dropped and the next block is
+ *        marked as a discontinuity.
+ */
+void* reader_thread(void *arg)
+{
+    reader_t *r = (reader_t*)arg;
+    size_t size = r->ring->block_size;
+    char *text = (char*)malloc(size);
+    bool dropped = false;
+    hex_input_t hex;
+    sigset_t signals;
+    block_t *b;
+    ssize_t n;
+
+    // A stop signal interrupts read(), the pipeline then drains as at end of input.
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_UNBLOCK, &signals, NULL);
+
+    hex_input_init(&hex);
+    while(!stop_requested)
+    {
+        b = block_ring_try_acquire(r->ring);
+        if(b == NULL && !r->drop_when_full)b = block_ring_acquire(r->ring);
+
+        // Raw bytes go straight to the block. Hex text is read to a side buffer,
+        // it turns into at most one byte for every two characters.
+        n = read(r->fd, (b != NULL && r->raw) ? (char*)b->data : text, size);
+        if(n < 0 && errno == EINTR)continue;
+        if(n < 0 && errno != EIO)printf("Read error %d!\n", errno); // EIO is a hung up tty.
+        if(n <= 0)break; // End of input.
+
+        if(b == NULL)
+        {
+            counter_add(&r->dropped_blocks, 1);
+            counter_add(&r->dropped_bytes, n);
+            hex_input_init(&hex);
+            dropped = true;
+            continue;
+        }
+        b->time_ns = clock_ns(CLOCK_MONOTONIC);
+        b->len = r->raw ? (size_t)n : hex_input_convert(&hex, text, n, b->data);
+        if(dropped)b->flags |= BLOCK_FLAG_DISCONTINUITY;
+        dropped = false;
+        block_ring_publish(r->ring);
+    }
+
+    // Tell the decoder there is nothing more.
+    b = block_ring_acquire(r->ring);
+    b->time_ns = clock_ns(CLOCK_MONOTONIC);
+    b->len = r->raw ? 0 : hex_input_finish(&hex, b->data);
+    b->flags = BLOCK_FLAG_EOF | (dropped ? BLOCK_FLAG_DISCONTINUITY : 0);
+    block_ring_publish(r->ring);
+    free(text);
+    return NULL;
+}
+
+/**
+ * @brief Writer stage, the only place results file I/O happens.
+ */
+void* writer_thread(void *arg)
+{
+    output_writer_t *w = (output_writer_t*)arg;
+
+    output_writer_run(w, &output_ring);
+    return NULL;
+}
+
+/**
+ * @brief Statistics stage, wakes up every interval and reports the change
+ *        of the counters, like statistics_loop() on the receiver.
+ */
+void* stats_thread(void *arg)
+{
+    stats_reporter_t *s = (stats_reporter_t*)arg;
+    stats_t prev, now;
+    static timing_t prev_timing, now_timing;
+    struct timespec next;
+    sigset_t signals;
+
+    u_int64_t next_ns = clock_ns(CLOCK_MONOTONIC), now_ns;
+
+    // Stop signals are for the thread that reads input.
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    stats_collect(s, &prev);
+    timing_collect(s, &prev_timing);
+    for(;;)
+    {
+        next_ns += s->interval * 1000000000ULL;
+        // Sleep in short steps so that the end of input is not held up.
+        while((now_ns = clock_ns(CLOCK_MONOTONIC)) < next_ns)
+        {
+            if(!__atomic_load_n(&s->running, __ATOMIC_RELAXED))return NULL;
+            next.tv_sec = 0;
+            next.tv_nsec = next_ns - now_ns < STATS_POLL_NS ? next_ns - now_ns : STATS_POLL_NS;
+            nanosleep(&next, NULL);
+        }
+        stats_collect(s, &now);
+        stats_print_interval(s->fp, s->interval, &now, &prev);
+        prev = now;
+        timing_collect(s, &now_timing);
+        timing_print_interval(s->fp, &now_timing, &prev_timing);
+        prev_timing = now_timing;
+    }
+}
+
+void stats_collect(const stats_reporter_t *s, stats_t *st)
+{
+    u_int64_t overruns, line_errors;
+    size_t i;
+
+    memset(st, 0, sizeof(*st));
+    for(i = 0; i < s->num_decoders; i++)stats_add(st, &s->decoders[i]->stats);
+    if(s->reader != NULL)st->dropped_bytes += counter_get(&s->reader->dropped_bytes);
+    for(i = 0; i < s->num_ttys; i++)
+    {
+        serial_port_errors(&s->ttys[i], &overruns, &line_errors);
+        st->tty_overruns += overruns;
+        st->tty_line_errors += line_errors;
+    }
+}
+
+void timing_collect(const stats_reporter_t *s, timing_t *t)
+{
+    size_t i;
+
+    memset(t, 0, sizeof(*t));
+    for(i = 0; i < s->num_decoders; i++)timing_add(t, &s->decoders[i]->timing);
+}
+
+void print_totals(const char *prefix, const stats_t *t)
+{
+    printf("%s%llu frames, %llu messages lost, %llu partial, %llu sequence breaks, %llu triples lost, %llu CRC errors, %llu resyncs\n",
+           prefix, (unsigned long long)t->frames, (unsigned long long)t->lost_messages,
+           (unsigned long long)t->partial_frames, (unsigned long long)t->sequence_breaks,
+           (unsigned long long)t->lost_triples, (unsigned long long)t->crc_errors,
+           (unsigned long long)t->resyncs);
+    if(t->corrupt_frames)
+    {
+        printf("%s%llu corrupted samples in %llu frames\n", prefix,
+               (unsigned long long)t->corrupt_samples, (unsigned long long)t->corrupt_frames);
+    }
+    if(t->tty_overruns || t->tty_line_errors)
+    {
+        printf("%stty lost bytes: %llu overruns, %llu framing/parity errors\n", prefix,
+               (unsigned long long)t->tty_overruns, (unsigned long long)t->tty_line_errors);
+    }
+    if(t->receiver_reports)
+    {
+        printf("%sReceiver: %llu reports (%llu lost), %llu messages received, %llu lost on radio, %llu dropped, %llu UART stalls\n",
+               prefix, (unsigned long long)t->receiver_reports, (unsigned long long)t->receiver_reports_lost,
+               (unsigned long long)t->receiver_received, (unsigned long long)t->radio_lost,
+               (unsigned long long)t->receiver_dropped, (unsigned long long)t->uart_stalls);
+        printf("%sMessages lost: %llu on radio, %llu in receiver, %llu on serial line or host\n", prefix,
+               (unsigned long long)t->radio_lost, (unsigned long long)t->receiver_dropped,
+               (unsigned long long)stats_serial_lost(t));
+    }
+}
+
+/**
+ * @brief Snapshot of the single port decoder, with the counters of the runs
+ *        before (previous) added.
+ */
+void take_checkpoint(checkpoint_t *c, const stats_reporter_t *s, const stats_t *previous, u_int32_t restarts, u_int64_t now_ns)
+{
+    stats_t totals;
+
+    stats_collect(s, &totals);
+    stats_add(&totals, previous);
+    checkpoint_take(c, s->decoders[0], &totals, restarts, now_ns, realtime_offset_ns);
+}
+
+/**
+ * @brief Raw mode and baud rate for a tty input.
+ * @return 0 on success, -1 if the port can't be set up.
+ */
+int setup_tty(serial_port_t *tty, int fd, const char *name, unsigned int baud)
+{
+    if(serial_port_setup(tty, fd, baud) != 0)
+    {
+        printf("Failed to set up %s at %u baud (%s)!\n", name, baud, strerror(errno));
+        return -1;
+    }
+    printf("%s at %u baud%s.\n", name, tty->baud, tty->has_icount ? "" : ", no error counters");
+    return 0;
+}
+
+/**
+ * @brief Write frame samples to results file, three samples (x y z) on one line.
+ *        A restart record is a comment line.
+ */
+void write_to_log(frame_decoder_t *d, const frame_t *f)
+{
+    log_target_t *t = (log_target_t*)d->user;
+    char *p;
+
+    if(t->index != NULL)index_frame(t, f);
+    if(f->flags & FRAME_FLAG_RESTART)
+    {
+        p = output_reserve(t->out, 64);
+        output_commit(t->out, snprintf(p, 64, "# restart, frame %llu\n", (unsigned long long)f->index));
+    }
+    else if(t->port < 0)output_samples_text(t->out, f->samples, f->num_samples);
+    else output_samples_text_port(t->out, (u_int16_t)t->port, f->samples, f->num_samples);
+    if(t->shm != NULL)frame_shm_publish(t->shm, f, t->input, realtime_offset_ns);
+}
+
+/**
+ * @brief Write frame to binary results file as one fixed size record.
+ */
+void write_to_log_binary(frame_decoder_t *d, const frame_t *f)
+{
+    log_target_t *t = (log_target_t*)d->user;
+    result_record_t rec;
+
+    if(t->index != NULL)index_frame(t, f);
+    result_record_fill(&rec, f, t->port < 0 ? 0 : (u_int16_t)t->port, realtime_offset_ns);
+    output_write(t->out, &rec, sizeof(rec));
+    if(t->shm != NULL)frame_shm_publish(t->shm, f, t->input, realtime_offset_ns);
+}
+
+/**
+ * @brief Write frame packed, see result_pack.h. The first frame of every
+ *        output block is a key frame, so rotated files decode on their own.
+ */
+void write_to_log_packed(frame_decoder_t *d, const frame_t *f)
+{
+    log_target_t *t = (log_target_t*)d->user;
+    result_record_t rec;
+    char *p;
+
+    if(t->index != NULL)index_frame(t, f);
+    result_record_fill(&rec, f, t->port < 0 ? 0 : (u_int16_t)t->port, realtime_offset_ns);
+    p = output_reserve(t->out, RESULT_PACK_MAX_BYTES);
+    if(t->out->len == 0)result_pack_new_block(t->pack);
+    output_commit(t->out, result_pack_frame(t->pack, p, &rec));
+    if(t->shm != NULL)frame_shm_publish(t->shm, f, t->input, realtime_offset_ns);
+}
+
+/**
+ * @brief Sidecar index entry for every stride-th frame, before the frame is
+ *        written. written + len of the output buffer is where it starts in
+ *        the output stream, a flush doesn't change that. A packed frame
+ *        there is a key frame.
+ */
+void index_frame(log_target_t *t, const frame_t *f)
+{
+    result_index_entry_t e;
+
+    if(!result_index_due(t->index, f->index))return;
+    result_index_mark(t->index, &e, f->index, f->arrival_ns + realtime_offset_ns,
+                      t->index_base + t->out->written + t->out->len, t->port < 0 ? 0 : (u_int16_t)t->port,
+                      t->index_file == NULL);
+    if(t->index_file != NULL)result_index_file_add(t->index_file, &e);
+    if(t->pack != NULL)result_pack_new_block(t->pack);
+}
+
+frame_handler_t result_handler(result_format_t format)
+{
+    if(format == RESULT_BINARY)return write_to_log_binary;
+    if(format == RESULT_PACKED)return write_to_log_packed;
+    return write_to_log;
+}
+
+output_file_start_t result_header(result_format_t format)
+{
+    if(format == RESULT_BINARY)return write_binary_header;
+    if(format == RESULT_PACKED)return write_packed_header;
+    return NULL;
+}
+
+/**
+ * @brief A new results file gets header, an old one is appended to if its
+ *        header passes valid.
+ * @return 0 on success, -1 if fd is a different kind of file.
+ */
+static int write_header(int fd, const result_file_header_t *header, bool (*valid)(const result_file_header_t *h))
+{
+    result_file_header_t old;
+    struct stat st;
+
+    if(fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        if(pread(fd, &old, sizeof(old), 0) != sizeof(old))return -1;
+        return valid(&old) ? 0 : -1;
+    }
+    return pwrite_all(fd, header, sizeof(*header), 0);
+}
+
+int write_binary_header(int fd)
+{
+    result_file_header_t header;
+
+    result_file_header_init(&header, clock_ns(CLOCK_REALTIME));
+    return write_header(fd, &header, result_file_header_valid);
+}
+
+int write_packed_header(int fd)
+{
+    result_file_header_t header;
+
+    result_pack_header_init(&header, clock_ns(CLOCK_REALTIME));
+    return write_header(fd, &header, result_pack_header_valid);
+}
+
+/**
+ * @brief How small the packed results came out.
+ */
+void print_packed(u_int64_t bytes, u_int64_t frames)
+{
+    printf("Packed results: %llu bytes, %.1f bytes per frame (%.1f times smaller than -b)\n", (unsigned long long)bytes,
+           frames > 0 ? (double)bytes / frames : 0.0, bytes > 0 ? (double)frames * sizeof(result_record_t) / bytes : 0.0);
+}
+
+/**
+ * @brief Byte count with an optional k, M or G (powers of 1024).
+ */
+u_int64_t parse_size(const char *s)
+{
+    char *end;
+    u_int64_t n = strtoull(s, &end, 0);
+
+    switch(*end)
+    {
+        case 'k': case 'K': return n << 10;
+        case 'm': case 'M': return n << 20;
+        case 'g': case 'G': return n << 30;
+        default: return n;
     }
-    else ; // Waiting for first token.
 }
-    
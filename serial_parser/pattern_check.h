@@ -0,0 +1,145 @@
+/**
+ * @file pattern_check.h
+ *
+ * @brief Checks every sample of a frame against the test pattern of the
+ *        sender (write_new_data() in sender_main.c): x counts up, y counts
+ *        down, both wrap around at 0xFFFF, z is always 127.
+ *
+ *        The expected frame is built from the first triple and a table of
+ *        per-sample steps, then compared with whole vectors (AVX2 or SSE2,
+ *        plain loop otherwise). The result is a bit mask of the samples that
+ *        differ, bit i for samples[i].
+ *
+ * @license MIT
+ */
+
+#ifndef PATTERN_CHECK_H_
+#define PATTERN_CHECK_H_
+
+#include <sys/types.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define PATTERN_SAMPLES             48 // FRAME_SAMPLES
+#define PATTERN_MAX_SAMPLES         64 // Bits of the mask.
+#define PATTERN_Z                   127
+
+// Steps from the first triple: +t for x, -t for y, 0 for z of triple t.
+#define PATTERN_STEP(t)             (u_int16_t)(t), (u_int16_t)(0 - (t)), 0
+#define PATTERN_X_LANES             0xFFFF, 0, 0
+#define PATTERN_Y_LANES             0, 0xFFFF, 0
+#define PATTERN_Z_LANES             0, 0, 0xFFFF
+#define PATTERN_16(m)               m, m, m, m, m, m, m, m, m, m, m, m, m, m, m, m
+
+alignas(32) static const u_int16_t pattern_step[PATTERN_SAMPLES] = {
+    PATTERN_STEP(0), PATTERN_STEP(1), PATTERN_STEP(2), PATTERN_STEP(3),
+    PATTERN_STEP(4), PATTERN_STEP(5), PATTERN_STEP(6), PATTERN_STEP(7),
+    PATTERN_STEP(8), PATTERN_STEP(9), PATTERN_STEP(10), PATTERN_STEP(11),
+    PATTERN_STEP(12), PATTERN_STEP(13), PATTERN_STEP(14), PATTERN_STEP(15)};
+alignas(32) static const u_int16_t pattern_x_lanes[PATTERN_SAMPLES] = {PATTERN_16(PATTERN_X_LANES)};
+alignas(32) static const u_int16_t pattern_y_lanes[PATTERN_SAMPLES] = {PATTERN_16(PATTERN_Y_LANES)};
+alignas(32) static const u_int16_t pattern_z_lanes[PATTERN_SAMPLES] = {PATTERN_16(PATTERN_Z_LANES)};
+
+/**
+ * @brief Compare PATTERN_SAMPLES samples with the pattern starting at x0, y0.
+ * @return mask of samples that differ.
+ */
+static inline u_int64_t pattern_mismatch(const u_int16_t *samples, u_int16_t x0, u_int16_t y0)
+{
+    u_int64_t mask = 0;
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256i vx = _mm256_set1_epi16((short)x0), vy = _mm256_set1_epi16((short)y0);
+    const __m256i vz = _mm256_set1_epi16(PATTERN_Z);
+    for(; i < PATTERN_SAMPLES; i += 16)
+    {
+        __m256i base = _mm256_or_si256(
+            _mm256_or_si256(_mm256_and_si256(vx, _mm256_load_si256((const __m256i*)(pattern_x_lanes + i))),
+                            _mm256_and_si256(vy, _mm256_load_si256((const __m256i*)(pattern_y_lanes + i)))),
+            _mm256_and_si256(vz, _mm256_load_si256((const __m256i*)(pattern_z_lanes + i))));
+        __m256i expect = _mm256_add_epi16(base, _mm256_load_si256((const __m256i*)(pattern_step + i)));
+        __m256i eq = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i*)(samples + i)), expect);
+        // Saturating pack keeps 0 and -1, one mask byte per sample.
+        u_int32_t bits = (u_int32_t)_mm_movemask_epi8(_mm_packs_epi16(_mm256_castsi256_si128(eq),
+                                                                       _mm256_extracti128_si256(eq, 1)));
+        mask |= (u_int64_t)(~bits & 0xFFFF) << i;
+    }
+#elif defined(__SSE2__)
+    const __m128i vx = _mm_set1_epi16((short)x0), vy = _mm_set1_epi16((short)y0);
+    const __m128i vz = _mm_set1_epi16(PATTERN_Z);
+    for(; i < PATTERN_SAMPLES; i += 16)
+    {
+        __m128i e0 = _mm_add_epi16(_mm_or_si128(_mm_or_si128(
+                _mm_and_si128(vx, _mm_load_si128((const __m128i*)(pattern_x_lanes + i))),
+                _mm_and_si128(vy, _mm_load_si128((const __m128i*)(pattern_y_lanes + i)))),
+                _mm_and_si128(vz, _mm_load_si128((const __m128i*)(pattern_z_lanes + i)))),
+            _mm_load_si128((const __m128i*)(pattern_step + i)));
+        __m128i e1 = _mm_add_epi16(_mm_or_si128(_mm_or_si128(
+                _mm_and_si128(vx, _mm_load_si128((const __m128i*)(pattern_x_lanes + i + 8))),
+                _mm_and_si128(vy, _mm_load_si128((const __m128i*)(pattern_y_lanes + i + 8)))),
+                _mm_and_si128(vz, _mm_load_si128((const __m128i*)(pattern_z_lanes + i + 8)))),
+            _mm_load_si128((const __m128i*)(pattern_step + i + 8)));
+        __m128i eq0 = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i*)(samples + i)), e0);
+        __m128i eq1 = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i*)(samples + i + 8)), e1);
+        // Saturating pack keeps 0 and -1, one mask byte per sample.
+        u_int32_t eq = (u_int32_t)_mm_movemask_epi8(_mm_packs_epi16(eq0, eq1));
+        mask |= (u_int64_t)(~eq & 0xFFFF) << i;
+    }
+#endif
+
+    for(; i < PATTERN_SAMPLES; i++)
+    {
+        u_int16_t base = (i % 3 == 0) ? x0 : (i % 3 == 1) ? y0 : PATTERN_Z;
+        if(samples[i] != (u_int16_t)(base + pattern_step[i]))mask |= 1ULL << i;
+    }
+    return mask;
+}
+
+/**
+ * @brief Compare n samples, up to PATTERN_MAX_SAMPLES, with the pattern
+ *        starting at x0, y0, one at a time. For frames that are not
+ *        PATTERN_SAMPLES long.
+ * @return mask of samples that differ.
+ */
+static inline u_int64_t pattern_mismatch_n(const u_int16_t *samples, size_t n, u_int16_t x0, u_int16_t y0)
+{
+    u_int64_t mask = 0;
+    size_t i;
+
+    for(i = 0; i < n && i < PATTERN_MAX_SAMPLES; i++)
+    {
+        u_int16_t t = (u_int16_t)(i / 3);
+        u_int16_t expect = (i % 3 == 0) ? (u_int16_t)(x0 + t) : (i % 3 == 1) ? (u_int16_t)(y0 - t) : PATTERN_Z;
+        if(samples[i] != expect)mask |= 1ULL << i;
+    }
+    return mask;
+}
+
+/**
+ * @brief Check a whole frame of n samples. The pattern starts at the first
+ *        triple, or at the second if only the first is off, so one bad
+ *        sample at the start doesn't make the whole frame look corrupted.
+ *        Samples after PATTERN_MAX_SAMPLES are not checked.
+ * @param x0, y0  set to the first x and y the frame should have.
+ * @return mask of corrupted samples, 0 if the frame is all right.
+ */
+static inline u_int64_t pattern_check_frame(const u_int16_t *samples, size_t n, u_int16_t *x0, u_int16_t *y0)
+{
+    *x0 = samples[0];
+    *y0 = samples[1];
+    if(n >= 8 && (samples[3] != (u_int16_t)(*x0 + 1) || samples[4] != (u_int16_t)(*y0 - 1))
+        && samples[6] == (u_int16_t)(samples[3] + 1) && samples[7] == (u_int16_t)(samples[4] - 1))
+    {
+        *x0 = (u_int16_t)(samples[3] - 1);
+        *y0 = (u_int16_t)(samples[4] + 1);
+    }
+    if(n == PATTERN_SAMPLES)return pattern_mismatch(samples, *x0, *y0);
+    return pattern_mismatch_n(samples, n, *x0, *y0);
+}
+
+#endif // PATTERN_CHECK_H_
@@ -0,0 +1,184 @@
+/**
+ * @file port_set.h
+ *
+ * @brief Several receivers read by one thread. Every port has its own fd and
+ *        frame decoder (sync, continuity and counters), epoll tells which
+ *        ports have data. Each ready port gets one read() per round, so a
+ *        busy port can't starve the others.
+ *
+ *        Regular files can't be polled, they are read as if always ready,
+ *        so recorded captures and pipes can stand in for ttys.
+ *
+ *        If stop is set (from a signal handler) all ports are finished and
+ *        closed as at end of input.
+ *
+ * @license MIT
+ */
+
+#ifndef PORT_SET_H_
+#define PORT_SET_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/epoll.h>
+
+#include "frame_decoder.h"
+
+#define PORT_SET_MAX_PORTS          32
+
+typedef struct
+{
+    const char *name;
+    int fd;
+    bool polled;                // Registered with epoll, else always ready.
+    bool open;
+    frame_decoder_t *decoder;
+} port_t;
+
+typedef struct
+{
+    int epoll_fd;
+    port_t ports[PORT_SET_MAX_PORTS];
+    size_t num_ports;
+    size_t num_open;
+    size_t num_unpolled;        // Open ports that are not in epoll.
+    u_int8_t *buf;              // Read buffer shared by all ports.
+    size_t buf_size;
+    const volatile sig_atomic_t *stop; // NULL if the set only ends at end of input.
+} port_set_t;
+
+/**
+ * @return 0 on success, -1 if out of memory or epoll is not available.
+ */
+static inline int port_set_init(port_set_t *s, size_t buf_size)
+{
+    s->num_ports = 0;
+    s->num_open = 0;
+    s->num_unpolled = 0;
+    s->buf_size = buf_size;
+    s->stop = NULL;
+    s->buf = (u_int8_t*)malloc(buf_size);
+    s->epoll_fd = epoll_create1(0);
+    return (s->buf != NULL && s->epoll_fd >= 0) ? 0 : -1;
+}
+
+/**
+ * @brief Add an open input fd, d decodes what is read from it.
+ * @return 0 on success, -1 if there are too many ports or fd can't be used.
+ */
+static inline int port_set_add(port_set_t *s, const char *name, int fd, frame_decoder_t *d)
+{
+    struct epoll_event ev;
+    port_t *p;
+
+    if(s->num_ports >= PORT_SET_MAX_PORTS)return -1;
+    p = &s->ports[s->num_ports];
+    p->name = name;
+    p->fd = fd;
+    p->decoder = d;
+    p->open = true;
+
+    ev.events = EPOLLIN;
+    ev.data.u32 = (u_int32_t)s->num_ports;
+    if(epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0)p->polled = true;
+    else if(errno == EPERM) // Regular file.
+    {
+        p->polled = false;
+        s->num_unpolled++;
+    }
+    else return -1;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    s->num_ports++;
+    s->num_open++;
+    return 0;
+}
+
+/**
+ * @brief End of input of port, finish the decoder and close.
+ */
+static inline void port_close(port_set_t *s, port_t *p)
+{
+    frame_decoder_finish(p->decoder);
+    if(p->polled)epoll_ctl(s->epoll_fd, EPOLL_CTL_DEL, p->fd, NULL);
+    else s->num_unpolled--;
+    close(p->fd);
+    p->open = false;
+    s->num_open--;
+}
+
+/**
+ * @brief Read once from port and decode. At the end of input the port is closed.
+ */
+static inline void port_read(port_set_t *s, port_t *p)
+{
+    struct timespec ts;
+    ssize_t n;
+
+    n = read(p->fd, s->buf, s->buf_size);
+    if(n < 0 && (errno == EINTR || errno == EAGAIN))return;
+    if(n < 0 && errno != EIO)printf("Read error %d on %s!\n", errno, p->name); // EIO is a hung up pty.
+    if(n <= 0)
+    {
+        port_close(s, p);
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    p->decoder->block_ns = (u_int64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    frame_decode_block(p->decoder, s->buf, n);
+}
+
+/**
+ * @brief Read and decode all ports until every one has reached end of input.
+ */
+static inline void port_set_run(port_set_t *s)
+{
+    struct epoll_event events[PORT_SET_MAX_PORTS];
+    port_t *p;
+    size_t i;
+    int n, e;
+
+    while(s->num_open > 0)
+    {
+        if(s->stop != NULL && *s->stop)
+        {
+            for(i = 0; i < s->num_ports; i++)
+            {
+                if(s->ports[i].open)port_close(s, &s->ports[i]);
+            }
+            break;
+        }
+
+        // Don't block while a file is waiting to be read.
+        n = epoll_wait(s->epoll_fd, events, PORT_SET_MAX_PORTS, s->num_unpolled > 0 ? 0 : -1);
+        if(n < 0 && errno != EINTR)
+        {
+            printf("epoll error %d!\n", errno);
+            break;
+        }
+        for(e = 0; e < n; e++)
+        {
+            p = &s->ports[events[e].data.u32];
+            if(p->open)port_read(s, p);
+        }
+        for(i = 0; i < s->num_ports && s->num_unpolled > 0; i++)
+        {
+            p = &s->ports[i];
+            if(p->open && !p->polled)port_read(s, p);
+        }
+    }
+}
+
+static inline void port_set_free(port_set_t *s)
+{
+    close(s->epoll_fd);
+    free(s->buf);
+}
+
+#endif // PORT_SET_H_
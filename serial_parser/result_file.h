@@ -0,0 +1,160 @@
+/**
+ * @file result_file.h
+ *
+ * @brief Binary results format and a small mmap based reader for it.
+ *
+ *        File is a result_file_header_t followed by fixed size
+ *        result_record_t records, one per decoded frame. All fields are in
+ *        host byte order (little-endian on the PCs we use), so a file can be
+ *        mapped and the records used in place. Record i is at
+ *        header_bytes + i * record_bytes.
+ *
+ * @license MIT
+ */
+
+#ifndef RESULT_FILE_H_
+#define RESULT_FILE_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "frame_decoder.h"
+
+#define RESULT_FILE_MAGIC           "RSRESULT"
+#define RESULT_FILE_VERSION         2 // 1 had 48 samples per record.
+#define RESULT_RECORD_SAMPLES       56 // Longest radio message has 55, one more for 8 byte aligned records.
+
+static_assert(RESULT_RECORD_SAMPLES >= (SERIAL_FRAME_MAX_PAYLOAD - FRAME_MSG_NR_BYTES) / 2, "Record must hold every sample of a radio message");
+
+#define RESULT_FLAG_PARTIAL         FRAME_FLAG_PARTIAL
+#define RESULT_FLAG_SEQUENCE_BREAK  FRAME_FLAG_SEQUENCE_BREAK
+#define RESULT_FLAG_MSG_NR          FRAME_FLAG_MSG_NR
+#define RESULT_FLAG_MSG_GAP         FRAME_FLAG_MSG_GAP
+#define RESULT_FLAG_CORRUPT         FRAME_FLAG_CORRUPT
+#define RESULT_FLAG_RESTART         FRAME_FLAG_RESTART
+#define RESULT_FLAG_TRUNCATED       0x0100 // Legacy frame had more than RESULT_RECORD_SAMPLES samples, rest dropped.
+
+typedef struct
+{
+    char magic[8];              // RESULT_FILE_MAGIC, not 0 terminated.
+    u_int16_t version;
+    u_int16_t header_bytes;     // sizeof(result_file_header_t)
+    u_int16_t record_bytes;     // sizeof(result_record_t)
+    u_int16_t record_samples;   // RESULT_RECORD_SAMPLES
+    u_int64_t created_ns;       // CLOCK_REALTIME when the file was created.
+    u_int8_t reserved[40];
+} result_file_header_t;         // 64 bytes
+
+typedef struct
+{
+    u_int64_t index;            // Frame number since the parser found the first token.
+    u_int64_t arrival_ns;       // CLOCK_REALTIME when the frame was read.
+    u_int16_t num_samples;      // Valid samples, the rest are 0.
+    u_int16_t flags;            // RESULT_FLAG_...
+    u_int16_t payload_bytes;
+    u_int16_t port;             // Receiver the frame came from in merged output of several ports, else 0.
+    u_int16_t samples[RESULT_RECORD_SAMPLES]; // x, y, z, x, y, z ...
+} result_record_t;              // 136 bytes
+
+typedef struct
+{
+    int fd;
+    const u_int8_t *map;
+    size_t map_len;
+    const result_file_header_t *header;
+    size_t count;               // Number of complete records.
+} result_reader_t;
+
+static inline void result_file_header_init(result_file_header_t *h, u_int64_t created_ns)
+{
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, RESULT_FILE_MAGIC, sizeof(h->magic));
+    h->version = RESULT_FILE_VERSION;
+    h->header_bytes = sizeof(result_file_header_t);
+    h->record_bytes = sizeof(result_record_t);
+    h->record_samples = RESULT_RECORD_SAMPLES;
+    h->created_ns = created_ns;
+}
+
+/**
+ * @brief Fill record from a decoded frame. realtime_offset_ns converts
+ *        frame arrival time (CLOCK_MONOTONIC) to CLOCK_REALTIME.
+ */
+static inline void result_record_fill(result_record_t *r, const frame_t *f, u_int16_t port, u_int64_t realtime_offset_ns)
+{
+    u_int16_t n = f->num_samples < RESULT_RECORD_SAMPLES ? f->num_samples : RESULT_RECORD_SAMPLES;
+
+    r->index = f->index;
+    r->arrival_ns = f->arrival_ns + realtime_offset_ns;
+    r->num_samples = n;
+    r->flags = f->flags | (f->num_samples > RESULT_RECORD_SAMPLES ? RESULT_FLAG_TRUNCATED : 0);
+    r->payload_bytes = f->payload_bytes;
+    r->port = port;
+    memcpy(r->samples, f->samples, n * sizeof(u_int16_t));
+    memset(r->samples + n, 0, (RESULT_RECORD_SAMPLES - n) * sizeof(u_int16_t));
+}
+
+/**
+ * @return true if the header is one this code can read.
+ */
+static inline bool result_file_header_valid(const result_file_header_t *h)
+{
+    return memcmp(h->magic, RESULT_FILE_MAGIC, sizeof(h->magic)) == 0
+        && h->version == RESULT_FILE_VERSION
+        && h->header_bytes >= sizeof(result_file_header_t)
+        && h->record_bytes >= sizeof(result_record_t)
+        && h->record_samples == RESULT_RECORD_SAMPLES;
+}
+
+/**
+ * @brief Map a binary results file for reading.
+ * @return 0 on success, -1 if the file can't be opened or isn't a results file.
+ */
+static inline int result_reader_open(result_reader_t *r, const char *path)
+{
+    struct stat st;
+
+    memset(r, 0, sizeof(*r));
+    r->fd = open(path, O_RDONLY);
+    if(r->fd < 0)return -1;
+    if(fstat(r->fd, &st) != 0 || (size_t)st.st_size < sizeof(result_file_header_t))
+    {
+        close(r->fd);
+        return -1;
+    }
+    r->map_len = st.st_size;
+    r->map = (const u_int8_t*)mmap(NULL, r->map_len, PROT_READ, MAP_SHARED, r->fd, 0);
+    if(r->map == MAP_FAILED)
+    {
+        close(r->fd);
+        return -1;
+    }
+    madvise((void*)r->map, r->map_len, MADV_SEQUENTIAL);
+    r->header = (const result_file_header_t*)r->map;
+    if(!result_file_header_valid(r->header))
+    {
+        munmap((void*)r->map, r->map_len);
+        close(r->fd);
+        return -1;
+    }
+    r->count = (r->map_len - r->header->header_bytes) / r->header->record_bytes; // Last record may still be written.
+    return 0;
+}
+
+static inline const result_record_t* result_reader_record(const result_reader_t *r, size_t i)
+{
+    return (const result_record_t*)(r->map + r->header->header_bytes + i * r->header->record_bytes);
+}
+
+static inline void result_reader_close(result_reader_t *r)
+{
+    munmap((void*)r->map, r->map_len);
+    close(r->fd);
+}
+
+#endif // RESULT_FILE_H_
@@ -0,0 +1,301 @@
+/**
+ * @file result_index.h
+ *
+ * @brief Sparse sidecar index of a results file, so a frame or a time can be
+ *        found without reading the file from the start.
+ *
+ *        results-filename.idx is a result_index_header_t followed by one
+ *        result_index_entry_t for every stride-th frame of a port: frame
+ *        number, arrival time and byte offset of the frame in the results
+ *        file. Entries are in file order, so for a file of one run and port
+ *        frame numbers and arrival times only go up and a lookup is a binary
+ *        search. A frame between entries is found by reading on from the
+ *        entry before it, at most stride frames. A packed file (result_pack.h)
+ *        has a key frame for every port at every entry.
+ *
+ *        The decoder thread marks the frames (result_index_mark()) with their
+ *        position in the output stream. With an output ring the marks go
+ *        through a lock-free queue to the writer thread, which knows what file
+ *        and offset a block of the stream goes to (output_writer.h). Without
+ *        one the decoder adds them to the file itself.
+ *
+ * @license MIT
+ */
+
+#ifndef RESULT_INDEX_H_
+#define RESULT_INDEX_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+
+#include "output_buffer.h"
+
+#define RESULT_INDEX_MAGIC          "RSRINDEX"
+#define RESULT_INDEX_VERSION        1
+#define RESULT_INDEX_SUFFIX         ".idx"
+#define RESULT_INDEX_DEFAULT_STRIDE 1000 // Frames between entries.
+#define RESULT_INDEX_QUEUE          4096 // Marks on the way to the writer thread, more are dropped.
+#define RESULT_INDEX_BUFFER         256 // Entries written to the file with one write().
+#define RESULT_INDEX_NAME_CHARS     272
+
+typedef struct
+{
+    char magic[8];              // RESULT_INDEX_MAGIC, not 0 terminated.
+    u_int16_t version;
+    u_int16_t header_bytes;     // sizeof(result_index_header_t)
+    u_int16_t entry_bytes;      // sizeof(result_index_entry_t)
+    u_int16_t reserved0;
+    u_int64_t stride;           // Frames between entries when the file was created.
+    u_int64_t created_ns;       // CLOCK_REALTIME
+    u_int8_t reserved[32];
+} result_index_header_t;        // 64 bytes
+
+typedef struct
+{
+    u_int64_t index;            // Frame number, as in result_record_t.
+    u_int64_t arrival_ns;       // CLOCK_REALTIME, as in result_record_t.
+    u_int64_t offset;           // Of the frame in the results file.
+    u_int16_t port;             // As in result_record_t.
+    u_int16_t reserved[3];
+} result_index_entry_t;         // 32 bytes
+
+// Marks the frames of one decoder, offset is in the output stream.
+typedef struct
+{
+    u_int64_t stride;
+    u_int64_t next;             // Frame number of the next mark.
+    u_int64_t dropped;          // Marks the queue had no room for.
+    alignas(64) std::atomic<size_t> head; // Marks queued, written by the decoder thread.
+    alignas(64) std::atomic<size_t> tail; // Marks taken, written by the writer thread.
+    result_index_entry_t queue[RESULT_INDEX_QUEUE];
+} result_index_t;
+
+// Index file being written.
+typedef struct
+{
+    int fd;                     // -1 if there is none.
+    char name[RESULT_INDEX_NAME_CHARS];
+    size_t count;               // Entries in buf.
+    u_int64_t entries;          // Entries written.
+    result_index_entry_t buf[RESULT_INDEX_BUFFER];
+} result_index_file_t;
+
+typedef struct
+{
+    int fd;
+    const u_int8_t *map;
+    size_t map_len;
+    const result_index_entry_t *entries;
+    size_t count;
+    u_int64_t stride;           // Of the header, 1 if every frame has an entry.
+} result_index_reader_t;
+
+static inline void result_index_init(result_index_t *ix, u_int64_t stride)
+{
+    ix->stride = stride > 0 ? stride : 1;
+    ix->next = 0;
+    ix->dropped = 0;
+    ix->head.store(0);
+    ix->tail.store(0);
+}
+
+/**
+ * @return true if frame number index is due for an entry.
+ */
+static inline bool result_index_due(const result_index_t *ix, u_int64_t index)
+{
+    return index >= ix->next;
+}
+
+/**
+ * @brief Decoder: the frame starts at offset of the output stream (or file).
+ *        Queued for the writer thread if queue, else only the next mark is
+ *        set and the caller writes e itself.
+ */
+static inline void result_index_mark(result_index_t *ix, result_index_entry_t *e, u_int64_t index, u_int64_t arrival_ns,
+                                     u_int64_t offset, u_int16_t port, bool queue)
+{
+    size_t head = ix->head.load(std::memory_order_relaxed);
+
+    memset(e, 0, sizeof(*e));
+    e->index = index;
+    e->arrival_ns = arrival_ns;
+    e->offset = offset;
+    e->port = port;
+    ix->next = (index / ix->stride + 1) * ix->stride;
+    if(!queue)return;
+    if(head - ix->tail.load(std::memory_order_acquire) >= RESULT_INDEX_QUEUE)
+    {
+        ix->dropped++; // Writer is far behind, the index gets a wider gap.
+        return;
+    }
+    ix->queue[head % RESULT_INDEX_QUEUE] = *e;
+    ix->head.store(head + 1, std::memory_order_release); // Before the block with the frame is published.
+}
+
+/**
+ * @brief Writer: take the next mark before stream offset end.
+ * @return false if there is none.
+ */
+static inline bool result_index_take(result_index_t *ix, u_int64_t end, result_index_entry_t *e)
+{
+    size_t tail = ix->tail.load(std::memory_order_relaxed);
+
+    if(tail == ix->head.load(std::memory_order_acquire))return false;
+    if(ix->queue[tail % RESULT_INDEX_QUEUE].offset >= end)return false;
+    *e = ix->queue[tail % RESULT_INDEX_QUEUE];
+    ix->tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+static inline int result_index_file_flush(result_index_file_t *f)
+{
+    int res = 0;
+
+    if(f->fd >= 0 && f->count > 0)res = write_all(f->fd, f->buf, f->count * sizeof(result_index_entry_t));
+    f->count = 0;
+    return res;
+}
+
+static inline void result_index_file_add(result_index_file_t *f, const result_index_entry_t *e)
+{
+    if(f->fd < 0)return;
+    if(f->count == RESULT_INDEX_BUFFER)result_index_file_flush(f);
+    f->buf[f->count++] = *e;
+    f->entries++;
+}
+
+/**
+ * @brief Open the index of results file results_name, a new one gets a
+ *        header, an old one is appended to.
+ * @return 0 on success, -1 if it can't be opened or is not an index.
+ */
+static inline int result_index_file_open(result_index_file_t *f, const char *results_name, u_int64_t stride)
+{
+    result_index_header_t h;
+    struct timespec ts;
+    struct stat st;
+
+    f->count = 0;
+    f->entries = 0;
+    snprintf(f->name, sizeof(f->name), "%s%s", results_name, RESULT_INDEX_SUFFIX);
+    f->fd = open(f->name, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if(f->fd < 0)return -1;
+    if(fstat(f->fd, &st) == 0 && st.st_size > 0)
+    {
+        if(pread(f->fd, &h, sizeof(h), 0) == sizeof(h) && memcmp(h.magic, RESULT_INDEX_MAGIC, sizeof(h.magic)) == 0
+            && h.version == RESULT_INDEX_VERSION && h.entry_bytes == sizeof(result_index_entry_t)
+            && (st.st_size - h.header_bytes) % sizeof(result_index_entry_t) == 0)return 0;
+        close(f->fd);
+        f->fd = -1;
+        return -1;
+    }
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, RESULT_INDEX_MAGIC, sizeof(h.magic));
+    h.version = RESULT_INDEX_VERSION;
+    h.header_bytes = sizeof(h);
+    h.entry_bytes = sizeof(result_index_entry_t);
+    h.stride = stride;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    h.created_ns = (u_int64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    return write_all(f->fd, &h, sizeof(h));
+}
+
+static inline void result_index_file_close(result_index_file_t *f)
+{
+    if(f->fd < 0)return;
+    result_index_file_flush(f);
+    close(f->fd);
+    f->fd = -1;
+}
+
+/**
+ * @brief Map the index of results file results_name.
+ * @return 0 on success, -1 if there is none.
+ */
+static inline int result_index_reader_open(result_index_reader_t *r, const char *results_name)
+{
+    char name[RESULT_INDEX_NAME_CHARS];
+    const result_index_header_t *h;
+    struct stat st;
+
+    memset(r, 0, sizeof(*r));
+    snprintf(name, sizeof(name), "%s%s", results_name, RESULT_INDEX_SUFFIX);
+    r->fd = open(name, O_RDONLY);
+    if(r->fd < 0)return -1;
+    if(fstat(r->fd, &st) != 0 || (size_t)st.st_size < sizeof(result_index_header_t))
+    {
+        close(r->fd);
+        return -1;
+    }
+    r->map_len = st.st_size;
+    r->map = (const u_int8_t*)mmap(NULL, r->map_len, PROT_READ, MAP_SHARED, r->fd, 0);
+    if(r->map == MAP_FAILED)
+    {
+        close(r->fd);
+        return -1;
+    }
+    h = (const result_index_header_t*)r->map;
+    if(memcmp(h->magic, RESULT_INDEX_MAGIC, sizeof(h->magic)) != 0 || h->version != RESULT_INDEX_VERSION
+        || h->entry_bytes != sizeof(result_index_entry_t) || h->header_bytes > r->map_len)
+    {
+        munmap((void*)r->map, r->map_len);
+        close(r->fd);
+        return -1;
+    }
+    r->stride = h->stride;
+    r->entries = (const result_index_entry_t*)(r->map + h->header_bytes);
+    r->count = (r->map_len - h->header_bytes) / sizeof(result_index_entry_t); // Last entry may still be written.
+    return 0;
+}
+
+/**
+ * @brief Last entry with frame number (by_time false) or arrival time (by_time
+ *        true) not above key, by binary search. Needs a file of one run and
+ *        port, see result_index_find_port() for others.
+ * @return entry number, -1 if key is before the first entry.
+ */
+static inline long result_index_find(const result_index_reader_t *r, u_int64_t key, bool by_time)
+{
+    size_t lo = 0, hi = r->count, mid;
+
+    while(lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if((by_time ? r->entries[mid].arrival_ns : r->entries[mid].index) <= key)lo = mid + 1;
+        else hi = mid;
+    }
+    return (long)lo - 1;
+}
+
+/**
+ * @brief Same for one port of a merged file, goes through the whole index.
+ */
+static inline long result_index_find_port(const result_index_reader_t *r, u_int64_t key, bool by_time, u_int16_t port)
+{
+    long found = -1;
+    size_t i;
+
+    for(i = 0; i < r->count; i++)
+    {
+        if(r->entries[i].port != port)continue;
+        if((by_time ? r->entries[i].arrival_ns : r->entries[i].index) <= key)found = (long)i;
+        else if(found >= 0)break;
+    }
+    return found;
+}
+
+static inline void result_index_reader_close(result_index_reader_t *r)
+{
+    munmap((void*)r->map, r->map_len);
+    close(r->fd);
+}
+
+#endif // RESULT_INDEX_H_
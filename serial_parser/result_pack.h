@@ -0,0 +1,388 @@
+/**
+ * @file result_pack.h
+ *
+ * @brief Packed binary results format, about a tenth of the size of
+ *        result_file.h records for the smooth signals we log.
+ *
+ *        File is a result_file_header_t with RESULT_PACK_MAGIC followed by
+ *        one variable length frame per decoded frame, holding the same
+ *        fields as a result_record_t:
+ *
+ *          tag         u8, RESULT_PACK_KEY for a key frame.
+ *          port        varint
+ *          index       varint, key frame: the index, else zigzag of the
+ *                      difference to the index after the last frame of the port.
+ *          arrival_ns  varint, key frame: the time, else zigzag of the
+ *                      difference to the last frame of the port.
+ *          flags, num_samples, payload_bytes  varint
+ *          widths      u16 little-endian, 5 bits of residual width per channel.
+ *          residuals   all x, then all y, then all z, packed LSB first in
+ *                      their width, padded to a whole byte.
+ *
+ *        Every channel (x, y, z) of every port is predicted from its last two
+ *        samples: last + (last - before), wrapping at 16 bits. The residual
+ *        (sample - prediction) is zigzag coded, so small steps either way give
+ *        small numbers. The test pattern and other straight lines give 0,
+ *        a frame of it takes about 10 bytes instead of 136.
+ *
+ *        A key frame starts the prediction of its port from scratch. The
+ *        parser writes one per port at the start of every output block, so
+ *        every file of a rotation and every append can be decoded on its
+ *        own. Varints are LEB128, 7 bits per byte, low bits first.
+ *
+ * @license MIT
+ */
+
+#ifndef RESULT_PACK_H_
+#define RESULT_PACK_H_
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "result_file.h"
+
+#define RESULT_PACK_MAGIC           "RSPACKED"
+#define RESULT_PACK_VERSION         2 // 1 had at most 48 samples per frame.
+#define RESULT_PACK_KEY             0x01
+#define RESULT_PACK_MAX_PORTS       32 // PORT_SET_MAX_PORTS
+#define RESULT_PACK_MAX_BYTES       192 // Largest packed frame, with room to spare.
+#define RESULT_PACK_PAD             8 // Bit reader loads 4 bytes at a time, may look past the frame.
+
+typedef struct
+{
+    u_int64_t index;            // Of the last frame.
+    u_int64_t arrival_ns;
+    u_int16_t last[3];          // Last sample of every channel.
+    u_int16_t before[3];        // The one before.
+    u_int8_t have[3];           // Samples known since the key frame, up to 2.
+    bool keyed;                 // There was a key frame, the fields above are valid.
+    u_int32_t epoch;            // Output block the key frame was written in, encoder only.
+} result_pack_port_t;
+
+// Encoder or decoder state of one packed stream.
+typedef struct
+{
+    u_int32_t epoch;            // Output block being written, encoder only.
+    result_pack_port_t ports[RESULT_PACK_MAX_PORTS];
+} result_pack_t;
+
+typedef struct
+{
+    int fd;
+    const u_int8_t *map;
+    size_t map_len;
+    size_t pos;                 // Next frame.
+    result_pack_t state;
+} result_pack_reader_t;
+
+static inline void result_pack_header_init(result_file_header_t *h, u_int64_t created_ns)
+{
+    result_file_header_init(h, created_ns);
+    memcpy(h->magic, RESULT_PACK_MAGIC, sizeof(h->magic));
+    h->version = RESULT_PACK_VERSION;
+    h->record_bytes = 0; // Variable.
+}
+
+static inline bool result_pack_header_valid(const result_file_header_t *h)
+{
+    return memcmp(h->magic, RESULT_PACK_MAGIC, sizeof(h->magic)) == 0
+        && h->version == RESULT_PACK_VERSION
+        && h->header_bytes >= sizeof(result_file_header_t)
+        && h->record_samples == RESULT_RECORD_SAMPLES;
+}
+
+static inline void result_pack_init(result_pack_t *p)
+{
+    memset(p, 0, sizeof(*p));
+    p->epoch = 1;
+}
+
+/**
+ * @brief The next frames start a new output block (or file), every port
+ *        starts it with a key frame.
+ */
+static inline void result_pack_new_block(result_pack_t *p)
+{
+    p->epoch++;
+}
+
+static inline u_int16_t result_pack_predict(const result_pack_port_t *s, unsigned int c)
+{
+    if(s->have[c] == 0)return 0;
+    if(s->have[c] == 1)return s->last[c];
+    return (u_int16_t)(2 * s->last[c] - s->before[c]);
+}
+
+static inline void result_pack_update(result_pack_port_t *s, unsigned int c, u_int16_t v)
+{
+    s->before[c] = s->last[c];
+    s->last[c] = v;
+    if(s->have[c] < 2)s->have[c]++;
+}
+
+static inline void result_pack_key(result_pack_port_t *s)
+{
+    s->have[0] = s->have[1] = s->have[2] = 0;
+    s->keyed = true;
+}
+
+static inline u_int8_t* result_pack_put_varint(u_int8_t *p, u_int64_t v)
+{
+    while(v >= 0x80)
+    {
+        *p++ = (u_int8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (u_int8_t)v;
+    return p;
+}
+
+static inline const u_int8_t* result_pack_get_varint(const u_int8_t *p, u_int64_t *v)
+{
+    unsigned int shift = 0;
+
+    *v = 0;
+    while((*p & 0x80) && shift < 63)
+    {
+        *v |= (u_int64_t)(*p++ & 0x7F) << shift;
+        shift += 7;
+    }
+    *v |= (u_int64_t)*p++ << shift;
+    return p;
+}
+
+static inline u_int64_t result_pack_zigzag64(int64_t v)
+{
+    return ((u_int64_t)v << 1) ^ (u_int64_t)(v >> 63);
+}
+
+static inline int64_t result_pack_unzigzag64(u_int64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+/**
+ * @brief Pack one record for the output, a key frame if its port has none in
+ *        this output block yet.
+ * @param out  room for RESULT_PACK_MAX_BYTES.
+ * @return bytes written to out.
+ */
+static inline size_t result_pack_frame(result_pack_t *p, void *out, const result_record_t *r)
+{
+    result_pack_port_t *s = &p->ports[r->port % RESULT_PACK_MAX_PORTS];
+    u_int8_t *o = (u_int8_t*)out;
+    u_int16_t zz[RESULT_RECORD_SAMPLES];
+    u_int16_t any[3] = {0, 0, 0};
+    unsigned int w[3], i, c;
+    u_int64_t acc = 0;
+    unsigned int bits = 0, n = r->num_samples;
+    bool key = s->epoch != p->epoch;
+
+    if(key)
+    {
+        result_pack_key(s);
+        s->epoch = p->epoch;
+    }
+    *o++ = key ? RESULT_PACK_KEY : 0;
+    o = result_pack_put_varint(o, r->port);
+    o = result_pack_put_varint(o, key ? r->index : result_pack_zigzag64((int64_t)(r->index - s->index - 1)));
+    o = result_pack_put_varint(o, key ? r->arrival_ns : result_pack_zigzag64((int64_t)(r->arrival_ns - s->arrival_ns)));
+    o = result_pack_put_varint(o, r->flags);
+    o = result_pack_put_varint(o, n);
+    o = result_pack_put_varint(o, r->payload_bytes);
+    s->index = r->index;
+    s->arrival_ns = r->arrival_ns;
+
+    for(i = 0, c = 0; i < n; i++)
+    {
+        u_int16_t d = (u_int16_t)(r->samples[i] - result_pack_predict(s, c));
+        zz[i] = (u_int16_t)((d << 1) ^ (u_int16_t)((int16_t)d >> 15));
+        any[c] |= zz[i];
+        result_pack_update(s, c, r->samples[i]);
+        if(++c == 3)c = 0;
+    }
+    for(c = 0; c < 3; c++)w[c] = any[c] ? 32 - __builtin_clz(any[c]) : 0;
+    *o++ = (u_int8_t)(w[0] | w[1] << 5);
+    *o++ = (u_int8_t)(w[1] >> 3 | w[2] << 2);
+
+    for(c = 0; c < 3; c++)
+    {
+        if(w[c] == 0)continue;
+        for(i = c; i < n; i += 3)
+        {
+            acc |= (u_int64_t)zz[i] << bits;
+            bits += w[c];
+            if(bits >= 32)
+            {
+                u_int32_t word = (u_int32_t)acc;
+                memcpy(o, &word, 4); // Little-endian host, see result_file.h.
+                o += 4;
+                acc >>= 32;
+                bits -= 32;
+            }
+        }
+    }
+    for(; bits > 0; bits = bits > 8 ? bits - 8 : 0)
+    {
+        *o++ = (u_int8_t)acc;
+        acc >>= 8;
+    }
+    return o - (u_int8_t*)out;
+}
+
+/**
+ * @brief Decode a frame from in, which has RESULT_PACK_PAD readable bytes
+ *        past len.
+ */
+static inline ssize_t result_unpack_padded(result_pack_t *p, const u_int8_t *in, size_t len, result_record_t *r)
+{
+    const u_int8_t *q = in;
+    result_pack_port_t *s;
+    u_int64_t v, acc = 0;
+    unsigned int w[3], i, c, n, bits = 0, total_bits = 0;
+    size_t used;
+    u_int8_t tag = *q++;
+    bool key = tag & RESULT_PACK_KEY;
+
+    if(tag & ~RESULT_PACK_KEY)return -1;
+    q = result_pack_get_varint(q, &v);
+    if((size_t)(q - in) > len)return 0; // Cut in the port, what was read past len is padding.
+    if(v >= RESULT_PACK_MAX_PORTS)return -1;
+    r->port = (u_int16_t)v;
+    s = &p->ports[v];
+    if(key)result_pack_key(s);
+    else if(!s->keyed)return -1; // Stream doesn't start at a key frame.
+    q = result_pack_get_varint(q, &v);
+    r->index = key ? v : s->index + 1 + result_pack_unzigzag64(v);
+    q = result_pack_get_varint(q, &v);
+    r->arrival_ns = key ? v : s->arrival_ns + result_pack_unzigzag64(v);
+    q = result_pack_get_varint(q, &v);
+    r->flags = (u_int16_t)v;
+    q = result_pack_get_varint(q, &v);
+    if((size_t)(q - in) > len)return 0;
+    if(v > RESULT_RECORD_SAMPLES)return -1;
+    n = r->num_samples = (u_int16_t)v;
+    q = result_pack_get_varint(q, &v);
+    r->payload_bytes = (u_int16_t)v;
+    w[0] = q[0] & 0x1F;
+    w[1] = (q[0] >> 5 | q[1] << 3) & 0x1F;
+    w[2] = (q[1] >> 2) & 0x1F;
+    q += 2;
+    for(c = 0; c < 3; c++)
+    {
+        if(w[c] > 16)return -1;
+        total_bits += w[c] * ((n + 2 - c) / 3);
+    }
+    used = (q - in) + (total_bits + 7) / 8;
+    if(used > len)return 0;
+
+    for(c = 0; c < 3; c++)
+    {
+        u_int32_t mask = (1U << w[c]) - 1;
+        for(i = c; i < n; i += 3)
+        {
+            if(bits < 16)
+            {
+                u_int32_t word;
+                memcpy(&word, q, 4);
+                acc |= (u_int64_t)word << bits;
+                q += 4;
+                bits += 32;
+            }
+            u_int16_t z = (u_int16_t)(acc & mask);
+            acc >>= w[c];
+            bits -= w[c];
+            r->samples[i] = (u_int16_t)(result_pack_predict(s, c) + ((z >> 1) ^ (u_int16_t)-(z & 1)));
+            result_pack_update(s, c, r->samples[i]);
+        }
+    }
+    memset(r->samples + n, 0, (RESULT_RECORD_SAMPLES - n) * sizeof(u_int16_t));
+    s->index = r->index;
+    s->arrival_ns = r->arrival_ns;
+    return (ssize_t)used;
+}
+
+/**
+ * @brief Decode the frame at the start of in[0, len).
+ * @return bytes used, 0 if in holds only part of a frame, -1 if it isn't a
+ *         packed frame (or the stream didn't start at a key frame).
+ */
+static inline ssize_t result_unpack_frame(result_pack_t *p, const void *in, size_t len, result_record_t *r)
+{
+    u_int8_t buf[RESULT_PACK_MAX_BYTES + RESULT_PACK_PAD];
+    result_pack_port_t saved;
+    ssize_t res;
+
+    if(len >= RESULT_PACK_MAX_BYTES + RESULT_PACK_PAD)return result_unpack_padded(p, (const u_int8_t*)in, len, r);
+
+    // Near the end, decode from a padded copy and undo if the frame is cut.
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, in, len);
+    if(len == 0)return 0;
+    if(buf[1] < RESULT_PACK_MAX_PORTS)saved = p->ports[buf[1]];
+    res = result_unpack_padded(p, buf, len, r);
+    if(res > (ssize_t)len)res = 0;
+    if(res == 0 && buf[1] < RESULT_PACK_MAX_PORTS)p->ports[buf[1]] = saved;
+    return res;
+}
+
+/**
+ * @brief Map a packed results file for reading.
+ * @return 0 on success, -1 if the file can't be opened or isn't a packed results file.
+ */
+static inline int result_pack_reader_open(result_pack_reader_t *r, const char *path)
+{
+    struct stat st;
+
+    memset(r, 0, sizeof(*r));
+    r->fd = open(path, O_RDONLY);
+    if(r->fd < 0)return -1;
+    if(fstat(r->fd, &st) != 0 || (size_t)st.st_size < sizeof(result_file_header_t))
+    {
+        close(r->fd);
+        return -1;
+    }
+    r->map_len = st.st_size;
+    r->map = (const u_int8_t*)mmap(NULL, r->map_len, PROT_READ, MAP_SHARED, r->fd, 0);
+    if(r->map == MAP_FAILED)
+    {
+        close(r->fd);
+        return -1;
+    }
+    madvise((void*)r->map, r->map_len, MADV_SEQUENTIAL);
+    if(!result_pack_header_valid((const result_file_header_t*)r->map))
+    {
+        munmap((void*)r->map, r->map_len);
+        close(r->fd);
+        return -1;
+    }
+    r->pos = ((const result_file_header_t*)r->map)->header_bytes;
+    result_pack_init(&r->state);
+    return 0;
+}
+
+/**
+ * @brief Decode the next frame.
+ * @return 1 if rec was filled, 0 at the end of the file (the last frame may
+ *         still be written), -1 if the file is damaged from here on.
+ */
+static inline int result_pack_reader_next(result_pack_reader_t *r, result_record_t *rec)
+{
+    ssize_t n = result_unpack_frame(&r->state, r->map + r->pos, r->map_len - r->pos, rec);
+
+    if(n <= 0)return (int)n;
+    r->pos += n;
+    return 1;
+}
+
+static inline void result_pack_reader_close(result_pack_reader_t *r)
+{
+    munmap((void*)r->map, r->map_len);
+    close(r->fd);
+}
+
+#endif // RESULT_PACK_H_
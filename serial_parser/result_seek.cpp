@@ -0,0 +1,291 @@
+/**
+ * @brief Prints frames from the middle of a results file written with
+ *        pars_serial_direct -I, found through the sidecar index
+ *        (result_index.h) instead of reading the file from the start.
+ *
+ * @usage
+ *        ./result_seek -f 123456 -n 10 results.bin
+ *        ./result_seek -t 1760630400.25 -T 1760630401 results.pk
+ *        ./result_seek -f 123456 results.bin.000000 results.bin.000001 ...
+ *
+ *        -f frame number, -t seconds since the epoch (arrival time), the
+ *        frames from there on are printed: -n of them (default 1) or those up
+ *        to -T seconds. -p port picks the port of a merged (-M) file. Files
+ *        of a rotation are given in order, the lookup starts in the right one.
+ *
+ *        Binary (-b) and packed (-c) results print a line per frame (number,
+ *        port, arrival time, flags) and its samples. Text results print the
+ *        lines of the frames, their index has an entry for every frame. In
+ *        a text file indexed every stride-th frame there are no frame
+ *        boundaries, the lines between the entries around the frames are
+ *        printed.
+ *
+ *        Frame numbers start at 0 in every run, in a file several runs were
+ *        appended to look up by time.
+ *
+ *        g++ -O2 -o result_seek result_seek.cpp
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "result_file.h"
+#include "result_pack.h"
+#include "result_index.h"
+#include "text_output.h"
+
+typedef enum
+{
+    SEEK_TEXT,
+    SEEK_BINARY,
+    SEEK_PACKED
+} seek_format_t;
+
+// What to print.
+typedef struct
+{
+    bool by_time;
+    u_int64_t from;             // Frame number or arrival time.
+    u_int64_t to;               // Arrival time, 0 for count frames.
+    u_int64_t count;
+    int port;                   // -1 for all.
+    u_int64_t printed;
+} seek_query_t;
+
+/**
+ * @brief Seconds since the epoch with a fraction, to ns without the rounding of a double.
+ */
+static u_int64_t parse_time_ns(const char *s)
+{
+    char *end;
+    u_int64_t ns = strtoull(s, &end, 10) * 1000000000ULL, scale = 100000000ULL;
+
+    if(*end == '.')
+    {
+        for(end++; *end >= '0' && *end <= '9' && scale > 0; end++, scale /= 10)ns += (*end - '0') * scale;
+    }
+    return ns;
+}
+
+static seek_format_t file_format(const u_int8_t *map, size_t len)
+{
+    if(len >= sizeof(result_file_header_t) && result_file_header_valid((const result_file_header_t*)map))return SEEK_BINARY;
+    if(len >= sizeof(result_file_header_t) && result_pack_header_valid((const result_file_header_t*)map))return SEEK_PACKED;
+    return SEEK_TEXT;
+}
+
+/**
+ * @return entry of index to start reading from, -1 if the key is before the first.
+ */
+static long find_entry(const result_index_reader_t *ix, const seek_query_t *q)
+{
+    if(q->port >= 0)return result_index_find_port(ix, q->from, q->by_time, (u_int16_t)q->port);
+    return result_index_find(ix, q->from, q->by_time);
+}
+
+/**
+ * @brief Print the record if the query wants it.
+ * @return false when the query is done.
+ */
+static bool print_record(output_buffer_t *out, const result_record_t *r, seek_query_t *q)
+{
+    char *p;
+
+    if(q->port >= 0 && r->port != q->port)return true;
+    if((q->by_time ? r->arrival_ns : r->index) < q->from)return true;
+    if(q->to != 0 && r->arrival_ns > q->to)return false;
+    p = output_reserve(out, 96);
+    output_commit(out, snprintf(p, 96, "# frame %llu port %u time %llu.%09llu flags 0x%04x\n", (unsigned long long)r->index,
+                                r->port, (unsigned long long)(r->arrival_ns / 1000000000ULL),
+                                (unsigned long long)(r->arrival_ns % 1000000000ULL), r->flags));
+    output_samples_text(out, r->samples, r->num_samples);
+    q->printed++;
+    return q->to != 0 || q->printed < q->count;
+}
+
+/**
+ * @brief Print what the query wants from map[offset, len) on.
+ * @return false when the query is done.
+ */
+static bool print_from(output_buffer_t *out, const u_int8_t *map, size_t len, size_t offset, seek_format_t format, seek_query_t *q)
+{
+    const result_file_header_t *h = (const result_file_header_t*)map;
+    result_pack_t pack;
+    result_record_t rec;
+    ssize_t n;
+
+    if(format == SEEK_BINARY)
+    {
+        for(; offset + h->record_bytes <= len; offset += h->record_bytes)
+        {
+            memcpy(&rec, map + offset, sizeof(rec));
+            if(!print_record(out, &rec, q))return false;
+        }
+    }
+    else
+    {
+        result_pack_init(&pack);
+        while((n = result_unpack_frame(&pack, map + offset, len - offset, &rec)) > 0)
+        {
+            offset += n;
+            if(!print_record(out, &rec, q))return false;
+        }
+        if(n < 0)
+        {
+            fprintf(stderr, "Can't decode the packed frame at byte %llu!\n", (unsigned long long)offset);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Text results of an index with every frame (stride 1, as
+ *        pars_serial_direct -I writes for text): the lines of a frame are
+ *        the bytes up to the next entry, so the frames the query wants are
+ *        printed from entry first on. A sparser index has no frame
+ *        boundaries, the lines between the entries around the frames are
+ *        printed.
+ * @return false when the query is done.
+ */
+static bool print_text(output_buffer_t *out, const u_int8_t *map, size_t len, const result_index_reader_t *ix,
+                       long first, seek_query_t *q)
+{
+    size_t start = first >= 0 ? ix->entries[first].offset : 0, end = len;
+    u_int64_t last = !q->by_time ? q->from + q->count : q->to != 0 ? q->to : q->from + 1;
+    const result_index_entry_t *e;
+    size_t i;
+
+    if(ix->stride == 1)
+    {
+        i = first >= 0 ? first : 0;
+        while(i > 0 && q->by_time && ix->entries[i - 1].arrival_ns >= q->from)i--; // Frames of one block have one time.
+        for(; i < ix->count; i++)
+        {
+            e = &ix->entries[i];
+            if(q->port >= 0 && e->port != q->port)continue;
+            if((q->by_time ? e->arrival_ns : e->index) < q->from)continue;
+            if(q->to != 0 && e->arrival_ns > q->to)return false;
+            end = i + 1 < ix->count ? ix->entries[i + 1].offset : len;
+            if(e->offset < end && end <= len)output_write(out, map + e->offset, end - e->offset);
+            q->printed++;
+            if(q->to == 0 && q->printed >= q->count)return false;
+        }
+        return true;
+    }
+
+    for(i = first >= 0 ? first + 1 : 0; i < ix->count; i++)
+    {
+        if(q->port >= 0 && ix->entries[i].port != q->port)continue;
+        if((q->by_time ? ix->entries[i].arrival_ns : ix->entries[i].index) >= last)
+        {
+            end = ix->entries[i].offset;
+            break;
+        }
+    }
+    if(first >= 0)fprintf(stderr, "From frame %llu on, text results have no frame boundaries\n",
+                          (unsigned long long)ix->entries[first].index);
+    if(start < end && end <= len)
+    {
+        output_write(out, map + start, end - start);
+        q->printed++;
+    }
+    return false; // Only one file.
+}
+
+int main(int argc, char **argv)
+{
+    seek_query_t query = {false, 0, 0, 1, -1, 0};
+    result_index_reader_t ix;
+    output_buffer_t out;
+    const u_int8_t *map;
+    struct stat st;
+    seek_format_t format;
+    bool have_key = false, have_index;
+    int opt, fd, i, start_file = -1;
+    long entry = -1;
+    size_t offset;
+
+    while((opt = getopt(argc, argv, "f:t:T:n:p:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'f': // Frame number.
+                query.from = strtoull(optarg, NULL, 0);
+                have_key = true;
+                break;
+            case 't': // Arrival time, seconds since the epoch.
+                query.from = parse_time_ns(optarg);
+                query.by_time = true;
+                have_key = true;
+                break;
+            case 'T': // Up to this arrival time.
+                query.to = parse_time_ns(optarg);
+                break;
+            case 'n': // Frames to print.
+                query.count = strtoull(optarg, NULL, 0);
+                break;
+            case 'p': // Port of a merged file.
+                query.port = atoi(optarg);
+                break;
+            default:
+                printf("Usage: %s (-f frame | -t seconds [-T seconds]) [-n frames] [-p port] results-file...\n", argv[0]);
+                return 1;
+        }
+    }
+    if(!have_key || optind >= argc)
+    {
+        printf("Usage: %s (-f frame | -t seconds [-T seconds]) [-n frames] [-p port] results-file...\n", argv[0]);
+        return 1;
+    }
+
+    // Last file with an index entry at or before the key.
+    for(i = optind; i < argc; i++)
+    {
+        if(result_index_reader_open(&ix, argv[i]) != 0)
+        {
+            fprintf(stderr, "No index for %s!\n", argv[i]);
+            return 1;
+        }
+        long e = find_entry(&ix, &query);
+        if(e >= 0 || start_file < 0)
+        {
+            start_file = i;
+            entry = e;
+        }
+        result_index_reader_close(&ix);
+        if(e < 0 && i > optind)break; // Key is in the file before.
+    }
+
+    if(output_init(&out, STDOUT_FILENO, OUTPUT_BUFFER_BYTES) != 0)return 1;
+    for(i = start_file; i < argc; i++)
+    {
+        fd = open(argv[i], O_RDONLY);
+        if(fd < 0 || fstat(fd, &st) != 0)
+        {
+            fprintf(stderr, "Failed to open %s!\n", argv[i]);
+            break;
+        }
+        map = st.st_size > 0 ? (const u_int8_t*)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0) : NULL;
+        close(fd);
+        if(map == MAP_FAILED || map == NULL)break;
+        format = file_format(map, st.st_size);
+        have_index = result_index_reader_open(&ix, argv[i]) == 0;
+        offset = format == SEEK_TEXT ? 0 : ((const result_file_header_t*)map)->header_bytes;
+        if(i == start_file && entry >= 0 && have_index)offset = ix.entries[entry].offset;
+
+        if(format == SEEK_TEXT)
+        {
+            if(!have_index)break;
+            if(!print_text(&out, map, st.st_size, &ix, i == start_file ? entry : -1, &query))i = argc;
+        }
+        else if(offset > (size_t)st.st_size || !print_from(&out, map, st.st_size, offset, format, &query))i = argc;
+        if(have_index)result_index_reader_close(&ix);
+        munmap((void*)map, st.st_size);
+    }
+    output_close(&out);
+    if(query.printed == 0 && start_file >= 0)fprintf(stderr, "No such frames.\n");
+    return 0;
+}
@@ -0,0 +1,76 @@
+/**
+ * @brief Converts a binary results file written by pars_serial_direct -b
+ *        or a packed one written with -c to the text results format (three
+ *        samples per line).
+ *
+ * @usage
+ *        ./result_to_text results.bin results.txt
+ *        ./result_to_text results.bin > results.txt
+ */
+
+#include <stdio.h>
+#include <fcntl.h>
+
+#include "result_file.h"
+#include "result_pack.h"
+#include "text_output.h"
+
+int main(int argc, char **argv)
+{
+    result_reader_t reader;
+    result_pack_reader_t packed;
+    const result_record_t *rec;
+    result_record_t unpacked;
+    bool is_packed = false;
+    int res = 0;
+    output_buffer_t out;
+    int out_fd = STDOUT_FILENO;
+    size_t i;
+
+    if (argc < 2)
+    {
+        printf("Usage: %s results.bin [results.txt]\n", argv[0]);
+        return 1;
+    }
+    if (result_reader_open(&reader, argv[1]) != 0)
+    {
+        if (result_pack_reader_open(&packed, argv[1]) != 0)
+        {
+            fprintf(stderr, "Failed to read %s!\n", argv[1]);
+            return 1;
+        }
+        is_packed = true;
+    }
+    if (argc > 2)
+    {
+        out_fd = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out_fd < 0)
+        {
+            fprintf(stderr, "Failed to open %s!\n", argv[2]);
+            return 1;
+        }
+    }
+
+    if (output_init(&out, out_fd, OUTPUT_BUFFER_BYTES) != 0)return 1;
+    if (is_packed)
+    {
+        while((res = result_pack_reader_next(&packed, &unpacked)) > 0)
+        {
+            output_samples_text(&out, unpacked.samples, unpacked.num_samples);
+        }
+        if (res < 0)fprintf(stderr, "%s is damaged at byte %llu!\n", argv[1], (unsigned long long)packed.pos);
+        result_pack_reader_close(&packed);
+    }
+    else
+    {
+        for(i = 0; i < reader.count; i++)
+        {
+            rec = result_reader_record(&reader, i);
+            output_samples_text(&out, rec->samples, rec->num_samples);
+        }
+        result_reader_close(&reader);
+    }
+
+    output_close(&out);
+    return res < 0 ? 1 : 0;
+}
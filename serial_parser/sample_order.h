@@ -0,0 +1,67 @@
+/**
+ * @file sample_order.h
+ *
+ * @brief Turns the sample bytes of a frame payload into host order 16-bit
+ *        samples in one pass over the whole payload.
+ *
+ *        The receiver sends the radio message as it came in, samples
+ *        big-endian (network order). If the LDMA descriptor of the message
+ *        swaps bytes (byteSwap in msg_descriptor_config()), they arrive
+ *        little-endian and are copied as they are. Big-endian samples are
+ *        byte swapped 16 at a time (AVX2 pshufb) or 8 at a time (SSE2 shifts)
+ *        when the compiler targets them, bswap otherwise. The payload needs
+ *        no alignment.
+ *
+ * @license MIT
+ */
+
+#ifndef SAMPLE_ORDER_H_
+#define SAMPLE_ORDER_H_
+
+#include <string.h>
+#include <sys/types.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * @brief n samples from wire to samples, host order.
+ * @param little_endian  samples are little-endian on the wire, else big-endian.
+ */
+static inline void samples_from_wire(u_int16_t *samples, const u_int8_t *wire, size_t n, bool little_endian)
+{
+    size_t i = 0;
+
+    if(little_endian)
+    {
+        memcpy(samples, wire, n * 2); // Little-endian host, see result_file.h.
+        return;
+    }
+
+#if defined(__AVX2__)
+    const __m256i swap = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                          1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    for(; i + 16 <= n; i += 16)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(wire + 2 * i));
+        _mm256_storeu_si256((__m256i*)(samples + i), _mm256_shuffle_epi8(v, swap));
+    }
+#elif defined(__SSE2__)
+    for(; i + 8 <= n; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(wire + 2 * i));
+        _mm_storeu_si128((__m128i*)(samples + i), _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+    }
+#endif
+    for(; i < n; i++)
+    {
+        u_int16_t v;
+        memcpy(&v, wire + 2 * i, 2);
+        samples[i] = __builtin_bswap16(v);
+    }
+}
+
+#endif // SAMPLE_ORDER_H_
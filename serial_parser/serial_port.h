@@ -0,0 +1,106 @@
+/**
+ * @file serial_port.h
+ *
+ * @brief Opens and sets up the receiver tty without stty or jpnevulator:
+ *        raw 8N1 without flow control at any baud rate the UART driver
+ *        supports (termios2 with BOTHER, so not only the Bxxx rates), and
+ *        VMIN/VTIME so one read() returns a block of bytes rather than a few.
+ *
+ *        Overruns and framing/parity errors counted by the kernel
+ *        (TIOCGICOUNT) are bytes lost before the parser sees them. A pty or a
+ *        USB-serial driver without counters reports none.
+ *
+ *        Linux only. asm/termbits.h can't be used together with termios.h.
+ *
+ * @license MIT
+ */
+
+#ifndef SERIAL_PORT_H_
+#define SERIAL_PORT_H_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <asm/termbits.h>
+#include <linux/serial.h>
+
+#define SERIAL_PORT_DEFAULT_BAUD    115200
+#define SERIAL_PORT_VMIN            255 // read() returns after this many bytes ...
+#define SERIAL_PORT_VTIME           1   // ... or 0.1 s without a byte.
+
+typedef struct
+{
+    int fd;
+    unsigned int baud;          // What the driver actually set.
+    bool has_icount;            // Driver keeps TIOCGICOUNT counters.
+    struct serial_icounter_struct base; // Counters when the port was set up.
+} serial_port_t;
+
+/**
+ * @brief Set up an open tty: raw, 8N1, no flow control, baud, block reads.
+ * @return 0 on success, -1 if fd is no tty or the settings were refused.
+ */
+static inline int serial_port_setup(serial_port_t *p, int fd, unsigned int baud)
+{
+    struct termios2 tio;
+
+    p->fd = fd;
+    if(ioctl(fd, TCGETS2, &tio) != 0)return -1;
+
+    tio.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON | IXOFF | IXANY);
+    tio.c_oflag &= ~OPOST;
+    tio.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+    tio.c_cflag &= ~(CSIZE | PARENB | CSTOPB | CRTSCTS | CBAUD | (CBAUD << IBSHIFT));
+    tio.c_cflag |= CS8 | CREAD | CLOCAL | BOTHER | (BOTHER << IBSHIFT);
+    tio.c_ispeed = baud;
+    tio.c_ospeed = baud;
+    tio.c_cc[VMIN] = SERIAL_PORT_VMIN;
+    tio.c_cc[VTIME] = SERIAL_PORT_VTIME;
+    if(ioctl(fd, TCSETS2, &tio) != 0)return -1;
+
+    // Driver may round the rate.
+    if(ioctl(fd, TCGETS2, &tio) != 0)return -1;
+    p->baud = tio.c_ispeed;
+
+    ioctl(fd, TCFLSH, TCIFLUSH); // Drop what came in before.
+    memset(&p->base, 0, sizeof(p->base));
+    p->has_icount = ioctl(fd, TIOCGICOUNT, &p->base) == 0;
+    return 0;
+}
+
+/**
+ * @brief Open path and set it up, see serial_port_setup().
+ * @return 0 on success, -1 on error (errno is set).
+ */
+static inline int serial_port_open(serial_port_t *p, const char *path, unsigned int baud)
+{
+    int fd = open(path, O_RDONLY | O_NOCTTY);
+
+    if(fd < 0)return -1;
+    if(serial_port_setup(p, fd, baud) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Bytes lost in the kernel since setup: UART and tty buffer overruns,
+ *        and bytes received with framing, parity or break errors.
+ */
+static inline void serial_port_errors(const serial_port_t *p, u_int64_t *overruns, u_int64_t *line_errors)
+{
+    struct serial_icounter_struct now;
+
+    *overruns = 0;
+    *line_errors = 0;
+    if(!p->has_icount || ioctl(p->fd, TIOCGICOUNT, &now) != 0)return;
+    *overruns = (u_int64_t)(now.overrun - p->base.overrun) + (now.buf_overrun - p->base.buf_overrun);
+    *line_errors = (u_int64_t)(now.frame - p->base.frame) + (now.parity - p->base.parity) + (now.brk - p->base.brk);
+}
+
+#endif // SERIAL_PORT_H_
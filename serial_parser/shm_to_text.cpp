@@ -0,0 +1,83 @@
+/**
+ * @brief Follows the frames pars_serial_direct -X publishes in shared memory
+ *        and writes them in the text results format (three samples per
+ *        line, port number first with -p). Ends when the parser exits.
+ *        Frames that were overwritten before they could be read are
+ *        reported on stderr.
+ *
+ * @usage
+ *        ./shm_to_text /pars_serial > live.txt
+ *        ./shm_to_text -a -p /pars_serial live.txt
+ *
+ *        -a starts with the oldest frame still in the ring instead of the
+ *        next one published.
+ *
+ *        g++ -O2 -o shm_to_text shm_to_text.cpp
+ */
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "frame_shm.h"
+#include "text_output.h"
+
+int main(int argc, char **argv)
+{
+    frame_shm_reader_t reader;
+    result_record_t rec;
+    output_buffer_t out;
+    int out_fd = STDOUT_FILENO, opt;
+    bool from_oldest = false, with_port = false;
+    u_int64_t frames = 0;
+
+    while((opt = getopt(argc, argv, "ap")) != -1)
+    {
+        switch(opt)
+        {
+            case 'a': // Start with the oldest frame in the ring.
+                from_oldest = true;
+                break;
+            case 'p': // Port number on every line.
+                with_port = true;
+                break;
+            default:
+                printf("Usage: %s [-a] [-p] /shm-name [results.txt]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc)
+    {
+        printf("Usage: %s [-a] [-p] /shm-name [results.txt]\n", argv[0]);
+        return 1;
+    }
+    if (frame_shm_open(&reader, argv[optind], from_oldest) != 0)
+    {
+        fprintf(stderr, "Failed to attach to %s!\n", argv[optind]);
+        return 1;
+    }
+    if (optind + 1 < argc)
+    {
+        out_fd = open(argv[optind + 1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out_fd < 0)
+        {
+            fprintf(stderr, "Failed to open %s!\n", argv[optind + 1]);
+            return 1;
+        }
+    }
+
+    if (output_init(&out, out_fd, OUTPUT_BUFFER_BYTES) != 0)return 1;
+    while(frame_shm_read_wait(&reader, &rec) > 0)
+    {
+        if(with_port)output_samples_text_port(&out, rec.port, rec.samples, rec.num_samples);
+        else output_samples_text(&out, rec.samples, rec.num_samples);
+        frames++;
+        if(reader.next == __atomic_load_n(&reader.header->head, __ATOMIC_ACQUIRE))output_flush(&out); // Caught up, let followers see it.
+    }
+
+    fprintf(stderr, "%llu frames read, %llu frames overwritten before they were read\n",
+            (unsigned long long)frames, (unsigned long long)reader.lost);
+    frame_shm_detach(&reader);
+    output_close(&out);
+    return 0;
+}
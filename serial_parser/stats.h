@@ -0,0 +1,193 @@
+/**
+ * @file stats.h
+ *
+ * @brief Live statistics of the parser. Counters are owned by one thread
+ *        (decoder or reader) and only read by the statistics thread, so they
+ *        are plain integers updated with relaxed atomic stores: no locks and
+ *        no read-modify-write instructions on the hot path.
+ *
+ *        The interval report mirrors statistics_loop() of receiver_lll_main.c,
+ *        so both ends of the link can be compared.
+ *
+ *        Stats frames of the receiver (serial_framing.h) add its own
+ *        counters: messages missing on the radio and messages it dropped.
+ *        What the parser finds missing beyond those was lost on the serial
+ *        line or in the host.
+ *
+ *        Frame timing is kept in histograms: time between frames, and the
+ *        same for frames after lost data (gaps), where stalls of the UART or
+ *        receiver show up that byte counts hide.
+ *
+ * @license MIT
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "histogram.h"
+
+typedef struct
+{
+    u_int64_t bytes;            // Input bytes decoded.
+    u_int64_t frames;
+    u_int64_t partial_frames;
+    u_int64_t sequence_breaks;
+    u_int64_t lost_triples;
+    u_int64_t resyncs;          // Token sync lost (input dropped, token missing or garbage between frames) or message numbers went back.
+    u_int64_t crc_errors;       // Token followed by a bad header or CRC.
+    u_int64_t lost_messages;    // Gaps in the radio message numbers.
+    u_int64_t corrupt_frames;   // Full frames with samples off the test pattern.
+    u_int64_t corrupt_samples;
+    u_int64_t dropped_bytes;    // Input dropped by the reader.
+    u_int64_t tty_overruns;     // Lost in the kernel (UART or tty buffer overrun), not a counter_add() counter.
+    u_int64_t tty_line_errors;  // Received with framing, parity or break errors, ditto.
+    u_int64_t receiver_reports; // Stats frames of the receiver.
+    u_int64_t receiver_reports_lost; // Gaps in their report numbers, the counts in them are missing.
+    u_int64_t receiver_received; // Radio messages the receiver got.
+    u_int64_t radio_lost;       // Message numbers the receiver found missing.
+    u_int64_t receiver_dropped; // Received, but dropped by the receiver (no buffer, queue full).
+    u_int64_t uart_stalls;      // Receiver UART idle with frames waiting.
+} stats_t;
+
+typedef struct
+{
+    histogram_t interarrival;   // Arrival time difference of consecutive frames.
+    histogram_t gaps;           // Same, for frames after a sequence break, message gap, partial frame or resync.
+} timing_t;
+
+/**
+ * @brief Add to a counter that has a single writer thread.
+ */
+static inline void counter_add(u_int64_t *c, u_int64_t n)
+{
+    __atomic_store_n(c, *c + n, __ATOMIC_RELAXED);
+}
+
+static inline u_int64_t counter_get(const u_int64_t *c)
+{
+    return __atomic_load_n(c, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Add the counters of one decoder (or reader) to sum, for the totals
+ *        of several ports.
+ */
+static inline void stats_add(stats_t *sum, const stats_t *s)
+{
+    sum->bytes += counter_get(&s->bytes);
+    sum->frames += counter_get(&s->frames);
+    sum->partial_frames += counter_get(&s->partial_frames);
+    sum->sequence_breaks += counter_get(&s->sequence_breaks);
+    sum->lost_triples += counter_get(&s->lost_triples);
+    sum->resyncs += counter_get(&s->resyncs);
+    sum->crc_errors += counter_get(&s->crc_errors);
+    sum->lost_messages += counter_get(&s->lost_messages);
+    sum->corrupt_frames += counter_get(&s->corrupt_frames);
+    sum->corrupt_samples += counter_get(&s->corrupt_samples);
+    sum->dropped_bytes += counter_get(&s->dropped_bytes);
+    sum->tty_overruns += s->tty_overruns;
+    sum->tty_line_errors += s->tty_line_errors;
+    sum->receiver_reports += counter_get(&s->receiver_reports);
+    sum->receiver_reports_lost += counter_get(&s->receiver_reports_lost);
+    sum->receiver_received += counter_get(&s->receiver_received);
+    sum->radio_lost += counter_get(&s->radio_lost);
+    sum->receiver_dropped += counter_get(&s->receiver_dropped);
+    sum->uart_stalls += counter_get(&s->uart_stalls);
+}
+
+/**
+ * @brief Messages the parser found missing that the receiver did not
+ *        account for: lost on the serial line or in the host.
+ */
+static inline u_int64_t stats_serial_lost(const stats_t *s)
+{
+    u_int64_t receiver = s->radio_lost + s->receiver_dropped;
+
+    return s->lost_messages > receiver ? s->lost_messages - receiver : 0;
+}
+
+static inline void timing_add(timing_t *sum, const timing_t *t)
+{
+    histogram_add(&sum->interarrival, &t->interarrival);
+    histogram_add(&sum->gaps, &t->gaps);
+}
+
+/**
+ * @brief Print the timing percentiles, nothing if no frame came in.
+ */
+static inline void timing_print(FILE *fp, const char *prefix, const timing_t *t)
+{
+    if(histogram_count(&t->interarrival) == 0)return;
+    fprintf(fp, "%s", prefix);
+    histogram_print(fp, "Frame inter-arrival", &t->interarrival);
+    if(histogram_count(&t->gaps) != 0)fprintf(fp, ", ");
+    histogram_print(fp, "gaps", &t->gaps);
+    fprintf(fp, "\n");
+}
+
+/**
+ * @brief Print the timing of the last interval.
+ */
+static inline void timing_print_interval(FILE *fp, const timing_t *now, const timing_t *prev)
+{
+    static timing_t d; // Only used by the statistics thread.
+
+    histogram_diff(&d.interarrival, &now->interarrival, &prev->interarrival);
+    histogram_diff(&d.gaps, &now->gaps, &prev->gaps);
+    timing_print(fp, "", &d);
+    fflush(fp);
+}
+
+/**
+ * @brief Print what happened during the last interval.
+ */
+static inline void stats_print_interval(FILE *fp, unsigned int seconds, const stats_t *now, const stats_t *prev)
+{
+    stats_t d;
+    bool loss;
+
+    d.bytes = now->bytes - prev->bytes;
+    d.frames = now->frames - prev->frames;
+    d.partial_frames = now->partial_frames - prev->partial_frames;
+    d.sequence_breaks = now->sequence_breaks - prev->sequence_breaks;
+    d.lost_triples = now->lost_triples - prev->lost_triples;
+    d.resyncs = now->resyncs - prev->resyncs;
+    d.crc_errors = now->crc_errors - prev->crc_errors;
+    d.lost_messages = now->lost_messages - prev->lost_messages;
+    d.corrupt_frames = now->corrupt_frames - prev->corrupt_frames;
+    d.corrupt_samples = now->corrupt_samples - prev->corrupt_samples;
+    d.dropped_bytes = now->dropped_bytes - prev->dropped_bytes;
+    d.tty_overruns = now->tty_overruns - prev->tty_overruns;
+    d.tty_line_errors = now->tty_line_errors - prev->tty_line_errors;
+    d.receiver_reports = now->receiver_reports - prev->receiver_reports;
+    d.receiver_reports_lost = now->receiver_reports_lost - prev->receiver_reports_lost;
+    d.receiver_received = now->receiver_received - prev->receiver_received;
+    d.radio_lost = now->radio_lost - prev->radio_lost;
+    d.receiver_dropped = now->receiver_dropped - prev->receiver_dropped;
+    d.uart_stalls = now->uart_stalls - prev->uart_stalls;
+    loss = d.partial_frames || d.sequence_breaks || d.resyncs || d.crc_errors || d.lost_messages || d.dropped_bytes
+        || d.corrupt_frames || d.tty_overruns || d.tty_line_errors;
+
+    if(!loss)fprintf(fp, "During %u seconds - %llu bytes received, no loss", seconds, (unsigned long long)d.bytes);
+    else fprintf(fp, "Data lost! during %u seconds - %llu bytes received", seconds, (unsigned long long)d.bytes);
+    fprintf(fp, " | %.0f B/s %.1f frames/s, %llu messages lost, %llu breaks (%llu triples lost), %llu partial, %llu corrupted samples, %llu CRC errors, %llu resyncs, %llu bytes dropped, %llu tty overruns, %llu tty line errors",
+            (double)d.bytes / seconds, (double)d.frames / seconds, (unsigned long long)d.lost_messages,
+            (unsigned long long)d.sequence_breaks, (unsigned long long)d.lost_triples,
+            (unsigned long long)d.partial_frames, (unsigned long long)d.corrupt_samples, (unsigned long long)d.crc_errors,
+            (unsigned long long)d.resyncs, (unsigned long long)d.dropped_bytes,
+            (unsigned long long)d.tty_overruns, (unsigned long long)d.tty_line_errors);
+    if(d.receiver_reports || d.receiver_reports_lost)
+    {
+        fprintf(fp, " | receiver: %llu received, %llu lost on radio, %llu dropped, %llu UART stalls, %llu reports lost",
+                (unsigned long long)d.receiver_received, (unsigned long long)d.radio_lost,
+                (unsigned long long)d.receiver_dropped, (unsigned long long)d.uart_stalls,
+                (unsigned long long)d.receiver_reports_lost);
+    }
+    fprintf(fp, "\n");
+    fflush(fp);
+}
+
+#endif // STATS_H_
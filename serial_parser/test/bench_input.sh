@@ -0,0 +1,21 @@
+#!/bin/sh
+# Raw block input (-r) against the jpnevulator hex dump, on the same
+# generated stream: MB/s of receiver bytes decoded by each. Both must give
+# the same results. Run by make bench, from serial_parser/ after make.
+
+set -e
+dir=${BENCH_DIR:-build/bench}
+n=${BENCH_MESSAGES:-1000000}
+mkdir -p "$dir"
+
+./gen_stream -n "$n" "$dir/input.bin" 2>/dev/null
+./gen_stream -x -n "$n" "$dir/input.hex" 2>/dev/null
+rm -f "$dir/input_raw.txt" "$dir/input_hex.txt"
+
+mbs() { sed -n 's/^Parsed .*(\([0-9.]*\) MB\/s).*/\1/p'; }
+raw=$(./pars_serial_direct -S 0 -r -i "$dir/input.bin" "$dir/input_raw.txt" | mbs)
+hex=$(./pars_serial_direct -S 0 "$dir/input_hex.txt" < "$dir/input.hex" | mbs)
+cmp -s "$dir/input_raw.txt" "$dir/input_hex.txt" || { echo "raw and hex results differ"; exit 1; }
+
+echo "$n messages, $(wc -c < "$dir/input.bin") bytes raw, $(wc -c < "$dir/input.hex") bytes hex"
+awk -v raw="$raw" -v hex="$hex" 'BEGIN { printf "raw -r: %s MB/s, hex dump: %s MB/s, raw %.1f times faster\n", raw, hex, (hex > 0 ? raw / hex : 0) }'
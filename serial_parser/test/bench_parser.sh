@@ -0,0 +1,83 @@
+#!/bin/sh
+# Every parser mode over generated clean and lossy streams: MB/s, frames/s
+# and detection accuracy. Run by make bench, from serial_parser/ after make.
+#
+# Accuracy is what the parser found against what gen_stream injected:
+#   lost     messages counted as lost / messages sent but not decoded
+#            (legacy: triples lost / FRAME_TRIPLES against messages lost
+#            on the radio, there are no message numbers)
+#   damaged  frames rejected by the CRC / frames cut or with bit errors
+#            (legacy: partial frames and frames with corrupted samples).
+#            Found is a little lower: two bit errors in one frame are one
+#            bad frame, a frame with a broken token is only a lost message.
+
+set -e
+dir=${BENCH_DIR:-build/bench}
+n=${BENCH_MESSAGES:-1000000}
+lossy="-l 0.01 -e 1e-6 -t 0.001"
+mkdir -p "$dir"
+
+# stream name gen_stream-options...
+stream()
+{
+    name=$1
+    shift
+    ./gen_stream -n "$n" "$@" "$dir/$name" 2> "$dir/$name.gen"
+}
+
+# run mode stream ports parser-options...
+# Streams ending in .hex go to stdin, others are given ports times with -i.
+run()
+{
+    mode=$1 name=$2 ports=$3
+    shift 3
+    if [ "${name%.hex}" != "$name" ]; then
+        ./pars_serial_direct -S 0 "$@" "$dir/bench_out" < "$dir/$name" > "$dir/bench.log"
+    else
+        inputs=""
+        i=0
+        while [ $i -lt "$ports" ]; do inputs="$inputs -i $dir/$name"; i=$((i + 1)); done
+        ./pars_serial_direct -S 0 "$@" $inputs "$dir/bench_out" > "$dir/bench.log"
+    fi
+    rm -f "$dir"/bench_out*
+    { cat "$dir/$name.gen"; grep -v '^Frame\|^Receiver' "$dir/bench.log"; } | awk -v mode="$mode" -v name="$name" -v ports="$ports" '
+        /^[0-9]+ messages, [0-9]+ lost, / { sent = $1 * ports; radio = $3 * ports; cut = $10 * ports; flips = $12 * ports }
+        /^Parsed / { for(i = 1; i < NF; i++) { if($i == "in") secs = $(i + 1); if($(i + 1) == "MB/s)") mbs = substr($i, 2) } }
+        /^[0-9]+ frames, / { frames = $1; lost = $3; partial = $6; triples = $11; crc = $14 }
+        /corrupted samples in/ { corrupted = $5 }
+        END {
+            if(mode ~ /legacy/) { found_lost = triples / 16; true_lost = radio; found_bad = partial + corrupted }
+            else { found_lost = lost; true_lost = sent - frames; found_bad = crc }
+            printf "%-16s %-17s %8.1f %11.0f %9d %8d/%-8d %6d/%d\n", mode, name, mbs, frames / secs, frames,
+                   found_lost, true_lost, found_bad, cut + flips
+        }'
+}
+
+stream clean.bin
+stream lossy.bin $lossy
+stream clean.hex -x
+stream lossy.hex -x $lossy
+stream legacy.bin -L
+stream legacy_lossy.bin -L $lossy
+stream le.bin -E
+stream batch.bin -B 4
+stream batch_lossy.bin -B 4 $lossy
+stream mixed.bin -B 4 -V $lossy
+
+echo "$n messages per stream"
+echo "mode             stream                MB/s    frames/s    frames  lost found/true  damaged found/true"
+for s in clean.bin lossy.bin; do
+    run "text -r" $s 1
+    run "binary -b" $s 1 -b
+    run "packed -c" $s 1 -c
+    run "2 ports -M" $s 2 -M
+    run "threads -P 0" $s 1 -P 0
+done
+run "hex dump" clean.hex 1
+run "hex dump" lossy.hex 1
+run "legacy -L" legacy.bin 1 -L
+run "legacy -L" legacy_lossy.bin 1 -L
+run "little end. -E" le.bin 1 -E
+run "batch" batch.bin 1
+run "batch" batch_lossy.bin 1
+run "batch mixed" mixed.bin 1
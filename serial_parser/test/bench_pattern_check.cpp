@@ -0,0 +1,103 @@
+/**
+ * @file bench_pattern_check.cpp
+ *
+ * @brief Test pattern check of full frames: pattern_check_frame() with the
+ *        vector compare against the same check one sample at a time
+ *        (pattern_mismatch_n()). Both must find the same corrupted samples.
+ *        Cost per frame is turned into the share of one core needed at
+ *        multi-Mbaud serial rates (data frames, 10 bits per byte, 8N1).
+ *
+ *        bench_pattern_check [frames], 20000000 by default.
+ *
+ * @license MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+#include "pattern_check.h"
+#include "../receiver/serial_framing.h"
+
+#define FRAMES_IN_BUFFER            4096 // Decoded frames are in cache.
+#define WIRE_FRAME_BYTES            (SERIAL_FRAME_OVERHEAD + 4 + 2 * PATTERN_SAMPLES)
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// pattern_check_frame() with the compare one sample at a time.
+static u_int64_t check_per_sample(const u_int16_t *samples, u_int16_t *x0, u_int16_t *y0)
+{
+    *x0 = samples[0];
+    *y0 = samples[1];
+    if((samples[3] != (u_int16_t)(*x0 + 1) || samples[4] != (u_int16_t)(*y0 - 1))
+        && samples[6] == (u_int16_t)(samples[3] + 1) && samples[7] == (u_int16_t)(samples[4] - 1))
+    {
+        *x0 = (u_int16_t)(samples[3] - 1);
+        *y0 = (u_int16_t)(samples[4] + 1);
+    }
+    return pattern_mismatch_n(samples, PATTERN_SAMPLES, *x0, *y0);
+}
+
+int main(int argc, char **argv)
+{
+    size_t frames = argc > 1 ? strtoull(argv[1], NULL, 0) : 20000000, f, i, corrupted = 0, corrupted_n = 0;
+    static const double mbauds[] = {1, 4, 16};
+    std::vector<u_int16_t> buf(FRAMES_IN_BUFFER * PATTERN_SAMPLES);
+    u_int16_t x = 0xFFF0, y = 20, x0, y0;
+    u_int64_t mask, sum = 0, sum_n = 0;
+    u_int32_t r = 1;
+    double t0, t_vec, t_n, ns_vec, ns_n, frames_s;
+
+    // Pattern across the wraparound of x and y, one frame in 64 with a bad sample.
+    for(i = 0; i < buf.size(); i += 3)
+    {
+        buf[i] = x++;
+        buf[i + 1] = y--;
+        buf[i + 2] = PATTERN_Z;
+    }
+    for(f = 0; f < FRAMES_IN_BUFFER; f += 64)
+    {
+        r = r * 1103515245 + 12345;
+        buf[f * PATTERN_SAMPLES + (r >> 8) % PATTERN_SAMPLES] ^= 0x0100;
+    }
+
+    t0 = now_s();
+    for(f = 0; f < frames; f++)
+    {
+        mask = pattern_check_frame(&buf[(f % FRAMES_IN_BUFFER) * PATTERN_SAMPLES], PATTERN_SAMPLES, &x0, &y0);
+        sum += mask ^ x0;
+        corrupted += __builtin_popcountll(mask);
+    }
+    t_vec = now_s() - t0;
+
+    t0 = now_s();
+    for(f = 0; f < frames; f++)
+    {
+        mask = check_per_sample(&buf[(f % FRAMES_IN_BUFFER) * PATTERN_SAMPLES], &x0, &y0);
+        sum_n += mask ^ x0;
+        corrupted_n += __builtin_popcountll(mask);
+    }
+    t_n = now_s() - t0;
+
+    if(sum != sum_n || corrupted != corrupted_n)
+    {
+        printf("vector and per-sample checks differ: %zu and %zu corrupted samples\n", corrupted, corrupted_n);
+        return 1;
+    }
+    ns_vec = t_vec / frames * 1e9;
+    ns_n = t_n / frames * 1e9;
+    printf("%zu frames, %zu corrupted samples\n", frames, corrupted);
+    printf("vector: %.1f ns/frame, per sample: %.1f ns/frame, %.1f times faster\n", ns_vec, ns_n, ns_n / ns_vec);
+    for(i = 0; i < sizeof(mbauds) / sizeof(mbauds[0]); i++)
+    {
+        frames_s = mbauds[i] * 1e6 / 10 / WIRE_FRAME_BYTES;
+        printf("%4.0f Mbaud, %6.0f frames/s: %.3f%% of a core\n", mbauds[i], frames_s, frames_s * ns_vec * 1e-7);
+    }
+    return 0;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file bench_sample_order.cpp
+ *
+ * @brief Samples of a frame to host order: samples_from_wire() over the
+ *        whole payload against one sample at a time, as bytes shifted
+ *        through the token window (the parser before) and as a plain
+ *        per-sample loop. All must give the same samples.
+ *
+ *        bench_sample_order [frames], 20000000 by default.
+ *
+ * @license MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+#include "sample_order.h"
+
+#define FRAME_SAMPLES               48
+#define FRAMES_IN_BUFFER            4096 // Payloads just read are in cache.
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Every byte shifted through a 4 byte window, a sample taken from it every
+// second byte with a 16-bit load.
+static void samples_window(u_int16_t *samples, const u_int8_t *wire, size_t n)
+{
+    u_int8_t token[4] = {0, 0, 0, 0};
+    u_int16_t v;
+    size_t i;
+    int k;
+
+    for(i = 0; i < 2 * n; i++)
+    {
+        for(k = 3; k > 0; k--)token[k] = token[k - 1];
+        token[0] = wire[i];
+        if(i % 2 == 1)
+        {
+            memcpy(&v, token, 2);
+            samples[i / 2] = v;
+        }
+    }
+}
+
+static void samples_each(u_int16_t *samples, const u_int8_t *wire, size_t n)
+{
+    size_t i;
+
+    for(i = 0; i < n; i++)samples[i] = (u_int16_t)((wire[2 * i] << 8) | wire[2 * i + 1]);
+}
+
+typedef void (*convert_t)(u_int16_t *samples, const u_int8_t *wire, size_t n);
+
+static void samples_batch(u_int16_t *samples, const u_int8_t *wire, size_t n)
+{
+    samples_from_wire(samples, wire, n, false);
+}
+
+static double run(convert_t convert, const std::vector<u_int8_t> &wire, size_t frames, u_int64_t *sum)
+{
+    u_int16_t samples[FRAME_SAMPLES];
+    double t0 = now_s();
+    size_t f;
+
+    *sum = 0;
+    for(f = 0; f < frames; f++)
+    {
+        // Payloads after a 4 byte message number, not aligned to the samples.
+        convert(samples, &wire[(f % FRAMES_IN_BUFFER) * (2 * FRAME_SAMPLES + 4) + 4], FRAME_SAMPLES);
+        *sum += samples[f % FRAME_SAMPLES] * (f + 1);
+    }
+    return now_s() - t0;
+}
+
+int main(int argc, char **argv)
+{
+    size_t frames = argc > 1 ? strtoull(argv[1], NULL, 0) : 20000000, i;
+    std::vector<u_int8_t> wire(FRAMES_IN_BUFFER * (2 * FRAME_SAMPLES + 4) + 1);
+    u_int64_t sum_window, sum_each, sum_batch;
+    double t_window, t_each, t_batch;
+
+    for(i = 0; i < wire.size(); i++)wire[i] = (u_int8_t)(i * 131 + (i >> 8));
+    t_window = run(samples_window, wire, frames, &sum_window);
+    t_each = run(samples_each, wire, frames, &sum_each);
+    t_batch = run(samples_batch, wire, frames, &sum_batch);
+    if(sum_window != sum_batch || sum_each != sum_batch)
+    {
+        printf("conversions differ\n");
+        return 1;
+    }
+    printf("%zu frames of %d samples\n", frames, FRAME_SAMPLES);
+    printf("token window: %.1f ns/frame, per sample: %.1f ns/frame, whole payload: %.1f ns/frame\n",
+           t_window / frames * 1e9, t_each / frames * 1e9, t_batch / frames * 1e9);
+    printf("whole payload %.1f times faster than the token window, %.1f times than per sample\n",
+           t_window / t_batch, t_each / t_batch);
+    return 0;
+}
@@ -0,0 +1,109 @@
+/**
+ * @file bench_text_output.cpp
+ *
+ * @brief Text results path: fprintf("%u ")/fprintf("%u\n") per sample as
+ *        write_to_log() did, against format_samples_text() into the output
+ *        buffer with one write() per block. Both files must be the same.
+ *
+ *        bench_text_output [frames [dir]], 1000000 frames of 48 samples
+ *        written to build/ by default.
+ *
+ * @license MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <string>
+#include <vector>
+
+#include "text_output.h"
+
+#define FRAME_SAMPLES               48
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static std::string read_file(const std::string &name)
+{
+    std::string data;
+    char buf[65536];
+    size_t n;
+    FILE *fp = fopen(name.c_str(), "rb");
+
+    if(fp == NULL)return data;
+    while((n = fread(buf, 1, sizeof(buf), fp)) > 0)data.append(buf, n);
+    fclose(fp);
+    return data;
+}
+
+int main(int argc, char **argv)
+{
+    size_t frames = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000, f, i;
+    std::string dir = argc > 2 ? argv[2] : "build";
+    std::string stdio_name = dir + "/text_stdio.txt", buffer_name = dir + "/text_buffer.txt";
+    u_int16_t samples[FRAME_SAMPLES], x = 0, y = 0xFFFF;
+    output_buffer_t out;
+    double t0, t_stdio, t_buffer, n;
+    FILE *fp;
+    int fd;
+
+    // Test pattern as the receiver sends it, x up and y down from frame to frame.
+    std::vector<u_int16_t> stream(frames * FRAME_SAMPLES);
+    for(i = 0; i < stream.size(); i += 3)
+    {
+        stream[i] = x++;
+        stream[i + 1] = y--;
+        stream[i + 2] = 127;
+    }
+
+    fp = fopen(stdio_name.c_str(), "w");
+    if(fp == NULL)
+    {
+        perror(stdio_name.c_str());
+        return 1;
+    }
+    t0 = now_s();
+    for(f = 0; f < frames; f++)
+    {
+        memcpy(samples, &stream[f * FRAME_SAMPLES], sizeof(samples));
+        for(i = 0; i < FRAME_SAMPLES; i++)fprintf(fp, i % 3 == 2 ? "%u\n" : "%u ", samples[i]);
+    }
+    fclose(fp);
+    t_stdio = now_s() - t0;
+
+    fd = open(buffer_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0 || output_init(&out, fd, OUTPUT_BUFFER_BYTES) != 0)
+    {
+        perror(buffer_name.c_str());
+        return 1;
+    }
+    t0 = now_s();
+    for(f = 0; f < frames; f++)
+    {
+        memcpy(samples, &stream[f * FRAME_SAMPLES], sizeof(samples));
+        output_samples_text(&out, samples, FRAME_SAMPLES);
+    }
+    output_close(&out);
+    t_buffer = now_s() - t0;
+
+    std::string text = read_file(buffer_name);
+    if(text.empty() || read_file(stdio_name) != text)
+    {
+        printf("%s and %s differ\n", stdio_name.c_str(), buffer_name.c_str());
+        return 1;
+    }
+    n = (double)frames * FRAME_SAMPLES;
+    printf("%zu frames, %zu bytes of text\n", frames, text.size());
+    printf("fprintf: %.1f M samples/s, output buffer: %.1f M samples/s, %.1f times faster\n",
+           n / t_stdio * 1e-6, n / t_buffer * 1e-6, t_stdio / t_buffer);
+    remove(stdio_name.c_str());
+    remove(buffer_name.c_str());
+    return 0;
+}
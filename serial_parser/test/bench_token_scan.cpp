@@ -0,0 +1,97 @@
+/**
+ * @file bench_token_scan.cpp
+ *
+ * @brief Token search over a multi-hundred MB stream: the byte by byte
+ *        shift register the parser used before against token_scan_range()
+ *        on 65536 byte blocks as they arrive. Both must find the same
+ *        tokens.
+ *
+ *        bench_token_scan [MB], 256 MB by default.
+ *
+ * @license MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+#include "token_scanner.h"
+
+#define BLOCK_BYTES                 65536
+#define FRAME_BYTES                 108 // Token every frame of 48 samples.
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Last 4 bytes shifted through a register, as token_received() did.
+static size_t scan_bytewise(const u_int8_t *buf, size_t len, std::vector<size_t> &ends)
+{
+    u_int32_t window = 0;
+    size_t i, n = 0;
+
+    for(i = 0; i < len; i++)
+    {
+        window = (window << 8) | buf[i];
+        if(window == TOKEN_VALUE && i >= TOKEN_LEN - 1)
+        {
+            ends[n++] = i + 1;
+            window = 0; // Tokens don't overlap.
+        }
+    }
+    return n;
+}
+
+// Each block scanned once it is in, from where the last scan stopped.
+static size_t scan_blocks(const u_int8_t *buf, size_t len, std::vector<size_t> &ends)
+{
+    size_t in, pos = 0, n = 0, found;
+
+    for(in = 0; in < len;)
+    {
+        in += len - in < BLOCK_BYTES ? len - in : BLOCK_BYTES;
+        found = token_scan_range(buf, pos, in, in, &ends[n]);
+        n += found;
+        if(found > 0)pos = ends[n - 1];
+        if(in >= TOKEN_LEN && pos < in - (TOKEN_LEN - 1))pos = in - (TOKEN_LEN - 1);
+    }
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    size_t mb = argc > 1 ? strtoul(argv[1], NULL, 0) : 256, len = mb << 20, i, n_byte, n_block;
+    u_int32_t x = 12345;
+    double t0, t_byte, t_block;
+
+    // Random payload with a token at the start of every frame.
+    std::vector<u_int8_t> buf(len);
+    for(i = 0; i < len; i++)
+    {
+        x = x * 1103515245 + 12345;
+        buf[i] = (u_int8_t)(x >> 16);
+    }
+    for(i = 0; i + TOKEN_LEN <= len; i += FRAME_BYTES)memcpy(&buf[i], token_bytes, TOKEN_LEN);
+
+    std::vector<size_t> ends_byte(TOKEN_SCAN_MAX_ENDS(len)), ends_block(TOKEN_SCAN_MAX_ENDS(len));
+    t0 = now_s();
+    n_byte = scan_bytewise(buf.data(), len, ends_byte);
+    t_byte = now_s() - t0;
+    t0 = now_s();
+    n_block = scan_blocks(buf.data(), len, ends_block);
+    t_block = now_s() - t0;
+
+    if(n_byte != n_block || memcmp(ends_byte.data(), ends_block.data(), n_byte * sizeof(size_t)) != 0)
+    {
+        printf("token ends differ: %zu bytewise, %zu block scan\n", n_byte, n_block);
+        return 1;
+    }
+    printf("%zu MB, %zu tokens\n", mb, n_byte);
+    printf("bytewise: %.0f MB/s, token_scan_range: %.0f MB/s, %.1f times faster\n",
+           mb / t_byte, mb / t_block, t_byte / t_block);
+    return 0;
+}
@@ -0,0 +1,293 @@
+/**
+ * @file stream_gen.h
+ *
+ * @brief Receiver byte streams for the unit tests, with what the decoder
+ *        must make of them. Like gen_stream: the test pattern of the sender,
+ *        message numbers from 0, data, batch and stats frames or the legacy
+ *        token only stream. Damage is injected at frame granularity so the
+ *        expected frames, flags and counters are known exactly:
+ *
+ *          loss      message never sent (radio), a gap before the next one.
+ *          drop      a byte of the frame flipped, the CRC fails.
+ *          cut       frame loses its tail, the next token starts the next.
+ *          garbage   bytes without token bytes between two frames.
+ *
+ *        In legacy mode a cut frame is passed on partial and drop and
+ *        garbage are not used, there is no CRC to catch them.
+ *
+ * @license MIT
+ */
+
+#ifndef STREAM_GEN_H_
+#define STREAM_GEN_H_
+
+#include <vector>
+
+#include "frame_decoder.h"
+
+#define STREAM_GEN_MAX_TRIPLES      ((SERIAL_FRAME_MAX_PAYLOAD - FRAME_MSG_NR_BYTES) / 6)
+
+typedef struct
+{
+    bool legacy;
+    bool little_endian;
+    unsigned int batch;         // Messages per frame, 1 for data frames.
+    bool mixed;                 // 1...STREAM_GEN_MAX_TRIPLES triples per message, else FRAME_TRIPLES.
+    double loss, drop, cut, garbage; // Probabilities per message, frame, frame, frame.
+    unsigned int stats_every;   // Stats frame after every this many frames, 0 for none.
+    u_int64_t seed;
+} stream_gen_config_t;
+
+// A frame the decoder must pass on.
+typedef struct
+{
+    u_int32_t msg_nr;           // Framed mode.
+    u_int16_t x0, y0;           // First triple.
+    u_int16_t num_samples;
+    u_int16_t payload_bytes;
+    u_int16_t flags;            // FRAME_FLAG_...
+    u_int64_t offset;           // Stream offset of the first sample byte.
+} stream_gen_frame_t;
+
+typedef struct
+{
+    std::vector<u_int8_t> bytes;
+    std::vector<stream_gen_frame_t> frames;
+    std::vector<size_t> frame_ends;  // Stream offset just past every frame in the stream, good or not.
+    u_int64_t lost_messages;
+    u_int64_t lost_triples;
+    u_int64_t sequence_breaks;
+    u_int64_t partial_frames;
+    u_int64_t crc_errors;
+    u_int64_t resyncs;
+    u_int64_t receiver_reports;
+    u_int64_t radio_lost;       // In the stats frames.
+} stream_gen_t;
+
+// xorshift64*, as gen_stream.
+static inline u_int64_t stream_gen_rnd(u_int64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+static inline bool stream_gen_chance(u_int64_t *state, double p)
+{
+    return p > 0 && (stream_gen_rnd(state) >> 11) * (1.0 / 9007199254740992.0) < p;
+}
+
+// A frame as the decoder passed it on, to compare with the generated ones.
+static inline void stream_gen_record(std::vector<stream_gen_frame_t> *frames, const frame_t *f)
+{
+    stream_gen_frame_t e;
+
+    e.msg_nr = f->msg_nr;
+    e.x0 = f->num_samples > 0 ? f->samples[0] : 0;
+    e.y0 = f->num_samples > 1 ? f->samples[1] : 0;
+    e.num_samples = f->num_samples;
+    e.payload_bytes = f->payload_bytes;
+    e.flags = f->flags;
+    e.offset = f->offset;
+    frames->push_back(e);
+}
+
+static inline bool stream_gen_same(const std::vector<stream_gen_frame_t> &a, const std::vector<stream_gen_frame_t> &b)
+{
+    size_t i;
+
+    if(a.size() != b.size())return false;
+    for(i = 0; i < a.size(); i++)
+    {
+        if(a[i].msg_nr != b[i].msg_nr || a[i].x0 != b[i].x0 || a[i].y0 != b[i].y0)return false;
+        if(a[i].num_samples != b[i].num_samples || a[i].payload_bytes != b[i].payload_bytes)return false;
+        if(a[i].flags != b[i].flags || a[i].offset != b[i].offset)return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Stream of num_msgs radio messages as the receiver sends them,
+ *        after damage, and the frames and counters a decoder must find.
+ */
+static inline void stream_gen(stream_gen_t *g, const stream_gen_config_t *c, u_int32_t num_msgs)
+{
+    u_int8_t frame[SERIAL_FRAME_MAX_WIRE_LEN + SERIAL_STATS_LEN + SERIAL_FRAME_OVERHEAD];
+    u_int8_t msgs[SERIAL_BATCH_MAX_MSGS][SERIAL_FRAME_MAX_PAYLOAD];
+    const u_int8_t *ptrs[SERIAL_BATCH_MAX_MSGS];
+    u_int16_t lens[SERIAL_BATCH_MAX_MSGS], triples[SERIAL_BATCH_MAX_MSGS];
+    stream_gen_frame_t pending[SERIAL_BATCH_MAX_MSGS];
+    u_int8_t crc[SERIAL_FRAME_CRC_LEN], *p;
+    u_int64_t rnd = c->seed | 1, missing_msgs = 0, missing_triples = 0, lost_msgs = 0, lost_triples = 0;
+    u_int64_t before_msgs[SERIAL_BATCH_MAX_MSGS], before_triples[SERIAL_BATCH_MAX_MSGS];
+    u_int16_t x = 0, y = 0xFFFF, t;
+    serial_stats_t report;
+    unsigned int batched = 0, frames = 0, i, k;
+    size_t len, start, body;
+    bool synced = false, gap = false; // A good frame was sent, bytes since the last one are bad.
+    bool lose;
+    u_int32_t nr;
+
+    g->bytes.clear();
+    g->frames.clear();
+    g->frame_ends.clear();
+    g->lost_messages = g->lost_triples = g->sequence_breaks = g->partial_frames = 0;
+    g->crc_errors = g->resyncs = g->receiver_reports = g->radio_lost = 0;
+    memset(&report, 0, sizeof(report));
+
+    for(nr = 0; nr < num_msgs; nr++)
+    {
+        // Radio message as the sender fills it.
+        t = c->mixed ? (u_int16_t)(1 + stream_gen_rnd(&rnd) % STREAM_GEN_MAX_TRIPLES) : FRAME_TRIPLES;
+        p = msgs[batched];
+        p[0] = (u_int8_t)(nr >> 24);
+        p[1] = (u_int8_t)(nr >> 16);
+        p[2] = (u_int8_t)(nr >> 8);
+        p[3] = (u_int8_t)nr;
+        for(i = 0; i < t; i++)
+        {
+            u_int16_t s[3] = {(u_int16_t)(x + i), (u_int16_t)(y - i), PATTERN_Z};
+            for(k = 0; k < 3; k++)
+            {
+                p[FRAME_MSG_NR_BYTES + 6 * i + 2 * k + (c->little_endian ? 1 : 0)] = (u_int8_t)(s[k] >> 8);
+                p[FRAME_MSG_NR_BYTES + 6 * i + 2 * k + (c->little_endian ? 0 : 1)] = (u_int8_t)s[k];
+            }
+        }
+        pending[batched].x0 = x;
+        pending[batched].y0 = y;
+        pending[batched].num_samples = (u_int16_t)(3 * t);
+        pending[batched].payload_bytes = (u_int16_t)(6 * t);
+        pending[batched].msg_nr = c->legacy ? 0 : nr; // Legacy frames have none.
+        pending[batched].flags = c->legacy ? 0 : FRAME_FLAG_MSG_NR;
+        x = (u_int16_t)(x + t);
+        y = (u_int16_t)(y - t);
+        if(stream_gen_chance(&rnd, c->loss))
+        {
+            missing_msgs++;
+            missing_triples += t;
+            report.radio_lost++;
+            continue;
+        }
+        lens[batched] = (u_int16_t)(FRAME_MSG_NR_BYTES + 6 * t);
+        triples[batched] = t;
+        before_msgs[batched] = missing_msgs; // Lost on the radio right before this one.
+        before_triples[batched] = missing_triples;
+        missing_msgs = missing_triples = 0;
+        report.received++;
+        if(++batched < c->batch && nr + 1 < num_msgs)continue;
+
+        // What the receiver sends.
+        if(c->legacy)
+        {
+            memcpy(frame, token_bytes, TOKEN_LEN);
+            memcpy(frame + TOKEN_LEN, msgs[0] + FRAME_MSG_NR_BYTES, lens[0] - FRAME_MSG_NR_BYTES);
+            len = TOKEN_LEN + lens[0] - FRAME_MSG_NR_BYTES;
+        }
+        else if(batched == 1)
+        {
+            memcpy(frame + SERIAL_FRAME_HEADER_LEN, msgs[0], lens[0]);
+            len = serial_frame_seal(frame, SERIAL_FRAME_TYPE_DATA, lens[0]);
+        }
+        else
+        {
+            for(i = 0; i < batched; i++)ptrs[i] = msgs[i];
+            len = serial_batch_seal(frame, crc, ptrs, lens, (u_int8_t)batched);
+            p = frame + SERIAL_FRAME_HEADER_LEN + SERIAL_BATCH_HEAD_LEN(batched);
+            for(i = 0; i < batched; i++)
+            {
+                memcpy(p, msgs[i] + FRAME_MSG_NR_BYTES, lens[i] - FRAME_MSG_NR_BYTES);
+                p += lens[i] - FRAME_MSG_NR_BYTES;
+            }
+            memcpy(p, crc, SERIAL_FRAME_CRC_LEN);
+        }
+
+        start = g->bytes.size();
+        lose = false;
+        if(!c->legacy && synced && stream_gen_chance(&rnd, c->drop))
+        {
+            frame[SERIAL_FRAME_HEADER_LEN + stream_gen_rnd(&rnd) % (len - SERIAL_FRAME_OVERHEAD)] ^= 0x01; // Sample bit, no token appears.
+            g->crc_errors++;
+            gap = true;
+            lose = true;
+        }
+        else if(nr + 1 < num_msgs && stream_gen_chance(&rnd, c->cut))
+        {
+            if(c->legacy)
+            {
+                len = TOKEN_LEN + 2 * (3 + stream_gen_rnd(&rnd) % (FRAME_SAMPLES - 3)); // A triple stays for the sequence check.
+                pending[0].payload_bytes = (u_int16_t)(len - TOKEN_LEN);
+                pending[0].num_samples = (u_int16_t)(pending[0].payload_bytes / 2);
+                pending[0].flags |= FRAME_FLAG_PARTIAL;
+                g->partial_frames++;
+            }
+            else
+            {
+                len = SERIAL_FRAME_HEADER_LEN + 1 + stream_gen_rnd(&rnd) % (len - SERIAL_FRAME_HEADER_LEN - 1); // Header stays.
+                if(synced)g->crc_errors++;
+                gap = true;
+                lose = true;
+            }
+        }
+
+        // Offsets of the bodies in the frame, as the decoder gives them.
+        body = start + (c->legacy ? TOKEN_LEN : SERIAL_FRAME_HEADER_LEN + (batched == 1 ? FRAME_MSG_NR_BYTES : SERIAL_BATCH_HEAD_LEN(batched)));
+        for(i = 0; i < batched; i++)
+        {
+            lost_msgs += before_msgs[i];
+            lost_triples += before_triples[i];
+            if(lose)
+            {
+                // Frame lost on the line, its messages are missing as well.
+                lost_msgs++;
+                lost_triples += triples[i];
+                continue;
+            }
+
+            // A gap in the numbers and the pattern before a message that goes out.
+            if(lost_msgs > 0 && g->frames.size() > 0)
+            {
+                if(!c->legacy)pending[i].flags |= FRAME_FLAG_MSG_GAP;
+                pending[i].flags |= FRAME_FLAG_SEQUENCE_BREAK;
+                g->lost_messages += c->legacy ? 0 : lost_msgs;
+                g->sequence_breaks++;
+                g->lost_triples += (u_int16_t)lost_triples;
+            }
+            lost_msgs = lost_triples = 0;
+            pending[i].offset = body;
+            body += triples[i] * 6;
+            g->frames.push_back(pending[i]);
+        }
+        if(!c->legacy && !lose)
+        {
+            if(synced && gap)g->resyncs++;
+            synced = true;
+            gap = false;
+        }
+        g->bytes.insert(g->bytes.end(), frame, frame + len);
+        g->frame_ends.push_back(g->bytes.size());
+        frames++;
+
+        if(!c->legacy && c->garbage > 0 && stream_gen_chance(&rnd, c->garbage))
+        {
+            for(k = 1 + stream_gen_rnd(&rnd) % 40; k > 0; k--)g->bytes.push_back((u_int8_t)(stream_gen_rnd(&rnd) & 0x7F)); // Below every token byte.
+            gap = true;
+        }
+        if(!c->legacy && c->stats_every > 0 && frames % c->stats_every == 0)
+        {
+            len = serial_stats_seal(frame, &report);
+            g->radio_lost += report.radio_lost;
+            report.report++;
+            report.received = report.radio_lost = 0;
+            g->receiver_reports++;
+            g->bytes.insert(g->bytes.end(), frame, frame + len);
+            g->frame_ends.push_back(g->bytes.size());
+            if(synced && gap)g->resyncs++;
+            synced = true;
+            gap = false;
+        }
+        batched = 0;
+    }
+}
+
+#endif // STREAM_GEN_H_
@@ -0,0 +1,65 @@
+#!/bin/sh
+# Offline mode -P 1...6 against a sequential run of the same capture: lossy
+# framed, batched and legacy streams, chunk ends all over them. Text
+# results must be the same byte for byte, binary records all but the
+# arrival time (a sequential run reads the file as a stream and stamps
+# frames, offline mode has no times) and the file creation time, and the
+# frame reports and totals in the log the same lines. Run by make test, from
+# serial_parser/ after make.
+
+set -e
+dir=${TEST_DIR:-build/test}
+n=${TEST_MESSAGES:-60000}
+lossy="-l 0.01 -e 1e-5 -t 0.002"
+mkdir -p "$dir"
+fail=0
+
+# Lines of a log that must not depend on the threads.
+reports()
+{
+    grep '^Frame [0-9]*: \|^Receiver: \|^[0-9]* frames, ' "$1" || true
+}
+
+# Differences outside of header created_ns and record arrival_ns, see result_file.h.
+binary_diff()
+{
+    cmp -l "$1" "$2" 2> /dev/null | awk '
+        { o = $1 - 1; if(o < 64) { if(o < 16 || o > 23) bad++ } else { r = (o - 64) % 136; if(r < 8 || r > 15) bad++ } }
+        END { exit bad > 0 }' && [ "$(wc -c < "$1")" -eq "$(wc -c < "$2")" ]
+}
+
+# check stream parser-options...
+check()
+{
+    name=$1
+    shift
+    for format in text -b; do
+        opt=$format
+        [ $format = text ] && opt=""
+        rm -f "$dir"/chunks_seq* # Results files are appended to.
+        ./pars_serial_direct -S 0 "$@" $opt -i "$dir/$name" "$dir/chunks_seq" > "$dir/chunks_seq.log"
+        for p in 1 2 3 4 5 6; do
+            rm -f "$dir"/chunks_par*
+            ./pars_serial_direct -S 0 "$@" $opt -P $p -i "$dir/$name" "$dir/chunks_par" > "$dir/chunks_par.log"
+            if [ $format = -b ]; then
+                binary_diff "$dir/chunks_seq" "$dir/chunks_par" || { echo "$name $format -P $p: records differ"; fail=1; }
+            else
+                cmp -s "$dir/chunks_seq" "$dir/chunks_par" || { echo "$name $format -P $p: results differ"; fail=1; }
+            fi
+            reports "$dir/chunks_seq.log" > "$dir/chunks_seq.rep"
+            reports "$dir/chunks_par.log" > "$dir/chunks_par.rep"
+            cmp -s "$dir/chunks_seq.rep" "$dir/chunks_par.rep" || { echo "$name $format -P $p: frame reports differ"; fail=1; }
+        done
+        echo "$name ${format}: $(grep '^[0-9]* frames, ' "$dir/chunks_seq.log")"
+    done
+    rm -f "$dir"/chunks_seq* "$dir"/chunks_par*
+}
+
+./gen_stream -n "$n" $lossy -R 1000 -s 11 "$dir/chunks_framed.bin" 2> /dev/null
+./gen_stream -n "$n" -B 4 -V $lossy -R 1000 -s 12 "$dir/chunks_batch.bin" 2> /dev/null
+./gen_stream -n "$n" -L $lossy -s 13 "$dir/chunks_legacy.bin" 2> /dev/null
+check chunks_framed.bin
+check chunks_batch.bin
+check chunks_legacy.bin -L
+[ $fail -eq 0 ] && echo "chunked decoding ok"
+exit $fail
@@ -0,0 +1,343 @@
+/**
+ * @file test_frame_decoder.cpp
+ *
+ * @brief frame_decoder.h on generated receiver streams: framed data, batch
+ *        and stats frames and legacy token only streams, with radio loss,
+ *        bit errors, cut frames and garbage between frames, fed whole, in
+ *        random blocks and byte by byte. Frames, flags, offsets and the
+ *        counters (lost messages, sequence breaks, CRC errors, resyncs,
+ *        partial frames, receiver reports) must be what was put in, however
+ *        the input is split. Also input dropped by the reader (resync), a
+ *        decoder started in the middle of a stream (prime), the end of input
+ *        (finish) and message numbers that wrap or go back.
+ *
+ * @license MIT
+ */
+
+#include <stdio.h>
+#include <vector>
+
+#include "check.h"
+#include "frame_decoder.h"
+#include "stream_gen.h"
+
+typedef std::vector<stream_gen_frame_t> frames_t;
+
+static frame_decoder_t d;
+
+static void collect(frame_decoder_t *dec, const frame_t *f)
+{
+    stream_gen_record((frames_t*)dec->user, f);
+}
+
+static void decoder_start(frames_t *frames, bool framed, bool little_endian)
+{
+    frames->clear();
+    frame_decoder_init(&d, framed, collect, frames);
+    d.little_endian = little_endian;
+    d.log = NULL;
+}
+
+/*
+ * Feed bytes [from, to) in blocks of 1...max_block bytes, every length equally
+ * likely, max_block 0 for all at once.
+ */
+static void feed(const std::vector<u_int8_t> &bytes, size_t from, size_t to, size_t max_block, u_int64_t *rnd)
+{
+    size_t n;
+
+    while(from < to)
+    {
+        n = max_block == 0 ? to - from : 1 + stream_gen_rnd(rnd) % max_block;
+        if(n > to - from)n = to - from;
+        frame_decode_block(&d, bytes.data() + from, n);
+        from += n;
+    }
+}
+
+static void check_stream(const char *name, const stream_gen_config_t *cfg, u_int32_t num_msgs)
+{
+    static const size_t blocks[] = {0, 1, 7, 100, 4096, 200000};
+    stream_gen_t g;
+    frames_t frames;
+    u_int64_t rnd = cfg->seed;
+    unsigned int i;
+
+    stream_gen(&g, cfg, num_msgs);
+    for(i = 0; i < sizeof(blocks) / sizeof(blocks[0]); i++)
+    {
+        decoder_start(&frames, !cfg->legacy, cfg->little_endian);
+        feed(g.bytes, 0, g.bytes.size(), blocks[i], &rnd);
+        frame_decoder_finish(&d);
+        CHECK(stream_gen_same(frames, g.frames));
+        CHECK(d.stats.bytes == g.bytes.size());
+        CHECK(d.stats.frames == g.frames.size());
+        CHECK(d.stats.lost_messages == g.lost_messages);
+        CHECK(d.stats.sequence_breaks == g.sequence_breaks);
+        CHECK(d.stats.lost_triples == g.lost_triples);
+        CHECK(d.stats.partial_frames == g.partial_frames);
+        CHECK(d.stats.crc_errors == g.crc_errors);
+        CHECK(d.stats.resyncs == g.resyncs);
+        CHECK(d.stats.corrupt_frames == 0);
+        CHECK(d.stats.receiver_reports == g.receiver_reports);
+        CHECK(d.stats.radio_lost == g.radio_lost);
+    }
+    printf("%-18s %8zu bytes %6zu frames %5llu lost %5llu breaks %4llu partial %4llu crc errors %4llu resyncs %3llu reports\n",
+           name, g.bytes.size(), frames.size(), (unsigned long long)d.stats.lost_messages,
+           (unsigned long long)d.stats.sequence_breaks, (unsigned long long)d.stats.partial_frames,
+           (unsigned long long)d.stats.crc_errors, (unsigned long long)d.stats.resyncs,
+           (unsigned long long)d.stats.receiver_reports);
+}
+
+static void test_streams(void)
+{
+    stream_gen_config_t cfg;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.batch = 1;
+    cfg.seed = 1;
+    check_stream("framed", &cfg, 20000);
+
+    cfg.loss = 0.02;
+    cfg.drop = 0.01;
+    cfg.cut = 0.01;
+    cfg.garbage = 0.01;
+    cfg.stats_every = 50;
+    cfg.seed = 2;
+    check_stream("framed lossy", &cfg, 20000);
+
+    cfg.little_endian = true;
+    cfg.seed = 3;
+    check_stream("little-endian", &cfg, 20000);
+
+    cfg.little_endian = false;
+    cfg.batch = 4;
+    cfg.seed = 4;
+    check_stream("batch", &cfg, 20000);
+
+    cfg.batch = SERIAL_BATCH_MAX_MSGS;
+    cfg.mixed = true;
+    cfg.seed = 5;
+    check_stream("batch mixed", &cfg, 20000);
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.legacy = true;
+    cfg.batch = 1;
+    cfg.seed = 6;
+    check_stream("legacy", &cfg, 20000);
+
+    cfg.loss = 0.02;
+    cfg.cut = 0.02;
+    cfg.seed = 7;
+    check_stream("legacy lossy", &cfg, 20000);
+}
+
+/*
+ * The reader drops bytes [cut, skip): frames done before cut come out as
+ * they are, the first frame that starts at skip or later is a gap, its
+ * offset and those after are skip - cut lower (offsets count the bytes
+ * decoded). Frames are 1:1 with frame_ends here, frame f starts at
+ * frame_ends[f - 1], a legacy frame is done when the next token is in.
+ */
+static void test_resync(bool framed)
+{
+    stream_gen_config_t cfg;
+    stream_gen_t g;
+    frames_t frames, expect;
+    u_int64_t rnd = 11, lost;
+    size_t cut, skip, i, f, start, after;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.legacy = !framed;
+    cfg.batch = 1;
+    cfg.seed = framed ? 12 : 13;
+    stream_gen(&g, &cfg, 2000);
+
+    for(i = 0; i < 200; i++)
+    {
+        cut = 1000 + stream_gen_rnd(&rnd) % (g.bytes.size() / 2);
+        skip = cut + 1 + stream_gen_rnd(&rnd) % 2000;
+        decoder_start(&frames, framed, false);
+        feed(g.bytes, 0, cut, 500, &rnd);
+        frame_decoder_resync(&d);
+        feed(g.bytes, skip, g.bytes.size(), 500, &rnd);
+        frame_decoder_finish(&d);
+
+        expect.clear();
+        after = 0;
+        for(f = 0; f < g.frames.size(); f++)
+        {
+            start = f > 0 ? g.frame_ends[f - 1] : 0;
+            if(g.frame_ends[f] + (framed ? 0 : TOKEN_LEN) <= cut)expect.push_back(g.frames[f]);
+            else if(start >= skip)
+            {
+                if(after == 0)after = expect.size();
+                expect.push_back(g.frames[f]);
+                expect.back().offset -= skip - cut;
+            }
+        }
+        lost = g.frames.size() - expect.size();
+        CHECK(after > 0 && lost > 0);
+        expect[after].flags |= FRAME_FLAG_SEQUENCE_BREAK | (framed ? FRAME_FLAG_MSG_GAP : 0);
+        CHECK(stream_gen_same(frames, expect));
+        CHECK(d.stats.lost_messages == (framed ? lost : 0));
+        CHECK(d.stats.sequence_breaks == 1);
+        CHECK(d.stats.lost_triples == lost * FRAME_TRIPLES);
+        CHECK(d.stats.resyncs == 1 && d.stats.crc_errors == 0);
+        CHECK(d.stats.bytes == g.bytes.size() - (skip - cut));
+    }
+}
+
+/*
+ * A decoder started at frame j, primed with the frame before as in offline
+ * mode (capture_split.h), gives the frames of a sequential run from j on,
+ * numbered from 0, and counts only what is after j.
+ */
+static void test_prime(bool framed)
+{
+    stream_gen_config_t cfg;
+    stream_gen_t g;
+    frames_t frames;
+    size_t j, prime, start, lost, breaks;
+    u_int64_t rnd = 21;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.legacy = !framed;
+    cfg.batch = 1;
+    cfg.loss = 0.05;
+    cfg.seed = framed ? 22 : 23;
+    stream_gen(&g, &cfg, 3000);
+
+    for(j = 2; j < g.frames.size(); j += 1 + stream_gen_rnd(&rnd) % 50)
+    {
+        // Legacy: the frame before is the bytes between two tokens, the token after it stays with the prime.
+        prime = g.frame_ends[j - 2];
+        start = framed ? g.frame_ends[j - 1] : g.frame_ends[j - 1] + TOKEN_LEN;
+        decoder_start(&frames, framed, false);
+        frame_decoder_prime(&d, g.bytes.data() + prime, start - prime, start);
+        CHECK(frames.empty() && d.stats.frames == 0);
+        feed(g.bytes, start, g.bytes.size(), 3000, &rnd);
+        frame_decoder_finish(&d);
+
+        CHECK(stream_gen_same(frames, frames_t(g.frames.begin() + j, g.frames.end())));
+        CHECK(d.frame.index == g.frames.size() - j);
+        lost = breaks = 0;
+        for(size_t f = j; f < g.frames.size(); f++)
+        {
+            if(g.frames[f].flags & FRAME_FLAG_SEQUENCE_BREAK)breaks++;
+            if(framed)lost += g.frames[f].msg_nr - g.frames[f - 1].msg_nr - 1;
+        }
+        CHECK(d.stats.sequence_breaks == breaks);
+        CHECK(d.stats.lost_messages == lost);
+        CHECK(d.stats.bytes == g.bytes.size() - start && d.stats.resyncs == 0);
+    }
+}
+
+// End of input: the last legacy frame has no token after it, a framed stream cut short drops its last frame.
+static void test_finish(void)
+{
+    stream_gen_config_t cfg;
+    stream_gen_t g;
+    frames_t frames;
+    size_t n;
+    u_int64_t rnd = 31;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.legacy = true;
+    cfg.batch = 1;
+    cfg.seed = 32;
+    stream_gen(&g, &cfg, 100);
+    decoder_start(&frames, false, false);
+    feed(g.bytes, 0, g.bytes.size(), 100, &rnd);
+    CHECK(frames.size() == g.frames.size() - 1);
+    frame_decoder_finish(&d);
+    CHECK(stream_gen_same(frames, g.frames));
+
+    cfg.legacy = false;
+    stream_gen(&g, &cfg, 100);
+    for(n = g.frame_ends[98] + 1; n < g.frame_ends[99]; n++)
+    {
+        decoder_start(&frames, true, false);
+        feed(g.bytes, 0, n, 0, &rnd);
+        frame_decoder_finish(&d);
+        CHECK(stream_gen_same(frames, frames_t(g.frames.begin(), g.frames.begin() + 99)));
+        CHECK(d.stats.crc_errors == 0 && d.stats.resyncs == 0);
+    }
+}
+
+// Framed stream of data frames with the given message numbers, pattern continues.
+static void msg_stream(std::vector<u_int8_t> *bytes, const u_int32_t *nrs, size_t n)
+{
+    u_int8_t frame[SERIAL_FRAME_MAX_WIRE_LEN], *p;
+    u_int16_t x = 0;
+    size_t i, len;
+    unsigned int t;
+
+    bytes->clear();
+    for(i = 0; i < n; i++)
+    {
+        p = frame + SERIAL_FRAME_HEADER_LEN;
+        p[0] = (u_int8_t)(nrs[i] >> 24);
+        p[1] = (u_int8_t)(nrs[i] >> 16);
+        p[2] = (u_int8_t)(nrs[i] >> 8);
+        p[3] = (u_int8_t)nrs[i];
+        for(t = 0; t < FRAME_TRIPLES; t++, x++)
+        {
+            u_int16_t s[3] = {x, (u_int16_t)(0xFFFF - x), PATTERN_Z};
+            for(unsigned int k = 0; k < 3; k++)
+            {
+                p[FRAME_MSG_NR_BYTES + 6 * t + 2 * k] = (u_int8_t)(s[k] >> 8);
+                p[FRAME_MSG_NR_BYTES + 6 * t + 2 * k + 1] = (u_int8_t)s[k];
+            }
+        }
+        len = serial_frame_seal(frame, SERIAL_FRAME_TYPE_DATA, FRAME_MSG_NR_BYTES + FRAME_PAYLOAD_BYTES);
+        bytes->insert(bytes->end(), frame, frame + len);
+    }
+}
+
+// Message numbers that wrap around are no gap, a jump back is a restart, not 4e9 lost messages.
+static void test_msg_nr(void)
+{
+    static const u_int32_t wrap[] = {0xFFFFFFFD, 0xFFFFFFFE, 0xFFFFFFFF, 0, 1, 2};
+    static const u_int32_t wrap_gap[] = {0xFFFFFFFE, 0xFFFFFFFF, 3, 4};
+    static const u_int32_t back[] = {1000, 1001, 1002, 0, 1, 2, 5, 6, 6, 7};
+    std::vector<u_int8_t> bytes;
+    frames_t frames;
+    u_int64_t rnd = 41;
+    size_t i;
+
+    msg_stream(&bytes, wrap, sizeof(wrap) / sizeof(wrap[0]));
+    decoder_start(&frames, true, false);
+    feed(bytes, 0, bytes.size(), 50, &rnd);
+    CHECK(frames.size() == 6 && d.stats.lost_messages == 0 && d.stats.resyncs == 0);
+    for(i = 0; i < frames.size(); i++)CHECK(frames[i].flags == FRAME_FLAG_MSG_NR && frames[i].msg_nr == wrap[i]);
+
+    msg_stream(&bytes, wrap_gap, sizeof(wrap_gap) / sizeof(wrap_gap[0]));
+    decoder_start(&frames, true, false);
+    feed(bytes, 0, bytes.size(), 0, &rnd);
+    CHECK(frames.size() == 4 && d.stats.lost_messages == 3 && d.stats.resyncs == 0);
+    CHECK(frames[2].flags == (FRAME_FLAG_MSG_NR | FRAME_FLAG_MSG_GAP));
+
+    msg_stream(&bytes, back, sizeof(back) / sizeof(back[0]));
+    decoder_start(&frames, true, false);
+    feed(bytes, 0, bytes.size(), 50, &rnd);
+    CHECK(frames.size() == 10);
+    CHECK(d.stats.lost_messages == 2); // 3 and 4, the restart and the repeat are no loss.
+    CHECK(d.stats.resyncs == 2);
+    CHECK(frames[3].flags == FRAME_FLAG_MSG_NR); // Restart.
+    CHECK(frames[6].flags == (FRAME_FLAG_MSG_NR | FRAME_FLAG_MSG_GAP));
+    CHECK(frames[8].flags == FRAME_FLAG_MSG_NR); // Repeat.
+    CHECK(frames[9].flags == FRAME_FLAG_MSG_NR);
+}
+
+int main(void)
+{
+    test_streams();
+    test_resync(true);
+    test_resync(false);
+    test_prime(true);
+    test_prime(false);
+    test_finish();
+    test_msg_nr();
+    return check_done();
+}
@@ -0,0 +1,51 @@
+#!/bin/sh
+# pars_serial_direct -M over three receivers with different loss, one of
+# them a pipe: the merged text must be the output of every port on its own
+# with the port number in front, the "Port i" totals must be those of the
+# port on its own and the total line their sum. Run by make test, from
+# serial_parser/ after make.
+
+set -e
+dir=${TEST_DIR:-build/test}
+mkdir -p "$dir"
+rm -f "$dir"/merged* "$dir"/single* "$dir/fifo"
+
+for i in 0 1 2; do
+    ./gen_stream -n 20000 -l 0.0$((2 * i)) -t 0.00$i -s $((i + 1)) "$dir/merged_in$i.bin" 2> /dev/null
+    ./pars_serial_direct -S 0 -i "$dir/merged_in$i.bin" "$dir/single$i" > "$dir/single$i.log"
+done
+mkfifo "$dir/fifo"
+cat "$dir/merged_in2.bin" > "$dir/fifo" &
+./pars_serial_direct -S 0 -M -i "$dir/merged_in0.bin" -i "$dir/merged_in1.bin" -i "$dir/fifo" "$dir/merged" > "$dir/merged.log"
+wait
+rm -f "$dir/fifo"
+
+fail=0
+for i in 0 1 2; do
+    if ! awk -v p=$i '$1 == p { print $2, $3, $4 }' "$dir/merged" | cmp -s - "$dir/single$i"; then
+        echo "port $i: merged output differs from the port on its own"
+        fail=1
+    fi
+    single=$(grep '^[0-9]* frames, ' "$dir/single$i.log")
+    if ! grep -q "^Port $i [^:]*: $single\$" "$dir/merged.log"; then
+        echo "port $i: totals differ from the port on its own: $single"
+        fail=1
+    fi
+done
+if ! awk '$1 !~ /^[012]$/ || NF != 4 { exit 1 }' "$dir/merged"; then
+    echo "merged output has lines without a port"
+    fail=1
+fi
+
+# Total line = sum of the port lines, field by field.
+sum=$(grep '^Port [0-9]* [^:]*: [0-9]* frames, ' "$dir/merged.log" | sed 's/^Port [0-9]* [^:]*: //' | awk -F', ' '
+    { for(i = 1; i <= NF; i++) { n = index($i, " "); s[i] += substr($i, 1, n - 1); name[i] = substr($i, n) } }
+    END { for(i = 1; i <= NF; i++) printf "%s%d%s", (i > 1 ? ", " : ""), s[i], name[i]; printf "\n" }')
+total=$(grep '^[0-9]* frames, ' "$dir/merged.log")
+if [ "$sum" != "$total" ]; then
+    echo "total \"$total\" is not the sum of the ports \"$sum\""
+    fail=1
+fi
+grep -h '^[0-9]* frames, \|^Port [0-9]* [^:]*: [0-9]* frames, ' "$dir/merged.log"
+[ $fail -eq 0 ] && echo "merged output ok"
+exit $fail
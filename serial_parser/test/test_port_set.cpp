@@ -0,0 +1,275 @@
+/**
+ * @file test_port_set.cpp
+ *
+ * @brief port_set.h with several receivers at once: pipes fed by writer
+ *        threads in random pieces and a regular file (not pollable), every
+ *        port with its own loss, batching and damage. Each port must decode
+ *        to its own frames and counters, the merged text output must carry
+ *        every triple once with the number of its port in front, in stream
+ *        order per port, and the counters of all ports must add up to the
+ *        totals. A set that is told to stop closes every port.
+ *
+ * @license MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <vector>
+
+#include "check.h"
+#include "port_set.h"
+#include "stats.h"
+#include "stream_gen.h"
+#include "text_output.h"
+
+#define NUM_PORTS                   4
+#define FILE_PORT                   (NUM_PORTS - 1)
+
+typedef struct
+{
+    int fd;
+    const std::vector<u_int8_t> *bytes;
+    u_int64_t seed;
+} writer_t;
+
+typedef struct
+{
+    u_int16_t port;
+    output_buffer_t *out;       // Shared by all ports, as with -M.
+    std::vector<stream_gen_frame_t> frames;
+} target_t;
+
+static void* write_stream(void *arg)
+{
+    writer_t *w = (writer_t*)arg;
+    size_t pos = 0, n;
+    ssize_t res;
+
+    while(pos < w->bytes->size())
+    {
+        n = 1 + stream_gen_rnd(&w->seed) % 5000;
+        if(n > w->bytes->size() - pos)n = w->bytes->size() - pos;
+        res = write(w->fd, w->bytes->data() + pos, n);
+        if(res < 0 && errno == EINTR)continue;
+        if(res <= 0)break;
+        pos += res;
+    }
+    close(w->fd); // End of input of the port.
+    return NULL;
+}
+
+static void handle(frame_decoder_t *d, const frame_t *f)
+{
+    target_t *t = (target_t*)d->user;
+
+    stream_gen_record(&t->frames, f);
+    output_samples_text_port(t->out, t->port, f->samples, f->num_samples);
+}
+
+static int temp_file(char *path)
+{
+    int fd = mkstemp(path);
+
+    if(fd >= 0)unlink(path);
+    return fd;
+}
+
+/*
+ * The merged text split by port: every line "port x y z", the triples of a
+ * port in the order of its frames. Returns false on a line that is not.
+ */
+static bool split_merged(int fd, std::vector<std::vector<u_int16_t> > *lines)
+{
+    std::vector<char> text;
+    char buf[65536], *p, *end;
+    unsigned long v[4];
+    ssize_t n;
+    int i;
+
+    lseek(fd, 0, SEEK_SET);
+    while((n = read(fd, buf, sizeof(buf))) > 0)text.insert(text.end(), buf, buf + n);
+    text.push_back('\0');
+    for(p = text.data(); *p != '\0'; p = end + 1)
+    {
+        for(i = 0; i < 4; i++)
+        {
+            v[i] = strtoul(p, &end, 10);
+            if(end == p || (*end != (i == 3 ? '\n' : ' ')))return false;
+            p = end + 1;
+        }
+        end = p - 1;
+        if(v[0] >= NUM_PORTS)return false;
+        for(i = 1; i < 4; i++)(*lines)[v[0]].push_back((u_int16_t)v[i]);
+    }
+    return true;
+}
+
+static void test_ports(void)
+{
+    static frame_decoder_t decoders[NUM_PORTS];
+    static const char *names[NUM_PORTS] = {"pipe 0", "pipe 1", "pipe 2", "file 3"};
+    stream_gen_config_t cfg[NUM_PORTS];
+    stream_gen_t g[NUM_PORTS];
+    target_t targets[NUM_PORTS];
+    writer_t writers[NUM_PORTS];
+    pthread_t threads[NUM_PORTS];
+    std::vector<std::vector<u_int16_t> > lines(NUM_PORTS);
+    std::vector<u_int16_t> expect;
+    output_buffer_t out;
+    port_set_t s;
+    stats_t totals;
+    u_int64_t lost_messages = 0, crc_errors = 0, resyncs = 0, frames = 0, bytes = 0, reports = 0;
+    char out_path[] = "/tmp/test_port_set_XXXXXX", file_path[] = "/tmp/test_port_set_XXXXXX";
+    int fds[2], out_fd, file_fd;
+    unsigned int i, k;
+    size_t j;
+
+    // Every port different: clean, lossy, lossy batches with line damage, ...
+    memset(cfg, 0, sizeof(cfg));
+    for(i = 0; i < NUM_PORTS; i++)
+    {
+        cfg[i].batch = 1;
+        cfg[i].seed = 1000 + i;
+    }
+    cfg[1].loss = 0.02;
+    cfg[1].stats_every = 50;
+    cfg[2].loss = 0.005;
+    cfg[2].batch = 4;
+    cfg[2].mixed = true;
+    cfg[2].drop = 0.01;
+    cfg[2].cut = 0.005;
+    cfg[2].garbage = 0.01;
+    cfg[3].loss = 0.05; // ... and a capture with heavy loss.
+    cfg[3].drop = 0.002;
+
+    out_fd = temp_file(out_path);
+    file_fd = temp_file(file_path);
+    CHECK(out_fd >= 0 && file_fd >= 0);
+    CHECK(output_init(&out, out_fd, 65536) == 0);
+    CHECK(port_set_init(&s, 4096) == 0); // Small reads, the ports take turns many times.
+    for(i = 0; i < NUM_PORTS; i++)
+    {
+        stream_gen(&g[i], &cfg[i], 30000 + 5000 * i);
+        targets[i].port = (u_int16_t)i;
+        targets[i].out = &out;
+        frame_decoder_init(&decoders[i], true, handle, &targets[i]);
+        decoders[i].log = NULL;
+        if(i == FILE_PORT)
+        {
+            CHECK(write_all(file_fd, g[i].bytes.data(), g[i].bytes.size()) == 0);
+            lseek(file_fd, 0, SEEK_SET);
+            CHECK(port_set_add(&s, names[i], file_fd, &decoders[i]) == 0);
+            CHECK(!s.ports[i].polled);
+            continue;
+        }
+        CHECK(pipe(fds) == 0);
+        CHECK(port_set_add(&s, names[i], fds[0], &decoders[i]) == 0);
+        CHECK(s.ports[i].polled);
+        writers[i].fd = fds[1];
+        writers[i].bytes = &g[i].bytes;
+        writers[i].seed = 77 + i;
+    }
+    CHECK(s.num_unpolled == 1);
+    for(i = 0; i < FILE_PORT; i++)CHECK(pthread_create(&threads[i], NULL, write_stream, &writers[i]) == 0);
+    port_set_run(&s);
+    for(i = 0; i < FILE_PORT; i++)pthread_join(threads[i], NULL);
+    output_flush(&out);
+    CHECK(s.num_open == 0 && s.num_unpolled == 0);
+
+    // Every port on its own.
+    memset(&totals, 0, sizeof(totals));
+    for(i = 0; i < NUM_PORTS; i++)
+    {
+        CHECK(!s.ports[i].open);
+        CHECK(stream_gen_same(targets[i].frames, g[i].frames));
+        CHECK(decoders[i].stats.bytes == g[i].bytes.size());
+        CHECK(decoders[i].stats.frames == g[i].frames.size());
+        CHECK(decoders[i].stats.lost_messages == g[i].lost_messages);
+        CHECK(decoders[i].stats.sequence_breaks == g[i].sequence_breaks);
+        CHECK(decoders[i].stats.crc_errors == g[i].crc_errors);
+        CHECK(decoders[i].stats.resyncs == g[i].resyncs);
+        CHECK(decoders[i].stats.receiver_reports == g[i].receiver_reports);
+        printf("%s: %zu frames, %llu lost, %llu crc errors, %llu resyncs\n", names[i], targets[i].frames.size(),
+               (unsigned long long)decoders[i].stats.lost_messages, (unsigned long long)decoders[i].stats.crc_errors,
+               (unsigned long long)decoders[i].stats.resyncs);
+        stats_add(&totals, &decoders[i].stats);
+        bytes += g[i].bytes.size();
+        frames += g[i].frames.size();
+        lost_messages += g[i].lost_messages;
+        crc_errors += g[i].crc_errors;
+        resyncs += g[i].resyncs;
+        reports += g[i].receiver_reports;
+    }
+
+    // The sum over the ports.
+    CHECK(totals.bytes == bytes);
+    CHECK(totals.frames == frames);
+    CHECK(totals.lost_messages == lost_messages);
+    CHECK(totals.crc_errors == crc_errors);
+    CHECK(totals.resyncs == resyncs);
+    CHECK(totals.receiver_reports == reports);
+    CHECK(lost_messages > 0 && crc_errors > 0 && resyncs > 0);
+
+    // Merged output: each line belongs to its port, nothing lost or mixed up.
+    CHECK(split_merged(out_fd, &lines));
+    for(i = 0; i < NUM_PORTS; i++)
+    {
+        expect.clear();
+        for(j = 0; j < g[i].frames.size(); j++)
+        {
+            for(k = 0; k < g[i].frames[j].num_samples / 3u; k++)
+            {
+                expect.push_back((u_int16_t)(g[i].frames[j].x0 + k));
+                expect.push_back((u_int16_t)(g[i].frames[j].y0 - k));
+                expect.push_back(PATTERN_Z);
+            }
+        }
+        CHECK(lines[i] == expect);
+    }
+    CHECK(out.written > 0);
+    free(out.buf);
+    close(out_fd);
+    port_set_free(&s);
+}
+
+// Stop requested: every port is finished and closed, without end of input.
+static void test_stop(void)
+{
+    static frame_decoder_t decoders[2];
+    static volatile sig_atomic_t stop = 1;
+    target_t targets[2];
+    output_buffer_t out;
+    port_set_t s;
+    int fds[2][2];
+    unsigned int i;
+
+    CHECK(output_init(&out, -1, 4096) == 0);
+    CHECK(port_set_init(&s, 4096) == 0);
+    for(i = 0; i < 2; i++)
+    {
+        CHECK(pipe(fds[i]) == 0);
+        targets[i].port = (u_int16_t)i;
+        targets[i].out = &out;
+        frame_decoder_init(&decoders[i], true, handle, &targets[i]);
+        decoders[i].log = NULL;
+        CHECK(port_set_add(&s, "pipe", fds[i][0], &decoders[i]) == 0);
+    }
+    s.stop = &stop;
+    port_set_run(&s); // Writers still open, would block forever.
+    CHECK(s.num_open == 0);
+    for(i = 0; i < 2; i++)
+    {
+        CHECK(!s.ports[i].open);
+        close(fds[i][1]);
+    }
+    free(out.buf);
+    port_set_free(&s);
+}
+
+int main(void)
+{
+    test_ports();
+    test_stop();
+    return check_done();
+}
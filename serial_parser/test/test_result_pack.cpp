@@ -0,0 +1,325 @@
+/**
+ * @file test_result_pack.cpp
+ *
+ * @brief Packed results (result_pack.h) decode back to the records they
+ *        were packed from, field by field: random records of every sample
+ *        count and sample range, test pattern captures of several ports
+ *        with lost frames and key frames mid-stream, decoding from every
+ *        output block on its own, and streams cut anywhere in a frame, in
+ *        memory and as a file still being written.
+ *
+ * @license MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "check.h"
+#include "pattern_check.h"
+#include "result_pack.h"
+
+#define PATTERN_PORTS               4
+
+static u_int32_t rnd_state = 1;
+
+static u_int32_t rnd(void)
+{
+    rnd_state = rnd_state * 1103515245 + 12345;
+    return rnd_state >> 8;
+}
+
+static u_int64_t rnd64(void)
+{
+    return (u_int64_t)rnd() << 40 ^ (u_int64_t)rnd() << 20 ^ rnd();
+}
+
+typedef struct
+{
+    std::vector<u_int8_t> bytes;
+    std::vector<size_t> starts;     // Offset of every frame.
+    std::vector<size_t> blocks;     // Frame that starts every output block.
+} packed_t;
+
+static bool same_record(const result_record_t *a, const result_record_t *b)
+{
+    unsigned int i;
+
+    if(a->index != b->index)return false;
+    if(a->arrival_ns != b->arrival_ns)return false;
+    if(a->num_samples != b->num_samples)return false;
+    if(a->flags != b->flags)return false;
+    if(a->payload_bytes != b->payload_bytes)return false;
+    if(a->port != b->port)return false;
+    for(i = 0; i < RESULT_RECORD_SAMPLES; i++)if(a->samples[i] != b->samples[i])return false;
+    return true;
+}
+
+// Packs recs, a new output block every block_every frames on average (0: one block).
+static void pack_all(const std::vector<result_record_t> &recs, unsigned int block_every, packed_t *out)
+{
+    result_pack_t p;
+    u_int8_t frame[RESULT_PACK_MAX_BYTES];
+    size_t i, n;
+
+    result_pack_init(&p);
+    out->bytes.clear();
+    out->starts.clear();
+    out->blocks.assign(1, 0);
+    for(i = 0; i < recs.size(); i++)
+    {
+        if(i > 0 && block_every != 0 && rnd() % block_every == 0)
+        {
+            result_pack_new_block(&p);
+            out->blocks.push_back(i);
+        }
+        n = result_pack_frame(&p, frame, &recs[i]);
+        CHECK(n > 0 && n <= RESULT_PACK_MAX_BYTES);
+        out->starts.push_back(out->bytes.size());
+        out->bytes.insert(out->bytes.end(), frame, frame + n);
+    }
+}
+
+// Decodes from frame first on with a fresh decoder, the records must be recs from there.
+static void unpack_check(const std::vector<result_record_t> &recs, const packed_t *in, size_t first)
+{
+    result_pack_t p;
+    result_record_t r;
+    size_t pos = in->starts[first], i = first, bad = 0;
+    ssize_t n;
+
+    result_pack_init(&p);
+    while((n = result_unpack_frame(&p, in->bytes.data() + pos, in->bytes.size() - pos, &r)) > 0)
+    {
+        if(i >= recs.size() || !same_record(&r, &recs[i]))bad++;
+        if(i + 1 < in->starts.size() && pos + n != in->starts[i + 1])bad++;
+        pos += n;
+        i++;
+    }
+    CHECK(n == 0);
+    CHECK(pos == in->bytes.size());
+    CHECK(i == recs.size());
+    CHECK(bad == 0);
+}
+
+static result_record_t random_record(void)
+{
+    static const u_int16_t ranges[] = {0, 1, 0x10, 0x100, 0x1000, 0xFFFF};
+    result_record_t r;
+    unsigned int i, range = ranges[rnd() % (sizeof(ranges) / sizeof(ranges[0]))];
+
+    memset(&r, 0, sizeof(r));
+    r.port = (u_int16_t)(rnd() % RESULT_PACK_MAX_PORTS);
+    r.index = rnd() % 8 == 0 ? rnd64() : rnd() % 1000;
+    r.arrival_ns = rnd() % 8 == 0 ? rnd64() : 1000000000ull * (rnd() % 100);
+    r.num_samples = (u_int16_t)(rnd() % (RESULT_RECORD_SAMPLES + 1));
+    r.flags = (u_int16_t)rnd();
+    r.payload_bytes = (u_int16_t)rnd();
+    for(i = 0; i < r.num_samples; i++)r.samples[i] = (u_int16_t)(range == 0xFFFF ? rnd() : rnd() % (range + 1));
+    return r;
+}
+
+// Every field anywhere in its range, samples of every width.
+static void test_random(void)
+{
+    std::vector<result_record_t> recs;
+    packed_t packed;
+    size_t i;
+
+    for(i = 0; i < 20000; i++)recs.push_back(random_record());
+    pack_all(recs, 0, &packed);
+    unpack_check(recs, &packed, 0);
+    pack_all(recs, 50, &packed);
+    unpack_check(recs, &packed, 0);
+    for(i = 0; i < packed.blocks.size(); i += 7)unpack_check(recs, &packed, packed.blocks[i]);
+}
+
+/*
+ * Capture of the sender's test pattern (see pattern_check.h) on
+ * PATTERN_PORTS receivers merged (-M): x counts up and wraps, y counts
+ * down, z is 127. Some frames are lost, some partial or corrupt.
+ */
+static void pattern_capture(std::vector<result_record_t> *recs, size_t num)
+{
+    u_int16_t x[PATTERN_PORTS], y[PATTERN_PORTS];
+    u_int64_t index[PATTERN_PORTS], t = 1700000000000000000ull;
+    result_record_t r;
+    unsigned int port, i, lost;
+    size_t k;
+
+    for(port = 0; port < PATTERN_PORTS; port++)
+    {
+        x[port] = (u_int16_t)(0xFF00 + port * 16); // Wraps early on.
+        y[port] = (u_int16_t)(0x0100 - port * 16);
+        index[port] = 0;
+    }
+    recs->clear();
+    for(k = 0; k < num; k++)
+    {
+        port = rnd() % PATTERN_PORTS;
+        lost = rnd() % 32 == 0 ? rnd() % 5 + 1 : 0;
+        x[port] = (u_int16_t)(x[port] + lost * (PATTERN_SAMPLES / 3));
+        y[port] = (u_int16_t)(y[port] - lost * (PATTERN_SAMPLES / 3));
+        index[port] += lost;
+        t += 1000000 + rnd() % 200000;
+
+        memset(&r, 0, sizeof(r));
+        r.port = (u_int16_t)port;
+        r.index = index[port]++;
+        r.arrival_ns = t;
+        r.num_samples = PATTERN_SAMPLES;
+        r.flags = lost ? RESULT_FLAG_MSG_GAP : 0;
+        r.payload_bytes = PATTERN_SAMPLES * 2;
+        if(rnd() % 64 == 0)
+        {
+            r.num_samples = (u_int16_t)(rnd() % PATTERN_SAMPLES); // Cut short.
+            r.flags |= RESULT_FLAG_PARTIAL;
+            r.payload_bytes = r.num_samples * 2;
+        }
+        for(i = 0; i < r.num_samples; i += 3)
+        {
+            r.samples[i] = (u_int16_t)(x[port] + i / 3);
+            if(i + 1 < r.num_samples)r.samples[i + 1] = (u_int16_t)(y[port] - i / 3);
+            if(i + 2 < r.num_samples)r.samples[i + 2] = PATTERN_Z;
+        }
+        if(rnd() % 128 == 0 && r.num_samples > 0)
+        {
+            r.samples[rnd() % r.num_samples] ^= (u_int16_t)(1 << (rnd() % 16)); // Bit flip.
+            r.flags |= RESULT_FLAG_CORRUPT;
+        }
+        x[port] = (u_int16_t)(x[port] + PATTERN_SAMPLES / 3);
+        y[port] = (u_int16_t)(y[port] - PATTERN_SAMPLES / 3);
+        recs->push_back(r);
+    }
+}
+
+static void test_pattern(void)
+{
+    std::vector<result_record_t> recs;
+    packed_t packed;
+    size_t i, small = 0;
+
+    pattern_capture(&recs, 50000);
+    pack_all(recs, 1000, &packed);
+    CHECK(packed.blocks.size() > 10);
+    unpack_check(recs, &packed, 0);
+
+    // Every output block decodes on its own, as a file of a rotation does.
+    for(i = 0; i < packed.blocks.size(); i++)unpack_check(recs, &packed, packed.blocks[i]);
+
+    // Straight lines pack to a few bytes, apart from key frames and the odd broken one.
+    for(i = 0; i + 1 < packed.starts.size(); i++)if(packed.starts[i + 1] - packed.starts[i] <= 12)small++;
+    CHECK(small > recs.size() * 9 / 10);
+    printf("pattern: %zu frames, %.1f B/frame packed, %zu blocks\n", recs.size(), (double)packed.bytes.size() / recs.size(), packed.blocks.size());
+}
+
+// Decoding a stream that ends anywhere in a frame.
+static void test_truncated(void)
+{
+    std::vector<result_record_t> recs;
+    packed_t packed;
+    result_pack_t p, before;
+    result_record_t r;
+    size_t i, pos, cut, bad = 0;
+    ssize_t n;
+
+    pattern_capture(&recs, 3000);
+    for(i = 0; i < 3000; i++)recs.push_back(random_record());
+    pack_all(recs, 100, &packed);
+    packed.bytes.resize(packed.bytes.size() + RESULT_PACK_PAD);
+
+    // Any shorter length is only part of the frame: 0 and the decoder as
+    // it was, then the whole frame decodes.
+    result_pack_init(&p);
+    for(i = 0; i < recs.size(); i++)
+    {
+        pos = packed.starts[i];
+        for(cut = pos; cut < (i + 1 < recs.size() ? packed.starts[i + 1] : packed.bytes.size() - RESULT_PACK_PAD); cut++)
+        {
+            before = p;
+            if(result_unpack_frame(&p, packed.bytes.data() + pos, cut - pos, &r) != 0)bad++;
+            if(memcmp(&before, &p, sizeof(p)) != 0)bad++;
+        }
+        n = result_unpack_frame(&p, packed.bytes.data() + pos, cut - pos, &r);
+        if(n != (ssize_t)(cut - pos) || !same_record(&r, &recs[i]))bad++;
+    }
+    CHECK(bad == 0);
+}
+
+// The last frame of a file being written is cut: the reader stops before it.
+static void test_truncated_file(void)
+{
+    std::vector<result_record_t> recs;
+    packed_t packed;
+    result_file_header_t header;
+    result_pack_reader_t reader;
+    result_record_t r;
+    char path[] = "/tmp/test_result_pack_XXXXXX";
+    size_t i, cut, whole, frames, bad = 0;
+    int fd, res;
+
+    pattern_capture(&recs, 200);
+    pack_all(recs, 50, &packed);
+    result_pack_header_init(&header, 1);
+    fd = mkstemp(path);
+    CHECK(fd >= 0);
+    if(fd < 0)return;
+    for(i = 0; i < 200; i++)
+    {
+        cut = packed.starts[rnd() % recs.size()] + (i % 4 == 0 ? 0 : rnd() % 8 + 1);
+        if(cut > packed.bytes.size())cut = packed.bytes.size();
+        if(ftruncate(fd, 0) != 0 || pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)
+            || pwrite(fd, packed.bytes.data(), cut, sizeof(header)) != (ssize_t)cut)
+        {
+            bad++;
+            continue;
+        }
+        if(result_pack_reader_open(&reader, path) != 0)
+        {
+            bad++;
+            continue;
+        }
+        for(whole = 0; whole < recs.size() && (whole + 1 < recs.size() ? packed.starts[whole + 1] : packed.bytes.size()) <= cut; whole++);
+        for(frames = 0; (res = result_pack_reader_next(&reader, &r)) > 0; frames++)if(frames >= whole || !same_record(&r, &recs[frames]))bad++;
+        if(res != 0 || frames != whole)bad++;
+        result_pack_reader_close(&reader);
+    }
+    close(fd);
+    unlink(path);
+    CHECK(bad == 0);
+}
+
+// Streams that aren't packed frames, or don't start at a key frame.
+static void test_invalid(void)
+{
+    result_pack_t p;
+    result_record_t r, in;
+    u_int8_t frame[RESULT_PACK_MAX_BYTES + RESULT_PACK_PAD];
+    size_t n;
+
+    memset(&in, 0, sizeof(in));
+    in.port = 3;
+    in.num_samples = 6;
+    result_pack_init(&p);
+    n = result_pack_frame(&p, frame, &in);
+    n = result_pack_frame(&p, frame, &in); // Not a key frame.
+    result_pack_init(&p);
+    CHECK(result_unpack_frame(&p, frame, n, &r) == -1);
+
+    frame[0] = 0x80; // Unknown tag.
+    CHECK(result_unpack_frame(&p, frame, n, &r) == -1);
+    frame[0] = RESULT_PACK_KEY;
+    frame[1] = RESULT_PACK_MAX_PORTS; // No such port.
+    CHECK(result_unpack_frame(&p, frame, n, &r) == -1);
+    CHECK(result_unpack_frame(&p, frame, 0, &r) == 0);
+}
+
+int main(void)
+{
+    test_random();
+    test_pattern();
+    test_truncated();
+    test_truncated_file();
+    test_invalid();
+    return check_done();
+}
@@ -0,0 +1,56 @@
+/**
+ * @file test_sample_order.cpp
+ *
+ * @brief samples_from_wire() against fixed bytes and against a per-sample
+ *        conversion, for both wire byte orders, every count up to a frame
+ *        of the largest payload and every alignment of the payload.
+ *
+ * @license MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+#include "sample_order.h"
+
+#define MAX_SAMPLES                 64
+#define GUARD                       0xA5A5
+
+int main(void)
+{
+    static const u_int8_t pinned[] = {0x12, 0x34, 0xAB, 0xCD, 0x00, 0xFF, 0xFF, 0x00};
+    u_int8_t wire[2 * MAX_SAMPLES + 32];
+    u_int16_t samples[MAX_SAMPLES + 1];
+    size_t n, align, i;
+    bool ok_be, ok_le;
+
+    samples_from_wire(samples, pinned, 4, false);
+    CHECK(samples[0] == 0x1234 && samples[1] == 0xABCD && samples[2] == 0x00FF && samples[3] == 0xFF00);
+    samples_from_wire(samples, pinned, 4, true);
+    CHECK(samples[0] == 0x3412 && samples[1] == 0xCDAB && samples[2] == 0xFF00 && samples[3] == 0x00FF);
+
+    for(i = 0; i < sizeof(wire); i++)wire[i] = (u_int8_t)(i * 37 + 11);
+    for(n = 0; n <= MAX_SAMPLES; n++)
+    {
+        for(align = 0; align < 32; align++)
+        {
+            const u_int8_t *w = wire + align;
+
+            // Big-endian, and nothing written past n.
+            samples[n] = GUARD;
+            samples_from_wire(samples, w, n, false);
+            ok_be = samples[n] == GUARD;
+            for(i = 0; i < n; i++)ok_be = ok_be && samples[i] == (u_int16_t)((w[2 * i] << 8) | w[2 * i + 1]);
+            CHECK(ok_be);
+
+            samples[n] = GUARD;
+            samples_from_wire(samples, w, n, true);
+            ok_le = samples[n] == GUARD;
+            for(i = 0; i < n; i++)ok_le = ok_le && samples[i] == (u_int16_t)((w[2 * i + 1] << 8) | w[2 * i]);
+            CHECK(ok_le);
+        }
+    }
+
+    return check_done();
+}
@@ -0,0 +1,58 @@
+#!/bin/sh
+# result_seek on text results: -f frame -n count must print the lines of
+# exactly those frames, the same samples as from binary results of the same
+# stream, for one port and for a port (-p) of merged (-M) results, and -t/-T
+# the frames the index has in that time. Run by make test, from
+# serial_parser/ after make.
+
+set -e
+dir=${TEST_DIR:-build/test}
+mkdir -p "$dir"
+rm -f "$dir"/seek*
+fail=0
+
+./gen_stream -n 30000 -B 4 -V -l 0.01 -s 21 "$dir/seek_in0.bin" 2> /dev/null
+./gen_stream -n 20000 -l 0.02 -s 22 "$dir/seek_in1.bin" 2> /dev/null
+./pars_serial_direct -S 0 -I 1000 -i "$dir/seek_in0.bin" "$dir/seek.txt" > /dev/null
+./pars_serial_direct -S 0 -b -I 1000 -i "$dir/seek_in0.bin" "$dir/seek.bin" > /dev/null
+./pars_serial_direct -S 0 -M -I 1000 -i "$dir/seek_in0.bin" -i "$dir/seek_in1.bin" "$dir/seek_m.txt" > /dev/null
+./pars_serial_direct -S 0 -M -b -I 1000 -i "$dir/seek_in0.bin" -i "$dir/seek_in1.bin" "$dir/seek_m.bin" > /dev/null
+
+# seek what options...: text and binary must give the same samples.
+seek()
+{
+    what=$1
+    shift
+    fields=1-
+    [ "$what" = _m ] && fields=2- # Merged text lines have the port in front.
+    ./result_seek "$@" "$dir/seek$what.txt" 2> /dev/null | cut -d ' ' -f $fields > "$dir/seek_text.out"
+    ./result_seek "$@" "$dir/seek$what.bin" 2> /dev/null | grep -v '^#' > "$dir/seek_bin.out"
+    if ! [ -s "$dir/seek_bin.out" ] || ! cmp -s "$dir/seek_text.out" "$dir/seek_bin.out"; then
+        echo "result_seek $* on ${what:-one port}: text differs from binary"
+        fail=1
+    fi
+}
+
+for f in 0 1 999 1000 1001 12345 29000; do
+    for n in 1 2 17; do
+        seek "" -f $f -n $n
+        seek _m -f $f -n $n -p 0
+        seek _m -f $((f / 2)) -n $n -p 1
+    done
+done
+
+# By time: the lines of the frames the index has between -t and -T.
+t=$(od -An -t u8 -j $((64 + 32 * 5000 + 8)) -N 8 "$dir/seek.txt.idx" | tr -d ' ')
+T=$(od -An -t u8 -j $((64 + 32 * 5100 + 8)) -N 8 "$dir/seek.txt.idx" | tr -d ' ')
+frames=$(od -An -v -t u8 -w32 -j 64 "$dir/seek.txt.idx" | awk -v t=$t -v T=$T '$2 >= t && $2 <= T { n++ } END { print n }')
+from=$(od -An -v -t u8 -w32 -j 64 "$dir/seek.txt.idx" | awk -v t=$t '$2 >= t { print $1; exit }')
+./result_seek -t "$((t / 1000000000)).$(printf %09d $((t % 1000000000)))" -T "$((T / 1000000000)).$(printf %09d $((T % 1000000000)))" \
+    "$dir/seek.txt" 2> /dev/null > "$dir/seek_time.out"
+./result_seek -f "$from" -n "$frames" "$dir/seek.txt" 2> /dev/null > "$dir/seek_frames.out"
+if ! [ -s "$dir/seek_time.out" ] || ! cmp -s "$dir/seek_time.out" "$dir/seek_frames.out"; then
+    echo "result_seek -t/-T: not the $frames frames from $from"
+    fail=1
+fi
+
+[ $fail -eq 0 ] && echo "text seek ok"
+exit $fail
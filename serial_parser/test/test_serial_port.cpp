@@ -0,0 +1,169 @@
+/**
+ * @file test_serial_port.cpp
+ *
+ * @brief serial_port.h on a pty pair: the slave is set up as the receiver
+ *        tty at standard and non-standard (BOTHER) rates, generated frames
+ *        written to the master must come out of the slave byte for byte
+ *        and decode to the frames that went in. A pty keeps no TIOCGICOUNT
+ *        counters, that must not fail the setup and reads as no errors.
+ *        Something that is no tty is refused.
+ *
+ * @license MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <vector>
+
+#include "check.h"
+#include "serial_port.h"
+#include "stream_gen.h"
+
+typedef struct
+{
+    int fd;
+    const std::vector<u_int8_t> *bytes;
+    u_int64_t seed;
+} writer_t;
+
+typedef struct
+{
+    std::vector<stream_gen_frame_t> frames;
+} collected_t;
+
+// Master side: the stream in random pieces, as a UART would hand it over.
+static void* write_stream(void *arg)
+{
+    writer_t *w = (writer_t*)arg;
+    size_t pos = 0, n;
+    ssize_t res;
+
+    while(pos < w->bytes->size())
+    {
+        n = 1 + stream_gen_rnd(&w->seed) % 700;
+        if(n > w->bytes->size() - pos)n = w->bytes->size() - pos;
+        res = write(w->fd, w->bytes->data() + pos, n);
+        if(res < 0 && errno == EINTR)continue;
+        if(res <= 0)break;
+        pos += res;
+    }
+    return NULL;
+}
+
+static void collect(frame_decoder_t *d, const frame_t *f)
+{
+    collected_t *c = (collected_t*)d->user;
+
+    stream_gen_record(&c->frames, f);
+}
+
+static int open_pty(int *master, char *slave_path, size_t len)
+{
+    *master = posix_openpt(O_RDWR | O_NOCTTY);
+    if(*master < 0)return -1;
+    if(grantpt(*master) != 0 || unlockpt(*master) != 0 || ptsname_r(*master, slave_path, len) != 0)
+    {
+        close(*master);
+        return -1;
+    }
+    return 0;
+}
+
+// Stream through the pty at baud, read as the parser reads a tty.
+static void test_rate(unsigned int baud, const stream_gen_config_t *cfg, u_int32_t num_msgs)
+{
+    static frame_decoder_t d;
+    static u_int8_t buf[65536];
+    stream_gen_t g;
+    collected_t got;
+    std::vector<u_int8_t> received;
+    serial_port_t port;
+    writer_t w;
+    pthread_t writer;
+    char slave[64];
+    int master;
+    ssize_t n;
+    u_int64_t overruns = 1, line_errors = 1;
+
+    stream_gen(&g, cfg, num_msgs);
+    if(open_pty(&master, slave, sizeof(slave)) != 0)
+    {
+        printf("no pty: %s\n", strerror(errno));
+        CHECK(false);
+        return;
+    }
+    CHECK(serial_port_open(&port, slave, baud) == 0);
+    CHECK(port.baud == baud);
+    CHECK(!port.has_icount); // A pty has no counters ...
+    serial_port_errors(&port, &overruns, &line_errors);
+    CHECK(overruns == 0 && line_errors == 0); // ... and that is no error.
+
+    frame_decoder_init(&d, !cfg->legacy, collect, &got);
+    d.little_endian = cfg->little_endian;
+    d.log = NULL;
+    w.fd = master;
+    w.bytes = &g.bytes;
+    w.seed = baud;
+    CHECK(pthread_create(&writer, NULL, write_stream, &w) == 0);
+    while(received.size() < g.bytes.size() && (n = read(port.fd, buf, sizeof(buf))) > 0)
+    {
+        received.insert(received.end(), buf, buf + n);
+        frame_decode_block(&d, buf, n);
+    }
+    pthread_join(writer, NULL);
+    frame_decoder_finish(&d);
+
+    CHECK(received == g.bytes); // Raw: no byte changed, added or dropped.
+    CHECK(stream_gen_same(got.frames, g.frames));
+    CHECK(d.stats.lost_messages == g.lost_messages);
+    CHECK(d.stats.sequence_breaks == g.sequence_breaks);
+    CHECK(d.stats.crc_errors == g.crc_errors);
+    CHECK(d.stats.resyncs == g.resyncs);
+    CHECK(d.stats.receiver_reports == g.receiver_reports);
+    serial_port_errors(&port, &overruns, &line_errors);
+    CHECK(overruns == 0 && line_errors == 0);
+    printf("%7u baud: %zu bytes, %zu frames, %llu lost, %llu crc errors\n", port.baud, received.size(), got.frames.size(),
+           (unsigned long long)d.stats.lost_messages, (unsigned long long)d.stats.crc_errors);
+    close(port.fd);
+    close(master);
+}
+
+int main(void)
+{
+    static const unsigned int rates[] = {SERIAL_PORT_DEFAULT_BAUD, 500000, 1000000, 1234567, 3000000, 4000000};
+    stream_gen_config_t cfg;
+    serial_port_t port;
+    int pipe_fds[2];
+    unsigned int i;
+
+    // Every byte value must pass: flow control, CR/NL and signal characters
+    // in the samples, the loss makes the message numbers take many values.
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.batch = 1;
+    cfg.loss = 0.01;
+    cfg.drop = 0.005;
+    cfg.garbage = 0.005;
+    cfg.stats_every = 100;
+    for(i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+    {
+        cfg.seed = rates[i];
+        cfg.batch = i % 2 == 0 ? 1 : 4;
+        cfg.mixed = i % 3 == 2;
+        test_rate(rates[i], &cfg, 20000);
+    }
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.legacy = true;
+    cfg.batch = 1;
+    cfg.loss = 0.01;
+    cfg.cut = 0.01;
+    test_rate(921600, &cfg, 20000);
+
+    CHECK(pipe(pipe_fds) == 0);
+    CHECK(serial_port_setup(&port, pipe_fds[0], SERIAL_PORT_DEFAULT_BAUD) == -1);
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    CHECK(serial_port_open(&port, "/nonexistent/tty", SERIAL_PORT_DEFAULT_BAUD) == -1 && errno == ENOENT);
+    return check_done();
+}
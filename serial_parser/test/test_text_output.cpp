@@ -0,0 +1,96 @@
+/**
+ * @file test_text_output.cpp
+ *
+ * @brief Text formatter against fprintf("%u ")/fprintf("%u\n") per sample:
+ *        every 16-bit value, full and partial frames, the port variant and
+ *        text_samples_len().
+ *
+ * @license MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#include "check.h"
+#include "text_output.h"
+
+#define MAX_SAMPLES                 64
+
+// Samples as the stdio writer printed them, a partial frame ends its line.
+static std::string stdio_text(const u_int16_t *samples, size_t n, int port)
+{
+    char *text = NULL;
+    size_t len = 0, i;
+    FILE *fp = open_memstream(&text, &len);
+
+    for(i = 0; i < n; i++)
+    {
+        if(port >= 0 && i % 3 == 0)fprintf(fp, "%u ", (unsigned int)port);
+        fprintf(fp, (i % 3 == 2 || i == n - 1) ? "%u\n" : "%u ", samples[i]);
+    }
+    fclose(fp);
+    std::string s(text, len);
+    free(text);
+    return s;
+}
+
+// Output buffer contents, it is never flushed in these tests.
+static std::string buffered_text(const u_int16_t *samples, size_t n, int port)
+{
+    output_buffer_t o;
+    std::string s;
+
+    output_init(&o, -1, OUTPUT_BUFFER_BYTES);
+    if(port >= 0)output_samples_text_port(&o, (u_int16_t)port, samples, (u_int16_t)n);
+    else output_samples_text(&o, samples, (u_int16_t)n);
+    s.assign(o.buf, o.len);
+    free(o.buf);
+    return s;
+}
+
+int main(void)
+{
+    u_int16_t samples[MAX_SAMPLES];
+    char buf[TEXT_SAMPLE_MAX_CHARS], expect[16];
+    size_t n, len, bad = 0, i;
+    u_int32_t v, x = 7;
+
+    // Every value on its own.
+    for(v = 0; v <= 0xFFFF; v++)
+    {
+        len = format_u16(buf, (u_int16_t)v);
+        snprintf(expect, sizeof(expect), "%u", (unsigned int)v);
+        samples[0] = (u_int16_t)v;
+        if(len != strlen(expect) || memcmp(buf, expect, len) != 0 || text_samples_len(samples, 1) != len + 1)bad++;
+    }
+    CHECK(bad == 0);
+
+    // Every value in each place of a triple.
+    bad = 0;
+    for(v = 0; v <= 0xFFFF; v++)
+    {
+        samples[0] = (u_int16_t)v;
+        samples[1] = (u_int16_t)(0xFFFF - v);
+        samples[2] = (u_int16_t)(v * 7);
+        if(buffered_text(samples, 3, -1) != stdio_text(samples, 3, -1))bad++;
+    }
+    CHECK(bad == 0);
+
+    // Full and partial frames of random, small and large values.
+    for(n = 0; n <= MAX_SAMPLES; n++)
+    {
+        for(i = 0; i < n; i++)
+        {
+            x = x * 1103515245 + 12345;
+            samples[i] = (u_int16_t)((x >> 8) >> ((x >> 28) % 16));
+        }
+        std::string text = stdio_text(samples, n, -1);
+        CHECK(buffered_text(samples, n, -1) == text);
+        CHECK(text_samples_len(samples, (u_int16_t)n) == text.size());
+        CHECK(buffered_text(samples, n, 3) == stdio_text(samples, n, 3));
+        CHECK(buffered_text(samples, n, 65535) == stdio_text(samples, n, 65535));
+    }
+
+    return check_done();
+}
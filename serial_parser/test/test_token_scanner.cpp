@@ -0,0 +1,114 @@
+/**
+ * @file test_token_scanner.cpp
+ *
+ * @brief token_scan_range() against a byte by byte search: over ranges of
+ *        1 byte up to some kB of the whole stream, and on a stream that
+ *        arrives in such blocks, scanned again from where the last scan
+ *        stopped as frame_decoder.h does, so tokens straddle every
+ *        possible block boundary.
+ *
+ * @license MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "check.h"
+#include "token_scanner.h"
+
+static std::vector<size_t> scan_bytewise(const std::vector<u_int8_t> &buf)
+{
+    std::vector<size_t> ends;
+    size_t i;
+
+    for(i = 0; i + TOKEN_LEN <= buf.size(); i++)
+    {
+        if(memcmp(&buf[i], token_bytes, TOKEN_LEN) == 0)
+        {
+            ends.push_back(i + TOKEN_LEN);
+            i += TOKEN_LEN - 1;
+        }
+    }
+    return ends;
+}
+
+static size_t next_block(size_t max_block, size_t left, u_int32_t *x)
+{
+    size_t block;
+
+    *x = *x * 1103515245 + 12345;
+    block = 1 + (*x >> 8) % max_block;
+    return block > left ? left : block;
+}
+
+// The stream all there, scanned range by range.
+static std::vector<size_t> scan_ranges(const std::vector<u_int8_t> &buf, size_t max_block, u_int32_t *x)
+{
+    std::vector<size_t> ends, range_ends(TOKEN_SCAN_MAX_ENDS(max_block));
+    size_t from, to, k, found;
+
+    for(from = 0; from < buf.size(); from = to)
+    {
+        to = from + next_block(max_block, buf.size() - from, x);
+        found = token_scan_range(buf.data(), from, to, buf.size(), range_ends.data());
+        for(k = 0; k < found; k++)ends.push_back(range_ends[k]);
+    }
+    return ends;
+}
+
+// The stream arriving block by block: only the bytes in so far are scanned.
+static std::vector<size_t> scan_blocks(const std::vector<u_int8_t> &buf, size_t max_block, u_int32_t *x)
+{
+    std::vector<size_t> ends, block_ends(TOKEN_SCAN_MAX_ENDS(max_block + TOKEN_LEN));
+    size_t len, pos = 0, k, found;
+
+    for(len = 0; len < buf.size();)
+    {
+        len += next_block(max_block, buf.size() - len, x);
+        found = token_scan_range(buf.data(), pos, len, len, block_ends.data());
+        for(k = 0; k < found; k++)ends.push_back(block_ends[k]);
+        if(found > 0)pos = block_ends[found - 1];
+        if(len >= TOKEN_LEN && pos < len - (TOKEN_LEN - 1))pos = len - (TOKEN_LEN - 1); // Can still start a token.
+    }
+    return ends;
+}
+
+int main(void)
+{
+    static const size_t max_blocks[] = {1, 2, 3, 4, 5, 7, 31, 33, 64, 4096};
+    u_int32_t x = 1;
+    size_t i, m, round;
+
+    for(round = 0; round < 20; round++)
+    {
+        // Mostly token bytes, so tokens, near misses and runs like DEDEADBEEF are frequent.
+        std::vector<u_int8_t> buf(20000);
+        for(i = 0; i < buf.size(); i++)
+        {
+            x = x * 1103515245 + 12345;
+            buf[i] = (x >> 16) % 8 ? token_bytes[(x >> 20) % TOKEN_LEN] : (u_int8_t)(x >> 24);
+        }
+        for(i = (x >> 8) % 50; i + TOKEN_LEN <= buf.size(); i += 20 + (x >> 8) % 200)
+        {
+            x = x * 1103515245 + 12345;
+            memcpy(&buf[i], token_bytes, TOKEN_LEN);
+        }
+        std::vector<size_t> expected = scan_bytewise(buf);
+        CHECK(expected.size() > 0);
+        for(m = 0; m < sizeof(max_blocks) / sizeof(max_blocks[0]); m++)
+        {
+            CHECK(scan_ranges(buf, max_blocks[m], &x) == expected);
+            CHECK(scan_blocks(buf, max_blocks[m], &x) == expected);
+        }
+    }
+
+    // A token arriving in three blocks is found with its last byte.
+    size_t ends[TOKEN_SCAN_MAX_ENDS(TOKEN_LEN)];
+    CHECK(token_scan_range(token_bytes, 0, 1, 1, ends) == 0);
+    CHECK(token_scan_range(token_bytes, 0, 2, 2, ends) == 0);
+    CHECK(token_scan_range(token_bytes, 0, 4, 4, ends) == 1 && ends[0] == TOKEN_LEN);
+    CHECK(token_scan_range(token_bytes, 1, 4, 4, ends) == 0); // Started before the range.
+
+    return check_done();
+}
@@ -0,0 +1,126 @@
+/**
+ * @file text_output.h
+ *
+ * @brief Text results format, three samples (x y z) on one line.
+ *
+ *        Samples are turned into decimal with a two digit lookup table
+ *        straight into the output buffer. Output is the same as
+ *        fprintf("%u ")/fprintf("%u\n") per sample.
+ *
+ * @license MIT
+ */
+
+#ifndef TEXT_OUTPUT_H_
+#define TEXT_OUTPUT_H_
+
+#include <string.h>
+#include <sys/types.h>
+
+#include "output_buffer.h"
+
+#define TEXT_SAMPLE_MAX_CHARS       6 // "65535\n"
+
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/**
+ * @brief Write v in decimal to p.
+ * @return number of characters written (1...5).
+ */
+static inline size_t format_u16(char *p, u_int16_t v)
+{
+    char tmp[5];
+    char *t = tmp + sizeof(tmp);
+    size_t n;
+
+    while(v >= 100)
+    {
+        t -= 2;
+        memcpy(t, digit_pairs + (v % 100) * 2, 2);
+        v /= 100;
+    }
+    if(v >= 10)
+    {
+        t -= 2;
+        memcpy(t, digit_pairs + v * 2, 2);
+    }
+    else *--t = (char)('0' + v);
+    n = tmp + sizeof(tmp) - t;
+    memcpy(p, t, n);
+    return n;
+}
+
+/**
+ * @brief Format samples of one frame. The line is ended after z and after
+ *        the last sample of a partial frame.
+ *        p must have room for num_samples * TEXT_SAMPLE_MAX_CHARS characters.
+ * @return number of characters written.
+ */
+static inline size_t format_samples_text(char *p, const u_int16_t *samples, u_int16_t num_samples)
+{
+    char *start = p;
+    u_int16_t i;
+
+    for(i = 0; i < num_samples; i++)
+    {
+        p += format_u16(p, samples[i]);
+        *p++ = (i % 3 == 2 || i == num_samples - 1) ? '\n' : ' ';
+    }
+    return p - start;
+}
+
+/**
+ * @return number of characters format_samples_text() writes for these samples.
+ */
+static inline size_t text_samples_len(const u_int16_t *samples, u_int16_t num_samples)
+{
+    size_t n = num_samples; // Separators
+    u_int16_t i, v;
+
+    for(i = 0; i < num_samples; i++)
+    {
+        v = samples[i];
+        n += v < 10 ? 1 : v < 100 ? 2 : v < 1000 ? 3 : v < 10000 ? 4 : 5;
+    }
+    return n;
+}
+
+static inline void output_samples_text(output_buffer_t *o, const u_int16_t *samples, u_int16_t num_samples)
+{
+    char *p = output_reserve(o, (size_t)num_samples * TEXT_SAMPLE_MAX_CHARS);
+    output_commit(o, format_samples_text(p, samples, num_samples));
+}
+
+/**
+ * @brief Like output_samples_text(), every line starts with the port number
+ *        (merged output of several receivers): "port x y z".
+ */
+static inline void output_samples_text_port(output_buffer_t *o, u_int16_t port, const u_int16_t *samples, u_int16_t num_samples)
+{
+    char *p = output_reserve(o, (size_t)num_samples * TEXT_SAMPLE_MAX_CHARS + (num_samples / 3 + 1) * TEXT_SAMPLE_MAX_CHARS);
+    char *start = p;
+    u_int16_t i;
+
+    for(i = 0; i < num_samples; i++)
+    {
+        if(i % 3 == 0)
+        {
+            p += format_u16(p, port);
+            *p++ = ' ';
+        }
+        p += format_u16(p, samples[i]);
+        *p++ = (i % 3 == 2 || i == num_samples - 1) ? '\n' : ' ';
+    }
+    output_commit(o, p - start);
+}
+
+#endif // TEXT_OUTPUT_H_
@@ -0,0 +1,100 @@
+/**
+ * @file token_scanner.h
+ *
+ * @brief Block level search for the 0xDEADBEEF frame sync token. Finds all
+ *        tokens in a buffer at once instead of shifting every byte through
+ *        a 4 byte window. A token is only found once all its bytes are in,
+ *        so a caller that gets a stream in blocks keeps the last
+ *        TOKEN_LEN - 1 bytes with the next block and scans again from
+ *        there, as frame_decoder.h does. Results are then the same as
+ *        feeding the bytes one by one to token_received().
+ *
+ *        Uses AVX2 or SSE2 compares when the compiler targets them (-mavx2),
+ *        memchr() otherwise.
+ *
+ * @license MIT
+ */
+
+#ifndef TOKEN_SCANNER_H_
+#define TOKEN_SCANNER_H_
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/types.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#define TOKEN_LEN                   4
+#define TOKEN_VALUE                 0xDEADBEEF
+// Tokens can't overlap, so a block of len bytes holds at most this many token ends.
+#define TOKEN_SCAN_MAX_ENDS(len)    (((len) + TOKEN_LEN - 1) / TOKEN_LEN + 1)
+
+static const u_int8_t token_bytes[TOKEN_LEN] = {0xDE, 0xAD, 0xBE, 0xEF}; // Order on the wire.
+
+/**
+ * @brief Find tokens that start in buf[from..to) and end within len.
+ *        ends[] gets the offset just past the last token byte, in
+ *        increasing order, and must have room for
+ *        TOKEN_SCAN_MAX_ENDS(to - from) entries.
+ * @return number of token ends written to ends.
+ */
+static inline size_t token_scan_range(const u_int8_t *buf, size_t from, size_t to, size_t len, size_t *ends)
+{
+    size_t i = from, n = 0;
+    const u_int8_t *p;
+
+    if(to + TOKEN_LEN - 1 > len)to = (len >= TOKEN_LEN - 1) ? len - (TOKEN_LEN - 1) : 0;
+
+#if defined(__AVX2__)
+    const __m256i b0 = _mm256_set1_epi8((char)token_bytes[0]), b1 = _mm256_set1_epi8((char)token_bytes[1]);
+    const __m256i b2 = _mm256_set1_epi8((char)token_bytes[2]), b3 = _mm256_set1_epi8((char)token_bytes[3]);
+    for(; i + 32 + TOKEN_LEN - 1 <= len && i + 32 <= to; i += 32)
+    {
+        __m256i m = _mm256_and_si256(
+            _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(buf + i)), b0),
+                             _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(buf + i + 1)), b1)),
+            _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(buf + i + 2)), b2),
+                             _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(buf + i + 3)), b3)));
+        u_int32_t mask = (u_int32_t)_mm256_movemask_epi8(m);
+        while(mask)
+        {
+            ends[n++] = i + __builtin_ctz(mask) + TOKEN_LEN;
+            mask &= mask - 1;
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i b0 = _mm_set1_epi8((char)token_bytes[0]), b1 = _mm_set1_epi8((char)token_bytes[1]);
+    const __m128i b2 = _mm_set1_epi8((char)token_bytes[2]), b3 = _mm_set1_epi8((char)token_bytes[3]);
+    for(; i + 16 + TOKEN_LEN - 1 <= len && i + 16 <= to; i += 16)
+    {
+        __m128i m = _mm_and_si128(
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buf + i)), b0),
+                          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buf + i + 1)), b1)),
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buf + i + 2)), b2),
+                          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buf + i + 3)), b3)));
+        u_int32_t mask = (u_int32_t)_mm_movemask_epi8(m);
+        while(mask)
+        {
+            ends[n++] = i + __builtin_ctz(mask) + TOKEN_LEN;
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    // Portable path and the remainder of the vector loops.
+    while(i < to && (p = (const u_int8_t*)memchr(buf + i, token_bytes[0], to - i)) != NULL)
+    {
+        i = p - buf;
+        if(p[1] == token_bytes[1] && p[2] == token_bytes[2] && p[3] == token_bytes[3])
+        {
+            ends[n++] = i + TOKEN_LEN;
+            i += TOKEN_LEN;
+        }
+        else i++;
+    }
+    return n;
+}
+
+#endif // TOKEN_SCANNER_H_